@@ -97,6 +97,7 @@ nice_input_message_iter_compare (const NiceInputMessageIter *a,
 #include "stream.h"
 #include "conncheck.h"
 #include "component.h"
+#include "pseudotcp.h"
 #include "random.h"
 #include "stun/stunagent.h"
 #include "stun/usages/turn.h"
@@ -116,6 +117,7 @@ nice_input_message_iter_compare (const NiceInputMessageIter *a,
 #define NICE_AGENT_TIMER_MIN_CONSENT_INTERVAL 4000  /* msec timer minimum for consent lost requests (RFC 7675) */
 #define NICE_AGENT_TIMER_KEEPALIVE_TIMEOUT 50000    /* msec timer for keepalive (without consent checks) to timeout and assume conection lost */
 #define NICE_AGENT_MAX_CONNECTIVITY_CHECKS_DEFAULT 100 /* see RFC 8445 6.1.2.5 */
+#define NICE_AGENT_TIMER_RELEASE_UNUSED 5000 /* msec after READY before releasing the unused sockets, see NiceAgent:backup-pairs */
 
 
 /* An upper limit to size of STUN packets handled (based on Ethernet
@@ -194,6 +196,7 @@ struct _NiceAgent
   GQueue pending_signals;
   gboolean use_ice_udp;
   gboolean use_ice_tcp;
+  gboolean use_ice_tcp_so;
   gboolean use_ice_trickle;
 
   guint conncheck_ongoing_idle_delay; /* ongoing delay before timer stop */
@@ -204,6 +207,12 @@ struct _NiceAgent
   gboolean close_forced;              /* property: close-forced */
   GTask* close_task;                  /* task associated with ongoing nice_agent_close_async() */
   gboolean recv_tos;                  /* property: recv-tos */
+  PseudoTcpCongestionControl pseudo_tcp_congestion_control; /* property:
+                                         pseudo-tcp-congestion-control */
+  gboolean pseudo_tcp_mtu_discovery;  /* property: pseudo-tcp-mtu-discovery */
+  gboolean pseudo_tcp_rack_tlp;       /* property: pseudo-tcp-rack-tlp */
+  gboolean pseudo_tcp_pacing;         /* property: pseudo-tcp-pacing */
+  gint backup_pairs;                  /* property: backup-pairs */
   /* XXX: add pointer to internal data struct for ABI-safe extensions */
 };
 
@@ -284,6 +293,9 @@ memcpy_buffer_to_input_message (NiceInputMessage *message,
     const guint8 *buffer, gsize buffer_length);
 guint8 *
 compact_input_message (const NiceInputMessage *message, gsize *buffer_length);
+gsize
+memcpy_input_message_to_buffer (const NiceInputMessage *message,
+    guint8 *buffer, gsize buffer_length);
 
 guint8 *
 compact_output_message (const NiceOutputMessage *message, gsize *buffer_length);
@@ -119,6 +119,7 @@ enum
   PROP_RELIABLE,
   PROP_ICE_UDP,
   PROP_ICE_TCP,
+  PROP_ICE_TCP_SO,
   PROP_BYTESTREAM_TCP,
   PROP_KEEPALIVE_CONNCHECK,
   PROP_FORCE_RELAY,
@@ -132,6 +133,11 @@ enum
   PROP_CONSENT_FRESHNESS,
   PROP_CLOSE_FORCED,
   PROP_RECV_TOS,
+  PROP_PSEUDO_TCP_CONGESTION_CONTROL,
+  PROP_PSEUDO_TCP_MTU_DISCOVERY,
+  PROP_PSEUDO_TCP_RACK_TLP,
+  PROP_PSEUDO_TCP_PACING,
+  PROP_BACKUP_PAIRS,
 };
 
 
@@ -148,6 +154,8 @@ enum
   SIGNAL_NEW_SELECTED_PAIR_FULL,
   SIGNAL_NEW_CANDIDATE_FULL,
   SIGNAL_NEW_REMOTE_CANDIDATE_FULL,
+  SIGNAL_RELIABLE_SUBSTREAM_READABLE,
+  SIGNAL_RELIABLE_SUBSTREAM_WRITABLE,
 
   N_SIGNALS,
 };
@@ -162,6 +170,8 @@ static void pseudo_tcp_socket_closed (PseudoTcpSocket *sock, guint32 err,
 static PseudoTcpWriteResult pseudo_tcp_socket_write_packet (PseudoTcpSocket *sock,
     const gchar *buffer, guint32 len, gpointer user_data);
 static void adjust_tcp_clock (NiceAgent *agent, NiceStream *stream, NiceComponent *component);
+static PseudoTcpSocket *pseudo_tcp_socket_for_packet (NiceAgent *agent,
+    NiceComponent *component, const guint8 *header, gsize len);
 
 static void nice_agent_constructed (GObject *object);
 static void nice_agent_dispose (GObject *object);
@@ -767,6 +777,29 @@ nice_agent_class_init (NiceAgentClass *klass)
         TRUE, /* use ice-tcp by default */
         G_PARAM_READWRITE));
 
+  /**
+   * NiceAgent:ice-tcp-so:
+   *
+   * Whether the agent should also gather ICE-TCP simultaneous-open host
+   * candidates, as described in RFC 6544. Both peers of such a pair connect
+   * to each other from the same local port at the same time, which may get a
+   * TCP connection through NATs that drop all unsolicited incoming
+   * connections. A refused attempt is retried by the connectivity checks.
+   * <para>
+   * This option has no effect if #NiceAgent:ice-tcp is %FALSE. It should be
+   * set before gathering candidates and should not be modified afterwards.
+   * </para>
+   *
+   * Since: 0.1.24
+   */
+   g_object_class_install_property (gobject_class, PROP_ICE_TCP_SO,
+      g_param_spec_boolean (
+        "ice-tcp-so",
+        "Use ICE-TCP simultaneous-open",
+        "Generate ICE-TCP simultaneous-open candidates",
+        FALSE,
+        G_PARAM_READWRITE));
+
   /**
    * NiceAgent:bytestream-tcp:
    *
@@ -987,6 +1020,111 @@ nice_agent_class_init (NiceAgentClass *klass)
         FALSE,
         G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
 
+  /**
+   * NiceAgent:pseudo-tcp-congestion-control:
+   *
+   * The congestion control algorithm used by the pseudo-TCP sockets of a
+   * reliable agent. It applies to the streams added after it is set.
+   * <para> See also: #PseudoTcpSocket:congestion-control </para>
+   *
+   * Since: 0.1.24
+   */
+  g_object_class_install_property (gobject_class,
+      PROP_PSEUDO_TCP_CONGESTION_CONTROL,
+      g_param_spec_enum (
+        "pseudo-tcp-congestion-control",
+        "Pseudo-TCP congestion control",
+        "The congestion control algorithm used by pseudo-TCP sockets",
+        pseudo_tcp_congestion_control_get_type (), PSEUDO_TCP_CONGESTION_RENO,
+        G_PARAM_READWRITE));
+
+  /**
+   * NiceAgent:pseudo-tcp-mtu-discovery:
+   *
+   * Whether the pseudo-TCP sockets of a reliable agent search for the path
+   * MTU, sending segments larger than the fixed MTU as probes. Leave it off
+   * for paths, through some TURN servers or VPNs, which only carry the fixed
+   * MTU. It applies to the streams added after it is set.
+   * <para> See also: #PseudoTcpSocket:mtu-discovery </para>
+   *
+   * Since: 0.1.24
+   */
+  g_object_class_install_property (gobject_class,
+      PROP_PSEUDO_TCP_MTU_DISCOVERY,
+      g_param_spec_boolean (
+        "pseudo-tcp-mtu-discovery",
+        "Pseudo-TCP path MTU discovery",
+        "Whether pseudo-TCP sockets search for the path MTU",
+        FALSE,
+        G_PARAM_READWRITE));
+
+  /**
+   * NiceAgent:pseudo-tcp-rack-tlp:
+   *
+   * Whether the pseudo-TCP sockets of a reliable agent detect losses from the
+   * time segments were sent, and probe for a lost tail, as in RFC 8985. This
+   * repairs the loss of the last segments of a short message well before the
+   * retransmission timeout. It applies to the streams added after it is set.
+   * <para> See also: #PseudoTcpSocket:rack-tlp </para>
+   *
+   * Since: 0.1.24
+   */
+  g_object_class_install_property (gobject_class,
+      PROP_PSEUDO_TCP_RACK_TLP,
+      g_param_spec_boolean (
+        "pseudo-tcp-rack-tlp",
+        "Pseudo-TCP RACK-TLP",
+        "Whether pseudo-TCP sockets detect losses with RACK-TLP",
+        FALSE,
+        G_PARAM_READWRITE));
+
+  /**
+   * NiceAgent:pseudo-tcp-pacing:
+   *
+   * Whether the pseudo-TCP sockets of a reliable agent spread their
+   * transmissions over the round trip time instead of sending the window in
+   * bursts, which may overflow the queues of NATs and TURN servers. It
+   * applies to the streams added after it is set.
+   * <para> See also: #PseudoTcpSocket:pacing </para>
+   *
+   * Since: 0.1.24
+   */
+  g_object_class_install_property (gobject_class,
+      PROP_PSEUDO_TCP_PACING,
+      g_param_spec_boolean (
+        "pseudo-tcp-pacing",
+        "Pseudo-TCP pacing",
+        "Whether pseudo-TCP sockets pace their transmissions",
+        FALSE,
+        G_PARAM_READWRITE));
+
+  /**
+   * NiceAgent:backup-pairs:
+   *
+   * The number of valid pairs, besides the selected one, whose sockets are
+   * kept open once a component is %NICE_COMPONENT_STATE_READY.
+   *
+   * A few seconds after a component becomes ready, the agent closes the
+   * sockets of all its other local candidates, and deallocates their relays
+   * on the TURN servers, as nice_agent_forget_relays() would. The candidates
+   * of the best valid pairs, up to this number, are kept to fail over to.
+   * An ICE restart only uses the local candidates that remain.
+   * <para>
+   * The default value of -1 keeps every socket for the whole session.
+   * </para>
+   *
+   * Since: 0.1.24
+   */
+  g_object_class_install_property (gobject_class, PROP_BACKUP_PAIRS,
+      g_param_spec_int (
+        "backup-pairs",
+        "Backup pairs",
+        "Number of valid pairs kept along the selected pair once ready, "
+        "or -1 to keep all the sockets",
+        -1, G_MAXINT,
+        -1, /* Not construct time so ignored */
+        G_PARAM_READWRITE));
+
   /* install signals */
 
   /**
@@ -1286,6 +1424,62 @@ nice_agent_class_init (NiceAgentClass *klass)
           NICE_TYPE_CANDIDATE,
           G_TYPE_INVALID);
 
+  /**
+   * NiceAgent::reliable-substream-readable
+   * @agent: The #NiceAgent object
+   * @stream_id: The ID of the stream
+   * @component_id: The ID of the component
+   * @substream_id: The ID of the substream
+   *
+   * This signal is fired when data arrives on a substream of a reliable
+   * component. Call nice_agent_recv_substream_nonblocking() until it fails with
+   * %G_IO_ERROR_WOULD_BLOCK; the signal is not emitted again before that.
+   *
+   * See also: nice_agent_send_substream()
+   * Since: 0.1.24
+   */
+  signals[SIGNAL_RELIABLE_SUBSTREAM_READABLE] =
+      g_signal_new (
+          "reliable-substream-readable",
+          G_OBJECT_CLASS_TYPE (klass),
+          G_SIGNAL_RUN_LAST,
+          0,
+          NULL,
+          NULL,
+          NULL,
+          G_TYPE_NONE,
+          3,
+          G_TYPE_UINT, G_TYPE_UINT, G_TYPE_UINT,
+          G_TYPE_INVALID);
+
+  /**
+   * NiceAgent::reliable-substream-writable
+   * @agent: The #NiceAgent object
+   * @stream_id: The ID of the stream
+   * @component_id: The ID of the component
+   * @substream_id: The ID of the substream
+   *
+   * This signal is fired once a substream of a reliable component is
+   * connected, and afterwards when nice_agent_send_substream() failed with
+   * %G_IO_ERROR_WOULD_BLOCK and the substream can take more data.
+   *
+   * See also: #NiceAgent::reliable-transport-writable
+   * Since: 0.1.24
+   */
+  signals[SIGNAL_RELIABLE_SUBSTREAM_WRITABLE] =
+      g_signal_new (
+          "reliable-substream-writable",
+          G_OBJECT_CLASS_TYPE (klass),
+          G_SIGNAL_RUN_LAST,
+          0,
+          NULL,
+          NULL,
+          NULL,
+          G_TYPE_NONE,
+          3,
+          G_TYPE_UINT, G_TYPE_UINT, G_TYPE_UINT,
+          G_TYPE_INVALID);
+
   /* Init debug options depending on env variables */
   nice_debug_init ();
 }
@@ -1365,6 +1559,8 @@ nice_agent_init (NiceAgent *agent)
   agent->bytestream_tcp = FALSE;
   agent->use_ice_udp = TRUE;
   agent->use_ice_tcp = TRUE;
+  agent->use_ice_tcp_so = FALSE;
+  agent->backup_pairs = -1;
 
   agent->close_task = NULL;
   agent->stun_resolving_cancellable = g_cancellable_new();
@@ -1422,6 +1618,16 @@ nice_agent_new_full (GMainContext *ctx,
       "consent-freshness", (flags & NICE_AGENT_OPTION_CONSENT_FRESHNESS) ? TRUE : FALSE,
       "close-forced", (flags & NICE_AGENT_OPTION_CLOSE_FORCED) ? TRUE : FALSE,
       "recv-tos", (flags & NICE_AGENT_OPTION_RECV_TOS) ? TRUE : FALSE,
+      "pseudo-tcp-congestion-control",
+      (flags & NICE_AGENT_OPTION_PSEUDO_TCP_BBR) ? PSEUDO_TCP_CONGESTION_BBR :
+      (flags & NICE_AGENT_OPTION_PSEUDO_TCP_CUBIC) ?
+      PSEUDO_TCP_CONGESTION_CUBIC : PSEUDO_TCP_CONGESTION_RENO,
+      "pseudo-tcp-mtu-discovery",
+      (flags & NICE_AGENT_OPTION_PSEUDO_TCP_MTU_DISCOVERY) ? TRUE : FALSE,
+      "pseudo-tcp-rack-tlp",
+      (flags & NICE_AGENT_OPTION_PSEUDO_TCP_RACK_TLP) ? TRUE : FALSE,
+      "pseudo-tcp-pacing",
+      (flags & NICE_AGENT_OPTION_PSEUDO_TCP_PACING) ? TRUE : FALSE,
       NULL);
 
   return agent;
@@ -1538,6 +1744,10 @@ nice_agent_get_property (
       g_value_set_boolean (value, agent->use_ice_tcp);
       break;
 
+    case PROP_ICE_TCP_SO:
+      g_value_set_boolean (value, agent->use_ice_tcp_so);
+      break;
+
     case PROP_BYTESTREAM_TCP:
       g_value_set_boolean (value, agent->bytestream_tcp);
       break;
@@ -1581,6 +1791,26 @@ nice_agent_get_property (
       g_value_set_boolean (value, agent->recv_tos);
       break;
 
+    case PROP_PSEUDO_TCP_CONGESTION_CONTROL:
+      g_value_set_enum (value, agent->pseudo_tcp_congestion_control);
+      break;
+
+    case PROP_PSEUDO_TCP_MTU_DISCOVERY:
+      g_value_set_boolean (value, agent->pseudo_tcp_mtu_discovery);
+      break;
+
+    case PROP_PSEUDO_TCP_RACK_TLP:
+      g_value_set_boolean (value, agent->pseudo_tcp_rack_tlp);
+      break;
+
+    case PROP_PSEUDO_TCP_PACING:
+      g_value_set_boolean (value, agent->pseudo_tcp_pacing);
+      break;
+
+    case PROP_BACKUP_PAIRS:
+      g_value_set_int (value, agent->backup_pairs);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     }
@@ -1650,6 +1880,10 @@ nice_agent_reset_all_stun_agents (NiceAgent *agent, gboolean only_software)
             agent->software_attribute);
       else
         nice_agent_init_stun_agent(agent, &component->stun_agent);
+
+      /* The lite responder has its own copy of the STUN agent */
+      if (component->lite_responder)
+        conn_check_lite_responder_update (agent, stream, component);
     }
   }
 }
@@ -1788,6 +2022,10 @@ nice_agent_set_property (
         agent->use_ice_tcp = g_value_get_boolean (value);
       break;
 
+    case PROP_ICE_TCP_SO:
+      agent->use_ice_tcp_so = g_value_get_boolean (value);
+      break;
+
     case PROP_BYTESTREAM_TCP:
       if (agent->reliable && agent->compatibility != NICE_COMPATIBILITY_GOOGLE)
         agent->bytestream_tcp = g_value_get_boolean (value);
@@ -1836,6 +2074,26 @@ nice_agent_set_property (
 #endif
       break;
 
+    case PROP_PSEUDO_TCP_CONGESTION_CONTROL:
+      agent->pseudo_tcp_congestion_control = g_value_get_enum (value);
+      break;
+
+    case PROP_PSEUDO_TCP_MTU_DISCOVERY:
+      agent->pseudo_tcp_mtu_discovery = g_value_get_boolean (value);
+      break;
+
+    case PROP_PSEUDO_TCP_RACK_TLP:
+      agent->pseudo_tcp_rack_tlp = g_value_get_boolean (value);
+      break;
+
+    case PROP_PSEUDO_TCP_PACING:
+      agent->pseudo_tcp_pacing = g_value_get_boolean (value);
+      break;
+
+    case PROP_BACKUP_PAIRS:
+      agent->backup_pairs = g_value_get_int (value);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     }
@@ -1854,6 +2112,16 @@ static void
       component->stream_id, component->id);
 }
 
+static void
+pseudo_tcp_socket_configure (NiceAgent *agent, PseudoTcpSocket *tcp)
+{
+  g_object_set (tcp, "congestion-control",
+      agent->pseudo_tcp_congestion_control,
+      "mtu-discovery", agent->pseudo_tcp_mtu_discovery,
+      "rack-tlp", agent->pseudo_tcp_rack_tlp,
+      "pacing", agent->pseudo_tcp_pacing, NULL);
+}
+
 static void
 pseudo_tcp_socket_create (NiceAgent *agent, NiceStream *stream, NiceComponent *component)
 {
@@ -1864,6 +2132,7 @@ pseudo_tcp_socket_create (NiceAgent *agent, NiceStream *stream, NiceComponent *c
                                       pseudo_tcp_socket_closed,
                                       pseudo_tcp_socket_write_packet};
   component->tcp = pseudo_tcp_socket_new (0, &tcp_callbacks);
+  pseudo_tcp_socket_configure (agent, component->tcp);
   component->tcp_writable_cancellable = g_cancellable_new ();
   nice_debug ("Agent %p: Create Pseudo Tcp Socket for component %d",
       agent, component->id);
@@ -1877,10 +2146,17 @@ static void priv_pseudo_tcp_error (NiceAgent *agent, NiceComponent *component)
   }
 
   if (component->tcp) {
+    GSList *i;
+
     agent_signal_component_state_change (agent, component->stream_id,
         component->id, NICE_COMPONENT_STATE_FAILED);
     nice_component_detach_all_sockets (component);
     pseudo_tcp_socket_close (component->tcp, TRUE);
+    for (i = component->substreams; i; i = i->next) {
+      NiceSubstream *substream = i->data;
+
+      pseudo_tcp_socket_close (substream->tcp, TRUE);
+    }
   }
 
   if (component->tcp_clock) {
@@ -2086,13 +2362,15 @@ pseudo_tcp_socket_readable (PseudoTcpSocket *sock, gpointer user_data)
    * nice_component_emit_io_callback(), after which it’s re-queried. This ensures
    * no data loss of packets already received and dequeued. */
   if (has_io_callback) {
+    guint8 *recv_buf = nice_component_borrow_recv_buffer ();
+
     do {
       gssize len;
 
       /* FIXME: Why copy into a temporary buffer here? Why can’t the I/O
        * callbacks be emitted directly from the pseudo-TCP receive buffer? */
-      len = pseudo_tcp_socket_recv (sock, (gchar *) component->recv_buffer,
-          component->recv_buffer_size);
+      len = pseudo_tcp_socket_recv (sock, (gchar *) recv_buf,
+          MAX_BUFFER_SIZE);
 
       nice_debug ("%s: I/O callback case: Received %" G_GSSIZE_FORMAT " bytes",
           G_STRFUNC, len);
@@ -2126,20 +2404,24 @@ pseudo_tcp_socket_readable (PseudoTcpSocket *sock, gpointer user_data)
         break;
       }
 
-      nice_component_emit_io_callback (agent, component, len);
+      nice_component_emit_io_callback (agent, component, recv_buf, len);
 
       if (!agent_find_component (agent, stream_id, component_id,
               &stream, &component)) {
         nice_debug ("Stream or Component disappeared during the callback");
+        nice_component_return_recv_buffer (recv_buf);
         goto out;
       }
       if (pseudo_tcp_socket_is_closed (component->tcp)) {
         nice_debug ("PseudoTCP socket got destroyed in readable callback!");
+        nice_component_return_recv_buffer (recv_buf);
         goto out;
       }
 
       has_io_callback = nice_component_has_io_callback (component);
     } while (has_io_callback);
+
+    nice_component_return_recv_buffer (recv_buf);
   } else if (component->recv_messages != NULL) {
     gint n_valid_messages;
     GError *child_error = NULL;
@@ -2276,18 +2558,221 @@ pseudo_tcp_socket_write_packet (PseudoTcpSocket *psocket,
 }
 
 
+static void
+substream_opened (PseudoTcpSocket *sock, gpointer user_data)
+{
+  NiceSubstream *substream = user_data;
+  NiceComponent *component = substream->component;
+  NiceAgent *agent;
+
+  agent = g_weak_ref_get (&component->agent_ref);
+  if (agent == NULL)
+    return;
+
+  nice_debug ("Agent %p: s%d:%d substream %u opened", agent,
+      component->stream_id, component->id, substream->id);
+
+  agent_queue_signal (agent, signals[SIGNAL_RELIABLE_SUBSTREAM_WRITABLE],
+      component->stream_id, component->id, substream->id);
+
+  g_object_unref (agent);
+}
+
+static void
+substream_readable (PseudoTcpSocket *sock, gpointer user_data)
+{
+  NiceSubstream *substream = user_data;
+  NiceComponent *component = substream->component;
+  NiceAgent *agent;
+
+  agent = g_weak_ref_get (&component->agent_ref);
+  if (agent == NULL)
+    return;
+
+  agent_queue_signal (agent, signals[SIGNAL_RELIABLE_SUBSTREAM_READABLE],
+      component->stream_id, component->id, substream->id);
+
+  g_object_unref (agent);
+}
+
+static void
+substream_writable (PseudoTcpSocket *sock, gpointer user_data)
+{
+  NiceSubstream *substream = user_data;
+  NiceComponent *component = substream->component;
+  NiceAgent *agent;
+
+  agent = g_weak_ref_get (&component->agent_ref);
+  if (agent == NULL)
+    return;
+
+  agent_queue_signal (agent, signals[SIGNAL_RELIABLE_SUBSTREAM_WRITABLE],
+      component->stream_id, component->id, substream->id);
+
+  g_object_unref (agent);
+}
+
+/* A closed substream is dropped from the component by adjust_tcp_clock(); it
+ * doesn’t affect the component or its other substreams. */
+static void
+substream_closed (PseudoTcpSocket *sock, guint32 err, gpointer user_data)
+{
+  NiceSubstream *substream = user_data;
+  NiceComponent *component = substream->component;
+
+  nice_debug ("Component %p: s%d:%d substream %u closed (error %u)",
+      component, component->stream_id, component->id, substream->id, err);
+}
+
+static PseudoTcpWriteResult
+substream_write_packet (PseudoTcpSocket *sock, const gchar *buffer,
+    guint32 len, gpointer user_data)
+{
+  NiceSubstream *substream = user_data;
+
+  return pseudo_tcp_socket_write_packet (sock, buffer, len,
+      substream->component);
+}
+
+static NiceSubstream *
+substream_find (NiceComponent *component, guint id)
+{
+  GSList *i;
+
+  for (i = component->substreams; i; i = i->next) {
+    NiceSubstream *substream = i->data;
+
+    if (substream->id == id)
+      return substream;
+  }
+
+  return NULL;
+}
+
+/* Substreams kept at once by a component, whoever opened them, so that a
+ * peer can't make the agent allocate pseudo-TCP sockets without bound. */
+#define MAX_SUBSTREAMS 64
+
+/* Enough of a pseudo-TCP packet to tell a connection request, see
+ * pseudotcp.c: the header, with the control flag, then the control byte. */
+#define PSEUDO_TCP_HEADER_SIZE 24
+#define PSEUDO_TCP_FLAGS_OFFSET 13
+#define PSEUDO_TCP_FLAG_CTL 0x02
+#define PSEUDO_TCP_CTL_CONNECT 0
+#define PSEUDO_TCP_CONNECT_PEEK_SIZE (PSEUDO_TCP_HEADER_SIZE + 1)
+
+/* Creates a substream in the LISTEN state; the caller connects it if it is
+ * opening the substream rather than the peer. */
+static NiceSubstream *
+substream_create (NiceAgent *agent, NiceComponent *component, guint id)
+{
+  NiceSubstream *substream = g_slice_new0 (NiceSubstream);
+  PseudoTcpCallbacks tcp_callbacks = {substream,
+                                      substream_opened,
+                                      substream_readable,
+                                      substream_writable,
+                                      substream_closed,
+                                      substream_write_packet};
+
+  g_assert (id != 0);
+
+  substream->component = component;
+  substream->id = id;
+  substream->tcp = pseudo_tcp_socket_new (id, &tcp_callbacks);
+  pseudo_tcp_socket_configure (agent, substream->tcp);
+  pseudo_tcp_socket_notify_mtu (substream->tcp, MAX_TCP_MTU);
+  component->substreams = g_slist_prepend (component->substreams, substream);
+
+  nice_debug ("Agent %p: s%d:%d created substream %u", agent,
+      component->stream_id, component->id, id);
+
+  return substream;
+}
+
+/* Copies the start of a message into @header, and returns its length. */
+static gsize
+input_message_peek (const NiceInputMessage *message, guint8 *header,
+    gsize size)
+{
+  gsize offset = 0;
+  guint i;
+
+  size = MIN (size, message->length);
+
+  for (i = 0;
+       offset < size &&
+       ((message->n_buffers >= 0 && i < (guint) message->n_buffers) ||
+        (message->n_buffers < 0 && message->buffers[i].buffer != NULL));
+       i++) {
+    gsize len = MIN (message->buffers[i].size, size - offset);
+
+    memcpy (header + offset, message->buffers[i].buffer, len);
+    offset += len;
+  }
+
+  return offset;
+}
+
+/* Returns the socket to pass a pseudo-TCP packet to, given its first bytes:
+ * the component’s own for conversation 0, else the substream’s. The peer
+ * only gets a new substream with a connection request, and while the
+ * component has fewer than MAX_SUBSTREAMS; any other packet for an unknown
+ * substream gets %NULL, and is to be dropped. */
+static PseudoTcpSocket *
+pseudo_tcp_socket_for_packet (NiceAgent *agent, NiceComponent *component,
+    const guint8 *header, gsize len)
+{
+  NiceSubstream *substream;
+  guint32 conversation;
+
+  if (len < 4)
+    return component->tcp;
+
+  conversation = ((guint32) header[0] << 24) | (header[1] << 16) |
+      (header[2] << 8) | header[3];
+  if (conversation == 0)
+    return component->tcp;
+
+  substream = substream_find (component, conversation);
+  if (substream != NULL)
+    return substream->tcp;
+
+  if (len < PSEUDO_TCP_CONNECT_PEEK_SIZE ||
+      !(header[PSEUDO_TCP_FLAGS_OFFSET] & PSEUDO_TCP_FLAG_CTL) ||
+      header[PSEUDO_TCP_HEADER_SIZE] != PSEUDO_TCP_CTL_CONNECT) {
+    nice_debug_verbose ("Agent %p: s%d:%d dropping packet for unknown "
+        "substream %u", agent, component->stream_id, component->id,
+        conversation);
+    return NULL;
+  }
+
+  if (g_slist_length (component->substreams) >= MAX_SUBSTREAMS) {
+    nice_debug ("Agent %p: s%d:%d too many substreams, refusing %u", agent,
+        component->stream_id, component->id, conversation);
+    return NULL;
+  }
+
+  return substream_create (agent, component, conversation)->tcp;
+}
+
 static gboolean
 notify_pseudo_tcp_socket_clock_agent_locked (NiceAgent *agent,
     gpointer user_data)
 {
   NiceComponent *component = user_data;
   NiceStream *stream;
+  GSList *i;
 
   stream = agent_find_stream (agent, component->stream_id);
   if (!stream)
     return G_SOURCE_REMOVE;
 
   pseudo_tcp_socket_notify_clock (component->tcp);
+  for (i = component->substreams; i; i = i->next) {
+    NiceSubstream *substream = i->data;
+
+    pseudo_tcp_socket_notify_clock (substream->tcp);
+  }
   adjust_tcp_clock (agent, stream, component);
 
   return G_SOURCE_CONTINUE;
@@ -2300,6 +2785,38 @@ adjust_tcp_clock (NiceAgent *agent, NiceStream *stream, NiceComponent *component
     guint64 timeout = component->last_clock_timeout;
 
     if (pseudo_tcp_socket_get_next_clock (component->tcp, &timeout)) {
+      GSList *i = component->substreams;
+
+      /* One clock serves all the substreams; drop the closed ones, and those
+       * still listening as the peer’s packet didn’t open them */
+      while (i) {
+        NiceSubstream *substream = i->data;
+        GSList *next = i->next;
+        PseudoTcpState state;
+
+        g_object_get (substream->tcp, "state", &state, NULL);
+
+        if (state == PSEUDO_TCP_LISTEN ||
+            pseudo_tcp_socket_is_closed (substream->tcp) ||
+            !pseudo_tcp_socket_get_next_clock (substream->tcp, &timeout)) {
+          nice_debug ("Agent %p: s%d:%d dropping closed substream %u",
+              agent, component->stream_id, component->id, substream->id);
+          component->substreams =
+              g_slist_delete_link (component->substreams, i);
+          nice_substream_free (substream);
+        } else if (substream->send_wanted > 0 &&
+            pseudo_tcp_socket_get_available_send_space (substream->tcp) >=
+            substream->send_wanted) {
+          /* The pseudo-TCP socket only signals writability once its send
+           * buffer has been full */
+          substream->send_wanted = 0;
+          agent_queue_signal (agent,
+              signals[SIGNAL_RELIABLE_SUBSTREAM_WRITABLE],
+              component->stream_id, component->id, substream->id);
+        }
+        i = next;
+      }
+
       if (timeout != component->last_clock_timeout) {
         component->last_clock_timeout = timeout;
         if (component->tcp_clock) {
@@ -2530,12 +3047,14 @@ process_queued_tcp_packets (NiceAgent *agent, NiceStream *stream,
       agent);
 
   while ((vec = g_queue_peek_head (&component->queued_tcp_packets)) != NULL) {
-    gboolean retval;
+    PseudoTcpSocket *tcp;
+    gboolean retval = TRUE;
 
     nice_debug ("%s: Sending %" G_GSIZE_FORMAT " bytes.", G_STRFUNC, vec->size);
-    retval =
-        pseudo_tcp_socket_notify_packet (component->tcp, vec->buffer,
-            vec->size);
+    tcp = pseudo_tcp_socket_for_packet (agent, component, vec->buffer,
+        vec->size);
+    if (tcp != NULL)
+      retval = pseudo_tcp_socket_notify_packet (tcp, vec->buffer, vec->size);
 
     if (!agent_find_component (agent, stream_id, component_id,
             &stream, &component)) {
@@ -2600,6 +3119,8 @@ void agent_signal_new_selected_pair (NiceAgent *agent, guint stream_id,
         "TCP-ACT" :
         lcandidate->transport == NICE_CANDIDATE_TRANSPORT_TCP_PASSIVE ?
         "TCP-PASS" :
+        lcandidate->transport == NICE_CANDIDATE_TRANSPORT_TCP_SO ?
+        "TCP-SO" :
         lcandidate->transport == NICE_CANDIDATE_TRANSPORT_UDP ? "UDP" : "???",
         ip, port, lcandidate->type == NICE_CANDIDATE_TYPE_HOST ? "HOST" :
         lcandidate->type == NICE_CANDIDATE_TYPE_SERVER_REFLEXIVE ?
@@ -2618,6 +3139,8 @@ void agent_signal_new_selected_pair (NiceAgent *agent, guint stream_id,
         "TCP-ACT" :
         rcandidate->transport == NICE_CANDIDATE_TRANSPORT_TCP_PASSIVE ?
         "TCP-PASS" :
+        rcandidate->transport == NICE_CANDIDATE_TRANSPORT_TCP_SO ?
+        "TCP-SO" :
         rcandidate->transport == NICE_CANDIDATE_TRANSPORT_UDP ? "UDP" : "???",
         ip, port, rcandidate->type == NICE_CANDIDATE_TYPE_HOST ? "HOST" :
         rcandidate->type == NICE_CANDIDATE_TYPE_SERVER_REFLEXIVE ?
@@ -2675,6 +3198,26 @@ nice_component_state_to_string (NiceComponentState state)
     }
 }
 
+static gboolean
+priv_release_unused_sockets_agent_locked (NiceAgent *agent, gpointer user_data)
+{
+  NiceComponent *component = user_data;
+  NiceStream *stream;
+
+  stream = agent_find_stream (agent, component->stream_id);
+  if (!stream)
+    return G_SOURCE_REMOVE;
+
+  /* New local candidates may still be paired */
+  if (stream->gathering)
+    return G_SOURCE_CONTINUE;
+
+  nice_component_release_unused_sockets (agent, component,
+      agent->backup_pairs);
+
+  return G_SOURCE_REMOVE;
+}
+
 void agent_signal_component_state_change (NiceAgent *agent, guint stream_id, guint component_id, NiceComponentState new_state)
 {
   NiceComponentState old_state;
@@ -2736,6 +3279,17 @@ void agent_signal_component_state_change (NiceAgent *agent, guint stream_id, gui
   if (agent->reliable)
     process_queued_tcp_packets (agent, stream, component);
 
+  /* Give the nomination some time to settle before closing anything */
+  if (new_state == NICE_COMPONENT_STATE_READY && agent->backup_pairs >= 0) {
+    agent_timeout_add_with_context (agent, &component->release_timer_source,
+        "Release unused sockets", NICE_AGENT_TIMER_RELEASE_UNUSED,
+        priv_release_unused_sockets_agent_locked, component);
+  } else if (component->release_timer_source != NULL) {
+    g_source_destroy (component->release_timer_source);
+    g_source_unref (component->release_timer_source);
+    component->release_timer_source = NULL;
+  }
+
   agent_queue_signal (agent, signals[SIGNAL_COMPONENT_STATE_CHANGED],
       stream_id, component_id, new_state);
 }
@@ -3222,7 +3776,8 @@ turn_server_resolved_cb (GObject *src, GAsyncResult *result,
 
         /* TODO: Add server-reflexive support for TCP candidates */
         if (host_candidate->c.transport ==
-            NICE_CANDIDATE_TRANSPORT_TCP_PASSIVE)
+            NICE_CANDIDATE_TRANSPORT_TCP_PASSIVE ||
+            host_candidate->c.transport == NICE_CANDIDATE_TRANSPORT_TCP_SO)
           continue;
         if (nice_address_ip_version (&host_candidate->c.addr) !=
             nice_address_ip_version (&turn->server))
@@ -3363,6 +3918,7 @@ nice_agent_set_relay_info(NiceAgent *agent,
 
         if  (c->c.type == NICE_CANDIDATE_TYPE_HOST &&
             c->c.transport != NICE_CANDIDATE_TRANSPORT_TCP_PASSIVE &&
+            c->c.transport != NICE_CANDIDATE_TRANSPORT_TCP_SO &&
             nice_address_ip_version (&c->c.addr) ==
             nice_address_ip_version (&turn->server)) {
           priv_add_new_candidate_discovery_turn (agent,
@@ -3582,7 +4138,9 @@ priv_add_upnp_discovery (NiceAgent *agent, NiceStream *stream,
         G_CALLBACK (_upnp_error_mapping_port), agent);
   }
 
-  if (host_candidate->transport == NICE_CANDIDATE_TRANSPORT_TCP_ACTIVE)
+  /* The port of a simultaneous-open candidate never accepts connections */
+  if (host_candidate->transport == NICE_CANDIDATE_TRANSPORT_TCP_ACTIVE ||
+      host_candidate->transport == NICE_CANDIDATE_TRANSPORT_TCP_SO)
     return;
 
   if (priv_find_upnp_candidate (stream->upnp_mapping, host_candidate))
@@ -3633,7 +4191,8 @@ agent_remove_local_candidate (NiceAgent *agent, NiceStream *stream,
   if (local_candidate->type != NICE_CANDIDATE_TYPE_HOST)
     return;
 
-  if (local_candidate->transport == NICE_CANDIDATE_TRANSPORT_TCP_ACTIVE)
+  if (local_candidate->transport == NICE_CANDIDATE_TRANSPORT_TCP_ACTIVE ||
+      local_candidate->transport == NICE_CANDIDATE_TRANSPORT_TCP_SO)
     return;
 
   item = priv_find_upnp_candidate (stream->upnp_mapping, local_candidate);
@@ -3840,7 +4399,8 @@ nice_agent_gather_candidates (
       ADD_HOST_UDP = ADD_HOST_MIN,
       ADD_HOST_TCP_ACTIVE,
       ADD_HOST_TCP_PASSIVE,
-      ADD_HOST_MAX = ADD_HOST_TCP_PASSIVE
+      ADD_HOST_TCP_SO,
+      ADD_HOST_MAX = ADD_HOST_TCP_SO
     } add_type;
 
     if (component == NULL)
@@ -3862,7 +4422,8 @@ nice_agent_gather_candidates (
         HostCandidateResult res = HOST_CANDIDATE_CANT_CREATE_SOCKET;
 
         if ((agent->use_ice_udp == FALSE && add_type == ADD_HOST_UDP) ||
-            (agent->use_ice_tcp == FALSE && add_type != ADD_HOST_UDP))
+            (agent->use_ice_tcp == FALSE && add_type != ADD_HOST_UDP) ||
+            (agent->use_ice_tcp_so == FALSE && add_type == ADD_HOST_TCP_SO))
           continue;
 
         switch (add_type) {
@@ -3876,6 +4437,9 @@ nice_agent_gather_candidates (
           case ADD_HOST_TCP_PASSIVE:
             transport = NICE_CANDIDATE_TRANSPORT_TCP_PASSIVE;
             break;
+          case ADD_HOST_TCP_SO:
+            transport = NICE_CANDIDATE_TRANSPORT_TCP_SO;
+            break;
         }
 
         start_port = component->min_port;
@@ -3932,7 +4496,8 @@ nice_agent_gather_candidates (
         priv_add_upnp_discovery (agent, stream, (NiceCandidate *) host_candidate);
 
         if (agent->full_mode && component && !nice_address_is_linklocal (addr) &&
-            transport != NICE_CANDIDATE_TRANSPORT_TCP_PASSIVE) {
+            transport != NICE_CANDIDATE_TRANSPORT_TCP_PASSIVE &&
+            transport != NICE_CANDIDATE_TRANSPORT_TCP_SO) {
           GList *item;
           int host_ip_version = nice_address_ip_version (&host_candidate->c.addr);
 
@@ -4430,6 +4995,20 @@ errors:
   return FALSE;
 }
 
+/* The keepalive requests embed the username, and the lite responder
+ * validates requests with the local credentials: both have to be built
+ * again once the credentials change */
+static void
+priv_update_credentials_caches (NiceAgent *agent, NiceStream *stream)
+{
+  GSList *i;
+
+  for (i = stream->components; i; i = i->next) {
+    nice_component_clear_keepalive_template (i->data);
+    conn_check_lite_responder_update (agent, stream, i->data);
+  }
+}
+
 NICEAPI_EXPORT gboolean
 nice_agent_set_remote_credentials (
   NiceAgent *agent,
@@ -4452,6 +5031,7 @@ nice_agent_set_remote_credentials (
 
     g_strlcpy (stream->remote_ufrag, ufrag, NICE_STREAM_MAX_UFRAG);
     g_strlcpy (stream->remote_password, pwd, NICE_STREAM_MAX_PWD);
+    priv_update_credentials_caches (agent, stream);
 
     conn_check_remote_credentials_set(agent, stream);
 
@@ -4485,6 +5065,7 @@ nice_agent_set_local_credentials (
   if (stream && ufrag && pwd) {
     g_strlcpy (stream->local_ufrag, ufrag, NICE_STREAM_MAX_UFRAG);
     g_strlcpy (stream->local_password, pwd, NICE_STREAM_MAX_PWD);
+    priv_update_credentials_caches (agent, stream);
 
     ret = TRUE;
     goto done;
@@ -4595,6 +5176,16 @@ nice_agent_set_remote_candidates (NiceAgent *agent, guint stream_id, guint compo
   return added;
 }
 
+/* Returns the length field of the next RFC 4571 frame, which must have been
+ * read. */
+static guint16
+rfc4571_read_frame_length (NiceComponent *component)
+{
+  const guint8 *data = nice_frame_reader_get_data (&component->rfc4571_reader);
+
+  return (data[0] << 8) | data[1];
+}
+
 /* Return values for agent_recv_message_unlocked(). Needed purely because it
  * must differentiate between RECV_OOB and RECV_SUCCESS. */
 typedef enum {
@@ -4657,6 +5248,29 @@ _agent_recv_turn_message_unlocked (
   return is_turn;
 }
 
+/* Classifies a packet by its first byte, following RFC 7983 §7. */
+static NiceDemuxProtocol
+agent_demux_classify (const NiceInputMessage *message)
+{
+  guint8 first_byte;
+
+  if (memcpy_input_message_to_buffer (message, &first_byte, 1) < 1)
+    return NICE_DEMUX_PROTOCOL_OTHER;
+
+  if (first_byte <= 3)
+    return NICE_DEMUX_PROTOCOL_STUN;
+  else if (first_byte >= 16 && first_byte <= 19)
+    return NICE_DEMUX_PROTOCOL_ZRTP;
+  else if (first_byte >= 20 && first_byte <= 63)
+    return NICE_DEMUX_PROTOCOL_DTLS;
+  else if (first_byte >= 64 && first_byte <= 79)
+    return NICE_DEMUX_PROTOCOL_TURN_CHANNEL;
+  else if (first_byte >= 128 && first_byte <= 191)
+    return NICE_DEMUX_PROTOCOL_RTP;
+
+  return NICE_DEMUX_PROTOCOL_OTHER;
+}
+
 /*
  * agent_recv_message_unlocked:
  * @agent: a #NiceAgent
@@ -4789,79 +5403,29 @@ agent_recv_message_unlocked (
             headroom < component->rfc4571_frame_size;
 
         if (missing_cached_data) {
-          gssize available = g_socket_get_available_bytes (nicesock->fileno);
-
-          if (available <= 0) {
-            sockret = available;
-
-            /* If we don't call check_connect_result on an outbound connection,
-             * then is_connected will always return FALSE. That's why we check
-             * both conditions to make sure g_socket_is_connected returns the
-             * correct result, otherwise we end up closing valid connections
-             */
-            if (!g_socket_check_connect_result (nicesock->fileno, NULL) ||
-                !g_socket_is_connected (nicesock->fileno)) {
-              /* If we receive a readable event on a TCP_BSD socket which is
-               * not connected, it means that it failed to connect, so we must
-               * return an error to make the socket fail/closed
-               */
-              sockret = -1;
-            } else {
-              gint flags = G_SOCKET_MSG_PEEK;
-
-              /* If available bytes are 0, but the socket is still considered
-               * connected, then either we're just trying to see if there's more
-               * data available or the peer closed the connection.
-               * The only way to know is to do a read, so we do here a peek and
-               * check the return value, if it's 0, it means the peer has closed
-               * the connection, so we must return an error instead of
-               * WOULD_BLOCK
-               */
-              if (g_socket_receive_message (nicesock->fileno, NULL,
-                      NULL, 0, NULL, NULL, &flags, NULL, NULL) == 0)
-                sockret = -1;
-            }
-          } else {
-            GInputVector local_buf = {
-              component->rfc4571_buffer,
-              component->rfc4571_buffer_size
-            };
-            NiceInputMessage local_message = {
-              &local_buf, 1, &component->rfc4571_remote_addr, 0
-            };
-
-            if (headroom > 0) {
-              memmove (component->rfc4571_buffer,
-                  component->rfc4571_buffer + component->rfc4571_frame_offset,
-                  headroom);
-              local_buf.buffer = (guint8 *) local_buf.buffer + headroom;
-              local_buf.size -= headroom;
-            }
-
-            component->rfc4571_buffer_offset = headroom;
-            component->rfc4571_frame_offset = 0;
-
-            sockret = nice_socket_recv_messages (nicesock, &local_message, 1,
-                NULL);
-            if (sockret == 1) {
-              component->rfc4571_buffer_offset += local_message.length;
-              headroom += local_message.length;
-            }
-          }
+          gsize needed = MAX (component->rfc4571_frame_size, sizeof (guint16));
+
+          /* A single read of as much as is available, usually several
+           * frames, which are then consumed without reading again. A
+           * connection which failed or was closed by the peer reads as an
+           * error. */
+          sockret = nice_frame_reader_fill (&component->rfc4571_reader,
+              nicesock, needed, &component->rfc4571_remote_addr);
+          if (sockret == 1)
+            headroom = nice_component_compute_rfc4571_headroom (component);
 
           if (component->rfc4571_frame_size == 0 &&
               headroom >= sizeof (guint16)) {
-            component->rfc4571_frame_size = sizeof (guint16) + ntohs (
-                *((guint16 *) (component->rfc4571_buffer +
-                    component->rfc4571_frame_offset)));
+            component->rfc4571_frame_size = sizeof (guint16) +
+                rfc4571_read_frame_length (component);
           }
         }
 
         have_whole_frame = component->rfc4571_frame_size != 0 &&
             headroom >= component->rfc4571_frame_size;
         if (have_whole_frame) {
-          rfc4571_buf.buffer = component->rfc4571_buffer +
-              component->rfc4571_frame_offset + sizeof (guint16);
+          rfc4571_buf.buffer = nice_frame_reader_get_data (
+              &component->rfc4571_reader) + sizeof (guint16);
           rfc4571_buf.size = component->rfc4571_frame_size - sizeof (guint16);
 
           rfc4571_message.buffers = &rfc4571_buf;
@@ -4879,6 +5443,14 @@ agent_recv_message_unlocked (
         }
       }
     }
+  } else if (component->lite_pending_length > 0 &&
+      message->n_buffers == 1 &&
+      message->buffers[0].buffer == component->lite_pending_buffer) {
+    /* Already read by the ICE-lite responder, which left it to us */
+    message->length = component->lite_pending_length;
+    *message->from = component->lite_pending_from;
+    component->lite_pending_length = 0;
+    sockret = 1;
   } else {
     sockret = nice_socket_recv_messages (nicesock, message, 1, exdata);
   }
@@ -4927,20 +5499,44 @@ agent_recv_message_unlocked (
   if (retval == RECV_OOB)
     goto done;
 
+  /* With RFC 7983 demultiplexing enabled, classify the packet once, and let
+   * anything which cannot be STUN bypass the STUN checks below. */
+  if (component->n_demux_callbacks > 0)
+    component->recv_protocol = agent_demux_classify (message);
+  else
+    component->recv_protocol = NICE_DEMUX_PROTOCOL_STUN;
+
   /* If the message’s stated length is equal to its actual length, it’s probably
    * a STUN message; otherwise it’s probably data. */
-  if (stun_message_validate_buffer_length_fast (
+  if (component->recv_protocol == NICE_DEMUX_PROTOCOL_STUN &&
+      stun_message_validate_buffer_length_fast (
       (StunInputVector *) message->buffers, message->n_buffers, message->length,
       (agent->compatibility != NICE_COMPATIBILITY_OC2007 &&
        agent->compatibility != NICE_COMPATIBILITY_OC2007R2)) == (ssize_t) message->length) {
-    /* Slow path: If this message isn’t obviously *not* a STUN packet, compact
-     * its buffers
-     * into a single monolithic one and parse the packet properly. */
+    /* If this message isn’t obviously *not* a STUN packet, parse it
+     * properly. This is done directly on the receive buffer when it is
+     * contiguous; otherwise the buffers are gathered into a stack scratch
+     * area, only falling back to an allocation for oversized messages. */
+    guint8 stun_scratch[MAX_STUN_DATAGRAM_PAYLOAD];
     guint8 *big_buf;
     gsize big_buf_len;
+    gboolean allocated_buf = FALSE;
     int validated_len;
 
-    big_buf = compact_input_message (message, &big_buf_len);
+    if (message->n_buffers == 1 ||
+        (message->n_buffers == -1 &&
+         message->buffers[0].buffer != NULL &&
+         message->buffers[1].buffer == NULL)) {
+      big_buf = message->buffers[0].buffer;
+      big_buf_len = message->length;
+    } else if (message->length <= sizeof (stun_scratch)) {
+      big_buf = stun_scratch;
+      big_buf_len = memcpy_input_message_to_buffer (message, stun_scratch,
+          sizeof (stun_scratch));
+    } else {
+      big_buf = compact_input_message (message, &big_buf_len);
+      allocated_buf = TRUE;
+    }
 
     validated_len = stun_message_validate_buffer_length (big_buf, big_buf_len,
         (agent->compatibility != NICE_COMPATIBILITY_OC2007 &&
@@ -4957,7 +5553,8 @@ agent_recv_message_unlocked (
         /* Handled STUN message. */
         nice_debug ("%s: Valid STUN packet received.", G_STRFUNC);
         retval = RECV_OOB;
-        g_free (big_buf);
+        if (allocated_buf)
+          g_free (big_buf);
         goto done;
       }
     }
@@ -4965,7 +5562,8 @@ agent_recv_message_unlocked (
     nice_debug ("%s: Packet passed fast STUN validation but failed "
         "slow validation.", G_STRFUNC);
 
-    g_free (big_buf);
+    if (allocated_buf)
+      g_free (big_buf);
   }
 
   if (!nice_component_verify_remote_candidate (component,
@@ -5012,7 +5610,17 @@ agent_recv_message_unlocked (
 
       nice_debug_verbose ("%s: notifying pseudo-TCP of packet, length %" G_GSIZE_FORMAT,
           G_STRFUNC, message->length);
-      pseudo_tcp_socket_notify_message (component->tcp, message);
+      {
+        guint8 header[PSEUDO_TCP_CONNECT_PEEK_SIZE];
+        gsize header_len;
+        PseudoTcpSocket *tcp;
+
+        header_len = input_message_peek (message, header, sizeof (header));
+        tcp = pseudo_tcp_socket_for_packet (agent, component, header,
+            header_len);
+        if (tcp != NULL)
+          pseudo_tcp_socket_notify_message (tcp, message);
+      }
 
       adjust_tcp_clock (agent, stream, component);
 
@@ -5059,9 +5667,9 @@ agent_consume_next_rfc4571_chunk (NiceAgent *agent, NiceComponent *component,
         component->rfc4571_consumed_size;
 
     bytes_copied = append_buffer_to_input_messages (agent->bytestream_tcp,
-        messages, n_messages, iter, component->rfc4571_buffer +
-            component->rfc4571_frame_offset + component->rfc4571_frame_size -
-            bytes_unconsumed,
+        messages, n_messages, iter,
+        nice_frame_reader_get_data (&component->rfc4571_reader) +
+            component->rfc4571_frame_size - bytes_unconsumed,
         bytes_unconsumed);
 
     component->rfc4571_consumed_size += bytes_copied;
@@ -5075,15 +5683,15 @@ agent_consume_next_rfc4571_chunk (NiceAgent *agent, NiceComponent *component,
     guint headroom;
     gboolean have_whole_next_frame;
 
-    component->rfc4571_frame_offset += component->rfc4571_frame_size;
+    nice_frame_reader_consume (&component->rfc4571_reader,
+        component->rfc4571_frame_size);
     component->rfc4571_frame_size = 0;
     component->rfc4571_consumed_size = 0;
 
     headroom = nice_component_compute_rfc4571_headroom (component);
     if (headroom >= sizeof (guint16)) {
-      component->rfc4571_frame_size = sizeof (guint16) + ntohs (
-          *((guint16 *) (component->rfc4571_buffer +
-              component->rfc4571_frame_offset)));
+      component->rfc4571_frame_size = sizeof (guint16) +
+          rfc4571_read_frame_length (component);
       have_whole_next_frame = headroom >= component->rfc4571_frame_size;
     } else {
       have_whole_next_frame = FALSE;
@@ -5185,6 +5793,31 @@ compact_input_message (const NiceInputMessage *message, gsize *buffer_length)
   return compact_message ((NiceOutputMessage *) message, *buffer_length);
 }
 
+/* Gathers the buffers of @message into the caller-provided @buffer, without
+ * allocating. Returns the number of bytes copied, which is less than the
+ * length of @message if it doesn’t fit in @buffer_length bytes. */
+gsize
+memcpy_input_message_to_buffer (const NiceInputMessage *message,
+    guint8 *buffer, gsize buffer_length)
+{
+  gsize offset = 0;
+  guint i;
+
+  buffer_length = MIN (buffer_length, message->length);
+
+  for (i = 0;
+       offset < buffer_length &&
+       ((message->n_buffers >= 0 && i < (guint) message->n_buffers) ||
+        (message->n_buffers < 0 && message->buffers[i].buffer != NULL));
+       i++) {
+    gsize len = MIN (buffer_length - offset, message->buffers[i].size);
+    memcpy (buffer + offset, message->buffers[i].buffer, len);
+    offset += len;
+  }
+
+  return offset;
+}
+
 /* Returns the number of bytes copied. Silently drops any data from @buffer
  * which doesn’t fit in @message. */
 gsize
@@ -5785,6 +6418,382 @@ nice_agent_recv_nonblocking (NiceAgent *agent, guint stream_id,
   return local_messages.length;
 }
 
+/* Finds the component of a substream and checks it can carry substreams. */
+static gboolean
+substream_find_component (NiceAgent *agent, guint stream_id,
+    guint component_id, NiceStream **stream, NiceComponent **component,
+    GError **error)
+{
+  if (!agent_find_component (agent, stream_id, component_id, stream,
+          component)) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_BROKEN_PIPE,
+        "Invalid stream/component.");
+    return FALSE;
+  }
+
+  if (!agent->reliable) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+        "Substreams are only available on reliable agents.");
+    return FALSE;
+  }
+
+  if ((*component)->selected_pair.local == NULL) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_CONNECTED,
+        "No candidate pair has been selected yet.");
+    return FALSE;
+  }
+
+  /* ICE-TCP carries the component’s byte stream without pseudo-TCP */
+  if (nice_socket_is_reliable ((*component)->selected_pair.local->sockptr)) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+        "Substreams are not available over ICE-TCP.");
+    return FALSE;
+  }
+
+  if (pseudo_tcp_socket_is_closed ((*component)->tcp)) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_BROKEN_PIPE,
+        "Pseudo-TCP socket not connected.");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+NICEAPI_EXPORT gssize
+nice_agent_send_substream (NiceAgent *agent, guint stream_id,
+    guint component_id, guint substream_id, const guint8 *buf, gsize buf_len,
+    guint lifetime, GError **error)
+{
+  NiceStream *stream;
+  NiceComponent *component;
+  NiceSubstream *substream;
+  gssize ret = -1;
+  GError *child_error = NULL;
+
+  g_return_val_if_fail (NICE_IS_AGENT (agent), -1);
+  g_return_val_if_fail (stream_id >= 1, -1);
+  g_return_val_if_fail (component_id >= 1, -1);
+  g_return_val_if_fail (substream_id >= 1, -1);
+  g_return_val_if_fail (buf != NULL && buf_len > 0, -1);
+  g_return_val_if_fail (error == NULL || *error == NULL, -1);
+
+  if (buf_len > G_MAXUINT32) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE,
+        "Message too large for substream %u.", substream_id);
+    return -1;
+  }
+
+  agent_lock (agent);
+
+  if (!substream_find_component (agent, stream_id, component_id, &stream,
+          &component, &child_error))
+    goto done;
+
+  if (component->selected_pair.local != NULL &&
+        !component->selected_pair.remote_consent.have) {
+    g_set_error (&child_error, G_IO_ERROR, G_IO_ERROR_PERMISSION_DENIED,
+                 "Consent to send has been revoked by the peer");
+    goto done;
+  }
+
+  substream = substream_find (component, substream_id);
+  if (substream == NULL &&
+      g_slist_length (component->substreams) >= MAX_SUBSTREAMS) {
+    g_set_error (&child_error, G_IO_ERROR, G_IO_ERROR_TOO_MANY_OPEN_FILES,
+        "Too many substreams to open substream %u.", substream_id);
+    goto done;
+  } else if (substream == NULL) {
+    substream = substream_create (agent, component, substream_id);
+    pseudo_tcp_socket_connect (substream->tcp);
+    adjust_tcp_clock (agent, stream, component);
+
+    g_set_error (&child_error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK,
+        "Substream %u is being opened.", substream_id);
+    goto done;
+  }
+
+  if (pseudo_tcp_socket_is_closed (substream->tcp)) {
+    g_set_error (&child_error, G_IO_ERROR, G_IO_ERROR_BROKEN_PIPE,
+        "Substream %u is closed.", substream_id);
+    goto done;
+  }
+
+  /* A message is queued whole or not at all */
+  if (pseudo_tcp_socket_send_message (substream->tcp, (const gchar *) buf,
+          buf_len, lifetime) < 0) {
+    switch (pseudo_tcp_socket_get_error (substream->tcp)) {
+      case EWOULDBLOCK:
+        /* Message header and payload */
+        substream->send_wanted = 4 + buf_len;
+        g_set_error (&child_error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK,
+            "Not enough space in the send buffer.");
+        break;
+      case ENOTCONN:
+        g_set_error (&child_error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK,
+            "Substream %u is being opened.", substream_id);
+        break;
+      case EMSGSIZE:
+        g_set_error (&child_error, G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE,
+            "Message too large for substream %u.", substream_id);
+        break;
+      default:
+        g_set_error (&child_error, G_IO_ERROR, G_IO_ERROR_FAILED,
+            "Error writing to substream %u.", substream_id);
+        break;
+    }
+  } else {
+    ret = buf_len;
+  }
+
+  adjust_tcp_clock (agent, stream, component);
+
+done:
+  g_assert ((child_error != NULL) == (ret == -1));
+  if (child_error != NULL)
+    g_propagate_error (error, child_error);
+
+  agent_unlock_and_emit (agent);
+
+  return ret;
+}
+
+NICEAPI_EXPORT gssize
+nice_agent_recv_substream_nonblocking (NiceAgent *agent, guint stream_id,
+    guint component_id, guint substream_id, guint8 *buf, gsize buf_len,
+    GCancellable *cancellable, GError **error)
+{
+  NiceStream *stream;
+  NiceComponent *component;
+  NiceSubstream *substream;
+  gssize ret = -1;
+  GError *child_error = NULL;
+
+  g_return_val_if_fail (NICE_IS_AGENT (agent), -1);
+  g_return_val_if_fail (stream_id >= 1, -1);
+  g_return_val_if_fail (component_id >= 1, -1);
+  g_return_val_if_fail (substream_id >= 1, -1);
+  g_return_val_if_fail (buf != NULL || buf_len == 0, -1);
+  g_return_val_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable), -1);
+  g_return_val_if_fail (error == NULL || *error == NULL, -1);
+
+  if (g_cancellable_set_error_if_cancelled (cancellable, error))
+    return -1;
+
+  agent_lock (agent);
+
+  if (!substream_find_component (agent, stream_id, component_id, &stream,
+          &component, &child_error))
+    goto done;
+
+  substream = substream_find (component, substream_id);
+  if (substream == NULL) {
+    g_set_error (&child_error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK,
+        "Substream %u is not open.", substream_id);
+    goto done;
+  }
+
+  ret = pseudo_tcp_socket_recv_message (substream->tcp, (gchar *) buf,
+      buf_len);
+  if (ret < 0) {
+    switch (pseudo_tcp_socket_get_error (substream->tcp)) {
+      case EWOULDBLOCK:
+        g_set_error (&child_error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK,
+            "No complete message on substream %u.", substream_id);
+        break;
+      case EMSGSIZE:
+        g_set_error (&child_error, G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE,
+            "The next message on substream %u is too large for the buffer.",
+            substream_id);
+        break;
+      case EBADMSG:
+        g_set_error (&child_error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+            "Invalid message on substream %u.", substream_id);
+        pseudo_tcp_socket_close (substream->tcp, TRUE);
+        break;
+      default:
+        g_set_error (&child_error, G_IO_ERROR, G_IO_ERROR_BROKEN_PIPE,
+            "Substream %u is closed.", substream_id);
+        break;
+    }
+    ret = -1;
+  }
+
+  /* Reading may reopen the receive window */
+  adjust_tcp_clock (agent, stream, component);
+
+done:
+  g_assert ((child_error != NULL) == (ret == -1));
+  if (child_error != NULL)
+    g_propagate_error (error, child_error);
+
+  agent_unlock_and_emit (agent);
+
+  return ret;
+}
+
+/* Longest RFC 4571 frame sent, leaving enough space for TURN overhead */
+#define RFC4571_MAX_FRAME_SIZE 0xF800
+/* Buffers, framing headers included, gathered into each write */
+#define RFC4571_BATCH_N_BUFFERS 64
+
+typedef struct {
+  GOutputVector buffers[RFC4571_BATCH_N_BUFFERS];
+  guint16 headers[RFC4571_BATCH_N_BUFFERS / 2];
+  NiceOutputMessage message;  /* of @buffers */
+  guint n_headers;
+  guint n_messages;  /* whole messages in @buffers */
+} Rfc4571Batch;
+
+/* Sends the batch as a single message, so as a single write, and adds the
+ * messages it completes to @n_sent. Returns 1 if it was sent, 0 if it would
+ * block, or -1 on error. */
+static gint
+rfc4571_batch_flush (NiceComponent *component, NiceSocket *sock,
+    NiceAddress *addr, Rfc4571Batch *batch, gboolean reliable, gint *n_sent)
+{
+  gint ret;
+
+  if (batch->message.n_buffers == 0) {
+    *n_sent += batch->n_messages;
+    batch->n_messages = 0;
+    return 1;
+  }
+
+  if (reliable)
+    ret = nice_socket_send_messages_reliable (sock, addr, &batch->message, 1);
+  else
+    ret = nice_socket_send_messages (sock, addr, &batch->message, 1);
+
+  if (component->tcp_writable_cancellable &&
+      !nice_socket_can_send (sock, addr))
+    g_cancellable_reset (component->tcp_writable_cancellable);
+
+  if (ret == 1) {
+    *n_sent += batch->n_messages;
+    batch->message.n_buffers = 0;
+    batch->n_headers = 0;
+    batch->n_messages = 0;
+  }
+
+  return ret;
+}
+
+/* Whether @sock writes whatever it is given to a byte stream, so that several
+ * frames can go out in one write. A TURN socket over TCP sends each write as
+ * one TURN message, which cannot be longer than a single frame. */
+static gboolean
+rfc4571_socket_can_batch (NiceSocket *sock)
+{
+  return sock->type == NICE_SOCKET_TYPE_TCP_BSD ||
+      sock->type == NICE_SOCKET_TYPE_TCP_ACTIVE ||
+      sock->type == NICE_SOCKET_TYPE_TCP_PASSIVE;
+}
+
+/* ICE-TCP requires that all packets be framed with RFC4571. The frames of
+ * @messages, headers included, are gathered on the stack and written
+ * together, or one by one if the socket cannot take more than a frame at a
+ * time. Long messages are split into several frames. If a message does not
+ * fit in one write, the rest of it is sent reliably, so that the stream
+ * never stops in the middle of a message.
+ *
+ * Returns: the number of messages sent, or -1 on error */
+static gint
+agent_send_rfc4571_messages (NiceAgent *agent, NiceComponent *component,
+    NiceSocket *sock, NiceAddress *addr, const NiceOutputMessage *messages,
+    guint n_messages)
+{
+  Rfc4571Batch batch;
+  gboolean can_batch = rfc4571_socket_can_batch (sock);
+  gint n_sent = 0;
+  gint ret = 1;
+  guint i;
+
+  batch.message.buffers = batch.buffers;
+  batch.message.n_buffers = 0;
+  batch.n_headers = 0;
+  batch.n_messages = 0;
+
+  for (i = 0; i < n_messages && ret == 1; i++) {
+    const NiceOutputMessage *message = &messages[i];
+    gsize message_len = output_message_get_size (message);
+    gsize offset_in_buffer = 0;
+    gboolean in_batch = FALSE;  /* whether part of it is in the batch */
+    gboolean split = FALSE;  /* whether part of it was already sent */
+    guint j = 0;
+
+    while (message_len > 0 && ret == 1) {
+      gsize frame_len = MIN (message_len, RFC4571_MAX_FRAME_SIZE);
+
+      message_len -= frame_len;
+
+      /* Room for the header and at least one buffer */
+      if (batch.message.n_buffers + 2 > RFC4571_BATCH_N_BUFFERS) {
+        ret = rfc4571_batch_flush (component, sock, addr, &batch,
+            agent->reliable || split, &n_sent);
+        if (ret != 1)
+          break;
+        split = split || in_batch;
+      }
+
+      batch.headers[batch.n_headers] = htons (frame_len);
+      batch.buffers[batch.message.n_buffers].buffer =
+          &batch.headers[batch.n_headers++];
+      batch.buffers[batch.message.n_buffers++].size = sizeof (guint16);
+      in_batch = TRUE;
+
+      while (frame_len > 0) {
+        const GOutputVector *buffer = &message->buffers[j];
+        gsize len = MIN (buffer->size - offset_in_buffer, frame_len);
+
+        if (len > 0) {
+          if (batch.message.n_buffers == RFC4571_BATCH_N_BUFFERS) {
+            ret = rfc4571_batch_flush (component, sock, addr, &batch,
+                agent->reliable || split, &n_sent);
+            if (ret != 1)
+              break;
+            split = TRUE;
+          }
+
+          batch.buffers[batch.message.n_buffers].buffer =
+              (const guint8 *) buffer->buffer + offset_in_buffer;
+          batch.buffers[batch.message.n_buffers++].size = len;
+          frame_len -= len;
+          offset_in_buffer += len;
+        }
+
+        if (offset_in_buffer == buffer->size) {
+          j++;
+          offset_in_buffer = 0;
+        }
+      }
+
+      if (ret == 1 && !can_batch) {
+        ret = rfc4571_batch_flush (component, sock, addr, &batch,
+            agent->reliable || split, &n_sent);
+        split = split || message_len > 0;
+      }
+    }
+
+    if (ret != 1)
+      break;
+
+    batch.n_messages++;
+
+    /* Don't force the following messages out reliably too */
+    if (split && !agent->reliable)
+      ret = rfc4571_batch_flush (component, sock, addr, &batch, TRUE, &n_sent);
+  }
+
+  if (ret == 1)
+    ret = rfc4571_batch_flush (component, sock, addr, &batch, agent->reliable,
+        &n_sent);
+
+  if (ret < 0 && n_sent == 0)
+    return ret;
+
+  return n_sent;
+}
+
 /* nice_agent_send_messages_nonblocking_internal:
  *
  * Returns: number of bytes sent if allow_partial is %TRUE, the number
@@ -5864,100 +6873,8 @@ nice_agent_send_messages_nonblocking_internal (
       addr = &component->selected_pair.remote->c.addr;
 
       if (nice_socket_is_reliable (sock)) {
-        guint i;
-
-        /* ICE-TCP requires that all packets be framed with RFC4571 */
-        n_sent = 0;
-        for (i = 0; i < n_messages; i++) {
-          const NiceOutputMessage *message = &messages[i];
-          gsize message_len = output_message_get_size (message);
-          gsize offset = 0;
-          gsize current_offset = 0;
-          gsize offset_in_buffer = 0;
-          gint n_sent_framed;
-          GOutputVector *local_bufs;
-          NiceOutputMessage local_message;
-          guint j;
-          guint n_bufs = 0;
-
-          /* Count the number of buffers. */
-          if (message->n_buffers == -1) {
-            for (j = 0; message->buffers[j].buffer != NULL; j++)
-              n_bufs++;
-          } else {
-            n_bufs = message->n_buffers;
-          }
-
-          local_bufs = g_malloc_n (n_bufs + 1, sizeof (GOutputVector));
-          local_message.buffers = local_bufs;
-
-          while (message_len > 0) {
-            guint16 packet_len;
-            guint16 rfc4571_frame;
-
-            /* Split long messages into 62KB packets, leaving enough space
-             * for TURN overhead as well */
-            if (message_len > 0xF800)
-              packet_len = 0xF800;
-            else
-              packet_len = (guint16) message_len;
-            message_len -= packet_len;
-            rfc4571_frame = htons (packet_len);
-
-            local_bufs[0].buffer = &rfc4571_frame;
-            local_bufs[0].size = sizeof (guint16);
-
-            local_message.n_buffers = 1;
-            /* If we had to split the message, we need to find which buffer
-             * to start copying from and our offset within that buffer */
-            offset_in_buffer = 0;
-            current_offset = 0;
-            for (j = 0; j < n_bufs; j++) {
-              if (message->buffers[j].size < offset - current_offset) {
-                current_offset += message->buffers[j].size;
-                continue;
-              } else {
-                offset_in_buffer = offset - current_offset;
-                current_offset = offset;
-                break;
-              }
-            }
-
-            /* Keep j position in array and start copying from there */
-            for (; j < n_bufs; j++) {
-              local_bufs[local_message.n_buffers].buffer =
-                  ((guint8 *) message->buffers[j].buffer) + offset_in_buffer;
-              local_bufs[local_message.n_buffers].size =
-                  MIN (message->buffers[j].size, packet_len);
-              packet_len -= local_bufs[local_message.n_buffers].size;
-              offset += local_bufs[local_message.n_buffers++].size;
-              offset_in_buffer = 0;
-            }
-
-            /* If we sent part of the message already, then send the rest
-             * reliably so the message is sent as a whole even if it's split */
-            if (current_offset == 0 && !agent->reliable)
-              n_sent_framed = nice_socket_send_messages (sock, addr,
-                  &local_message, 1);
-            else
-              n_sent_framed = nice_socket_send_messages_reliable (sock, addr,
-                  &local_message, 1);
-
-            if (component->tcp_writable_cancellable &&
-                !nice_socket_can_send (sock, addr))
-              g_cancellable_reset (component->tcp_writable_cancellable);
-
-            if (n_sent_framed < 0 && n_sent == 0)
-              n_sent = n_sent_framed;
-            if (n_sent_framed != 1)
-              break;
-            /* This is the last split frame, increment n_sent */
-            if (message_len == 0)
-              n_sent ++;
-          }
-          g_free (local_bufs);
-        }
-
+        n_sent = agent_send_rfc4571_messages (agent, component, sock, addr,
+            messages, n_messages);
       } else {
         n_sent = nice_socket_send_messages (sock, addr, messages, n_messages);
       }
@@ -6049,6 +6966,144 @@ nice_agent_send (
   return n_sent_bytes;
 }
 
+/* Frames of a zero-copy send on ICE-TCP, each with its header as a separate
+ * buffer */
+#define RFC4571_ZEROCOPY_MAX_FRAMES 4
+
+NICEAPI_EXPORT gint
+nice_agent_send_zerocopy (
+  NiceAgent *agent,
+  guint stream_id,
+  guint component_id,
+  GBytes *bytes,
+  GError **error)
+{
+  NiceComponent *component;
+  NiceSocket *sock;
+  NiceAddress *addr;
+  GOutputVector buffers[2 * RFC4571_ZEROCOPY_MAX_FRAMES];
+  guint16 headers[RFC4571_ZEROCOPY_MAX_FRAMES];
+  NiceOutputMessage message = { buffers, 0 };
+  GOutputVector local_buf;
+  NiceOutputMessage local_message = { &local_buf, 1 };
+  const guint8 *data;
+  gsize len;
+  gint n_sent;
+
+  g_return_val_if_fail (NICE_IS_AGENT (agent), -1);
+  g_return_val_if_fail (stream_id >= 1, -1);
+  g_return_val_if_fail (component_id >= 1, -1);
+  g_return_val_if_fail (bytes != NULL, -1);
+  g_return_val_if_fail (error == NULL || *error == NULL, -1);
+
+  data = g_bytes_get_data (bytes, &len);
+  g_return_val_if_fail (len <= G_MAXINT, -1);
+
+  agent_lock (agent);
+
+  /* Pseudo-TCP copies the data into its own buffers anyway */
+  if (agent->reliable ||
+      !agent_find_component (agent, stream_id, component_id, NULL,
+          &component) ||
+      component->selected_pair.local == NULL ||
+      !component->selected_pair.remote_consent.have)
+    goto copy;
+
+  sock = component->selected_pair.local->sockptr;
+  addr = &component->selected_pair.remote->c.addr;
+
+  if (nice_socket_is_reliable (sock)) {
+    gsize offset = 0;
+    guint n_frames = 0;
+
+    if (len > RFC4571_ZEROCOPY_MAX_FRAMES * RFC4571_MAX_FRAME_SIZE)
+      goto copy;
+
+    while (offset < len) {
+      gsize frame_len = MIN (len - offset, RFC4571_MAX_FRAME_SIZE);
+
+      headers[n_frames] = htons (frame_len);
+      buffers[message.n_buffers].buffer = &headers[n_frames++];
+      buffers[message.n_buffers++].size = sizeof (guint16);
+      buffers[message.n_buffers].buffer = data + offset;
+      buffers[message.n_buffers++].size = frame_len;
+      offset += frame_len;
+    }
+  } else {
+    buffers[message.n_buffers].buffer = data;
+    buffers[message.n_buffers++].size = len;
+  }
+
+  n_sent = nice_socket_send_zerocopy (sock, addr, &message, bytes);
+
+  if (component->tcp_writable_cancellable &&
+      !nice_socket_can_send (sock, addr))
+    g_cancellable_reset (component->tcp_writable_cancellable);
+
+  if (n_sent == 0) {
+    g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK,
+        g_strerror (EAGAIN));
+  } else if (n_sent < 0) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+        "Error writing data to socket.");
+  }
+
+  agent_unlock_and_emit (agent);
+
+  return (n_sent == 1) ? (gint) len : -1;
+
+copy:
+  agent_unlock_and_emit (agent);
+
+  /* The data is copied before this returns */
+  local_buf.buffer = data;
+  local_buf.size = len;
+  n_sent = nice_agent_send_messages_nonblocking_internal (agent, stream_id,
+      component_id, &local_message, 1, FALSE, error);
+
+  return (n_sent == 1) ? (gint) len : -1;
+}
+
+static gboolean
+agent_set_corked (NiceAgent *agent, guint stream_id, guint component_id,
+    gboolean corked)
+{
+  NiceComponent *component;
+  gboolean ret = FALSE;
+
+  agent_lock (agent);
+
+  if (agent_find_component (agent, stream_id, component_id, NULL,
+          &component)) {
+    nice_component_set_corked (component, corked);
+    ret = TRUE;
+  }
+
+  agent_unlock_and_emit (agent);
+
+  return ret;
+}
+
+NICEAPI_EXPORT gboolean
+nice_agent_cork (NiceAgent *agent, guint stream_id, guint component_id)
+{
+  g_return_val_if_fail (NICE_IS_AGENT (agent), FALSE);
+  g_return_val_if_fail (stream_id >= 1, FALSE);
+  g_return_val_if_fail (component_id >= 1, FALSE);
+
+  return agent_set_corked (agent, stream_id, component_id, TRUE);
+}
+
+NICEAPI_EXPORT gboolean
+nice_agent_uncork (NiceAgent *agent, guint stream_id, guint component_id)
+{
+  g_return_val_if_fail (NICE_IS_AGENT (agent), FALSE);
+  g_return_val_if_fail (stream_id >= 1, FALSE);
+  g_return_val_if_fail (component_id >= 1, FALSE);
+
+  return agent_set_corked (agent, stream_id, component_id, FALSE);
+}
+
 NICEAPI_EXPORT GSList *
 nice_agent_get_local_candidates (
   NiceAgent *agent,
@@ -6271,10 +7326,72 @@ nice_agent_dispose (GObject *object)
     G_OBJECT_CLASS (nice_agent_parent_class)->dispose (object);
 }
 
-gboolean
-component_io_cb (GSocket *gsocket, GIOCondition condition, gpointer user_data)
+/*
+ * Reads datagrams for the lock-free ICE-lite responder, answering Binding
+ * requests on the selected pair until the socket would block.
+ *
+ * @return TRUE if the socket was drained without needing the agent, FALSE
+ * if the agent must take over; the datagram that could not be answered is
+ * then left in @recv_buf
+ *
+ * Each datagram is handled with the component’s lite_mutex held. The socket
+ * sources are only destroyed under it, and their sockets only freed after
+ * that, so a source which is not destroyed yet guarantees that its socket,
+ * and the component, outlive the answer, whichever thread removes them.
+ */
+static gboolean
+component_io_lite_respond (NiceComponent *component,
+    SocketSource *socket_source, guint8 *recv_buf)
+{
+  gboolean drained = FALSE;
+
+  while (TRUE) {
+    GInputVector local_buf = { recv_buf, MAX_BUFFER_SIZE };
+    NiceInputMessage local_message = {
+      &local_buf, 1, &component->lite_pending_from, 0
+    };
+    NiceSocket *nicesock;
+    gint ret;
+
+    g_mutex_lock (&component->lite_mutex);
+
+    if (g_source_is_destroyed (g_main_current_source ()) ||
+        component->lite_responder == NULL)
+      break;
+
+    nicesock = socket_source->socket;
+
+    nice_message_extra_data_copy (&component->exdata, NULL);
+    ret = nice_socket_recv_messages (nicesock, &local_message, 1,
+        &component->exdata);
+
+    if (ret == 0) {
+      drained = TRUE;
+      break;
+    } else if (ret < 0) {
+      break;  /* let the agent read the error again */
+    }
+
+    if (!conn_check_lite_respond (component, nicesock,
+            &component->lite_pending_from, recv_buf,
+            local_message.length)) {
+      component->lite_pending_buffer = recv_buf;
+      component->lite_pending_length = local_message.length;
+      break;
+    }
+
+    g_mutex_unlock (&component->lite_mutex);
+  }
+
+  g_mutex_unlock (&component->lite_mutex);
+
+  return drained;
+}
+
+static gboolean
+component_io_dispatch (SocketSource *socket_source, GIOCondition condition,
+    guint8 *recv_buf)
 {
-  SocketSource *socket_source = user_data;
   NiceComponent *component;
   NiceAgent *agent;
   NiceStream *stream;
@@ -6293,6 +7410,19 @@ component_io_cb (GSocket *gsocket, GIOCondition condition, gpointer user_data)
   if (agent == NULL)
     return G_SOURCE_REMOVE;
 
+  /* A datagram left by an earlier dispatch is in a buffer returned since */
+  component->lite_pending_length = 0;
+
+  /* An ICE-lite agent answers the Binding requests on its selected pair
+   * without the agent lock, which is only taken for anything else. */
+  if (g_atomic_pointer_get (&component->lite_responder) != NULL &&
+      !(condition & G_IO_HUP) &&
+      nice_component_has_io_callback (component) &&
+      component_io_lite_respond (component, socket_source, recv_buf)) {
+    g_object_unref (agent);
+    return G_SOURCE_CONTINUE;
+  }
+
   agent_lock (agent);
 
   if (g_source_is_destroyed (g_main_current_source ())) {
@@ -6364,7 +7494,7 @@ component_io_cb (GSocket *gsocket, GIOCondition condition, gpointer user_data)
      * I/O callback directly from the pseudo-TCP receive buffer. */
     GInputVector local_bufs[] = {
       { local_header_buf, sizeof (local_header_buf) },
-      { component->recv_buffer, component->recv_buffer_size },
+      { recv_buf, MAX_BUFFER_SIZE },
     };
     NiceInputMessage local_message = {
       local_bufs, G_N_ELEMENTS (local_bufs), NULL, 0
@@ -6418,9 +7548,7 @@ component_io_cb (GSocket *gsocket, GIOCondition condition, gpointer user_data)
         (component->recv_messages != NULL &&
             !nice_input_message_iter_is_at_end (iter,
                 component->recv_messages, component->n_recv_messages))) {
-      GInputVector internal_buf = {
-        component->recv_buffer, component->recv_buffer_size
-      };
+      GInputVector internal_buf = { recv_buf, MAX_BUFFER_SIZE };
       NiceInputMessage internal_message = {
         &internal_buf, 1, NULL, 0
       };
@@ -6489,7 +7617,8 @@ component_io_cb (GSocket *gsocket, GIOCondition condition, gpointer user_data)
         nice_debug_verbose ("%s: %p: received a valid message with %"
             G_GSIZE_FORMAT " bytes", G_STRFUNC, agent, msg->length);
         if (has_io_callback) {
-          nice_component_emit_io_callback (agent, component, msg->length);
+          nice_component_emit_io_callback (agent, component, recv_buf,
+              msg->length);
         } else {
           iter->message++;
         }
@@ -6513,14 +7642,13 @@ component_io_cb (GSocket *gsocket, GIOCondition condition, gpointer user_data)
     }
   } else if (has_io_callback) {
     while (has_io_callback) {
-      GInputVector local_bufs = {
-        component->recv_buffer, component->recv_buffer_size
-      };
+      GInputVector local_bufs = { recv_buf, MAX_BUFFER_SIZE };
       NiceInputMessage local_message = { &local_bufs, 1, NULL, 0 };
       RecvStatus retval;
 
-      /* Receive a single message. */
-      nice_message_extra_data_copy (&component->exdata, NULL);
+      /* Receive a single message, unless the lite responder already did */
+      if (component->lite_pending_length == 0)
+        nice_message_extra_data_copy (&component->exdata, NULL);
       retval = agent_recv_message_unlocked (agent, stream, component,
           socket_source->socket, &local_message, &component->exdata);
 
@@ -6541,7 +7669,7 @@ component_io_cb (GSocket *gsocket, GIOCondition condition, gpointer user_data)
             " bytes", G_STRFUNC, agent, local_message.length);
 
         if (local_message.length > 0) {
-          nice_component_emit_io_callback (agent, component,
+          nice_component_emit_io_callback (agent, component, recv_buf,
               local_message.length);
         }
       }
@@ -6597,8 +7725,13 @@ component_io_cb (GSocket *gsocket, GIOCondition condition, gpointer user_data)
 
 done:
 
+  /* Drop a datagram left by the lite responder if nothing consumed it */
+  component->lite_pending_length = 0;
+
   if (remove_source)
     nice_component_remove_socket (agent, component, socket_source->socket);
+  else
+    nice_component_update_socket_wakeup (socket_source);
 
   /* If we’re in the middle of a read, don’t emit any signals, or we could cause
    * re-entrancy by (e.g.) emitting component-state-changed and having the
@@ -6621,6 +7754,22 @@ out:
   return G_SOURCE_REMOVE;
 }
 
+gboolean
+component_io_cb (GSocket *gsocket, GIOCondition condition, gpointer user_data)
+{
+  guint8 *recv_buf;
+  gboolean ret;
+
+  /* The buffer is only held for this dispatch, and an I/O callback iterating
+   * a main context borrows another one for the nested dispatch. It must not
+   * be returned through the component, which may be freed by now. */
+  recv_buf = nice_component_borrow_recv_buffer ();
+  ret = component_io_dispatch (user_data, condition, recv_buf);
+  nice_component_return_recv_buffer (recv_buf);
+
+  return ret;
+}
+
 typedef struct {
   NiceAgentRecvFunc func;
   gpointer data;
@@ -6706,6 +7855,55 @@ nice_agent_attach_recv_ex (
   return ret;
 }
 
+NICEAPI_EXPORT gboolean
+nice_agent_attach_recv_demux (
+  NiceAgent *agent,
+  guint stream_id,
+  guint component_id,
+  NiceDemuxProtocol protocol,
+  NiceAgentRecvFuncEx func,
+  gpointer data,
+  GDestroyNotify notify)
+{
+  NiceComponent *component = NULL;
+  gboolean ret = FALSE;
+
+  g_return_val_if_fail (NICE_IS_AGENT (agent), FALSE);
+  g_return_val_if_fail (stream_id >= 1, FALSE);
+  g_return_val_if_fail (component_id >= 1, FALSE);
+  g_return_val_if_fail (protocol <= NICE_DEMUX_PROTOCOL_OTHER, FALSE);
+
+  agent_lock (agent);
+
+  if (!agent_find_component (agent, stream_id, component_id, NULL,
+          &component)) {
+    g_warning ("Could not find component %u in stream %u", component_id,
+        stream_id);
+    goto done;
+  }
+
+  if (protocol == NICE_DEMUX_PROTOCOL_STUN) {
+    g_warning ("STUN messages are handled by the agent and cannot be "
+        "demultiplexed to a callback");
+    goto done;
+  }
+
+  if (agent->reliable) {
+    g_warning ("Demultiplexing is not supported on reliable agents");
+    goto done;
+  }
+
+  nice_component_set_demux_callback (component, protocol, func, data, notify);
+  ret = TRUE;
+
+ done:
+  if (!ret && notify)
+    notify (data);
+
+  agent_unlock_and_emit (agent);
+  return ret;
+}
+
 NICEAPI_EXPORT gboolean
 nice_agent_set_selected_pair (
   NiceAgent *agent,
@@ -7929,6 +9127,7 @@ nice_agent_consent_lost (
     nice_debug ("Agent %p: local consent lost for stream/component %u/%u", agent,
         component->stream_id, component->id);
     component->have_local_consent = FALSE;
+    nice_component_set_lite_responder (component, NULL);
     result = TRUE;
   }
   agent_unlock_and_emit (agent);
@@ -409,6 +409,32 @@ typedef enum
   NICE_NOMINATION_MODE_AGGRESSIVE,
 } NiceNominationMode;
 
+/**
+ * NiceDemuxProtocol:
+ * @NICE_DEMUX_PROTOCOL_STUN: STUN message, first byte 0 to 3
+ * @NICE_DEMUX_PROTOCOL_ZRTP: ZRTP packet, first byte 16 to 19
+ * @NICE_DEMUX_PROTOCOL_DTLS: DTLS record, first byte 20 to 63
+ * @NICE_DEMUX_PROTOCOL_TURN_CHANNEL: TURN ChannelData message, first byte
+ * 64 to 79
+ * @NICE_DEMUX_PROTOCOL_RTP: RTP or RTCP packet, first byte 128 to 191
+ * @NICE_DEMUX_PROTOCOL_OTHER: Any other packet
+ *
+ * The protocols which can be told apart by the first byte of a packet
+ * multiplexed on a single component, as described in RFC 7983.
+ * <para> See also: nice_agent_attach_recv_demux() </para>
+ *
+ * Since: 0.1.24
+ */
+typedef enum
+{
+  NICE_DEMUX_PROTOCOL_STUN = 0,
+  NICE_DEMUX_PROTOCOL_ZRTP,
+  NICE_DEMUX_PROTOCOL_DTLS,
+  NICE_DEMUX_PROTOCOL_TURN_CHANNEL,
+  NICE_DEMUX_PROTOCOL_RTP,
+  NICE_DEMUX_PROTOCOL_OTHER,
+} NiceDemuxProtocol;
+
 /**
  * NiceAgentOption:
  * @NICE_AGENT_OPTION_NONE: No enabled options (Since: 0.1.19)
@@ -424,6 +450,17 @@ typedef enum
  * @NICE_AGENT_OPTION_CLOSE_FORCED: When removing TURN port allocations on TURN server,
  * don't do retransmissions and don't wait for a response. (Since: 0.1.23)
  * @NICE_AGENT_OPTION_RECV_TOS: Enables receiving IP_TOS/IPV6_TCLASS packet header fields. (Since: 0.1.23)
+ * @NICE_AGENT_OPTION_PSEUDO_TCP_CUBIC: Use CUBIC congestion control for
+ * pseudo-TCP, see #NiceAgent:pseudo-tcp-congestion-control. (Since: 0.1.24)
+ * @NICE_AGENT_OPTION_PSEUDO_TCP_BBR: Use BBR-style model-based congestion
+ * control for pseudo-TCP. Takes precedence over
+ * @NICE_AGENT_OPTION_PSEUDO_TCP_CUBIC. (Since: 0.1.24)
+ * @NICE_AGENT_OPTION_PSEUDO_TCP_MTU_DISCOVERY: Search for the path MTU in
+ * pseudo-TCP, see #NiceAgent:pseudo-tcp-mtu-discovery. (Since: 0.1.24)
+ * @NICE_AGENT_OPTION_PSEUDO_TCP_RACK_TLP: Use RACK-TLP loss detection in
+ * pseudo-TCP, see #NiceAgent:pseudo-tcp-rack-tlp. (Since: 0.1.24)
+ * @NICE_AGENT_OPTION_PSEUDO_TCP_PACING: Pace the transmissions of
+ * pseudo-TCP, see #NiceAgent:pseudo-tcp-pacing. (Since: 0.1.24)
  *
  * These are options that can be passed to nice_agent_new_full(). They set
  * various properties on the agent. Not including them sets the property to
@@ -442,6 +479,11 @@ typedef enum {
   NICE_AGENT_OPTION_BYTESTREAM_TCP = 1 << 6,
   NICE_AGENT_OPTION_CLOSE_FORCED = 1 << 7,
   NICE_AGENT_OPTION_RECV_TOS = 1 << 8,
+  NICE_AGENT_OPTION_PSEUDO_TCP_CUBIC = 1 << 9,
+  NICE_AGENT_OPTION_PSEUDO_TCP_BBR = 1 << 10,
+  NICE_AGENT_OPTION_PSEUDO_TCP_MTU_DISCOVERY = 1 << 11,
+  NICE_AGENT_OPTION_PSEUDO_TCP_RACK_TLP = 1 << 12,
+  NICE_AGENT_OPTION_PSEUDO_TCP_PACING = 1 << 13,
 } NiceAgentOption;
 
 /**
@@ -893,6 +935,86 @@ nice_agent_send_messages_nonblocking (
     GCancellable *cancellable,
     GError **error);
 
+/**
+ * nice_agent_send_zerocopy:
+ * @agent: a #NiceAgent
+ * @stream_id: the ID of the stream to send to
+ * @component_id: the ID of the component to send to
+ * @bytes: the message to send
+ * @error: (allow-none): return location for a #GError, or %NULL
+ *
+ * Sends @bytes as a single message, like nice_agent_send_messages_nonblocking(),
+ * but without copying it if possible. Over ICE-TCP and TURN-over-TCP on Linux,
+ * large messages are sent with MSG_ZEROCOPY: the kernel reads them from the
+ * memory of @bytes after this returns, so @agent keeps a reference on @bytes
+ * until the kernel is done with it. Create @bytes with
+ * g_bytes_new_with_free_func() to know when the memory can be reused; the free
+ * function may be called from the thread of the #GMainContext of @agent.
+ *
+ * Where that is not supported, in reliable mode, or for small messages, @bytes
+ * is copied as by nice_agent_send_messages_nonblocking(), and it can be reused
+ * as soon as this returns.
+ *
+ * On failure, -1 will be returned and @error will be set, as by
+ * nice_agent_send_messages_nonblocking().
+ *
+ * Returns: the number of bytes sent, or -1 on error
+ *
+ * Since: 0.1.24
+ */
+gint
+nice_agent_send_zerocopy (
+    NiceAgent *agent,
+    guint stream_id,
+    guint component_id,
+    GBytes *bytes,
+    GError **error);
+
+/**
+ * nice_agent_cork:
+ * @agent: a #NiceAgent
+ * @stream_id: the ID of the stream
+ * @component_id: the ID of the component
+ *
+ * Holds back the messages sent on the given stream/component pair over
+ * ICE-TCP, until nice_agent_uncork() is called. Instead of a write for every
+ * message, they are queued with their framing and written together, in full
+ * TCP segments. Sending many small messages between these two calls saves
+ * system calls and packets.
+ *
+ * The queue is written out anyway once it grows past the point where sends
+ * would block. Over UDP, including pseudo-TCP in reliable mode, this has no
+ * effect. A reliable agent over ICE-TCP writes to the TCP connection
+ * directly, so it is corked like any other.
+ *
+ * The connectivity checks, keepalives and consent freshness requests and
+ * responses sent on the corked TCP connections are held back too. Keep the
+ * component corked briefly: a cork held for seconds delays consent freshness,
+ * and may let consent expire on either side.
+ *
+ * Returns: %FALSE if the stream or component could not be found
+ *
+ * Since: 0.1.24
+ */
+gboolean
+nice_agent_cork (NiceAgent *agent, guint stream_id, guint component_id);
+
+/**
+ * nice_agent_uncork:
+ * @agent: a #NiceAgent
+ * @stream_id: the ID of the stream
+ * @component_id: the ID of the component
+ *
+ * Writes out the messages held back since nice_agent_cork(), and sends the
+ * following ones right away again.
+ *
+ * Returns: %FALSE if the stream or component could not be found
+ *
+ * Since: 0.1.24
+ */
+gboolean
+nice_agent_uncork (NiceAgent *agent, guint stream_id, guint component_id);
+
 /**
  * nice_agent_get_local_candidates:
  * @agent: The #NiceAgent Object
@@ -1063,6 +1185,51 @@ nice_agent_attach_recv_ex (
   gpointer data,
   GDestroyNotify notify);
 
+/**
+ * nice_agent_attach_recv_demux:
+ * @agent: The #NiceAgent Object
+ * @stream_id: The ID of stream
+ * @component_id: The ID of the component
+ * @protocol: The #NiceDemuxProtocol of the packets to deliver to @func
+ * @func: (allow-none): The callback function to be called when a packet of
+ * @protocol is received on the stream's component, or %NULL to remove it
+ * @data: user data associated with the callback
+ * @notify: A function to free @data
+ *
+ * Enables RFC 7983 demultiplexing on a component of a non-reliable agent.
+ * Once at least one demultiplexing callback is attached, every packet received
+ * on the component is classified by its first byte, exactly once, before any
+ * other processing. Packets which cannot be STUN skip the STUN validation
+ * path entirely, and packets of @protocol are then passed to @func instead of
+ * the callback given to nice_agent_attach_recv(). Packets of protocols
+ * without a demultiplexing callback keep going to that callback.
+ *
+ * The callbacks are only invoked while a callback is attached with
+ * nice_agent_attach_recv(), and in the #GMainContext passed to it; they do
+ * not apply to nice_agent_recv_messages().
+ *
+ * STUN messages are consumed by the #NiceAgent itself, so
+ * %NICE_DEMUX_PROTOCOL_STUN cannot be given a callback.
+ *
+ * @data becomes owned by libnice, which will call @notify to free the data when
+ * they are no longer needed.
+ *
+ * Returns: %TRUE on success, %FALSE if the stream or component IDs are
+ * invalid, if @protocol is %NICE_DEMUX_PROTOCOL_STUN, or if the agent is
+ * reliable.
+ *
+ * Since: 0.1.24
+ */
+gboolean
+nice_agent_attach_recv_demux (
+  NiceAgent *agent,
+  guint stream_id,
+  guint component_id,
+  NiceDemuxProtocol protocol,
+  NiceAgentRecvFuncEx func,
+  gpointer data,
+  GDestroyNotify notify);
+
 /**
  * nice_agent_recv:
  * @agent: a #NiceAgent
@@ -1186,6 +1353,95 @@ nice_agent_recv_nonblocking (
     GCancellable *cancellable,
     GError **error);
 
+/**
+ * nice_agent_send_substream:
+ * @agent: a #NiceAgent
+ * @stream_id: the ID of the stream to send on
+ * @component_id: the ID of the component to send on
+ * @substream_id: the ID of the substream to send on, at least 1
+ * @buf: (array length=buf_len): the message to send
+ * @buf_len: length of @buf, between 1 and 32768 bytes
+ * @lifetime: milliseconds after which the message may be abandoned, or 0 to
+ * deliver it reliably
+ * @error: (allow-none): return location for a #GError, or %NULL
+ *
+ * Sends a message on a substream of a reliable component. Each substream
+ * delivers its messages reliably and in order, but independently of the
+ * other substreams and of the component’s own byte stream: a lost packet only
+ * delays the substream it belongs to. This requires both agents to be
+ * reliable, and a UDP or TURN candidate pair to be selected, as the
+ * substreams are carried over pseudo-TCP.
+ *
+ * A substream is opened by the first message sent on it, which fails with
+ * %G_IO_ERROR_WOULD_BLOCK; #NiceAgent::reliable-substream-writable is then
+ * emitted once the substream is connected. The peer doesn’t need to do
+ * anything beforehand: its end of the substream is created when the
+ * connection request arrives. A component keeps at most 64 substreams at
+ * once, closed ones aside: opening another fails with
+ * %G_IO_ERROR_TOO_MANY_OPEN_FILES.
+ *
+ * The message is queued whole or not at all. If there isn’t enough room in
+ * the send buffer, %G_IO_ERROR_WOULD_BLOCK is returned, and
+ * #NiceAgent::reliable-substream-writable is emitted when there is.
+ *
+ * A message sent with a non-zero @lifetime is only partially reliable: if it
+ * has not been delivered by then, it is dropped, and the peer moves on to the
+ * next message of the substream instead of waiting for it to be
+ * retransmitted. This suits data which is useless once late, such as media
+ * or state updates. Peers without support for this deliver every message.
+ *
+ * Returns: @buf_len on success, or -1 on error
+ *
+ * Since: 0.1.24
+ */
+gssize
+nice_agent_send_substream (
+    NiceAgent *agent,
+    guint stream_id,
+    guint component_id,
+    guint substream_id,
+    const guint8 *buf,
+    gsize buf_len,
+    guint lifetime,
+    GError **error);
+
+/**
+ * nice_agent_recv_substream_nonblocking:
+ * @agent: a #NiceAgent
+ * @stream_id: the ID of the stream to receive on
+ * @component_id: the ID of the component to receive on
+ * @substream_id: the ID of the substream to receive on, at least 1
+ * @buf: (array length=buf_len) (out caller-allocates): caller-allocated buffer
+ * to write the received message into, of length at least @buf_len
+ * @buf_len: (in): length of @buf
+ * @cancellable: (allow-none): a #GCancellable to allow the operation to be
+ * cancelled from another thread, or %NULL
+ * @error: (allow-none): return location for a #GError, or %NULL
+ *
+ * Receives the next message sent with nice_agent_send_substream() on a
+ * substream, without blocking. If no complete message has arrived yet,
+ * %G_IO_ERROR_WOULD_BLOCK is returned; wait for
+ * #NiceAgent::reliable-substream-readable before trying again. If @buf is too
+ * small for the message, %G_IO_ERROR_MESSAGE_TOO_LARGE is returned and the
+ * message is kept for the next call. Messages the sender abandoned (see
+ * nice_agent_send_substream()) are skipped.
+ *
+ * Returns: the length of the message, 0 if the peer closed the substream, or
+ * -1 on error
+ *
+ * Since: 0.1.24
+ */
+gssize
+nice_agent_recv_substream_nonblocking (
+    NiceAgent *agent,
+    guint stream_id,
+    guint component_id,
+    guint substream_id,
+    guint8 *buf,
+    gsize buf_len,
+    GCancellable *cancellable,
+    GError **error);
+
 /**
  * nice_agent_recv_messages_nonblocking:
  * @agent: a #NiceAgent
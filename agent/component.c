@@ -86,6 +86,8 @@ static void
 nice_component_detach_socket (NiceComponent *component, NiceSocket *nicesock, gboolean *socket_source_freed);
 static void
 nice_component_clear_selected_pair (NiceComponent *component);
+static void
+source_set_dummy_callback (GSource *source);
 
 
 void
@@ -95,6 +97,18 @@ incoming_check_free (IncomingCheck *icheck)
   g_slice_free (IncomingCheck, icheck);
 }
 
+static gboolean
+wakeup_source_dispatch (GSource *source, GSourceFunc callback,
+    gpointer user_data)
+{
+  /* Only there to make its parent dispatch */
+  return G_SOURCE_CONTINUE;
+}
+
+static GSourceFuncs wakeup_source_funcs = {
+  NULL, NULL, wakeup_source_dispatch, NULL, NULL, NULL
+};
+
 /* Must *not* take the agent lock, since it’s called from within
  * nice_component_set_io_context(), which holds the Component’s I/O lock. */
 static void
@@ -118,6 +132,16 @@ socket_source_attach (SocketSource *socket_source, GMainContext *context)
   g_source_set_callback (source, (GSourceFunc) G_CALLBACK (component_io_cb),
       socket_source, NULL);
 
+  /* Polling the socket does not tell about messages it already read from the
+   * kernel, so a child source dispatches it while it holds any. */
+  if (socket_source->socket->has_buffered_data != NULL) {
+    socket_source->wakeup_source = g_source_new (&wakeup_source_funcs,
+        sizeof (GSource));
+    g_source_add_child_source (source, socket_source->wakeup_source);
+    g_source_unref (socket_source->wakeup_source);
+    nice_component_update_socket_wakeup (socket_source);
+  }
+
   /* Add the source. */
   nice_debug ("Attaching source %p (socket %p, FD %d) to context %p", source,
       socket_source->socket, g_socket_get_fd (socket_source->socket->fileno),
@@ -138,10 +162,14 @@ socket_source_detach (SocketSource *source)
       (source->source != NULL) ? g_source_get_context (source->source) : 0);
 
   if (source->source != NULL) {
+    /* See component_io_lite_respond() */
+    g_mutex_lock (&source->component->lite_mutex);
     g_source_destroy (source->source);
+    g_mutex_unlock (&source->component->lite_mutex);
     g_source_unref (source->source);
   }
   source->source = NULL;
+  source->wakeup_source = NULL;
 }
 
 static void
@@ -325,6 +353,135 @@ nice_component_clean_turn_servers (NiceAgent *agent, NiceComponent *cmp)
   }
 }
 
+static gboolean
+socket_is_used (GSList *used_sockets, NiceSocket *nsocket)
+{
+  GSList *i;
+
+  for (i = used_sockets; i; i = i->next) {
+    if (nice_socket_is_based_on (i->data, nsocket))
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+static GSList *
+add_pair_sockets (GSList *used_sockets, CandidateCheckPair *pair)
+{
+  used_sockets = g_slist_prepend (used_sockets, pair->sockptr);
+  used_sockets = g_slist_prepend (used_sockets,
+      ((NiceCandidateImpl *) pair->local)->sockptr);
+
+  return used_sockets;
+}
+
+/*
+ * Closes the sockets of the local candidates that take no part in the
+ * selected pair, nor in the @n_backup_pairs best other valid pairs, and
+ * deallocates their relays. The pairs using them are pruned.
+ */
+void
+nice_component_release_unused_sockets (NiceAgent *agent, NiceComponent *cmp,
+    guint n_backup_pairs)
+{
+  GSList *i;
+  GSList *used_sockets = NULL;
+  GSList *unused_sockets = NULL;
+  GSList *relay_candidates = NULL;
+  NiceStream *stream;
+  guint n_backups = 0;
+
+  stream = agent_find_stream (agent, cmp->stream_id);
+  if (stream == NULL || cmp->selected_pair.local == NULL)
+    return;
+
+  used_sockets = g_slist_prepend (used_sockets,
+      cmp->selected_pair.local->sockptr);
+
+  /* The list is sorted by priority, so the best backups come first */
+  for (i = stream->conncheck_list; i; i = i->next) {
+    CandidateCheckPair *p = i->data;
+
+    if (p->component_id != cmp->id)
+      continue;
+
+    if ((NiceCandidateImpl *) p->local != cmp->selected_pair.local ||
+        (NiceCandidateImpl *) p->remote != cmp->selected_pair.remote) {
+      if (!p->valid || n_backups >= n_backup_pairs)
+        continue;
+      n_backups++;
+    }
+
+    /* Pruning the parent of a discovered pair would fail it too */
+    used_sockets = add_pair_sockets (used_sockets, p);
+    if (p->succeeded_pair)
+      used_sockets = add_pair_sockets (used_sockets, p->succeeded_pair);
+    if (p->discovered_pair)
+      used_sockets = add_pair_sockets (used_sockets, p->discovered_pair);
+  }
+
+  for (i = cmp->local_candidates; i;) {
+    NiceCandidateImpl *candidate = i->data;
+    GSList *next = i->next;
+
+    if (socket_is_used (used_sockets, candidate->sockptr)) {
+      i = next;
+      continue;
+    }
+
+    if (candidate->c.type == NICE_CANDIDATE_TYPE_RELAYED) {
+      agent_remove_local_candidate (agent, stream, (NiceCandidate *) candidate);
+      relay_candidates = g_slist_append (relay_candidates, candidate);
+      cmp->local_candidates = g_slist_delete_link (cmp->local_candidates, i);
+    } else if (!g_slist_find (unused_sockets, candidate->sockptr)) {
+      unused_sockets = g_slist_append (unused_sockets, candidate->sockptr);
+    }
+    i = next;
+  }
+
+  /* Connections of the failed or unused TCP pairs */
+  for (i = stream->conncheck_list; i; i = i->next) {
+    CandidateCheckPair *p = i->data;
+
+    if (p->component_id == cmp->id &&
+        p->sockptr != ((NiceCandidateImpl *) p->local)->sockptr &&
+        !socket_is_used (used_sockets, p->sockptr) &&
+        !g_slist_find (unused_sockets, p->sockptr))
+      unused_sockets = g_slist_append (unused_sockets, p->sockptr);
+  }
+
+  /* The deallocation of a relay is sent through its base socket, which
+   * must stay open until it is done. */
+  for (i = relay_candidates; i; i = i->next) {
+    NiceCandidateImpl *candidate = i->data;
+    GSList *l;
+
+    for (l = unused_sockets; l;) {
+      GSList *next = l->next;
+
+      if (nice_socket_is_based_on (candidate->sockptr, l->data))
+        unused_sockets = g_slist_delete_link (unused_sockets, l);
+      l = next;
+    }
+  }
+
+  nice_debug ("Agent %p: s%d/c%d: releasing %u sockets and %u relays, "
+      "keeping %u backup pairs", agent, cmp->stream_id, cmp->id,
+      g_slist_length (unused_sockets), g_slist_length (relay_candidates),
+      n_backups);
+
+  for (i = relay_candidates; i; i = i->next)
+    nice_component_prune_relay_candidate (agent, cmp, i->data);
+
+  for (i = unused_sockets; i; i = i->next)
+    nice_component_remove_socket (agent, cmp, i->data);
+
+  g_slist_free (relay_candidates);
+  g_slist_free (unused_sockets);
+  g_slist_free (used_sockets);
+}
+
 static void
 nice_component_clear_selected_pair (NiceComponent *component)
 {
@@ -334,9 +491,50 @@ nice_component_clear_selected_pair (NiceComponent *component)
     component->selected_pair.remote_consent.tick_source = NULL;
   }
 
+  nice_component_clear_keepalive_template (component);
+  nice_component_set_lite_responder (component, NULL);
+
   memset (&component->selected_pair, 0, sizeof(CandidatePair));
 }
 
+/* Must be called with the agent lock held as it touches internal Component
+ * state. */
+void
+nice_component_clear_keepalive_template (NiceComponent *component)
+{
+  g_free (component->selected_pair.keepalive.stun_template);
+  component->selected_pair.keepalive.stun_template = NULL;
+  component->selected_pair.keepalive.stun_template_len = 0;
+}
+
+static void
+lite_responder_free (LiteResponder *responder)
+{
+  g_free (responder->ufrag);
+  g_free (responder->password);
+  g_free (responder);
+}
+
+/* Publishes the snapshot used by the ICE-lite responder, or disables it when
+ * @responder is %NULL. Must be called with the agent lock held. */
+void
+nice_component_set_lite_responder (NiceComponent *component,
+    LiteResponder *responder)
+{
+  LiteResponder *old = g_atomic_pointer_get (&component->lite_responder);
+
+  if (old == NULL && responder == NULL)
+    return;
+
+  /* Waits for a responder still answering with the old snapshot */
+  g_mutex_lock (&component->lite_mutex);
+  g_atomic_pointer_set (&component->lite_responder, responder);
+  g_mutex_unlock (&component->lite_mutex);
+
+  if (old)
+    lite_responder_free (old);
+}
+
 /* Must be called with the agent lock held as it touches internal Component
  * state. */
 void
@@ -345,6 +543,8 @@ nice_component_close (NiceAgent *agent, NiceStream *stream, NiceComponent *cmp)
   IOCallbackData *data;
   GOutputVector *vec;
   IncomingCheck *c;
+  GSList *i;
+  guint protocol;
 
   /* Start closing the pseudo-TCP socket first. FIXME: There is a very big and
    * reliably triggerable race here. pseudo_tcp_socket_close() does not block
@@ -359,6 +559,11 @@ nice_component_close (NiceAgent *agent, NiceStream *stream, NiceComponent *cmp)
   if (cmp->tcp) {
     pseudo_tcp_socket_close (cmp->tcp, TRUE);
   }
+  for (i = cmp->substreams; i; i = i->next) {
+    NiceSubstream *substream = i->data;
+
+    pseudo_tcp_socket_close (substream->tcp, TRUE);
+  }
 
   if (cmp->restart_candidate)
     nice_candidate_free (cmp->restart_candidate),
@@ -390,6 +595,11 @@ nice_component_close (NiceAgent *agent, NiceStream *stream, NiceComponent *cmp)
     g_source_unref (cmp->tcp_clock);
     cmp->tcp_clock = NULL;
   }
+  if (cmp->release_timer_source) {
+    g_source_destroy (cmp->release_timer_source);
+    g_source_unref (cmp->release_timer_source);
+    cmp->release_timer_source = NULL;
+  }
   if (cmp->tcp_writable_cancellable) {
     g_cancellable_cancel (cmp->tcp_writable_cancellable);
     g_clear_object (&cmp->tcp_writable_cancellable);
@@ -399,6 +609,8 @@ nice_component_close (NiceAgent *agent, NiceStream *stream, NiceComponent *cmp)
     io_callback_data_free (data);
 
   nice_component_set_io_callback (cmp, NULL, NULL, NULL, NULL, 0, NULL);
+  for (protocol = 0; protocol <= NICE_DEMUX_PROTOCOL_OTHER; protocol++)
+    nice_component_set_demux_callback (cmp, protocol, NULL, NULL, NULL);
 
   g_cancellable_cancel (cmp->stop_cancellable);
 
@@ -407,14 +619,18 @@ nice_component_close (NiceAgent *agent, NiceStream *stream, NiceComponent *cmp)
     g_slice_free (GOutputVector, vec);
   }
 
-  g_free (cmp->recv_buffer);
-  g_free (cmp->rfc4571_buffer);
-  cmp->recv_buffer = NULL;
-  cmp->rfc4571_buffer = NULL;
+  nice_frame_reader_clear (&cmp->rfc4571_reader);
 
   nice_message_extra_data_copy (&cmp->exdata, NULL);
 }
 
+void
+nice_substream_free (NiceSubstream *substream)
+{
+  g_clear_object (&substream->tcp);
+  g_slice_free (NiceSubstream, substream);
+}
+
 void
 nice_component_cancel_turn_server_resolving (NiceComponent* component)
 {
@@ -522,6 +738,11 @@ nice_component_restart (NiceComponent *cmp, NiceAgent *agent)
   /* Reset the priority to 0 to make sure we get a new pair */
   cmp->selected_pair.priority = 0;
 
+  /* The credentials are about to change, and the keepalive username with
+   * them */
+  nice_component_clear_keepalive_template (cmp);
+  nice_component_set_lite_responder (cmp, NULL);
+
   cmp->have_local_consent = TRUE;
 
   /* The stun agent may contain references to the password previously
@@ -574,6 +795,9 @@ nice_component_update_selected_pair (NiceAgent *agent, NiceComponent *component,
   component->selected_pair.stun_priority = pair->stun_priority;
   component->selected_pair.remote_consent.have = pair->remote_consent.have;
 
+  if (stream)
+    conn_check_lite_responder_update (agent, stream, component);
+
   nice_component_add_valid_candidate (agent, component,
       (NiceCandidate *) pair->remote);
 }
@@ -684,8 +908,6 @@ nice_component_attach_socket (NiceComponent *component, NiceSocket *nicesock)
   g_assert (component != NULL);
   g_assert (nicesock != NULL);
 
-  g_assert (component->ctx != NULL);
-
   /* Find an existing SocketSource in the component which contains @socket, or
    * create a new one.
    *
@@ -704,14 +926,37 @@ nice_component_attach_socket (NiceComponent *component, NiceSocket *nicesock)
         g_slist_prepend (component->socket_sources, socket_source);
     if (nicesock->fileno != NULL)
       component->socket_sources_age++;
+
+    if (component->corked)
+      nice_socket_set_corked (nicesock, TRUE);
   }
 
-  /* Create and attach a source */
+  /* Create and attach a source, unless no context was set yet: the sockets
+   * are then all attached by nice_component_set_io_context(). */
+  if (component->ctx == NULL)
+    return;
+
   nice_debug ("Component %p: Attach source (stream %u).",
       component, component->stream_id);
   socket_source_attach (socket_source, component->ctx);
 }
 
+/* Corks or uncorks all the sockets of @component; those attached while it is
+ * corked start corked. */
+void
+nice_component_set_corked (NiceComponent *component, gboolean corked)
+{
+  GSList *i;
+
+  component->corked = corked;
+
+  for (i = component->socket_sources; i != NULL; i = i->next) {
+    SocketSource *socket_source = i->data;
+
+    nice_socket_set_corked (socket_source->socket, corked);
+  }
+}
+
 /* Reattaches socket handles of @component to the main context.
  *
  * Must *not* take the agent lock, since it’s called from within
@@ -811,27 +1056,95 @@ nice_component_free_socket_sources (NiceComponent *component)
   nice_component_clear_selected_pair (component);
 }
 
+/* The scratch buffers for component_io_cb() and the pseudo-TCP readable
+ * callback. The components of a context are dispatched one at a time, so
+ * rather than each component holding one, they are borrowed for the duration
+ * of a dispatch from a free list kept per thread; it only grows with the
+ * dispatches nested on that thread, e.g. by an I/O callback iterating a
+ * main context. A free buffer stores the next one at its start. */
+static void
+recv_buffer_pool_free (gpointer data)
+{
+  while (data != NULL) {
+    gpointer next = *(gpointer *) data;
+
+    g_free (data);
+    data = next;
+  }
+}
+
+static GPrivate recv_buffer_pool = G_PRIVATE_INIT (recv_buffer_pool_free);
+
+/* Returns a buffer of MAX_BUFFER_SIZE bytes, to be given back with
+ * nice_component_return_recv_buffer() on the same thread. */
+guint8 *
+nice_component_borrow_recv_buffer (void)
+{
+  guint8 *buf = g_private_get (&recv_buffer_pool);
+
+  if (G_UNLIKELY (buf == NULL))
+    return g_malloc (MAX_BUFFER_SIZE);
+
+  g_private_set (&recv_buffer_pool, *(gpointer *) buf);
+
+  return buf;
+}
+
+void
+nice_component_return_recv_buffer (guint8 *buf)
+{
+  *(gpointer *) buf = g_private_get (&recv_buffer_pool);
+  g_private_set (&recv_buffer_pool, buf);
+}
+
+/* The own context is only created once it is needed, as each context holds
+ * a file descriptor to be woken up.
+ *
+ * Must be called with the agent lock held. */
+static GMainContext *
+nice_component_get_own_context (NiceComponent *component)
+{
+  if (component->own_ctx == NULL) {
+    component->own_ctx = g_main_context_new ();
+    component->stop_cancellable_source =
+        g_cancellable_source_new (component->stop_cancellable);
+    source_set_dummy_callback (component->stop_cancellable_source);
+    g_source_attach (component->stop_cancellable_source, component->own_ctx);
+  }
+
+  return component->own_ctx;
+}
+
+/* Returns the component's own context, which the blocking receive functions
+ * iterate, creating it if needed. If no context was set yet, the sockets,
+ * unattached until now, are attached to it. */
 GMainContext *
 nice_component_dup_io_context (NiceComponent *component)
 {
-  return g_main_context_ref (component->own_ctx);
+  GMainContext *own_ctx = nice_component_get_own_context (component);
+
+  if (component->ctx == NULL)
+    nice_component_set_io_context (component, own_ctx);
+
+  return g_main_context_ref (own_ctx);
 }
 
-/* If @context is %NULL, it's own context is used, so component->ctx is always
- * guaranteed to be non-%NULL. */
+/* If @context is %NULL, its own context is used. component->ctx stays %NULL,
+ * and the sockets unattached, until either is called. */
 void
 nice_component_set_io_context (NiceComponent *component, GMainContext *context)
 {
+  if (context == NULL)
+    context = nice_component_get_own_context (component);
+
   g_mutex_lock (&component->io_mutex);
 
   if (component->ctx != context) {
-    if (context == NULL)
-      context = g_main_context_ref (component->own_ctx);
-    else
-      g_main_context_ref (context);
+    g_main_context_ref (context);
 
     nice_component_detach_all_sockets (component);
-    g_main_context_unref (component->ctx);
+    if (component->ctx != NULL)
+      g_main_context_unref (component->ctx);
 
     component->ctx = context;
     nice_component_reattach_all_sockets (component);
@@ -890,6 +1203,62 @@ nice_component_set_io_callback (NiceComponent *component,
   g_mutex_unlock (&component->io_mutex);
 }
 
+/* This must be called with the agent lock held. */
+void
+nice_component_set_demux_callback (NiceComponent *component,
+    NiceDemuxProtocol protocol, NiceAgentRecvFuncEx func, gpointer user_data,
+    GDestroyNotify notify)
+{
+  DemuxCallback *demux;
+  gpointer old_user_data;
+  GDestroyNotify old_notify;
+
+  g_assert (protocol <= NICE_DEMUX_PROTOCOL_OTHER);
+
+  g_mutex_lock (&component->io_mutex);
+
+  demux = &component->demux_callbacks[protocol];
+
+  old_user_data = demux->user_data;
+  old_notify = demux->user_data_notify;
+
+  if (demux->func != NULL)
+    component->n_demux_callbacks--;
+
+  demux->func = func;
+  demux->user_data = user_data;
+  demux->user_data_notify = notify;
+
+  if (func != NULL)
+    component->n_demux_callbacks++;
+
+  g_mutex_unlock (&component->io_mutex);
+
+  /* Outside of the io_mutex, as the application may call back into the
+   * component from there. */
+  if (old_notify)
+    old_notify (old_user_data);
+}
+
+/* Returns the callback which receives packets of @protocol: its
+ * demultiplexing callback if there is one, the I/O callback otherwise.
+ *
+ * Must be called with the io_mutex held. */
+static NiceAgentRecvFuncEx
+nice_component_lookup_io_callback (NiceComponent *component,
+    NiceDemuxProtocol protocol, gpointer *user_data)
+{
+  DemuxCallback *demux = &component->demux_callbacks[protocol];
+
+  if (component->io_callback != NULL && demux->func != NULL) {
+    *user_data = demux->user_data;
+    return demux->func;
+  }
+
+  *user_data = component->io_user_data;
+  return component->io_callback;
+}
+
 gboolean
 nice_component_has_io_callback (NiceComponent *component)
 {
@@ -913,6 +1282,7 @@ io_callback_data_new (const guint8 *buf, gsize buf_len,
   data->buf_len = buf_len;
   nice_message_extra_data_copy (&data->exdata, exdata);
   data->offset = 0;
+  data->protocol = NICE_DEMUX_PROTOCOL_OTHER;
 
   return data;
 }
@@ -965,11 +1335,15 @@ emit_io_callback_cb (gpointer user_data)
    * iteration, just in case the client has removed the stream in the
    * callback. */
   while (TRUE) {
-    io_callback = component->io_callback;
-    io_user_data = component->io_user_data;
     data = g_queue_peek_head (&component->pending_io_messages);
 
-    if (data == NULL || io_callback == NULL)
+    if (data == NULL)
+      break;
+
+    io_callback = nice_component_lookup_io_callback (component,
+        data->protocol, &io_user_data);
+
+    if (io_callback == NULL)
       break;
 
     g_mutex_unlock (&component->io_mutex);
@@ -1000,14 +1374,16 @@ emit_io_callback_cb (gpointer user_data)
   return G_SOURCE_REMOVE;
 }
 
-/* This must be called with the agent lock *held*. */
+/* This must be called with the agent lock *held*. @buf only needs to stay
+ * valid for the call, as it is copied if the callback has to be deferred. */
 void
 nice_component_emit_io_callback (NiceAgent *agent, NiceComponent *component,
-    gsize buf_len)
+    const guint8 *buf, gsize buf_len)
 {
   guint stream_id, component_id;
   NiceAgentRecvFuncEx io_callback;
   gpointer io_user_data;
+  NiceDemuxProtocol protocol = NICE_DEMUX_PROTOCOL_OTHER;
 
   g_assert (component != NULL);
   g_assert (buf_len > 0);
@@ -1016,8 +1392,10 @@ nice_component_emit_io_callback (NiceAgent *agent, NiceComponent *component,
   component_id = component->id;
 
   g_mutex_lock (&component->io_mutex);
-  io_callback = component->io_callback;
-  io_user_data = component->io_user_data;
+  if (component->n_demux_callbacks > 0)
+    protocol = component->recv_protocol;
+  io_callback = nice_component_lookup_io_callback (component, protocol,
+      &io_user_data);
   g_mutex_unlock (&component->io_mutex);
 
   /* Allow this to be called with a NULL io_callback, since the caller can’t
@@ -1036,7 +1414,7 @@ nice_component_emit_io_callback (NiceAgent *agent, NiceComponent *component,
     /* Thread owns the main context, so invoke the callback directly. */
     agent_unlock_and_emit (agent);
     io_callback (agent, stream_id, component_id, buf_len,
-        (gchar *) component->recv_buffer, &component->exdata, io_user_data);
+        (gchar *) buf, &component->exdata, io_user_data);
     agent_lock (agent);
   } else {
     IOCallbackData *data;
@@ -1045,8 +1423,9 @@ nice_component_emit_io_callback (NiceAgent *agent, NiceComponent *component,
 
     /* Slow path: Current thread doesn’t own the Component’s context at the
      * moment, so schedule the callback in an idle handler. */
-    data = io_callback_data_new (component->recv_buffer, buf_len,
+    data = io_callback_data_new (buf, buf_len,
         &component->exdata);
+    data->protocol = protocol;
     g_queue_push_tail (&component->pending_io_messages,
         data);  /* transfer ownership */
 
@@ -1175,21 +1554,17 @@ nice_component_init (NiceComponent *component)
   g_weak_ref_init (&component->agent_ref, NULL);
 
   g_mutex_init (&component->io_mutex);
+  g_mutex_init (&component->lite_mutex);
   g_queue_init (&component->pending_io_messages);
   component->io_callback_id = 0;
 
-  component->own_ctx = g_main_context_new ();
   component->stop_cancellable = g_cancellable_new ();
-  component->stop_cancellable_source =
-      g_cancellable_source_new (component->stop_cancellable);
-  source_set_dummy_callback (component->stop_cancellable_source);
-  g_source_attach (component->stop_cancellable_source, component->own_ctx);
-  component->ctx = g_main_context_ref (component->own_ctx);
 
-  /* Start off with a fresh main context and all I/O paused. This
+  /* Start off without a main context and all I/O paused. This
    * will be updated when nice_agent_attach_recv() or nice_agent_recv_messages()
    * are called. */
-  nice_component_set_io_context (component, NULL);
+  component->own_ctx = NULL;
+  component->ctx = NULL;
   nice_component_set_io_callback (component, NULL, NULL, NULL, NULL, 0, NULL);
 
   g_queue_init (&component->queued_tcp_packets);
@@ -1197,15 +1572,8 @@ nice_component_init (NiceComponent *component)
 
   component->have_local_consent = TRUE;
 
-/* Maximum size of a UDP packet’s payload, as the packet’s length field is 16b
- * wide. */
-#define MAX_BUFFER_SIZE ((1 << 16) - 1)  /* 65535 */
-
-  component->recv_buffer = g_malloc (MAX_BUFFER_SIZE);
-  component->recv_buffer_size = MAX_BUFFER_SIZE;
-
-  component->rfc4571_buffer_size = sizeof (guint16) + G_MAXUINT16;
-  component->rfc4571_buffer = g_malloc (component->rfc4571_buffer_size);
+  nice_frame_reader_init (&component->rfc4571_reader,
+      sizeof (guint16) + G_MAXUINT16);
 
   component->turn_resolving_cancellable = g_cancellable_new ();
 }
@@ -1316,10 +1684,16 @@ nice_component_finalize (GObject *obj)
   g_list_free_full (cmp->valid_candidates,
       (GDestroyNotify) nice_candidate_free);
 
+  if (cmp->lite_responder)
+    lite_responder_free (cmp->lite_responder);
+  g_mutex_clear (&cmp->lite_mutex);
+
   g_cancellable_cancel (cmp->turn_resolving_cancellable);
   g_clear_object (&cmp->turn_resolving_cancellable);
 
   g_clear_object (&cmp->tcp);
+  g_slist_free_full (cmp->substreams, (GDestroyNotify) nice_substream_free);
+  cmp->substreams = NULL;
   g_clear_object (&cmp->stop_cancellable);
   g_clear_object (&cmp->iostream);
   g_mutex_clear (&cmp->io_mutex);
@@ -1334,7 +1708,8 @@ nice_component_finalize (GObject *obj)
     cmp->ctx = NULL;
   }
 
-  g_main_context_unref (cmp->own_ctx);
+  if (cmp->own_ctx != NULL)
+    g_main_context_unref (cmp->own_ctx);
 
   g_weak_ref_clear (&cmp->agent_ref);
 
@@ -1411,6 +1786,15 @@ component_source_prepare (GSource *source, gint *timeout_)
     goto done;
   }
 
+  for (parentl = component->socket_sources; parentl; parentl = parentl->next) {
+    SocketSource *parent_socket_source = parentl->data;
+
+    if (nice_socket_has_buffered_data (parent_socket_source->socket)) {
+      skip_poll = TRUE;
+      goto done;
+    }
+  }
+
   if (component->socket_sources_age ==
       component_source->component_socket_sources_age)
     goto done;
@@ -1770,10 +2154,21 @@ nice_component_get_sockets (NiceComponent *component)
   return array;
 }
 
+/* To be called after reading from the socket of @socket_source. */
+void
+nice_component_update_socket_wakeup (SocketSource *socket_source)
+{
+  if (socket_source->wakeup_source == NULL)
+    return;
+
+  g_source_set_ready_time (socket_source->wakeup_source,
+      nice_socket_has_buffered_data (socket_source->socket) ? 0 : -1);
+}
+
 guint
 nice_component_compute_rfc4571_headroom (NiceComponent *component)
 {
-  return component->rfc4571_buffer_offset - component->rfc4571_frame_offset;
+  return nice_frame_reader_get_available (&component->rfc4571_reader);
 }
 
 gboolean
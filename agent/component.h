@@ -52,6 +52,7 @@ typedef struct _NiceComponent NiceComponent;
 #include "pseudotcp.h"
 #include "stream.h"
 #include "socket.h"
+#include "frame-reader.h"
 
 G_BEGIN_DECLS
 
@@ -67,6 +68,7 @@ typedef struct _CandidatePair CandidatePair;
 typedef struct _CandidatePairKeepalive CandidatePairKeepalive;
 typedef struct _CandidatePairConsentCheck CandidatePairConsentCheck;
 typedef struct _IncomingCheck IncomingCheck;
+typedef struct _LiteResponder LiteResponder;
 
 struct _CandidatePairKeepalive
 {
@@ -74,6 +76,11 @@ struct _CandidatePairKeepalive
   guint stream_id;
   guint component_id;
   StunTimer timer;
+  guint8 *stun_template;  /* keepalive request without transaction ID and
+                             trailers, see priv_update_keepalive_template() */
+  gsize stun_template_len;
+  gboolean stun_template_controlling;
+  guint64 stun_template_tie_breaker;
 };
 
 struct _CandidatePairConsentCheck
@@ -94,6 +101,24 @@ struct _CandidatePair
   CandidatePairConsentCheck remote_consent;
 };
 
+/* Immutable snapshot of what an ICE-lite agent needs to answer Binding
+ * requests on its selected pair without taking the agent lock, see
+ * conn_check_lite_respond(). It is only used with the component’s lite_mutex
+ * held, so a replaced snapshot can be freed straight away. */
+struct _LiteResponder
+{
+  NiceSocket *sockptr;          /* local socket of the selected pair, only
+                                   compared, never dereferenced */
+  NiceAddress remote_addr;
+  StunAgent stun_agent;         /* only used from the component context */
+  gchar *ufrag;
+  gsize ufrag_len;
+  gchar *password;
+  gsize password_len;
+  gboolean controlling;
+  guint64 tie_breaker;
+};
+
 struct _IncomingCheck
 {
   NiceAddress from;
@@ -118,6 +143,7 @@ incoming_check_free (IncomingCheck *icheck);
 typedef struct {
   NiceSocket *socket;
   GSource *source;
+  GSource *wakeup_source;  /* child of @source, for sockets which buffer */
   NiceComponent *component;
 } SocketSource;
 
@@ -139,6 +165,7 @@ typedef struct {
   gsize buf_len;
   gsize offset;
   NiceMessageExtraData exdata;
+  NiceDemuxProtocol protocol;
 } IOCallbackData;
 
 IOCallbackData *
@@ -147,6 +174,29 @@ io_callback_data_new (const guint8 *buf, gsize buf_len,
 void
 io_callback_data_free (IOCallbackData *data);
 
+/* A callback attached with nice_agent_attach_recv_demux() for one
+ * #NiceDemuxProtocol. */
+typedef struct {
+  NiceAgentRecvFuncEx func;
+  gpointer user_data;
+  GDestroyNotify user_data_notify;
+} DemuxCallback;
+
+/* An independently ordered stream of messages multiplexed on a reliable
+ * component, see nice_agent_send_substream(). Each one is carried by its own
+ * pseudo-TCP connection, whose conversation number is the substream ID, so
+ * that a loss on one doesn’t hold back the others. */
+typedef struct {
+  NiceComponent *component;         /* unowned */
+  guint id;                         /* never 0, which is component->tcp */
+  PseudoTcpSocket *tcp;             /* owned */
+  gsize send_wanted;                /* send space a blocked message needs, or
+                                       0 */
+} NiceSubstream;
+
+void
+nice_substream_free (NiceSubstream *substream);
+
 #define NICE_TYPE_COMPONENT nice_component_get_type()
 #define NICE_COMPONENT(obj) \
   (G_TYPE_CHECK_INSTANCE_CAST ((obj), NICE_TYPE_COMPONENT, NiceComponent))
@@ -199,11 +249,19 @@ struct _NiceComponent {
                                          each element is an owned
                                          IOCallbackData */
   guint io_callback_id;             /* GSource ID of the I/O callback */
+  DemuxCallback demux_callbacks[NICE_DEMUX_PROTOCOL_OTHER + 1];
+                                    /* RFC 7983 per-protocol callbacks,
+                                         protected by io_mutex */
+  guint n_demux_callbacks;          /* number of set demux_callbacks; also
+                                         requires the agent lock to change */
+  NiceDemuxProtocol recv_protocol;  /* protocol of the last packet received
+                                         with demultiplexing enabled */
 
   GMainContext *own_ctx;            /* own context for GSources for this
-                                       component */
+                                       component, created when needed */
   GMainContext *ctx;                /* context for GSources for this
-                                       component (possibly set from the app) */
+                                       component (possibly set from the app),
+                                       NULL until one is needed */
   NiceInputMessage *recv_messages;  /* unowned messages for receiving into */
   guint n_recv_messages;            /* length of recv_messages */
   NiceInputMessageIter recv_messages_iter; /* current write position in
@@ -220,10 +278,16 @@ struct _NiceComponent {
   GSource *stop_cancellable_source;  /* owned */
 
   PseudoTcpSocket *tcp;
+  GSList *substreams;               /* list of owned NiceSubstream; reliable
+                                       components only */
   GSource* tcp_clock;
   guint64 last_clock_timeout;
   gboolean tcp_readable;
   GCancellable *tcp_writable_cancellable;
+  gboolean corked;                  /* its sockets hold back the data sent,
+                                       see nice_agent_cork() */
+  GSource *release_timer_source;    /* releases the unused sockets once
+                                       READY, see NiceAgent:backup-pairs */
 
   GIOStream *iostream;
 
@@ -237,20 +301,23 @@ struct _NiceComponent {
 
   gboolean have_local_consent;
 
-  /* scratch buffer for use in the component_io_cb() function to
-   * hold the incoming packet, allocated at component creation, since
-   * the callback is a critical path, where memory allocation should
-   * be avoided.
-   */
-  guint8 *recv_buffer;
-  guint recv_buffer_size;
+  /* ICE-lite Binding responder, see conn_check_lite_respond() */
+  LiteResponder *lite_responder;    /* atomic, NULL when requests must go
+                                         through the agent */
+  GMutex lite_mutex;                /* protects lite_responder, and is held
+                                         while a socket source is destroyed,
+                                         so the responder can check that its
+                                         socket is still alive */
+  gsize lite_pending_length;        /* datagram read into lite_pending_buffer
+                                         by the responder but left to the
+                                         agent, within the same dispatch */
+  const guint8 *lite_pending_buffer;
+  NiceAddress lite_pending_from;
+
   NiceMessageExtraData exdata;
 
   /* ICE-TCP frame state */
-  guint8 *rfc4571_buffer;
-  guint rfc4571_buffer_offset;
-  guint rfc4571_buffer_size;
-  guint rfc4571_frame_offset;
+  NiceFrameReader rfc4571_reader;
   guint rfc4571_frame_size;
   guint rfc4571_consumed_size;
   NiceAddress rfc4571_remote_addr;
@@ -291,6 +358,13 @@ void
 nice_component_update_selected_pair (NiceAgent *agent, NiceComponent *component,
     const CandidatePair *pair);
 
+void
+nice_component_clear_keepalive_template (NiceComponent *component);
+
+void
+nice_component_set_lite_responder (NiceComponent *component,
+    LiteResponder *responder);
+
 NiceCandidate *
 nice_component_find_remote_candidate (NiceComponent *component,
     const NiceAddress *addr, NiceCandidateTransport transport);
@@ -302,6 +376,9 @@ nice_component_set_selected_remote_candidate (NiceComponent *component,
 void
 nice_component_attach_socket (NiceComponent *component, NiceSocket *nsocket);
 
+void
+nice_component_set_corked (NiceComponent *component, gboolean corked);
+
 void
 nice_component_remove_socket (NiceAgent *agent, NiceComponent *component,
     NiceSocket *nsocket);
@@ -316,6 +393,14 @@ nice_component_input_source_new (NiceAgent *agent, guint stream_id,
     guint component_id, GPollableInputStream *pollable_istream,
     GCancellable *cancellable);
 
+/* Maximum size of a UDP packet’s payload, as the packet’s length field is 16b
+ * wide. */
+#define MAX_BUFFER_SIZE ((1 << 16) - 1)  /* 65535 */
+
+guint8 *
+nice_component_borrow_recv_buffer (void);
+void
+nice_component_return_recv_buffer (guint8 *buf);
 GMainContext *
 nice_component_dup_io_context (NiceComponent *component);
 void
@@ -327,14 +412,21 @@ nice_component_set_io_callback (NiceComponent *component,
     GError **error);
 void
 nice_component_emit_io_callback (NiceAgent *agent, NiceComponent *component,
-    gsize buf_len);
+    const guint8 *buf, gsize buf_len);
 gboolean
 nice_component_has_io_callback (NiceComponent *component);
 void
+nice_component_set_demux_callback (NiceComponent *component,
+    NiceDemuxProtocol protocol, NiceAgentRecvFuncEx func, gpointer user_data,
+    GDestroyNotify notify);
+void
 nice_component_prune_relay_candidate (NiceAgent *agent,
     NiceComponent *cmp, NiceCandidateImpl *relay_cand);
 void
 nice_component_clean_turn_servers (NiceAgent *agent, NiceComponent *component);
+void
+nice_component_release_unused_sockets (NiceAgent *agent,
+    NiceComponent *component, guint n_backup_pairs);
 
 
 TurnServer *
@@ -364,6 +456,9 @@ nice_component_get_sockets (NiceComponent *component);
 guint
 nice_component_compute_rfc4571_headroom (NiceComponent *component);
 
+void
+nice_component_update_socket_wakeup (SocketSource *socket_source);
+
 gboolean
 nice_component_resolving_turn (NiceComponent *component);
 
@@ -63,6 +63,9 @@
 #include "stun/usages/bind.h"
 #include "stun/usages/turn.h"
 
+/* Connection attempts of a TCP-SO pair before it is declared failed */
+#define TCP_SO_MAX_CONNECT_ATTEMPTS 10
+
 static void priv_update_check_list_failed_components (NiceAgent *agent, NiceStream *stream);
 static guint priv_prune_pending_checks (NiceAgent *agent, NiceStream *stream, NiceComponent *component);
 static gboolean priv_schedule_triggered_check (NiceAgent *agent, NiceStream *stream, NiceComponent *component, NiceSocket *local_socket, NiceCandidate *remote_cand);
@@ -1349,6 +1352,56 @@ static void ms_ice2_legacy_conncheck_send(StunMessage *msg, NiceSocket *sock,
   memcpy (fingerprint_attr, &fingerprint_orig, sizeof (fingerprint_orig));
 }
 
+/*
+ * Makes sure the selected pair of 'component' holds a keepalive request
+ * template matching the current role and tie-breaker. Everything but the
+ * transaction ID and the integrity/fingerprint trailers is the same for
+ * every keepalive or consent check sent on a pair, so the username and
+ * attributes are only formatted again when one of them changes.
+ *
+ * @return FALSE if no keepalive request can be built for that pair
+ */
+static gboolean priv_update_keepalive_template (NiceAgent *agent,
+    NiceStream *stream, NiceComponent *component)
+{
+  CandidatePair *p = &component->selected_pair;
+  uint8_t uname[NICE_STREAM_MAX_UNAME];
+  size_t uname_len;
+  uint8_t buffer[STUN_MAX_MESSAGE_SIZE_IPV6];
+  StunMessage msg;
+  size_t len;
+
+  if (p->keepalive.stun_template != NULL &&
+      p->keepalive.stun_template_controlling == agent->controlling_mode &&
+      p->keepalive.stun_template_tie_breaker == agent->tie_breaker)
+    return TRUE;
+
+  nice_component_clear_keepalive_template (component);
+
+  uname_len = priv_create_username (agent, stream, component->id,
+      (NiceCandidate *) p->remote, (NiceCandidate *) p->local,
+      uname, sizeof (uname), FALSE);
+  if (uname_len == 0)
+    return FALSE;
+
+  len = stun_usage_ice_conncheck_create_template (&component->stun_agent,
+      &msg, buffer, sizeof (buffer), uname, uname_len,
+      agent->controlling_mode, agent->controlling_mode, p->stun_priority,
+      agent->tie_breaker, NULL, agent_to_ice_compatibility (agent));
+
+  nice_debug ("Agent %p : keepalive template for s%d/c%d created %"
+      G_GSIZE_FORMAT ", username='%.*s' (%" G_GSIZE_FORMAT ").", agent,
+      stream->id, component->id, len, (int) uname_len, uname, uname_len);
+
+  /* A failed build leaves an empty template, reported by the caller */
+  p->keepalive.stun_template = g_memdup (buffer, len);
+  p->keepalive.stun_template_len = len;
+  p->keepalive.stun_template_controlling = agent->controlling_mode;
+  p->keepalive.stun_template_tie_breaker = agent->tie_breaker;
+
+  return TRUE;
+}
+
 /*
  * Timer callback that handles initiating and managing connectivity
  * checks (paced by the Ta timer).
@@ -1400,39 +1453,29 @@ static gboolean priv_conn_keepalive_tick_unlocked (NiceAgent *agent)
         }
 
         if (NICE_AGENT_DO_KEEPALIVE_CONNCHECKS (agent)) {
-          uint8_t uname[NICE_STREAM_MAX_UNAME];
-          size_t uname_len =
-              priv_create_username (agent, agent_find_stream (agent, stream->id),
-                  component->id, (NiceCandidate *) p->remote,
-                  (NiceCandidate *) p->local, uname, sizeof (uname), FALSE);
           uint8_t *password = NULL;
-          size_t password_len = priv_get_password (agent,
-              agent_find_stream (agent, stream->id),
+          size_t password_len = priv_get_password (agent, stream,
               (NiceCandidate *) p->remote, &password);
           uint8_t stun_buffer[STUN_MAX_MESSAGE_SIZE_IPV6];
           StunMessage stun_message;
 
-          if (uname_len > 0) {
+          if (priv_update_keepalive_template (agent, stream, component)) {
             if (nice_debug_is_enabled ()) {
               gchar tmpbuf[INET6_ADDRSTRLEN];
               nice_address_to_string (&p->remote->c.addr, tmpbuf);
               nice_debug ("Agent %p : Keepalive STUN-CC REQ to '%s:%u', "
-                  "(c-id:%u), username='%.*s' (%" G_GSIZE_FORMAT "), "
-                  "password='%.*s' (%" G_GSIZE_FORMAT "), priority=%08x.",
+                  "(c-id:%u), password='%.*s' (%" G_GSIZE_FORMAT "), "
+                  "priority=%08x.",
                   agent, tmpbuf, nice_address_get_port (&p->remote->c.addr),
-                  component->id, (int) uname_len, uname, uname_len,
-                  (int) password_len, password, password_len,
+                  component->id, (int) password_len, password, password_len,
                   p->stun_priority);
             }
 
-            buf_len = stun_usage_ice_conncheck_create (&component->stun_agent,
-                &stun_message, stun_buffer, sizeof(stun_buffer),
-                uname, uname_len, password, password_len,
-                agent->controlling_mode, agent->controlling_mode,
-                p->stun_priority,
-                agent->tie_breaker,
-                NULL,
-                agent_to_ice_compatibility (agent));
+            buf_len = stun_usage_ice_conncheck_create_from_template (
+                &component->stun_agent, &stun_message,
+                stun_buffer, sizeof(stun_buffer),
+                p->keepalive.stun_template, p->keepalive.stun_template_len,
+                password, password_len);
 
             nice_debug ("Agent %p: conncheck created %zd - %p",
                 agent, buf_len, stun_message.buffer);
@@ -1771,6 +1814,8 @@ nice_socket_has_compatible_transport (NiceSocket *socket,
     case NICE_SOCKET_TYPE_TCP_BSD:
       if (nice_tcp_bsd_socket_get_passive_parent (socket))
         *transport = NICE_CANDIDATE_TRANSPORT_TCP_PASSIVE;
+      else if (nice_tcp_bsd_socket_is_simultaneous_open (socket))
+        *transport = NICE_CANDIDATE_TRANSPORT_TCP_SO;
       else
         *transport = NICE_CANDIDATE_TRANSPORT_TCP_ACTIVE;
       break;
@@ -1780,6 +1825,9 @@ nice_socket_has_compatible_transport (NiceSocket *socket,
     case NICE_SOCKET_TYPE_TCP_ACTIVE:
       *transport = NICE_CANDIDATE_TRANSPORT_TCP_ACTIVE;
       break;
+    case NICE_SOCKET_TYPE_TCP_SO:
+      *transport = NICE_CANDIDATE_TRANSPORT_TCP_SO;
+      break;
     case NICE_SOCKET_TYPE_UDP_BSD:
       *transport = NICE_CANDIDATE_TRANSPORT_UDP;
       break;
@@ -2961,24 +3009,33 @@ int conn_check_send (NiceAgent *agent, CandidateCheckPair *pair)
 
   stun->next_tick = g_get_monotonic_time () + timeout * 1000;
 
-  /* TCP-ACTIVE candidate must create a new socket before sending
-   * by connecting to the peer. The new socket is stored in the candidate
-   * check pair, until we discover a new local peer reflexive */
+  /* TCP-ACTIVE and TCP-SO candidates must create a new socket before
+   * sending by connecting to the peer. The new socket is stored in the
+   * candidate check pair, until we discover a new local peer reflexive */
   if (pair->sockptr->fileno == NULL &&
       pair->sockptr->type != NICE_SOCKET_TYPE_UDP_TURN &&
-      pair->local->transport == NICE_CANDIDATE_TRANSPORT_TCP_ACTIVE) {
+      (pair->local->transport == NICE_CANDIDATE_TRANSPORT_TCP_ACTIVE ||
+          pair->local->transport == NICE_CANDIDATE_TRANSPORT_TCP_SO)) {
     NiceStream *stream2 = NULL;
     NiceComponent *component2 = NULL;
     NiceSocket *new_socket;
 
     if (agent_find_component (agent, pair->stream_id, pair->component_id,
             &stream2, &component2)) {
-      new_socket = nice_tcp_active_socket_connect (pair->sockptr,
-          &pair->remote->addr);
+      if (pair->local->transport == NICE_CANDIDATE_TRANSPORT_TCP_SO) {
+        new_socket = nice_tcp_so_socket_connect (pair->sockptr,
+            &pair->remote->addr);
+        pair->so_connect_attempts++;
+      } else {
+        new_socket = nice_tcp_active_socket_connect (pair->sockptr,
+            &pair->remote->addr);
+      }
       if (new_socket) {
-        nice_debug ("Agent %p: add to tcp-act socket %p a new "
+        nice_debug ("Agent %p: add to %s socket %p a new "
             "tcp connect socket %p on pair %p in s/c %d/%d",
-            agent, pair->sockptr, new_socket, pair, stream->id, component->id);
+            agent, pair->local->transport == NICE_CANDIDATE_TRANSPORT_TCP_SO ?
+            "tcp-so" : "tcp-act", pair->sockptr, new_socket, pair,
+            stream->id, component->id);
         pair->sockptr = new_socket;
         _priv_set_socket_tos (agent, pair->sockptr, stream2->tos);
 
@@ -3403,12 +3460,21 @@ static void priv_check_for_role_conflict (NiceAgent *agent, gboolean control)
 {
   /* role conflict, change mode; wait for a new conn. check */
   if (control != agent->controlling_mode) {
+    GSList *i, *j;
+
     nice_debug ("Agent %p : Role conflict, changing agent role to \"%s\".",
         agent, control ? "controlling" : "controlled");
     agent->controlling_mode = control;
     /* the pair priorities depend on the roles, so recalculation
      * is needed */
     recalculate_pair_priorities (agent);
+
+    /* the lite responder answers according to the previous role */
+    for (i = agent->streams; i; i = i->next) {
+      NiceStream *stream = i->data;
+      for (j = stream->components; j; j = j->next)
+        conn_check_lite_responder_update (agent, stream, j->data);
+    }
   }
   else 
     nice_debug ("Agent %p : Role conflict, staying with role \"%s\".",
@@ -4514,6 +4580,135 @@ static gboolean conn_check_handle_renomination (NiceAgent *agent, NiceStream *st
   return FALSE;
 }
 
+static bool priv_lite_responder_validater (StunAgent *agent,
+    StunMessage *message, uint8_t *username, uint16_t username_len,
+    uint8_t **password, size_t *password_len, void *user_data)
+{
+  LiteResponder *responder = user_data;
+
+  /* The USERNAME is "local:remote", as checked by the agent */
+  if (username_len <= responder->ufrag_len ||
+      username[responder->ufrag_len] != ':' ||
+      memcmp (username, responder->ufrag, responder->ufrag_len) != 0)
+    return FALSE;
+
+  *password = (uint8_t *) responder->password;
+  *password_len = responder->password_len;
+  return TRUE;
+}
+
+/*
+ * Publishes a new snapshot for the ICE-lite responder of 'component',
+ * matching its current selected pair, credentials and role, or disables
+ * the responder when the pair cannot be answered without the agent.
+ *
+ * Only RFC 5245 lite agents using plain UDP host sockets qualify: TURN,
+ * ICE-TCP and the legacy compatibility modes all need the agent state to
+ * process a request.
+ */
+void conn_check_lite_responder_update (NiceAgent *agent, NiceStream *stream,
+    NiceComponent *component)
+{
+  CandidatePair *p = &component->selected_pair;
+  LiteResponder *responder;
+
+  if (agent->full_mode || agent->reliable ||
+      agent->compatibility != NICE_COMPATIBILITY_RFC5245 ||
+      p->local == NULL || p->remote == NULL ||
+      p->local->sockptr == NULL ||
+      p->local->sockptr->type != NICE_SOCKET_TYPE_UDP_BSD ||
+      !component->have_local_consent ||
+      stream->local_ufrag[0] == 0 || stream->local_password[0] == 0) {
+    nice_component_set_lite_responder (component, NULL);
+    return;
+  }
+
+  responder = g_new0 (LiteResponder, 1);
+  responder->sockptr = p->local->sockptr;
+  responder->remote_addr = p->remote->c.addr;
+  nice_agent_init_stun_agent (agent, &responder->stun_agent);
+  responder->ufrag = g_strdup (stream->local_ufrag);
+  responder->ufrag_len = strlen (responder->ufrag);
+  responder->password = g_strdup (stream->local_password);
+  responder->password_len = strlen (responder->password);
+  responder->controlling = agent->controlling_mode;
+  responder->tie_breaker = agent->tie_breaker;
+
+  nice_debug ("Agent %p : lite responder enabled for s%d/c%d.", agent,
+      stream->id, component->id);
+
+  nice_component_set_lite_responder (component, responder);
+}
+
+/*
+ * Answers a Binding request received on the selected pair of an ICE-lite
+ * agent, without the agent lock. This runs from component_io_cb() in the
+ * component context, before the agent lock is taken, with the component’s
+ * lite_mutex held: 'nicesock' is alive, so comparing it to the snapshot is
+ * enough.
+ *
+ * Such a request can not change the state of the agent: the pair is
+ * already nominated and succeeded. Anything else, including requests with
+ * a role conflict or a renomination, is left to
+ * conn_check_handle_inbound_stun().
+ *
+ * @return TRUE if the request was answered, FALSE if the agent must
+ * process the packet
+ */
+gboolean conn_check_lite_respond (NiceComponent *component,
+    NiceSocket *nicesock, const NiceAddress *from, guint8 *buf, gsize len)
+{
+  LiteResponder *responder;
+  union {
+    struct sockaddr_storage storage;
+    struct sockaddr addr;
+  } sockaddr;
+  uint8_t rbuf[MAX_STUN_DATAGRAM_PAYLOAD];
+  size_t rbuf_len = sizeof (rbuf);
+  StunMessage req;
+  StunMessage msg;
+  bool control;
+  uint64_t tie;
+  uint16_t attr_len;
+
+  responder = component->lite_responder;
+  if (responder == NULL || responder->sockptr != nicesock ||
+      !nice_address_equal (&responder->remote_addr, from))
+    return FALSE;
+
+  /* Cheap rejection of media before any parsing */
+  if (len < STUN_MESSAGE_HEADER_LENGTH || (buf[0] & 0xC0) != 0 ||
+      stun_message_validate_buffer_length (buf, len, TRUE) != (int) len)
+    return FALSE;
+
+  if (stun_agent_validate (&responder->stun_agent, &req, buf, len,
+          priv_lite_responder_validater, responder) != STUN_VALIDATION_SUCCESS)
+    return FALSE;
+
+  if (stun_message_get_class (&req) != STUN_REQUEST ||
+      stun_message_get_method (&req) != STUN_BINDING)
+    return FALSE;
+
+  if (stun_message_find64 (&req, responder->controlling ?
+          STUN_ATTRIBUTE_ICE_CONTROLLING : STUN_ATTRIBUTE_ICE_CONTROLLED,
+          &tie) == STUN_MESSAGE_RETURN_SUCCESS ||
+      stun_message_find (&req, STUN_ATTRIBUTE_NOMINATION, &attr_len) != NULL)
+    return FALSE;
+
+  nice_address_copy_to_sockaddr (from, &sockaddr.addr);
+  control = responder->controlling;
+  if (stun_usage_ice_conncheck_create_reply (&responder->stun_agent, &req,
+          &msg, rbuf, &rbuf_len, &sockaddr.storage, sizeof (sockaddr),
+          &control, responder->tie_breaker,
+          STUN_USAGE_ICE_COMPATIBILITY_RFC5245) !=
+      STUN_USAGE_ICE_RETURN_SUCCESS)
+    return FALSE;
+
+  nice_socket_send (nicesock, from, rbuf_len, (const gchar *) rbuf);
+
+  return TRUE;
+}
+
 /*
  * Processing an incoming STUN message.
  *
@@ -4992,6 +5187,24 @@ conn_check_prune_socket (NiceAgent *agent, NiceStream *stream, NiceComponent *co
     if (selected_pair_failed && !p->retransmit && p->stun_transactions)
       p->retransmit = TRUE;
 
+    /* A simultaneous open is refused whenever our SYN reaches the peer
+     * before its own connection attempt, so the pair is checked again
+     * from its candidate socket, a bounded number of times. */
+    if (p->sockptr == sock && p->state == NICE_CHECK_IN_PROGRESS &&
+        p->local != NULL &&
+        p->local->transport == NICE_CANDIDATE_TRANSPORT_TCP_SO &&
+        ((NiceCandidateImpl *) p->local)->sockptr != sock &&
+        p->so_connect_attempts < TCP_SO_MAX_CONNECT_ATTEMPTS) {
+      nice_debug ("Agent %p : tcp-so connection of pair %p failed, "
+          "retrying (attempt %u)", agent, p, p->so_connect_attempts);
+      priv_free_all_stun_transactions (p, component);
+      p->sockptr = ((NiceCandidateImpl *) p->local)->sockptr;
+      SET_PAIR_STATE (agent, p, NICE_CHECK_WAITING);
+      p_count++;
+      l = next;
+      continue;
+    }
+
     if ((p->local != NULL && ((NiceCandidateImpl*) p->local)->sockptr == sock) ||
         (p->remote != NULL && ((NiceCandidateImpl*)p->remote)->sockptr == sock) ||
         (p->sockptr == sock)) {
@@ -105,6 +105,7 @@ struct _CandidateCheckPair
   guint64 priority;
   guint32 stun_priority;
   GSList *stun_transactions; /* a list of ongoing stun requests */
+  guint so_connect_attempts; /* of a TCP-SO pair, see conn_check_send() */
 };
 
 int conn_check_add_for_candidate (NiceAgent *agent, guint stream_id, NiceComponent *component, NiceCandidate *remote);
@@ -129,6 +130,10 @@ void conn_check_update_check_list_state_for_ready (NiceAgent *agent,
     NiceStream *stream, NiceComponent *component);
 void conn_check_unfreeze_related (NiceAgent *agent, CandidateCheckPair *pair);
 guint conn_check_stun_transactions_count (NiceAgent *agent);
+void conn_check_lite_responder_update (NiceAgent *agent, NiceStream *stream,
+    NiceComponent *component);
+gboolean conn_check_lite_respond (NiceComponent *component,
+    NiceSocket *nicesock, const NiceAddress *from, guint8 *buf, gsize len);
 
 
 #endif /*_NICE_CONNCHECK_H */
@@ -787,8 +787,8 @@ HostCandidateResult discovery_add_local_host_candidate (
     nicesock = nice_tcp_active_socket_new (agent->main_context, address);
   } else if (transport == NICE_CANDIDATE_TRANSPORT_TCP_PASSIVE) {
     nicesock = nice_tcp_passive_socket_new (agent->main_context, address, &error);
-  } else {
-    /* TODO: Add TCP-SO */
+  } else if (transport == NICE_CANDIDATE_TRANSPORT_TCP_SO) {
+    nicesock = nice_tcp_so_socket_new (agent->main_context, address, &error);
   }
   if (!nicesock) {
     if (error && g_error_matches (error, G_IO_ERROR, G_IO_ERROR_ADDRESS_IN_USE))
@@ -132,6 +132,14 @@ const guint16 PACKET_MAXIMUMS[] = {
 // when relay framing is in use
 #define JINGLE_HEADER_SIZE 64
 
+/* Packetization layer path MTU discovery (RFC 8899). Probes search upwards
+ * from the MTU in use to MAX_PLPMTU; a black hole drops it to BASE_PLPMTU. */
+#define BASE_PLPMTU 1200
+#define MAX_PLPMTU 1500
+#define PLPMTUD_MAX_PROBES 3  /* losses of one probe size before giving up */
+#define PLPMTUD_SEARCH_GRANULARITY 16
+#define PLPMTUD_RAISE_TIMER (600 * 1000)  /* 10 minutes */
+
 //////////////////////////////////////////////////////////////////////
 // Global Constants and Functions
 //////////////////////////////////////////////////////////////////////
@@ -169,11 +177,19 @@ const guint16 PACKET_MAXIMUMS[] = {
 #define DEF_RTO     1000 /* 1 seconds (RFC 6298 sect 2.1) */
 #define MAX_RTO    60000 /* 60 seconds */
 #define DEFAULT_ACK_DELAY    100 /* 100 milliseconds */
+#define TLP_MIN_TIMEOUT       10 /* 10 milliseconds */
 #define DEFAULT_NO_DELAY     TRUE
 
 #define DEFAULT_RCV_BUF_SIZE (60 * 1024)
 #define DEFAULT_SND_BUF_SIZE (90 * 1024)
 
+/* Ceilings for buffer autotuning, like Linux's tcp_rmem[2] and tcp_wmem[2] */
+#define DEFAULT_RCV_BUF_MAX (4 * 1024 * 1024)
+#define DEFAULT_SND_BUF_MAX (4 * 1024 * 1024)
+/* Once the autotuned buffers of all the sockets in the process have grown
+ * this much above their defaults, growth stops and receive buffers shrink */
+#define AUTOTUNE_MEMORY_PRESSURE (64 * 1024 * 1024)
+
 /* NOTE: This must fit in 8 bits. This is used on the wire. */
 typedef enum {
   /* Google-provided options: */
@@ -185,6 +201,15 @@ typedef enum {
   TCP_OPT_FIN_ACK = 254,  /* FIN-ACK support */
 } TcpOption;
 
+/* Bits of the TCP_OPT_FIN_ACK option value, which older libnice versions
+ * always send as zero. Jingle stacks never send the option at all. */
+#define FIN_ACK_OPT_SACK 0x01  /* selective acknowledgements, see FLAG_SACK */
+#define FIN_ACK_OPT_FORWARD 0x02  /* abandoned messages, see FLAG_FORWARD */
+
+/* Maximum number of SACK blocks carried in an ACK segment. */
+#define MAX_SACK_BLOCKS 4
+#define SACK_BLOCK_SIZE 8
+
 
 /*
 #define FLAG_SYN 0x02
@@ -197,6 +222,14 @@ typedef enum {
   FLAG_FIN = 1 << 0,
   FLAG_CTL = 1 << 1,
   FLAG_RST = 1 << 2,
+  /* libnice extension: the payload of this ACK is a list of SACK blocks
+   * (pairs of left and right edge sequence numbers) rather than data. Only
+   * sent once both ends negotiated FIN_ACK_OPT_SACK. */
+  FLAG_SACK = 1 << 3,
+  /* libnice extension: the sender abandoned everything before this segment's
+   * sequence number, which the receiver skips. Only sent once both ends
+   * negotiated FIN_ACK_OPT_FORWARD. */
+  FLAG_FORWARD = 1 << 4,
 } TcpFlags;
 
 #define CTL_CONNECT  0
@@ -309,9 +342,11 @@ pseudo_tcp_fifo_set_capacity (PseudoTcpFifo *b, gsize size)
   if (b->data_length > size)
     return FALSE;
 
-  if (size != b->data_length) {
+  if (size != b->buffer_length) {
     guint8 *buffer = g_slice_alloc (size);
-    gsize copy = b->data_length;
+    /* Copy past the end of the data too, so that out-of-order data written
+     * with pseudo_tcp_fifo_write_offset() survives the resize. */
+    gsize copy = min (size, b->buffer_length);
     gsize tail_copy = min (copy, b->buffer_length - b->read_position);
 
     memcpy (buffer, &b->buffer[b->read_position], tail_copy);
@@ -445,12 +480,28 @@ typedef struct {
   guint32 seq, len;
   guint8 xmit;
   TcpFlags flags;
+  gboolean sacked;  /* reported received by a SACK block */
+  guint32 xmit_time;  /* time of the latest transmission */
+  guint32 deadline;  /* time the message expires at, or 0 */
+  guint32 msg_end;  /* end of the message, if deadline is set */
 } SSegment;
 
+/* A range of out-of-order data held in rbuf past rcv_nxt */
 typedef struct {
   guint32 seq, len;
 } RSegment;
 
+/* A range of rbuf abandoned by the sender, @offset bytes past the read
+ * position */
+typedef struct {
+  guint32 offset, len;
+} RSkip;
+
+/* Messages are prefixed with their length (see pseudo_tcp_socket_send_message)
+ * and must fit in the receive buffer of the peer. */
+#define MESSAGE_HEADER_SIZE 4
+#define MAX_MESSAGE_SIZE (32 * 1024)
+
 /**
  * ClosedownSource:
  * @CLOSEDOWN_LOCAL: Error detected locally, or connection forcefully closed
@@ -466,6 +517,51 @@ typedef enum {
   CLOSEDOWN_REMOTE,
 } ClosedownSource;
 
+/* Congestion control module. The loss recovery mechanics (fast retransmit,
+ * NewReno/SACK recovery, window inflation) are shared; a module only decides
+ * how the window grows and how far it is cut.
+ *
+ * @on_ack: called for each ACK advancing snd_una, with the number of bytes
+ * it acknowledged and the RTT sample it gave in milliseconds (or -1). The
+ * module must leave cwnd alone when @in_recovery is set.
+ * @on_loss: entering fast recovery; must set ssthresh.
+ * @on_rto: retransmission timeout; must set ssthresh and cwnd.
+ * @pacing_rate: rate the module would like segments to be sent at, in bytes
+ * per second, or 0 if it has no opinion. */
+typedef struct {
+  const gchar *name;
+  void (*init) (PseudoTcpSocket *self);
+  void (*on_ack) (PseudoTcpSocket *self, guint32 acked, long rtt,
+      gboolean in_recovery, guint32 now);
+  void (*on_loss) (PseudoTcpSocket *self, guint32 now);
+  void (*on_rto) (PseudoTcpSocket *self, guint32 now);
+  guint32 (*pacing_rate) (PseudoTcpSocket *self);
+} CongestionOps;
+
+typedef struct {
+  guint32 w_max;  /* window before the last reduction */
+  guint32 origin;  /* window the cubic function plateaus at */
+  guint32 k;  /* time to reach origin from the epoch start, in ms */
+  guint32 epoch_start;  /* start of the current growth epoch, or 0 */
+  guint32 w_est;  /* window NewReno would have, RFC 9438 §4.3 */
+} CubicState;
+
+#define BBR_BW_ROUNDS 10
+
+typedef struct {
+  guint32 bw_samples[BBR_BW_ROUNDS];  /* delivery rate per round, bytes/s */
+  guint32 btl_bw;  /* max of bw_samples */
+  guint32 round_count;
+  guint32 round_end;  /* the round is over once this is acknowledged */
+  guint32 round_start;  /* time the round started, 0 if not started */
+  guint32 round_delivered;  /* bytes acknowledged during the round */
+  guint32 min_rtt;  /* ms, 0 if unknown */
+  guint32 min_rtt_stamp;
+  guint32 full_bw;  /* btl_bw when it last grew by 25% */
+  guint8 full_bw_count;  /* rounds since then */
+  gboolean filled_pipe;  /* startup is over */
+} BbrState;
+
 
 struct _PseudoTcpSocketPrivate {
   PseudoTcpCallbacks callbacks;
@@ -481,11 +577,20 @@ struct _PseudoTcpSocketPrivate {
   guint32 last_traffic;
 
   // Incoming data
-  GList *rlist;
+  GArray *rskips;  /* of RSkip, sorted */
+  GArray *rlist;  /* of RSegment, sorted and merged: no two ranges overlap
+                     or touch */
   guint32 rbuf_len, rcv_nxt, rcv_wnd, lastrecv;
   guint8 rwnd_scale; // Window scale factor
   PseudoTcpFifo rbuf;
   guint32 rcv_fin;  /* sequence number of the received FIN octet, or 0 */
+  // Receive buffer autotuning
+  gboolean rbuf_autotune;  /* FALSE once the application sets rcv-buf */
+  guint32 rbuf_max;
+  guint32 rcv_rtt;  /* receiver side RTT estimate; 0 if unknown */
+  guint32 rcv_rtt_seq, rcv_rtt_time;  /* current window measurement */
+  guint32 rcvq_space;  /* most bytes read by the application in one RTT */
+  guint32 rcvq_copied, rcvq_time;  /* bytes read since rcvq_time */
 
   // Outgoing data
   GQueue slist;
@@ -494,9 +599,21 @@ struct _PseudoTcpSocketPrivate {
   guint32 snd_una;  /* oldest unacknowledged sequence number */
   guint8 swnd_scale; // Window scale factor
   PseudoTcpFifo sbuf;
+  gboolean sbuf_autotune;  /* FALSE once the application sets snd-buf */
+  guint32 sbuf_max;
+
+  /* Bytes this socket added to autotuned_memory */
+  gsize autotuned_bytes;
 
   // Maximum segment size, estimated protocol level, largest segment sent
   guint32 mss, msslevel, largest, mtu_advise;
+  // Path MTU discovery
+  gboolean mtu_discovery;
+  guint32 plpmtud_low, plpmtud_high;  /* confirmed size, largest candidate */
+  guint32 plpmtud_raise_time;  /* when the search ended, or 0 */
+  guint32 probe_size;  /* packet size of the outstanding probe, or 0 */
+  guint32 probe_seq, probe_len;
+  guint8 probe_failures;  /* lost probes of the current probe size */
   // Retransmit timer
   guint32 rto_base;
 
@@ -511,6 +628,31 @@ struct _PseudoTcpSocketPrivate {
   guint8 dup_acks;
   guint32 recover;
   gboolean fast_recovery;
+  // SACK scoreboard over slist
+  guint32 sacked_bytes;  /* sum of the lengths of the SACKed segments */
+  guint32 sack_high;  /* highest SACKed sequence number */
+  guint32 sack_rexmit_nxt;  /* holes below this were retransmitted during the
+                               current recovery */
+  // RACK-TLP loss detection (RFC 8985)
+  gboolean rack_tlp;
+  guint32 rack_xmit_time, rack_end_seq;  /* latest sent delivered segment */
+  guint32 rack_rtt, rack_min_rtt;
+  guint32 rack_timer;  /* reordering timeout, or 0 */
+  guint32 tlp_timer;  /* probe timeout, or 0 */
+  gboolean tlp_outstanding;
+  guint32 tlp_high_seq, tlp_xmit_time;  /* snd_nxt and time at the probe */
+  // Pacing
+  gboolean pacing;
+  guint32 max_pacing_rate;  /* bytes per second, or 0 */
+  guint32 pace_next;  /* earliest time the next segment may be sent */
+  guint32 pace_frac;  /* microseconds past pace_next */
+  gboolean pace_blocked;  /* data is waiting for pace_next */
+  PseudoTcpCongestionControl cc_algorithm;
+  const CongestionOps *cc;
+  union {
+    CubicState cubic;
+    BbrState bbr;
+  } cc_state;
   guint32 t_ack;  /* time a delayed ack was scheduled; 0 if no acks scheduled */
   guint32 last_acked_ts;
 
@@ -529,6 +671,13 @@ struct _PseudoTcpSocketPrivate {
    * option) to enable correct FIN-ACK connection termination. Defaults to
    * TRUE unless no compatible option is received. */
   gboolean support_fin_ack;
+
+  /* Whether selective acknowledgements are used. Negotiated as part of the
+   * FIN-ACK option, so this is FALSE whenever support_fin_ack is. */
+  gboolean support_sack;
+  gboolean support_forward;
+  guint32 fwd_seq;  /* last forward point sent */
+  guint32 fwd_time;  /* time it was sent, or 0 once acknowledged */
 };
 
 #define LARGER(a,b) (((a) - (b) - 1) < (G_MAXUINT32 >> 1))
@@ -547,6 +696,15 @@ enum
   PROP_RCV_BUF,
   PROP_SND_BUF,
   PROP_SUPPORT_FIN_ACK,
+  PROP_SUPPORT_SACK,
+  PROP_CONGESTION_CONTROL,
+  PROP_RCV_BUF_MAX,
+  PROP_SND_BUF_MAX,
+  PROP_MTU_DISCOVERY,
+  PROP_MTU,
+  PROP_RACK_TLP,
+  PROP_PACING,
+  PROP_MAX_PACING_RATE,
   LAST_PROPERTY
 };
 
@@ -559,6 +717,9 @@ static void pseudo_tcp_socket_finalize (GObject *object);
 
 
 static void queue_connect_message (PseudoTcpSocket *self);
+static void queue_message (PseudoTcpSocket *self, const gchar *data,
+    guint32 len, guint32 deadline);
+static void reopen_receive_window (PseudoTcpSocket *self);
 static guint32 queue (PseudoTcpSocket *self, const gchar *data,
     guint32 len, TcpFlags flags);
 static PseudoTcpWriteResult packet(PseudoTcpSocket *self, guint32 seq,
@@ -572,13 +733,41 @@ static void attempt_send(PseudoTcpSocket *self, SendFlags sflags);
 static void closedown (PseudoTcpSocket *self, guint32 err,
     ClosedownSource source);
 static void adjustMTU(PseudoTcpSocket *self);
+static guint32 plpmtud_probe_size (PseudoTcpSocket *self, guint32 now);
+static void plpmtud_probe_acked (PseudoTcpSocket *self);
+static void plpmtud_probe_lost (PseudoTcpSocket *self, gboolean too_large);
+static void plpmtud_black_hole (PseudoTcpSocket *self);
+static int plpmtud_retransmit_probe (PseudoTcpSocket *self, guint32 now);
+static guint32 sack_write_blocks (PseudoTcpSocket *self, guint8 *buf);
+static void sack_update_scoreboard (PseudoTcpSocket *self, const guint8 *data,
+    guint32 len, guint32 now);
+static void sack_clear_scoreboard (PseudoTcpSocket *self);
+static int sack_retransmit_holes (PseudoTcpSocket *self, guint32 now);
+static int enter_recovery (PseudoTcpSocket *self, guint32 now);
+static void rack_update (PseudoTcpSocket *self, SSegment *sseg, guint32 now);
+static gboolean rack_detect_loss (PseudoTcpSocket *self, guint32 now);
+static void tlp_arm (PseudoTcpSocket *self, guint32 now);
+static int tlp_send_probe (PseudoTcpSocket *self, guint32 now);
+static gboolean pacing_blocked (PseudoTcpSocket *self, guint32 now);
+static void pacing_charge (PseudoTcpSocket *self, guint32 len, guint32 now);
+static void rlist_insert (PseudoTcpSocket *self, guint32 seq, guint32 len);
+static guint32 rlist_consume (PseudoTcpSocket *self);
+static void abandon_expired_messages (PseudoTcpSocket *self, guint32 now);
+static gboolean receive_forward (PseudoTcpSocket *self, guint32 fwd);
+static gsize rskips_trim (PseudoTcpSocket *self);
+static void rskips_advance (PseudoTcpSocket *self, gsize len);
 static void parse_options (PseudoTcpSocket *self, const guint8 *data,
     guint32 len);
 static void resize_send_buffer (PseudoTcpSocket *self, guint32 new_size);
 static void resize_receive_buffer (PseudoTcpSocket *self, guint32 new_size);
+static void update_receive_rtt (PseudoTcpSocket *self, guint32 now);
+static void autotune_receive_buffer (PseudoTcpSocket *self, guint32 bytesread);
+static void autotune_send_buffer (PseudoTcpSocket *self);
 static void set_state (PseudoTcpSocket *self, PseudoTcpState new_state);
 static void set_state_established (PseudoTcpSocket *self);
 static void set_state_closed (PseudoTcpSocket *self, guint32 err);
+static void set_congestion_control (PseudoTcpSocket *self,
+    PseudoTcpCongestionControl algorithm);
 
 static const gchar *pseudo_tcp_state_get_name (PseudoTcpState state);
 static gboolean pseudo_tcp_state_has_sent_fin (PseudoTcpState state);
@@ -588,6 +777,9 @@ static gboolean pseudo_tcp_state_has_received_fin_ack (PseudoTcpState state);
 // The following logging is for detailed (packet-level) pseudotcp analysis only.
 static PseudoTcpDebugLevel debug_level = PSEUDO_TCP_DEBUG_NONE;
 
+/* Sum of the autotuned growth of all the buffers in the process, in bytes */
+static gsize autotuned_memory = 0;
+
 #define DEBUG(level, fmt, ...)                                          \
   if (debug_level >= level)                                             \
     g_log (level == PSEUDO_TCP_DEBUG_NORMAL ? "libnice-pseudotcp" : "libnice-pseudotcp-verbose", G_LOG_LEVEL_DEBUG, "PseudoTcpSocket %p %s: " fmt, \
@@ -683,6 +875,181 @@ pseudo_tcp_socket_class_init (PseudoTcpSocketClass *cls)
           "Whether to enable the optional FIN–ACK support.",
           TRUE,
           G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * PseudoTcpSocket:support-sack:
+   *
+   * Whether to use selective acknowledgements (SACK) for this socket, so that
+   * several segments lost from the same window can be retransmitted within
+   * one round trip. Like #PseudoTcpSocket:support-fin-ack, this is a libnice
+   * extension which is negotiated on connection setup; it requires the
+   * FIN–ACK extension to be supported by both ends.
+   *
+   * Support is enabled by default. It can only be changed before the
+   * connection is started.
+   *
+   * Since: 0.1.24
+   */
+  g_object_class_install_property (object_class, PROP_SUPPORT_SACK,
+      g_param_spec_boolean ("support-sack", "Support SACK",
+          "Whether to enable the optional selective acknowledgement support.",
+          TRUE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * PseudoTcpSocket:congestion-control:
+   *
+   * The congestion control algorithm (enum #PseudoTcpCongestionControl) used
+   * for the data sent on this socket. It can only be changed before the
+   * connection is started.
+   *
+   * Since: 0.1.24
+   */
+  g_object_class_install_property (object_class, PROP_CONGESTION_CONTROL,
+      g_param_spec_uint ("congestion-control", "Congestion control",
+          "The congestion control algorithm "
+          "(enum PseudoTcpCongestionControl) used by the socket",
+          PSEUDO_TCP_CONGESTION_RENO, PSEUDO_TCP_CONGESTION_BBR,
+          PSEUDO_TCP_CONGESTION_RENO,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * PseudoTcpSocket:rcv-buf-max:
+   *
+   * The size, in bytes, up to which the receive buffer may grow. Unless
+   * #PseudoTcpSocket:rcv-buf is set, the receive buffer starts at its default
+   * size and is resized every round trip to twice the amount of data the
+   * application read in the best round trip so far, so that the advertised
+   * window keeps up with the bandwidth-delay product of the path. The buffer
+   * shrinks back towards its default size when the autotuned buffers of all
+   * the sockets in the process use too much memory.
+   *
+   * The window scale factor sent on connection setup is chosen to fit this
+   * ceiling, so it can only be changed before the connection is started.
+   *
+   * Since: 0.1.24
+   */
+  g_object_class_install_property (object_class, PROP_RCV_BUF_MAX,
+      g_param_spec_uint ("rcv-buf-max", "Maximum receive buffer",
+          "Maximum size of the autotuned receive buffer",
+          1, G_MAXUINT, DEFAULT_RCV_BUF_MAX,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * PseudoTcpSocket:snd-buf-max:
+   *
+   * The size, in bytes, up to which the send buffer may grow. Unless
+   * #PseudoTcpSocket:snd-buf is set, the send buffer is grown to twice the
+   * congestion window whenever the window outgrows it.
+   *
+   * Since: 0.1.24
+   */
+  g_object_class_install_property (object_class, PROP_SND_BUF_MAX,
+      g_param_spec_uint ("snd-buf-max", "Maximum send buffer",
+          "Maximum size of the autotuned send buffer",
+          1, G_MAXUINT, DEFAULT_SND_BUF_MAX,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * PseudoTcpSocket:mtu-discovery:
+   *
+   * Whether to search for the path MTU once the connection is established,
+   * as described in RFC 8899. Starting from the MTU given to
+   * pseudo_tcp_socket_notify_mtu(), the socket occasionally sends a segment
+   * of data larger than the current MSS. The larger size is adopted once the
+   * peer acknowledges that segment, and abandoned after repeated losses.
+   * Lost probes are retransmitted at the current MSS and do not reduce the
+   * congestion window. If full sized segments keep timing out, the MTU
+   * falls back to 1200 bytes and the search starts again.
+   *
+   * Probes are ordinary data segments, so no support is needed from the
+   * peer.
+   *
+   * Since: 0.1.24
+   */
+  g_object_class_install_property (object_class, PROP_MTU_DISCOVERY,
+      g_param_spec_boolean ("mtu-discovery", "Path MTU discovery",
+          "Whether to probe for a larger path MTU",
+          FALSE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * PseudoTcpSocket:mtu:
+   *
+   * The size in bytes of the largest packets currently sent, including the
+   * pseudo-TCP, UDP and IP headers. With #PseudoTcpSocket:mtu-discovery, this
+   * is the path MTU confirmed so far, which applications may use to size
+   * their own datagrams on the same path.
+   *
+   * Since: 0.1.24
+   */
+  g_object_class_install_property (object_class, PROP_MTU,
+      g_param_spec_uint ("mtu", "MTU",
+          "The size of the largest packets currently sent",
+          0, G_MAXUINT, MIN_PACKET,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * PseudoTcpSocket:rack-tlp:
+   *
+   * Whether to detect losses from the time segments were sent, using RACK
+   * and tail loss probes as described in RFC 8985. A segment is then
+   * retransmitted once a segment sent sufficiently later has been
+   * acknowledged, without waiting for three duplicate ACKs. If the
+   * acknowledgements stop altogether, the last segment sent is retransmitted
+   * after two round trips rather than after the retransmission timeout of at
+   * least one second. This mostly helps request/response traffic, where a
+   * lost segment at the end of a message is otherwise only repaired by the
+   * retransmission timeout.
+   *
+   * Like #PseudoTcpSocket:mtu-discovery, this only changes the behaviour
+   * of the sender, so no support is needed from the peer.
+   *
+   * Since: 0.1.24
+   */
+  g_object_class_install_property (object_class, PROP_RACK_TLP,
+      g_param_spec_boolean ("rack-tlp", "RACK-TLP",
+          "Whether to use time based loss detection and tail loss probes",
+          FALSE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * PseudoTcpSocket:pacing:
+   *
+   * Whether to spread the segments allowed by the congestion window over the
+   * round trip time, rather than sending them in a single burst. Bursts can
+   * overflow the queues of NATs and TURN servers along the path, and the
+   * resulting losses then shrink the congestion window.
+   *
+   * Segments are sent at the rate requested by the congestion control module
+   * if it has one (see #PseudoTcpSocket:congestion-control), and otherwise at
+   * twice the congestion window per round trip time in slow start and 1.2
+   * times the congestion window per round trip time afterwards. As the
+   * pseudo-TCP clock has a resolution of one millisecond, up to a
+   * millisecond’s worth of data is still sent at once.
+   *
+   * Since: 0.1.24
+   */
+  g_object_class_install_property (object_class, PROP_PACING,
+      g_param_spec_boolean ("pacing", "Pacing",
+          "Whether to spread transmissions over the round trip time",
+          FALSE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * PseudoTcpSocket:max-pacing-rate:
+   *
+   * Upper bound on the pacing rate, in bytes per second, or 0 for no bound.
+   * This only has an effect if #PseudoTcpSocket:pacing is enabled. It is
+   * also used as the rate before the round trip time is known.
+   *
+   * Since: 0.1.24
+   */
+  g_object_class_install_property (object_class, PROP_MAX_PACING_RATE,
+      g_param_spec_uint ("max-pacing-rate", "Maximum pacing rate",
+          "Upper bound on the pacing rate in bytes per second, or 0",
+          0, G_MAXUINT32, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 }
 
 
@@ -719,6 +1086,33 @@ pseudo_tcp_socket_get_property (GObject *object,
     case PROP_SUPPORT_FIN_ACK:
       g_value_set_boolean (value, self->priv->support_fin_ack);
       break;
+    case PROP_SUPPORT_SACK:
+      g_value_set_boolean (value, self->priv->support_sack);
+      break;
+    case PROP_CONGESTION_CONTROL:
+      g_value_set_uint (value, self->priv->cc_algorithm);
+      break;
+    case PROP_RCV_BUF_MAX:
+      g_value_set_uint (value, self->priv->rbuf_max);
+      break;
+    case PROP_SND_BUF_MAX:
+      g_value_set_uint (value, self->priv->sbuf_max);
+      break;
+    case PROP_MTU_DISCOVERY:
+      g_value_set_boolean (value, self->priv->mtu_discovery);
+      break;
+    case PROP_MTU:
+      g_value_set_uint (value, self->priv->mss + PACKET_OVERHEAD);
+      break;
+    case PROP_RACK_TLP:
+      g_value_set_boolean (value, self->priv->rack_tlp);
+      break;
+    case PROP_PACING:
+      g_value_set_boolean (value, self->priv->pacing);
+      break;
+    case PROP_MAX_PACING_RATE:
+      g_value_set_uint (value, self->priv->max_pacing_rate);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -751,15 +1145,53 @@ pseudo_tcp_socket_set_property (GObject *object,
       break;
     case PROP_RCV_BUF:
       g_return_if_fail (self->priv->state == PSEUDO_TCP_LISTEN);
+      self->priv->rbuf_autotune = FALSE;
       resize_receive_buffer (self, g_value_get_uint (value));
       break;
     case PROP_SND_BUF:
       g_return_if_fail (self->priv->state == PSEUDO_TCP_LISTEN);
+      self->priv->sbuf_autotune = FALSE;
       resize_send_buffer (self, g_value_get_uint (value));
       break;
     case PROP_SUPPORT_FIN_ACK:
       self->priv->support_fin_ack = g_value_get_boolean (value);
       break;
+    case PROP_SUPPORT_SACK:
+      g_return_if_fail (self->priv->state == PSEUDO_TCP_LISTEN);
+      self->priv->support_sack = g_value_get_boolean (value);
+      break;
+    case PROP_CONGESTION_CONTROL:
+      g_return_if_fail (self->priv->state == PSEUDO_TCP_LISTEN);
+      set_congestion_control (self, g_value_get_uint (value));
+      break;
+    case PROP_RCV_BUF_MAX:
+      g_return_if_fail (self->priv->state == PSEUDO_TCP_LISTEN);
+      self->priv->rbuf_max = g_value_get_uint (value);
+      /* Pick the window scale factor for the new ceiling */
+      resize_receive_buffer (self, self->priv->rbuf_len);
+      break;
+    case PROP_SND_BUF_MAX:
+      self->priv->sbuf_max = g_value_get_uint (value);
+      break;
+    case PROP_MTU_DISCOVERY:
+      self->priv->mtu_discovery = g_value_get_boolean (value);
+      if (self->priv->state == PSEUDO_TCP_ESTABLISHED)
+        adjustMTU (self);
+      break;
+    case PROP_RACK_TLP:
+      self->priv->rack_tlp = g_value_get_boolean (value);
+      self->priv->rack_timer = self->priv->tlp_timer = 0;
+      break;
+    case PROP_PACING:
+      self->priv->pacing = g_value_get_boolean (value);
+      if (!self->priv->pacing && self->priv->pace_blocked) {
+        self->priv->pace_blocked = FALSE;
+        attempt_send (self, sfNone);
+      }
+      break;
+    case PROP_MAX_PACING_RATE:
+      self->priv->max_pacing_rate = g_value_get_uint (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -771,7 +1203,6 @@ pseudo_tcp_socket_finalize (GObject *object)
 {
   PseudoTcpSocket *self = PSEUDO_TCP_SOCKET (object);
   PseudoTcpSocketPrivate *priv = self->priv;
-  GList *i;
   SSegment *sseg;
 
   if (priv == NULL)
@@ -780,15 +1211,13 @@ pseudo_tcp_socket_finalize (GObject *object)
   while ((sseg = g_queue_pop_head (&priv->slist)))
     g_slice_free (SSegment, sseg);
   g_queue_clear (&priv->unsent_slist);
-  for (i = priv->rlist; i; i = i->next) {
-    RSegment *rseg = i->data;
-    g_slice_free (RSegment, rseg);
-  }
-  g_list_free (priv->rlist);
+  g_array_unref (priv->rlist);
+  g_array_unref (priv->rskips);
   priv->rlist = NULL;
 
   pseudo_tcp_fifo_clear (&priv->rbuf);
   pseudo_tcp_fifo_clear (&priv->sbuf);
+  g_atomic_pointer_add (&autotuned_memory, -(gssize) priv->autotuned_bytes);
 
   g_free (priv);
   self->priv = NULL;
@@ -816,10 +1245,20 @@ pseudo_tcp_socket_init (PseudoTcpSocket *obj)
   priv->sbuf_len = DEFAULT_SND_BUF_SIZE;
   pseudo_tcp_fifo_init (&priv->sbuf, priv->sbuf_len);
 
+  priv->rbuf_autotune = priv->sbuf_autotune = TRUE;
+  priv->rbuf_max = DEFAULT_RCV_BUF_MAX;
+  priv->sbuf_max = DEFAULT_SND_BUF_MAX;
+  priv->rcv_rtt = priv->rcvq_space = 0;
+  priv->rcv_rtt_seq = priv->rcv_rtt_time = 0;
+  priv->rcvq_copied = priv->rcvq_time = 0;
+  priv->autotuned_bytes = 0;
+
   priv->state = PSEUDO_TCP_LISTEN;
   priv->conv = 0;
   g_queue_init (&priv->slist);
   g_queue_init (&priv->unsent_slist);
+  priv->rlist = g_array_sized_new (FALSE, FALSE, sizeof (RSegment), 8);
+  priv->rskips = g_array_new (FALSE, FALSE, sizeof (RSkip));
   priv->rcv_wnd = priv->rbuf_len;
   priv->rwnd_scale = priv->swnd_scale = 0;
   priv->snd_nxt = 0;
@@ -835,6 +1274,11 @@ pseudo_tcp_socket_init (PseudoTcpSocket *obj)
   priv->largest = 0;
   priv->mss = MIN_PACKET - PACKET_OVERHEAD;
   priv->mtu_advise = DEF_MTU;
+  priv->mtu_discovery = FALSE;
+  priv->plpmtud_low = priv->plpmtud_high = 0;
+  priv->plpmtud_raise_time = 0;
+  priv->probe_size = priv->probe_seq = priv->probe_len = 0;
+  priv->probe_failures = 0;
 
   priv->rto_base = 0;
 
@@ -846,6 +1290,19 @@ pseudo_tcp_socket_init (PseudoTcpSocket *obj)
   priv->dup_acks = 0;
   priv->recover = 0;
   priv->last_acked_ts = 0;
+  priv->sacked_bytes = 0;
+  priv->sack_high = priv->sack_rexmit_nxt = 0;
+  priv->rack_tlp = FALSE;
+  priv->rack_xmit_time = priv->rack_end_seq = 0;
+  priv->rack_rtt = 0;
+  priv->rack_min_rtt = G_MAXUINT32;
+  priv->rack_timer = priv->tlp_timer = 0;
+  priv->tlp_outstanding = FALSE;
+  priv->tlp_high_seq = priv->tlp_xmit_time = 0;
+  priv->pacing = FALSE;
+  priv->max_pacing_rate = 0;
+  priv->pace_next = priv->pace_frac = 0;
+  priv->pace_blocked = FALSE;
 
   priv->ts_recent = priv->ts_lastack = 0;
 
@@ -857,6 +1314,14 @@ pseudo_tcp_socket_init (PseudoTcpSocket *obj)
 
   priv->support_wnd_scale = TRUE;
   priv->support_fin_ack = TRUE;
+  priv->support_sack = TRUE;
+  priv->support_forward = TRUE;
+  priv->fwd_seq = priv->fwd_time = 0;
+
+  set_congestion_control (obj, PSEUDO_TCP_CONGESTION_RENO);
+
+  /* Advertise a window scale factor which leaves room for autotuning */
+  resize_receive_buffer (obj, priv->rbuf_len);
 }
 
 PseudoTcpSocket *pseudo_tcp_socket_new (guint32 conversation,
@@ -887,7 +1352,8 @@ queue_connect_message (PseudoTcpSocket *self)
   if (priv->support_fin_ack) {
     buf[size++] = TCP_OPT_FIN_ACK;
     buf[size++] = 1;  /* option length; zero is invalid (RFC 1122, §4.2.2.5) */
-    buf[size++] = 0;  /* currently unused */
+    buf[size++] = (priv->support_sack ? FIN_ACK_OPT_SACK : 0) |
+        (priv->support_forward ? FIN_ACK_OPT_FORWARD : 0);
   }
 
   priv->snd_wnd = size;
@@ -970,6 +1436,42 @@ pseudo_tcp_socket_notify_clock(PseudoTcpSocket *self)
     attempt_send (self, sfFin);
   }
 
+  // Check if messages at the head of the queue are too old to be sent
+  abandon_expired_messages (self, now);
+
+  // Check if the receiver has missed the forward point
+  if (priv->fwd_time &&
+      time_diff (priv->fwd_time + priv->rx_rto, now) <= 0) {
+    DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Resending forward to %u", priv->fwd_seq);
+    packet (self, priv->fwd_seq, FLAG_FORWARD, 0, 0, now);
+    priv->fwd_time = now;
+  }
+
+  // Check if a segment sent before the latest delivered one is now lost
+  if (priv->rack_timer && time_diff (priv->rack_timer, now) <= 0) {
+    priv->rack_timer = 0;
+    if (priv->dup_acks < 3 && rack_detect_loss (self, now)) {
+      int transmit_status = enter_recovery (self, now);
+
+      if (transmit_status != 0) {
+        closedown (self, transmit_status, CLOSEDOWN_LOCAL);
+        return;
+      }
+    }
+  }
+
+  // Check if it's time to send a tail loss probe
+  if (priv->tlp_timer && time_diff (priv->tlp_timer, now) <= 0) {
+    int transmit_status;
+
+    priv->tlp_timer = 0;
+    transmit_status = tlp_send_probe (self, now);
+    if (transmit_status != 0) {
+      closedown (self, transmit_status, CLOSEDOWN_LOCAL);
+      return;
+    }
+  }
+
   // Check if it's time to retransmit a segment
   if (priv->rto_base &&
       (time_diff(priv->rto_base + priv->rx_rto, now) <= 0)) {
@@ -978,7 +1480,6 @@ pseudo_tcp_socket_notify_clock(PseudoTcpSocket *self)
     } else {
       // Note: (priv->slist.front().xmit == 0)) {
       // retransmit segments
-      guint32 nInFlight;
       guint32 rto_limit;
       int transmit_status;
 
@@ -986,6 +1487,10 @@ pseudo_tcp_socket_notify_clock(PseudoTcpSocket *self)
           "(rto_base: %u) (now: %u) (dup_acks: %u)",
           priv->rx_rto, priv->rto_base, now, (guint) priv->dup_acks);
 
+      if (priv->mtu_discovery &&
+          ((SSegment *) g_queue_peek_head (&priv->slist))->xmit >= 2)
+        plpmtud_black_hole (self);
+
       transmit_status = transmit(self, g_queue_peek_head (&priv->slist), now);
       if (transmit_status != 0) {
         DEBUG (PSEUDO_TCP_DEBUG_NORMAL,
@@ -994,12 +1499,7 @@ pseudo_tcp_socket_notify_clock(PseudoTcpSocket *self)
         return;
       }
 
-      nInFlight = priv->snd_nxt - priv->snd_una;
-      priv->ssthresh = max(nInFlight / 2, 2 * priv->mss);
-      DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "ssthresh: %u = (nInFlight: %u / 2) + "
-          "2 * mss: %u", priv->ssthresh, nInFlight, priv->mss);
-      //LOG(LS_INFO) << "priv->ssthresh: " << priv->ssthresh << "  nInFlight: " << nInFlight << "  priv->mss: " << priv->mss;
-      priv->cwnd = priv->mss;
+      priv->cc->on_rto (self, now);
 
       // Back off retransmit timer.  Note: the limit is lower when connecting.
       rto_limit = (priv->state < PSEUDO_TCP_ESTABLISHED) ? DEF_RTO : MAX_RTO;
@@ -1012,9 +1512,23 @@ pseudo_tcp_socket_notify_clock(PseudoTcpSocket *self)
         priv->fast_recovery = FALSE;
         DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "exit recovery on timeout");
       }
+
+      /* The receiver may have discarded SACKed data (RFC 2018, §8) */
+      sack_clear_scoreboard (self);
+
+      priv->tlp_timer = priv->rack_timer = 0;
+      priv->tlp_outstanding = FALSE;
     }
   }
 
+  // Check if paced data may be sent now
+  if (priv->pace_blocked && time_diff (priv->pace_next, now) <= 0) {
+    priv->pace_blocked = FALSE;
+    attempt_send (self, sfNone);
+    if (priv->state == PSEUDO_TCP_CLOSED)
+      return;
+  }
+
   // Check if it's time to probe closed windows
   if ((priv->snd_wnd == 0)
         && (time_diff(priv->lastsend + priv->rx_rto, now) <= 0)) {
@@ -1167,6 +1681,23 @@ pseudo_tcp_socket_get_next_clock(PseudoTcpSocket *self, guint64 *timeout)
   if (priv->t_ack) {
     *timeout = min(*timeout, priv->t_ack + priv->ack_delay);
   }
+  if (priv->rack_timer) {
+    *timeout = min(*timeout, priv->rack_timer);
+  }
+  if (priv->tlp_timer) {
+    *timeout = min(*timeout, priv->tlp_timer);
+  }
+  if (priv->pace_blocked) {
+    *timeout = min(*timeout, priv->pace_next);
+  }
+  if (priv->support_forward) {
+    SSegment *head = g_queue_peek_head (&priv->slist);
+
+    if (head != NULL && head->deadline != 0)
+      *timeout = min(*timeout, head->deadline);
+    if (priv->fwd_time)
+      *timeout = min(*timeout, priv->fwd_time + priv->rx_rto);
+  }
   if (priv->rto_base) {
     *timeout = min(*timeout, priv->rto_base + priv->rx_rto);
   }
@@ -1178,12 +1709,34 @@ pseudo_tcp_socket_get_next_clock(PseudoTcpSocket *self, guint64 *timeout)
 }
 
 
+/* Advertises the space freed in rbuf once it is worth a segment. */
+static void
+reopen_receive_window (PseudoTcpSocket *self)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+  gsize available_space;
+
+  available_space = pseudo_tcp_fifo_get_write_remaining (&priv->rbuf);
+
+  if (available_space - priv->rcv_wnd >=
+      min (priv->rbuf_len / 2, priv->mss)) {
+    // !?! Not sure about this was closed business
+    gboolean bWasClosed = (priv->rcv_wnd == 0);
+
+    priv->rcv_wnd = available_space;
+
+    if (bWasClosed) {
+      attempt_send(self, sfImmediateAck);
+    }
+  }
+}
+
 gint
 pseudo_tcp_socket_recv(PseudoTcpSocket *self, char * buffer, size_t len)
 {
   PseudoTcpSocketPrivate *priv = self->priv;
   gsize bytesread;
-  gsize available_space;
+  gsize readable;
 
   /* Received a FIN from the peer, so return 0. RFC 793, §3.5, Case 2. */
   if (priv->support_fin_ack && priv->shutdown_reads) {
@@ -1205,32 +1758,105 @@ pseudo_tcp_socket_recv(PseudoTcpSocket *self, char * buffer, size_t len)
   if (len == 0)
     return 0;
 
-  bytesread = pseudo_tcp_fifo_read (&priv->rbuf, (guint8 *) buffer, len);
+  // Never read across data the sender abandoned
+  readable = rskips_trim (self);
+  bytesread = pseudo_tcp_fifo_read (&priv->rbuf, (guint8 *) buffer,
+      min (len, readable));
+  rskips_advance (self, bytesread);
 
  // If there's no data in |m_rbuf|.
   if (bytesread == 0 &&
       !(pseudo_tcp_state_has_received_fin (priv->state) ||
         pseudo_tcp_state_has_received_fin_ack (priv->state))) {
+    reopen_receive_window (self);
     priv->bReadEnable = TRUE;
     priv->error = EWOULDBLOCK;
     return -1;
   }
 
-  available_space = pseudo_tcp_fifo_get_write_remaining (&priv->rbuf);
+  autotune_receive_buffer (self, bytesread);
+  reopen_receive_window (self);
 
-  if (available_space - priv->rcv_wnd >=
-      min (priv->rbuf_len / 2, priv->mss)) {
-    // !?! Not sure about this was closed business
-    gboolean bWasClosed = (priv->rcv_wnd == 0);
+  return bytesread;
+}
 
-    priv->rcv_wnd = available_space;
+gint
+pseudo_tcp_socket_recv_message (PseudoTcpSocket *self, char *buffer,
+    size_t len)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+  guint8 header[MESSAGE_HEADER_SIZE];
+  guint32 msg_len;
+  gsize readable;
 
-    if (bWasClosed) {
-      attempt_send(self, sfImmediateAck);
+  if (priv->support_fin_ack && priv->shutdown_reads)
+    return 0;
+
+  if (priv->state != PSEUDO_TCP_ESTABLISHED &&
+      !pseudo_tcp_state_has_received_fin (priv->state) &&
+      !pseudo_tcp_state_has_received_fin_ack (priv->state)) {
+    priv->error = ENOTCONN;
+    return -1;
+  }
+
+  while (TRUE) {
+    readable = rskips_trim (self);
+
+    if (readable < MESSAGE_HEADER_SIZE) {
+      // A message cut short by abandoned data is never completed
+      if (readable > 0 && priv->rskips->len > 0) {
+        pseudo_tcp_fifo_consume_read_data (&priv->rbuf, readable);
+        rskips_advance (self, readable);
+        continue;
+      }
+      break;
+    }
+
+    pseudo_tcp_fifo_read_offset (&priv->rbuf, header, MESSAGE_HEADER_SIZE, 0);
+    memcpy (&msg_len, header, MESSAGE_HEADER_SIZE);
+    msg_len = GUINT32_FROM_BE (msg_len);
+
+    if (msg_len == 0 || msg_len > MAX_MESSAGE_SIZE) {
+      priv->error = EBADMSG;
+      return -1;
+    }
+
+    if (readable < MESSAGE_HEADER_SIZE + msg_len) {
+      if (priv->rskips->len > 0) {
+        DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Dropping %" G_GSIZE_FORMAT " bytes of "
+            "a partially abandoned message", readable);
+        pseudo_tcp_fifo_consume_read_data (&priv->rbuf, readable);
+        rskips_advance (self, readable);
+        continue;
+      }
+      break;
     }
+
+    if (len < msg_len) {
+      priv->error = EMSGSIZE;
+      return -1;
+    }
+
+    pseudo_tcp_fifo_consume_read_data (&priv->rbuf, MESSAGE_HEADER_SIZE);
+    pseudo_tcp_fifo_read (&priv->rbuf, (guint8 *) buffer, msg_len);
+    rskips_advance (self, MESSAGE_HEADER_SIZE + msg_len);
+
+    autotune_receive_buffer (self, MESSAGE_HEADER_SIZE + msg_len);
+    reopen_receive_window (self);
+
+    return msg_len;
   }
 
-  return bytesread;
+  reopen_receive_window (self);
+
+  // The peer sent a FIN after its last complete message
+  if (pseudo_tcp_state_has_received_fin (priv->state) ||
+      pseudo_tcp_state_has_received_fin_ack (priv->state))
+    return 0;
+
+  priv->bReadEnable = TRUE;
+  priv->error = EWOULDBLOCK;
+  return -1;
 }
 
 gint
@@ -1255,6 +1881,8 @@ pseudo_tcp_socket_send(PseudoTcpSocket *self, const char * buffer, guint32 len)
 
   written = queue (self, buffer, len, FLAG_NONE);
   attempt_send(self, sfNone);
+  if (priv->tlp_timer == 0)
+    tlp_arm (self, get_current_time (self));
 
   if (written > 0 && (guint32)written < len) {
     priv->bWriteEnable = TRUE;
@@ -1263,6 +1891,46 @@ pseudo_tcp_socket_send(PseudoTcpSocket *self, const char * buffer, guint32 len)
   return written;
 }
 
+gint
+pseudo_tcp_socket_send_message (PseudoTcpSocket *self, const char *buffer,
+    guint32 len, guint32 lifetime)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+  guint32 now = get_current_time (self);
+  guint32 deadline = 0;
+
+  if (priv->state != PSEUDO_TCP_ESTABLISHED) {
+    priv->error = pseudo_tcp_state_has_sent_fin (priv->state) ? EPIPE : ENOTCONN;
+    return -1;
+  }
+
+  if (len == 0 || len > MAX_MESSAGE_SIZE) {
+    priv->error = EMSGSIZE;
+    return -1;
+  }
+
+  if (pseudo_tcp_fifo_get_write_remaining (&priv->sbuf) <
+      MESSAGE_HEADER_SIZE + len) {
+    priv->bWriteEnable = TRUE;
+    priv->error = EWOULDBLOCK;
+    return -1;
+  }
+
+  // A peer which can't skip abandoned data gets everything
+  if (lifetime > 0 && priv->support_forward) {
+    deadline = now + lifetime;
+    if (deadline == 0)
+      deadline = 1;
+  }
+
+  queue_message (self, buffer, len, deadline);
+  attempt_send (self, sfNone);
+  if (priv->tlp_timer == 0)
+    tlp_arm (self, get_current_time (self));
+
+  return len;
+}
+
 void
 pseudo_tcp_socket_close(PseudoTcpSocket *self, gboolean force)
 {
@@ -1382,9 +2050,11 @@ queue (PseudoTcpSocket *self, const gchar * data, guint32 len, TcpFlags flags)
 
   // We can concatenate data if the last segment is the same type
   // (control v. regular data), and has not been transmitted yet
+  // (and isn't a message which may be abandoned on its own)
   if (g_queue_get_length (&priv->slist) &&
       (((SSegment *)g_queue_peek_tail (&priv->slist))->flags == flags) &&
-      (((SSegment *)g_queue_peek_tail (&priv->slist))->xmit == 0)) {
+      (((SSegment *)g_queue_peek_tail (&priv->slist))->xmit == 0) &&
+      (((SSegment *)g_queue_peek_tail (&priv->slist))->deadline == 0)) {
     ((SSegment *)g_queue_peek_tail (&priv->slist))->len += len;
   } else {
     SSegment *sseg = g_slice_new0 (SSegment);
@@ -1401,6 +2071,37 @@ queue (PseudoTcpSocket *self, const gchar * data, guint32 len, TcpFlags flags)
   return pseudo_tcp_fifo_write (&priv->sbuf, (guint8*) data, len);;
 }
 
+/* Queues a length-prefixed message as a segment of its own, so that it can be
+ * abandoned at @deadline (see abandon_expired_messages()). The caller has
+ * checked there is space for it. */
+static void
+queue_message (PseudoTcpSocket *self, const gchar *data, guint32 len,
+    guint32 deadline)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+  guint32 header = GUINT32_TO_BE (len);
+  SSegment *sseg;
+
+  if (deadline == 0) {
+    queue (self, (const gchar *) &header, MESSAGE_HEADER_SIZE, FLAG_NONE);
+    queue (self, data, len, FLAG_NONE);
+    return;
+  }
+
+  sseg = g_slice_new0 (SSegment);
+  sseg->seq = priv->snd_una + pseudo_tcp_fifo_get_buffered (&priv->sbuf);
+  sseg->len = MESSAGE_HEADER_SIZE + len;
+  sseg->flags = FLAG_NONE;
+  sseg->deadline = deadline;
+  sseg->msg_end = sseg->seq + sseg->len;
+  g_queue_push_tail (&priv->slist, sseg);
+  g_queue_push_tail (&priv->unsent_slist, sseg);
+
+  pseudo_tcp_fifo_write (&priv->sbuf, (const guint8 *) &header,
+      MESSAGE_HEADER_SIZE);
+  pseudo_tcp_fifo_write (&priv->sbuf, (const guint8 *) data, len);
+}
+
 // Creates a packet and submits it to the network. This method can either
 // send payload or just an ACK packet.
 //
@@ -1421,9 +2122,17 @@ packet(PseudoTcpSocket *self, guint32 seq, TcpFlags flags,
     guint32 u32[MAX_PACKET / 4];
   } buffer;
   PseudoTcpWriteResult wres = WR_SUCCESS;
+  guint32 sack_len = 0;
 
   g_assert (HEADER_SIZE + len <= MAX_PACKET);
 
+  // Pure ACKs also report the out-of-order data we are holding
+  if (len == 0 && flags == FLAG_NONE && priv->support_sack &&
+      priv->rlist->len > 0) {
+    sack_len = sack_write_blocks (self, buffer.u8 + HEADER_SIZE);
+    flags |= FLAG_SACK;
+  }
+
   *buffer.u32 = htonl(priv->conv);
   *(buffer.u32 + 1) = htonl(seq);
   *(buffer.u32 + 2) = htonl(priv->rcv_nxt);
@@ -1449,7 +2158,8 @@ packet(PseudoTcpSocket *self, guint32 seq, TcpFlags flags,
       priv->conv, (unsigned)flags, seq, seq + len, priv->rcv_nxt, priv->rcv_wnd,
       now % 10000, priv->ts_recent % 10000, len);
 
-  wres = priv->callbacks.WritePacket(self, (gchar *) buffer.u8, len + HEADER_SIZE,
+  wres = priv->callbacks.WritePacket(self, (gchar *) buffer.u8,
+                                     len + sack_len + HEADER_SIZE,
                                      priv->callbacks.user_data);
   /* Note: When len is 0, this is an ACK packet.  We don't read the
      return value for those, and thus we won't retry.  So go ahead and treat
@@ -1592,6 +2302,8 @@ process(PseudoTcpSocket *self, Segment *seg)
   guint32 kIdealRefillSize;
   gboolean is_valuable_ack, is_duplicate_ack, is_fin_ack = FALSE;
   gboolean received_fin = FALSE;
+  const gchar *sack_data = NULL;
+  guint32 sack_len = 0;
 
   /* If this is the wrong conversation, send a reset!?!
      (with the correct conversation?) */
@@ -1607,6 +2319,13 @@ process(PseudoTcpSocket *self, Segment *seg)
   priv->last_traffic = priv->lastrecv = now;
   priv->bOutgoing = FALSE;
 
+  /* The SACK blocks describe data we sent; they are not part of the stream. */
+  if ((seg->flags & FLAG_SACK) && priv->support_sack) {
+    sack_data = seg->data;
+    sack_len = seg->len;
+    seg->len = 0;
+  }
+
   if (priv->state == PSEUDO_TCP_CLOSED ||
       (pseudo_tcp_state_has_received_fin_ack (priv->state) && seg->len > 0)) {
     /* Send an RST segment. See: RFC 1122, §4.2.2.13; RFC 793, §3.4, point 3,
@@ -1658,18 +2377,29 @@ process(PseudoTcpSocket *self, Segment *seg)
     priv->ts_recent = seg->tsval;
   }
 
+  if (sack_len > 0)
+    sack_update_scoreboard (self, (const guint8 *) sack_data, sack_len, now);
+
   // Check if this is a valuable ack
   is_valuable_ack = (LARGER(seg->ack, priv->snd_una) &&
       SMALLER_OR_EQUAL(seg->ack, priv->snd_nxt));
   is_duplicate_ack = (seg->ack == priv->snd_una);
 
+  // The ACK of a forward point tells nothing about losses
+  if (priv->fwd_time && LARGER_OR_EQUAL (seg->ack, priv->fwd_seq)) {
+    priv->fwd_time = 0;
+    is_duplicate_ack = FALSE;
+  }
+
   if (is_valuable_ack) {
     guint32 nAcked;
     guint32 nFree;
+    gboolean in_recovery;
+    long rtt = -1;
 
     // Calculate round-trip time
     if (seg->tsecr) {
-      long rtt = time_diff(now, seg->tsecr);
+      rtt = time_diff(now, seg->tsecr);
       if (rtt >= 0) {
         if (priv->rx_srtt == 0) {
           priv->rx_srtt = rtt;
@@ -1697,6 +2427,23 @@ process(PseudoTcpSocket *self, Segment *seg)
     nAcked = seg->ack - priv->snd_una;
     priv->snd_una = seg->ack;
 
+    if (priv->probe_size != 0 &&
+        LARGER_OR_EQUAL (priv->snd_una, priv->probe_seq + priv->probe_len))
+      plpmtud_probe_acked (self);
+
+    if (priv->tlp_outstanding &&
+        LARGER_OR_EQUAL (priv->snd_una, priv->tlp_high_seq)) {
+      priv->tlp_outstanding = FALSE;
+      /* An ACK echoing the timestamp of the probe was triggered by it, so
+       * the probe repaired a loss which still needs a congestion response
+       * (RFC 8985, §7.4). Otherwise the original segment got there. */
+      if (seg->tsecr && time_diff (seg->tsecr, priv->tlp_xmit_time) >= 0) {
+        DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Tail loss probe repaired a loss");
+        priv->cc->on_loss (self, now);
+        priv->cwnd = min (priv->cwnd, priv->ssthresh);
+      }
+    }
+
     priv->rto_base = (priv->snd_una == priv->snd_nxt) ? 0 : now;
 
     /* ACKs for FIN segments give an increment on nAcked, but there is no
@@ -1716,7 +2463,12 @@ process(PseudoTcpSocket *self, Segment *seg)
       g_assert (g_queue_get_length (&priv->slist) != 0);
       data = (SSegment *) g_queue_peek_head (&priv->slist);
 
+      if (!data->sacked)
+        rack_update (self, data, now);
+
       if (nFree < data->len) {
+        if (data->sacked)
+          priv->sacked_bytes -= nFree;
         data->len -= nFree;
         data->seq += nFree;
         nFree = 0;
@@ -1724,13 +2476,16 @@ process(PseudoTcpSocket *self, Segment *seg)
         if (data->len > priv->largest) {
           priv->largest = data->len;
         }
+        if (data->sacked)
+          priv->sacked_bytes -= data->len;
         nFree -= data->len;
         g_slice_free (SSegment, data);
         g_queue_pop_head (&priv->slist);
       }
     }
 
-    if (priv->dup_acks >= 3) {
+    in_recovery = (priv->dup_acks >= 3);
+    if (in_recovery) {
       if (LARGER_OR_EQUAL (priv->snd_una, priv->recover)) { // NewReno
         guint32 nInFlight = priv->snd_nxt - priv->snd_una;
         // (Fast Retransmit)
@@ -1743,25 +2498,30 @@ process(PseudoTcpSocket *self, Segment *seg)
         int transmit_status;
 
         DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "recovery retransmit");
-        transmit_status = transmit(self, g_queue_peek_head (&priv->slist), now);
+        if (priv->support_sack) {
+          // Partial ack: repair whatever holes the scoreboard still has
+          transmit_status = sack_retransmit_holes (self, now);
+        } else {
+          transmit_status = transmit(self, g_queue_peek_head (&priv->slist),
+              now);
+        }
         if (transmit_status != 0) {
           DEBUG (PSEUDO_TCP_DEBUG_NORMAL,
               "Error transmitting recovery retransmit segment. Closing down.");
           closedown (self, transmit_status, CLOSEDOWN_LOCAL);
           return FALSE;
         }
-        priv->cwnd += (nAcked > priv->mss ? priv->mss : 0) -
-            min(nAcked, priv->cwnd);
+        if (!priv->support_sack) {
+          priv->cwnd += (nAcked > priv->mss ? priv->mss : 0) -
+              min(nAcked, priv->cwnd);
+        }
       }
     } else {
       priv->dup_acks = 0;
-      // Slow start, congestion avoidance
-      if (priv->cwnd < priv->ssthresh) {
-        priv->cwnd += priv->mss;
-      } else {
-        priv->cwnd += max(1LU, priv->mss * priv->mss / priv->cwnd);
-      }
     }
+
+    priv->cc->on_ack (self, nAcked, rtt, in_recovery, now);
+    autotune_send_buffer (self);
   } else if (is_duplicate_ack) {
     /* !?! Note, tcp says don't do this... but otherwise how does a
        closed window become open? */
@@ -1771,8 +2531,6 @@ process(PseudoTcpSocket *self, Segment *seg)
     if (seg->len > 0) {
       // it's a dup ack, but with a data payload, so don't modify priv->dup_acks
     } else if (priv->snd_una != priv->snd_nxt) {
-      guint32 nInFlight;
-
       priv->dup_acks += 1;
       DEBUG (PSEUDO_TCP_DEBUG_VERBOSE, "Received dup ack (dups: %u)",
           priv->dup_acks);
@@ -1780,14 +2538,21 @@ process(PseudoTcpSocket *self, Segment *seg)
         int transmit_status;
 
 
-        if (LARGER_OR_EQUAL (priv->snd_una, priv->recover) ||
+        if (priv->probe_size != 0 && priv->snd_una == priv->probe_seq) {
+          /* The hole is an MTU probe, which says nothing about congestion:
+           * resend its data at the current MSS without entering recovery,
+           * like Linux's tcp_mtup_probe_failed(). */
+          DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "MTU probe lost");
+          transmit_status = plpmtud_retransmit_probe (self, now);
+          if (transmit_status != 0) {
+            closedown (self, transmit_status, CLOSEDOWN_LOCAL);
+            return FALSE;
+          }
+          priv->dup_acks = 0;
+        } else if (LARGER_OR_EQUAL (priv->snd_una, priv->recover) ||
             seg->tsecr == priv->last_acked_ts) { /* NewReno */
           /* Invoke fast retransmit  RFC3782 section 3 step 1A*/
-          DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "enter recovery");
-          DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "recovery retransmit");
-
-          transmit_status = transmit(self, g_queue_peek_head (&priv->slist),
-              now);
+          transmit_status = enter_recovery (self, now);
           if (transmit_status != 0) {
             DEBUG (PSEUDO_TCP_DEBUG_NORMAL,
                 "Error transmitting recovery retransmit segment. Closing down.");
@@ -1795,28 +2560,41 @@ process(PseudoTcpSocket *self, Segment *seg)
             closedown (self, transmit_status, CLOSEDOWN_LOCAL);
             return FALSE;
           }
-          priv->recover = priv->snd_nxt;
-          nInFlight = priv->snd_nxt - priv->snd_una;
-          priv->ssthresh = max(nInFlight / 2, 2 * priv->mss);
-          DEBUG (PSEUDO_TCP_DEBUG_NORMAL,
-              "ssthresh: %u = max((nInFlight: %u / 2), 2 * mss: %u)",
-              priv->ssthresh, nInFlight, priv->mss);
-          priv->cwnd = priv->ssthresh + 3 * priv->mss;
-          priv->fast_recovery = TRUE;
         } else {
           DEBUG (PSEUDO_TCP_DEBUG_VERBOSE,
               "Skipping fast recovery: recover: %u snd_una: %u", priv->recover,
               priv->snd_una);
         }
       } else if (priv->dup_acks > 3) {
-        if (priv->fast_recovery)
-          priv->cwnd += priv->mss;
+        if (priv->fast_recovery && priv->support_sack) {
+          int transmit_status = sack_retransmit_holes (self, now);
+
+          if (transmit_status != 0) {
+            closedown (self, transmit_status, CLOSEDOWN_LOCAL);
+            return FALSE;
+          }
+        } else if (priv->fast_recovery) {
+          priv->cwnd += priv->mss;
+        }
       }
     } else {
       priv->dup_acks = 0;
     }
   }
 
+  // A segment sent after the head was delivered: the head may be lost
+  // without there being three duplicate ACKs
+  if (priv->rack_tlp && priv->dup_acks < 3 &&
+      LARGER_OR_EQUAL (priv->snd_una, priv->recover) &&
+      rack_detect_loss (self, now)) {
+    int transmit_status = enter_recovery (self, now);
+
+    if (transmit_status != 0) {
+      closedown (self, transmit_status, CLOSEDOWN_LOCAL);
+      return FALSE;
+    }
+  }
+
   // !?! A bit hacky
   if ((priv->state == PSEUDO_TCP_SYN_RECEIVED) && !bConnect) {
     set_state_established (self);
@@ -1984,6 +2762,11 @@ process(PseudoTcpSocket *self, Segment *seg)
 
   bNewData = FALSE;
 
+  if ((seg->flags & FLAG_FORWARD) && priv->support_forward && !bIgnoreData) {
+    bNewData = receive_forward (self, seg->seq);
+    sflags = sfImmediateAck;
+  }
+
   if (seg->len > 0) {
     if (bIgnoreData) {
       if (seg->seq == priv->rcv_nxt) {
@@ -1998,43 +2781,19 @@ process(PseudoTcpSocket *self, Segment *seg)
       g_assert (res == seg->len);
 
       if (seg->seq == priv->rcv_nxt) {
-        GList *iter = NULL;
-
         pseudo_tcp_fifo_consume_write_buffer (&priv->rbuf, seg->len);
         priv->rcv_nxt += seg->len;
         priv->rcv_wnd -= seg->len;
         bNewData = TRUE;
 
-        iter = priv->rlist;
-        while (iter &&
-            SMALLER_OR_EQUAL(((RSegment *)iter->data)->seq, priv->rcv_nxt)) {
-          RSegment *data = (RSegment *)(iter->data);
-          if (LARGER (data->seq + data->len, priv->rcv_nxt)) {
-            guint32 nAdjust = (data->seq + data->len) - priv->rcv_nxt;
-            sflags = sfImmediateAck; // (Fast Recovery)
-            DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Recovered %u bytes (%u -> %u)",
-                nAdjust, priv->rcv_nxt, priv->rcv_nxt + nAdjust);
-            pseudo_tcp_fifo_consume_write_buffer (&priv->rbuf, nAdjust);
-            priv->rcv_nxt += nAdjust;
-            priv->rcv_wnd -= nAdjust;
-          }
-          g_slice_free (RSegment, priv->rlist->data);
-          priv->rlist = g_list_delete_link (priv->rlist, priv->rlist);
-          iter = priv->rlist;
-        }
-      } else {
-        GList *iter = NULL;
-        RSegment *rseg = g_slice_new0 (RSegment);
+        update_receive_rtt (self, now);
 
+        if (rlist_consume (self) > 0)
+          sflags = sfImmediateAck; // (Fast Recovery)
+      } else {
         DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Saving %u bytes (%u -> %u)",
             seg->len, seg->seq, seg->seq + seg->len);
-        rseg->seq = seg->seq;
-        rseg->len = seg->len;
-        iter = priv->rlist;
-        while (iter && SMALLER (((RSegment*)iter->data)->seq, rseg->seq)) {
-          iter = g_list_next (iter);
-        }
-        priv->rlist = g_list_insert_before(priv->rlist, iter, rseg);
+        rlist_insert (self, seg->seq, seg->len);
       }
     }
   }
@@ -2046,6 +2805,7 @@ process(PseudoTcpSocket *self, Segment *seg)
 
 
   attempt_send(self, sflags);
+  tlp_arm (self, now);
 
   // If we have new data, notify the user
   if (bNewData && priv->bReadEnable) {
@@ -2064,13 +2824,26 @@ static gboolean
 transmit(PseudoTcpSocket *self, SSegment *segment, guint32 now)
 {
   PseudoTcpSocketPrivate *priv = self->priv;
-  guint32 nTransmit = min(segment->len, priv->mss);
+  gboolean is_probe = (priv->probe_size != 0 &&
+      segment->seq == priv->probe_seq);
+  guint32 nTransmit;
 
   if (segment->xmit >= ((priv->state == PSEUDO_TCP_ESTABLISHED) ? 15 : 30)) {
     DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "too many retransmits");
     return ETIMEDOUT;
   }
 
+  if (is_probe && segment->xmit > 0) {
+    // Sending a probe again means it was lost
+    plpmtud_probe_lost (self, FALSE);
+    is_probe = FALSE;
+  }
+
+  if (is_probe)
+    nTransmit = min (segment->len, priv->probe_len);
+  else
+    nTransmit = min (segment->len, priv->mss);
+
   while (TRUE) {
     guint32 seq = segment->seq;
     guint8 flags = segment->flags;
@@ -2086,12 +2859,21 @@ transmit(PseudoTcpSocket *self, SSegment *segment, guint32 now)
     if (wres == WR_SUCCESS)
       break;
 
-    if (wres == WR_FAIL) {
+    if (wres == WR_FAIL && !is_probe) {
       DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "packet failed");
       return ECONNABORTED;  /* FIXME: This error code doesn’t quite seem right */
     }
 
-    g_assert (wres == WR_TOO_LARGE);
+    /* The lower layer may not distinguish between EMSGSIZE and other errors,
+     * so a probe which can't be sent is taken to be too large. */
+    g_assert (wres == WR_TOO_LARGE || is_probe);
+
+    if (is_probe) {
+      plpmtud_probe_lost (self, TRUE);
+      is_probe = FALSE;
+      nTransmit = min (segment->len, priv->mss);
+      continue;
+    }
 
     while (TRUE) {
       if (PACKET_MAXIMUMS[priv->msslevel + 1] == 0) {
@@ -2113,12 +2895,19 @@ transmit(PseudoTcpSocket *self, SSegment *segment, guint32 now)
     DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Adjusting mss to %u bytes ", priv->mss);
   }
 
+  segment->xmit_time = now;
+  pacing_charge (self, nTransmit, now);
+
   if (nTransmit < segment->len) {
     SSegment *subseg = g_slice_new0 (SSegment);
     subseg->seq = segment->seq + nTransmit;
     subseg->len = segment->len - nTransmit;
     subseg->flags = segment->flags;
     subseg->xmit = segment->xmit;
+    subseg->sacked = segment->sacked;
+    subseg->xmit_time = segment->xmit_time;
+    subseg->deadline = segment->deadline;
+    subseg->msg_end = segment->msg_end;
 
     DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "mss reduced to %u", priv->mss);
 
@@ -2166,8 +2955,10 @@ attempt_send(PseudoTcpSocket *self, SendFlags sflags)
     guint32 cwnd;
     guint32 nWindow;
     guint32 nInFlight;
+    guint32 nPipe;
     guint32 nUseable;
     guint32 nAvailable;
+    guint32 nProbe;
     gsize snd_buffered;
     GList *iter;
     SSegment *sseg;
@@ -2179,13 +2970,26 @@ attempt_send(PseudoTcpSocket *self, SendFlags sflags)
     }
     nWindow = min(priv->snd_wnd, cwnd);
     nInFlight = priv->snd_nxt - priv->snd_una;
-    nUseable = (nInFlight < nWindow) ? (nWindow - nInFlight) : 0;
+    // SACKed data has already left the network
+    nPipe = nInFlight - priv->sacked_bytes;
+    nUseable = (nPipe < nWindow) ? (nWindow - nPipe) : 0;
     snd_buffered = pseudo_tcp_fifo_get_buffered (&priv->sbuf);
-    if (snd_buffered < nInFlight)  /* iff a FIN has been sent */
+    nProbe = 0;
+    if (snd_buffered < nInFlight) { /* iff a FIN has been sent */
       nAvailable = 0;
-    else
+    } else {
       nAvailable = min(snd_buffered - nInFlight, priv->mss);
 
+      // Only probe with a full probe's worth of data and window
+      nProbe = plpmtud_probe_size (self, now);
+      if (nProbe != 0 &&
+          snd_buffered - nInFlight >= nProbe - PACKET_OVERHEAD &&
+          nUseable >= nProbe - PACKET_OVERHEAD)
+        nAvailable = nProbe - PACKET_OVERHEAD;
+      else
+        nProbe = 0;
+    }
+
     if (nAvailable > nUseable) {
       if (nUseable * 4 < nWindow) {
         // RFC 813 - avoid SWS
@@ -2206,6 +3010,11 @@ attempt_send(PseudoTcpSocket *self, SendFlags sflags)
           available_space, snd_buffered - nInFlight, priv->ssthresh);
     }
 
+    // Leave the rest of the window to the pacing timer
+    if (nAvailable > 0 && sflags != sfFin && sflags != sfRst &&
+        pacing_blocked (self, now))
+      nAvailable = 0;
+
     if (sflags == sfDuplicateAck) {
       packet(self, priv->snd_nxt, 0, 0, 0, now);
       sflags = sfNone;
@@ -2242,12 +3051,26 @@ attempt_send(PseudoTcpSocket *self, SendFlags sflags)
       return;
     sseg = iter->data;
 
+    if (nProbe != 0) {
+      if (sseg->len < nAvailable || sseg->flags != FLAG_NONE ||
+          sflags == sfFin || sflags == sfRst) {
+        nAvailable = min (nAvailable, priv->mss);
+      } else {
+        DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Probing MTU %u", nProbe);
+        priv->probe_size = nProbe;
+        priv->probe_seq = sseg->seq;
+        priv->probe_len = nAvailable;
+      }
+    }
+
     // If the segment is too large, break it into two
     if (sseg->len > nAvailable && sflags != sfFin && sflags != sfRst) {
       SSegment *subseg = g_slice_new0 (SSegment);
       subseg->seq = sseg->seq + nAvailable;
       subseg->len = sseg->len - nAvailable;
       subseg->flags = sseg->flags;
+      subseg->deadline = sseg->deadline;
+      subseg->msg_end = sseg->msg_end;
 
       sseg->len = nAvailable;
       g_queue_insert_after (&priv->unsent_slist, iter, subseg);
@@ -2269,232 +3092,1256 @@ attempt_send(PseudoTcpSocket *self, SendFlags sflags)
   }
 }
 
-/* If @source is %CLOSEDOWN_REMOTE, don’t send an RST packet, since closedown()
- * has been called as a result of an RST segment being received.
- * See: RFC 1122, §4.2.2.13. */
+/* Adds the out-of-order range [@seq, @seq + @len) to rlist. The range to
+ * insert at is found by binary search, and the ranges it overlaps or touches
+ * are merged into one, so the array never holds more ranges than there are
+ * holes in the receive window and no allocation is needed per segment. */
 static void
-closedown (PseudoTcpSocket *self, guint32 err, ClosedownSource source)
+rlist_insert (PseudoTcpSocket *self, guint32 seq, guint32 len)
 {
   PseudoTcpSocketPrivate *priv = self->priv;
+  GArray *rlist = priv->rlist;
+  guint32 end = seq + len;
+  guint lo = 0, hi = rlist->len, first, last;
 
-  DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Closing down socket %p with %s error %u.",
-      self, (source == CLOSEDOWN_LOCAL) ? "local" : "remote", err);
+  // Find the first range which doesn't end before the new one starts
+  while (lo < hi) {
+    guint mid = lo + (hi - lo) / 2;
+    RSegment *rseg = &g_array_index (rlist, RSegment, mid);
 
-  if (source == CLOSEDOWN_LOCAL && priv->support_fin_ack) {
-    queue_rst_message (self);
-    attempt_send (self, sfRst);
-  } else if (source == CLOSEDOWN_LOCAL) {
-    priv->shutdown = SD_FORCEFUL;
+    if (SMALLER (rseg->seq + rseg->len, seq))
+      lo = mid + 1;
+    else
+      hi = mid;
   }
+  first = lo;
 
-  /* ‘Cute’ little navigation through the state machine to avoid breaking the
-   * invariant that CLOSED can only be reached from TIME-WAIT or LAST-ACK. */
-  switch (priv->state) {
-  case PSEUDO_TCP_LISTEN:
-  case PSEUDO_TCP_SYN_SENT:
-    break;
-  case PSEUDO_TCP_SYN_RECEIVED:
-  case PSEUDO_TCP_ESTABLISHED:
-    set_state (self, PSEUDO_TCP_FIN_WAIT_1);
-    /* Fall through. */
-  case PSEUDO_TCP_FIN_WAIT_1:
-    set_state (self, PSEUDO_TCP_FIN_WAIT_2);
-    /* Fall through. */
-  case PSEUDO_TCP_FIN_WAIT_2:
-  case PSEUDO_TCP_CLOSING:
-    set_state (self, PSEUDO_TCP_TIME_WAIT);
-    break;
-  case PSEUDO_TCP_CLOSE_WAIT:
-    set_state (self, PSEUDO_TCP_LAST_ACK);
-    break;
-  case PSEUDO_TCP_LAST_ACK:
-  case PSEUDO_TCP_TIME_WAIT:
-  case PSEUDO_TCP_CLOSED:
-  default:
-    break;
+  // Swallow every range which starts before the new one ends
+  for (last = first; last < rlist->len; last++) {
+    RSegment *rseg = &g_array_index (rlist, RSegment, last);
+
+    if (LARGER (rseg->seq, end))
+      break;
+    if (SMALLER (rseg->seq, seq))
+      seq = rseg->seq;
+    if (LARGER (rseg->seq + rseg->len, end))
+      end = rseg->seq + rseg->len;
   }
 
-  set_state_closed (self, err);
+  if (last == first) {
+    RSegment rseg = { seq, end - seq };
+
+    g_array_insert_val (rlist, first, rseg);
+  } else {
+    RSegment *rseg = &g_array_index (rlist, RSegment, first);
+
+    rseg->seq = seq;
+    rseg->len = end - seq;
+    if (last > first + 1)
+      g_array_remove_range (rlist, first + 1, last - first - 1);
+  }
 }
 
-static void
-adjustMTU(PseudoTcpSocket *self)
+/* Moves rcv_nxt past the ranges of rlist it has reached, returning the
+ * number of bytes this made readable. Ranges are merged, so at most one of
+ * them follows on. */
+static guint32
+rlist_consume (PseudoTcpSocket *self)
 {
   PseudoTcpSocketPrivate *priv = self->priv;
+  guint32 recovered = 0;
 
-  // Determine our current mss level, so that we can adjust appropriately later
-  for (priv->msslevel = 0;
-       PACKET_MAXIMUMS[priv->msslevel + 1] > 0;
-       ++priv->msslevel) {
-    if (((guint16)PACKET_MAXIMUMS[priv->msslevel]) <= priv->mtu_advise) {
+  while (priv->rlist->len > 0) {
+    RSegment *data = &g_array_index (priv->rlist, RSegment, 0);
+
+    if (LARGER (data->seq, priv->rcv_nxt))
       break;
+
+    if (LARGER (data->seq + data->len, priv->rcv_nxt)) {
+      guint32 nAdjust = (data->seq + data->len) - priv->rcv_nxt;
+      DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Recovered %u bytes (%u -> %u)",
+          nAdjust, priv->rcv_nxt, priv->rcv_nxt + nAdjust);
+      pseudo_tcp_fifo_consume_write_buffer (&priv->rbuf, nAdjust);
+      priv->rcv_nxt += nAdjust;
+      priv->rcv_wnd -= nAdjust;
+      recovered += nAdjust;
     }
+    g_array_remove_index (priv->rlist, 0);
   }
-  priv->mss = priv->mtu_advise - PACKET_OVERHEAD;
-  // !?! Should we reset priv->largest here?
-  DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Adjusting mss to %u bytes", priv->mss);
-  // Enforce minimums on ssthresh and cwnd
-  priv->ssthresh = max(priv->ssthresh, 2 * priv->mss);
-  priv->cwnd = max(priv->cwnd, priv->mss);
+
+  return recovered;
 }
 
-static void
-apply_window_scale_option (PseudoTcpSocket *self, guint8 scale_factor)
+/* Handles a FLAG_FORWARD segment: the sender will never deliver the data
+ * before @fwd, so the hole in rbuf is recorded in rskips for the reader to
+ * step over, and whatever was held past it becomes readable. Returns whether
+ * the stream moved forward. */
+static gboolean
+receive_forward (PseudoTcpSocket *self, guint32 fwd)
 {
-   PseudoTcpSocketPrivate *priv = self->priv;
+  PseudoTcpSocketPrivate *priv = self->priv;
+  guint32 skip;
+  RSkip *last;
 
-   priv->swnd_scale = scale_factor;
-   DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Setting scale factor to %u", scale_factor);
+  if (SMALLER_OR_EQUAL (fwd, priv->rcv_nxt))
+    return FALSE;
+
+  skip = fwd - priv->rcv_nxt;
+  if (skip > pseudo_tcp_fifo_get_write_remaining (&priv->rbuf)) {
+    DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Forward to %u is out of window", fwd);
+    return FALSE;
+  }
+
+  DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Skipping %u abandoned bytes (%u -> %u)",
+      skip, priv->rcv_nxt, fwd);
+
+  last = priv->rskips->len > 0 ?
+      &g_array_index (priv->rskips, RSkip, priv->rskips->len - 1) : NULL;
+  if (last != NULL &&
+      last->offset + last->len == pseudo_tcp_fifo_get_buffered (&priv->rbuf)) {
+    last->len += skip;
+  } else {
+    RSkip rskip = { pseudo_tcp_fifo_get_buffered (&priv->rbuf), skip };
+
+    g_array_append_val (priv->rskips, rskip);
+  }
+
+  pseudo_tcp_fifo_consume_write_buffer (&priv->rbuf, skip);
+  priv->rcv_nxt = fwd;
+  priv->rcv_wnd -= skip;
+  rlist_consume (self);
+
+  return TRUE;
+}
+
+/* Drops the abandoned bytes at the read position of rbuf, and returns how
+ * many bytes can be read before the next of them. */
+static gsize
+rskips_trim (PseudoTcpSocket *self)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+
+  while (priv->rskips->len > 0) {
+    RSkip *rskip = &g_array_index (priv->rskips, RSkip, 0);
+    guint i;
+
+    if (rskip->offset > 0)
+      return rskip->offset;
+
+    pseudo_tcp_fifo_consume_read_data (&priv->rbuf, rskip->len);
+    for (i = 1; i < priv->rskips->len; i++)
+      g_array_index (priv->rskips, RSkip, i).offset -= rskip->len;
+    g_array_remove_index (priv->rskips, 0);
+  }
+
+  return pseudo_tcp_fifo_get_buffered (&priv->rbuf);
 }
 
+/* Accounts for @len bytes read from rbuf, which must not cross a skip. */
 static void
-apply_fin_ack_option (PseudoTcpSocket *self)
+rskips_advance (PseudoTcpSocket *self, gsize len)
 {
   PseudoTcpSocketPrivate *priv = self->priv;
+  guint i;
 
-  priv->support_fin_ack = TRUE;
+  for (i = 0; i < priv->rskips->len; i++)
+    g_array_index (priv->rskips, RSkip, i).offset -= len;
 }
 
+/* Gives up on the messages at the head of slist whose deadline has passed:
+ * their data is dropped as if it had been acknowledged, and a FLAG_FORWARD
+ * segment tells the receiver to skip it. Only the head is considered, so the
+ * forward point moves like snd_una does. */
 static void
-apply_option (PseudoTcpSocket *self, guint8 kind, const guint8 *data,
-    guint32 len)
+abandon_expired_messages (PseudoTcpSocket *self, guint32 now)
 {
-  switch (kind) {
-  case TCP_OPT_MSS:
-    DEBUG (PSEUDO_TCP_DEBUG_NORMAL,
-        "Peer specified MSS option which is not supported.");
-    // TODO: Implement.
-    break;
-  case TCP_OPT_WND_SCALE:
-    // Window scale factor.
-    // http://www.ietf.org/rfc/rfc1323.txt
-    if (len != 1) {
-      DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Invalid window scale option received.");
-      return;
+  PseudoTcpSocketPrivate *priv = self->priv;
+  guint32 fwd = priv->snd_una;
+  SSegment *sseg;
+
+  if (!priv->support_forward)
+    return;
+
+  while ((sseg = g_queue_peek_head (&priv->slist)) != NULL &&
+      sseg->deadline != 0 && time_diff (sseg->deadline, now) <= 0) {
+    guint32 msg_end = sseg->msg_end;
+
+    while ((sseg = g_queue_peek_head (&priv->slist)) != NULL &&
+        SMALLER (sseg->seq, msg_end)) {
+      g_queue_pop_head (&priv->slist);
+      if (sseg->xmit == 0)
+        g_queue_remove (&priv->unsent_slist, sseg);
+      if (sseg->sacked)
+        priv->sacked_bytes -= sseg->len;
+      g_slice_free (SSegment, sseg);
     }
-    apply_window_scale_option(self, data[0]);
-    break;
-  case TCP_OPT_FIN_ACK:
-    // FIN-ACK support.
-    DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "FIN-ACK support enabled.");
-    apply_fin_ack_option (self);
-    break;
-  case TCP_OPT_EOL:
-  case TCP_OPT_NOOP:
-    /* Nothing to do. */
-    break;
-  default:
-    DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Invalid TCP option %u", kind);
-    break;
+    fwd = msg_end;
   }
-}
 
+  if (fwd == priv->snd_una)
+    return;
+
+  DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Abandoning %u bytes of expired messages "
+      "(%u -> %u)", fwd - priv->snd_una, priv->snd_una, fwd);
+
+  pseudo_tcp_fifo_consume_read_data (&priv->sbuf, fwd - priv->snd_una);
+  priv->snd_una = fwd;
+  if (LARGER (fwd, priv->snd_nxt))
+    priv->snd_nxt = fwd;
+
+  if (priv->probe_size != 0 && SMALLER (priv->probe_seq, fwd))
+    priv->probe_size = 0;
+  if (priv->tlp_outstanding && LARGER_OR_EQUAL (fwd, priv->tlp_high_seq))
+    priv->tlp_outstanding = FALSE;
+  if (priv->dup_acks >= 3 && LARGER_OR_EQUAL (fwd, priv->recover)) {
+    priv->fast_recovery = FALSE;
+    priv->dup_acks = 0;
+  }
+  priv->rto_base = (priv->snd_una == priv->snd_nxt) ? 0 : now;
+
+  priv->fwd_seq = fwd;
+  priv->fwd_time = now;
+  packet (self, fwd, FLAG_FORWARD, 0, 0, now);
+}
 
 static void
-parse_options (PseudoTcpSocket *self, const guint8 *data, guint32 len)
+sack_write_block (guint8 *buf, guint32 index, guint32 left, guint32 right)
 {
-  PseudoTcpSocketPrivate *priv = self->priv;
-  gboolean has_window_scaling_option = FALSE;
-  gboolean has_fin_ack_option = FALSE;
-  guint32 pos = 0;
+  guint32 edges[2] = { htonl (left), htonl (right) };
 
-  // See http://www.freesoft.org/CIE/Course/Section4/8.htm for
-  // parsing the options list.
-  while (pos < len) {
-    guint8 kind = TCP_OPT_EOL;
-    guint8 opt_len;
+  memcpy (buf + index * SACK_BLOCK_SIZE, edges, SACK_BLOCK_SIZE);
+}
 
-    if (len < pos + 1)
-      return;
+/* Writes up to MAX_SACK_BLOCKS blocks describing the out-of-order data held
+ * in rlist, lowest first since those are the holes the sender must fill
+ * first. Returns the number of bytes written. */
+static guint32
+sack_write_blocks (PseudoTcpSocket *self, guint8 *buf)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+  guint32 n;
 
-    kind = data[pos];
-    pos++;
+  for (n = 0; n < priv->rlist->len && n < MAX_SACK_BLOCKS; n++) {
+    RSegment *rseg = &g_array_index (priv->rlist, RSegment, n);
 
-    if (kind == TCP_OPT_EOL) {
-      // End of option list.
-      break;
-    } else if (kind == TCP_OPT_NOOP) {
-      // No op.
-      continue;
-    }
+    sack_write_block (buf, n, rseg->seq, rseg->seq + rseg->len);
+  }
 
-    if (len < pos + 1)
-      return;
+  return n * SACK_BLOCK_SIZE;
+}
 
-    // Length of this option.
-    opt_len = data[pos];
-    pos++;
+/* Marks the segments of slist covered by the received SACK blocks. */
+static void
+sack_update_scoreboard (PseudoTcpSocket *self, const guint8 *data,
+    guint32 len, guint32 now)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+  guint32 pos;
 
-    if (len < pos + opt_len)
-      return;
+  for (pos = 0; pos + SACK_BLOCK_SIZE <= len &&
+           pos < MAX_SACK_BLOCKS * SACK_BLOCK_SIZE; pos += SACK_BLOCK_SIZE) {
+    guint32 edges[2];
+    guint32 left, right;
+    GList *iter;
 
-    // Content of this option.
-    if (opt_len <= len - pos) {
-      apply_option (self, kind, data + pos, opt_len);
-      pos += opt_len;
-    } else {
-      DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Invalid option length received.");
-      return;
+    memcpy (edges, data + pos, SACK_BLOCK_SIZE);
+    left = ntohl (edges[0]);
+    right = ntohl (edges[1]);
+
+    if (!SMALLER (left, right) || SMALLER (left, priv->snd_una) ||
+        LARGER (right, priv->snd_nxt)) {
+      DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Invalid SACK block %u:%u", left, right);
+      continue;
     }
 
-    if (kind == TCP_OPT_WND_SCALE)
-      has_window_scaling_option = TRUE;
-    else if (kind == TCP_OPT_FIN_ACK)
-      has_fin_ack_option = TRUE;
-  }
+    for (iter = g_queue_peek_head_link (&priv->slist); iter;
+         iter = iter->next) {
+      SSegment *sseg = iter->data;
+      guint32 end = sseg->seq + sseg->len;
 
-  if (!has_window_scaling_option) {
-    DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Peer doesn't support window scaling");
-    if (priv->rwnd_scale > 0) {
-      // Peer doesn't support TCP options and window scaling.
-      // Revert receive buffer size to default value.
-      resize_receive_buffer (self, DEFAULT_RCV_BUF_SIZE);
-      priv->swnd_scale = 0;
+      if (!SMALLER (sseg->seq, right))
+        break;
+      if (sseg->sacked || sseg->len == 0 || SMALLER (sseg->seq, left) ||
+          LARGER (end, right))
+        continue;
+
+      sseg->sacked = TRUE;
+      rack_update (self, sseg, now);
+      if (priv->sacked_bytes == 0 || LARGER (end, priv->sack_high))
+        priv->sack_high = end;
+      priv->sacked_bytes += sseg->len;
     }
   }
 
-  if (!has_fin_ack_option) {
-    DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Peer doesn't support FIN-ACK");
-    priv->support_fin_ack = FALSE;
-  }
+  DEBUG (PSEUDO_TCP_DEBUG_VERBOSE, "SACK scoreboard: %u bytes up to %u",
+      priv->sacked_bytes, priv->sack_high);
 }
 
 static void
-resize_send_buffer (PseudoTcpSocket *self, guint32 new_size)
+sack_clear_scoreboard (PseudoTcpSocket *self)
 {
   PseudoTcpSocketPrivate *priv = self->priv;
+  GList *iter;
 
-  priv->sbuf_len = new_size;
-  pseudo_tcp_fifo_set_capacity (&priv->sbuf, new_size);
-}
+  if (priv->sacked_bytes == 0)
+    return;
 
+  for (iter = g_queue_peek_head_link (&priv->slist); iter; iter = iter->next)
+    ((SSegment *) iter->data)->sacked = FALSE;
+  priv->sacked_bytes = 0;
+}
 
-static void
-resize_receive_buffer (PseudoTcpSocket *self, guint32 new_size)
+/* Retransmits, in order, the segments below the highest SACKed one which are
+ * neither SACKed nor already retransmitted during this recovery, as long as
+ * the estimated pipe stays below cwnd. Lost segments are counted in the pipe
+ * until they are retransmitted, a simplification of RFC 6675, §4. */
+static int
+sack_retransmit_holes (PseudoTcpSocket *self, guint32 now)
 {
   PseudoTcpSocketPrivate *priv = self->priv;
-  guint8 scale_factor = 0;
-  gboolean result;
-  gsize available_space;
+  guint32 pipe;
+  GList *iter;
 
-  if (priv->rbuf_len == new_size)
-    return;
+  if (priv->sacked_bytes == 0)
+    return 0;
 
-  // Determine the scale factor such that the scaled window size can fit
-  // in a 16-bit unsigned integer.
-  while (new_size > 0xFFFF) {
-    ++scale_factor;
-    new_size >>= 1;
-  }
+  if (SMALLER (priv->sack_rexmit_nxt, priv->snd_una))
+    priv->sack_rexmit_nxt = priv->snd_una;
 
-  // Determine the proper size of the buffer.
-  new_size <<= scale_factor;
-  result = pseudo_tcp_fifo_set_capacity (&priv->rbuf, new_size);
+  pipe = priv->snd_nxt - priv->snd_una - priv->sacked_bytes;
 
-  // Make sure the new buffer is large enough to contain data in the old
-  // buffer. This should always be true because this method is called either
-  // before connection is established or when peers are exchanging connect
-  // messages.
+  for (iter = g_queue_peek_head_link (&priv->slist);
+       iter && pipe < priv->cwnd; iter = iter->next) {
+    SSegment *sseg = iter->data;
+    int transmit_status;
+
+    if (sseg->xmit == 0 || !SMALLER (sseg->seq, priv->sack_high))
+      break;
+    if (sseg->sacked || SMALLER (sseg->seq, priv->sack_rexmit_nxt))
+      continue;
+
+    DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "SACK retransmit %u:%u", sseg->seq,
+        sseg->seq + sseg->len);
+    transmit_status = transmit (self, sseg, now);
+    if (transmit_status != 0)
+      return transmit_status;
+
+    pipe += sseg->len;
+    priv->sack_rexmit_nxt = sseg->seq + sseg->len;
+  }
+
+  return 0;
+}
+
+/* Retransmits the oldest segment and enters fast recovery, on the third
+ * duplicate ACK or when RACK declares that segment lost. */
+static int
+enter_recovery (PseudoTcpSocket *self, guint32 now)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+  int transmit_status;
+
+  DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "enter recovery");
+  DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "recovery retransmit");
+
+  priv->dup_acks = max (priv->dup_acks, 3);
+  priv->rack_timer = priv->tlp_timer = 0;
+
+  transmit_status = transmit(self, g_queue_peek_head (&priv->slist), now);
+  if (transmit_status != 0)
+    return transmit_status;
+
+  priv->recover = priv->snd_nxt;
+  priv->cc->on_loss (self, now);
+  if (priv->support_sack) {
+    SSegment *head = g_queue_peek_head (&priv->slist);
+
+    /* No window inflation: SACKed segments leave the pipe instead,
+     * see RFC 6675. Then repair the other holes right away rather
+     * than one per round trip. */
+    priv->cwnd = priv->ssthresh;
+    priv->sack_rexmit_nxt = head->seq + head->len;
+    transmit_status = sack_retransmit_holes (self, now);
+    if (transmit_status != 0)
+      return transmit_status;
+  } else {
+    priv->cwnd = priv->ssthresh + 3 * priv->mss;
+  }
+  priv->fast_recovery = TRUE;
+
+  return 0;
+}
+
+/* Whether segment 1, sent at @t1 and ending at @end1, was sent after
+ * segment 2 (RFC 8985, §6.2). */
+static gboolean
+rack_sent_after (guint32 t1, guint32 end1, guint32 t2, guint32 end2)
+{
+  return time_diff (t1, t2) > 0 || (t1 == t2 && LARGER (end1, end2));
+}
+
+/* Records that @sseg has just been delivered, cumulatively or by SACK. */
+static void
+rack_update (PseudoTcpSocket *self, SSegment *sseg, guint32 now)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+  long rtt;
+
+  if (!priv->rack_tlp || sseg->xmit == 0)
+    return;
+
+  rtt = time_diff (now, sseg->xmit_time);
+  if (rtt < 0)
+    return;
+
+  /* An ACK which comes sooner than any round trip can't be for the
+   * retransmission: it was for an earlier transmission */
+  if (sseg->xmit > 1 && (guint32) rtt < priv->rack_min_rtt)
+    return;
+
+  priv->rack_min_rtt = min (priv->rack_min_rtt, (guint32) rtt);
+  priv->rack_rtt = rtt;
+
+  if (priv->rack_xmit_time == 0 ||
+      rack_sent_after (sseg->xmit_time, sseg->seq + sseg->len,
+          priv->rack_xmit_time, priv->rack_end_seq)) {
+    priv->rack_xmit_time = sseg->xmit_time;
+    priv->rack_end_seq = sseg->seq + sseg->len;
+  }
+}
+
+/* Returns whether the oldest outstanding segment is lost: it was sent before
+ * the latest delivered segment, more than a round trip plus a reordering
+ * window ago. If it is not lost yet, the reordering timer is armed for when
+ * it would be. Later holes are left to the SACK recovery. */
+static gboolean
+rack_detect_loss (PseudoTcpSocket *self, guint32 now)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+  SSegment *head = g_queue_peek_head (&priv->slist);
+  guint32 reo_wnd;
+  long remaining;
+
+  priv->rack_timer = 0;
+
+  if (!priv->rack_tlp || priv->rack_xmit_time == 0 || head == NULL ||
+      head->xmit == 0 || head->sacked ||
+      !rack_sent_after (priv->rack_xmit_time, priv->rack_end_seq,
+          head->xmit_time, head->seq + head->len))
+    return FALSE;
+
+  reo_wnd = min (priv->rack_min_rtt / 4, priv->rx_srtt);
+  remaining = time_diff (head->xmit_time + priv->rack_rtt + reo_wnd, now);
+  if (remaining <= 0) {
+    DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "RACK: %u lost", head->seq);
+    return TRUE;
+  }
+
+  priv->rack_timer = now + remaining;
+  return FALSE;
+}
+
+/* Schedules a tail loss probe two round trips from now (RFC 8985, §7.2), or
+ * cancels it if there is nothing to probe for or the RTO comes first. */
+static void
+tlp_arm (PseudoTcpSocket *self, guint32 now)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+  guint32 flight = priv->snd_nxt - priv->snd_una;
+  guint32 pto;
+
+  priv->tlp_timer = 0;
+
+  if (!priv->rack_tlp || priv->state != PSEUDO_TCP_ESTABLISHED ||
+      flight == 0 || priv->dup_acks >= 3 || priv->tlp_outstanding ||
+      priv->rx_srtt == 0)
+    return;
+
+  pto = 2 * priv->rx_srtt;
+  // The ACK of a lone segment may be delayed
+  if (flight <= priv->mss)
+    pto += priv->ack_delay;
+  pto = max (pto, TLP_MIN_TIMEOUT);
+
+  if (priv->rto_base &&
+      time_diff (priv->rto_base + priv->rx_rto, now + pto) <= 0)
+    return;
+
+  priv->tlp_timer = now + pto;
+}
+
+/* Retransmits the last segment sent, so that the ACK it elicits reveals
+ * any loss at the tail of the flight to RACK or the duplicate ACK logic. */
+static int
+tlp_send_probe (PseudoTcpSocket *self, guint32 now)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+  GList *iter;
+  SSegment *sseg = NULL;
+  int transmit_status;
+
+  for (iter = g_queue_peek_tail_link (&priv->slist); iter; iter = iter->prev) {
+    sseg = iter->data;
+    if (sseg->xmit > 0)
+      break;
+  }
+
+  if (iter == NULL || sseg->sacked || sseg->len == 0)
+    return 0;
+
+  DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Tail loss probe %u:%u", sseg->seq,
+      sseg->seq + sseg->len);
+  transmit_status = transmit (self, sseg, now);
+  if (transmit_status != 0)
+    return transmit_status;
+
+  priv->tlp_outstanding = TRUE;
+  priv->tlp_high_seq = priv->snd_nxt;
+  priv->tlp_xmit_time = now;
+  priv->rto_base = now;
+
+  return 0;
+}
+
+/* Returns the rate to pace transmissions at in bytes per second, or 0 to
+ * send as the window allows. */
+static guint32
+pacing_rate (PseudoTcpSocket *self)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+  guint64 rate;
+
+  rate = priv->cc->pacing_rate (self);
+  if (rate == 0 && priv->rx_srtt != 0) {
+    // Leave room for the window to grow (Linux tcp_update_pacing_rate)
+    guint gain = (priv->cwnd < priv->ssthresh) ? 200 : 120;
+
+    rate = (guint64) priv->cwnd * gain * 10 / priv->rx_srtt;
+  }
+
+  if (priv->max_pacing_rate != 0 &&
+      (rate == 0 || rate > priv->max_pacing_rate))
+    rate = priv->max_pacing_rate;
+
+  return min (rate, G_MAXUINT32);
+}
+
+/* Returns whether new data must wait for the pacing timer. */
+static gboolean
+pacing_blocked (PseudoTcpSocket *self, guint32 now)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+
+  if (!priv->pacing || priv->pace_next == 0 ||
+      time_diff (priv->pace_next, now) <= 0)
+    return FALSE;
+
+  priv->pace_blocked = TRUE;
+  return TRUE;
+}
+
+/* Pushes the pacing timer back by the time @len bytes take at the pacing
+ * rate. Time left unused while idle is not accumulated into a burst. */
+static void
+pacing_charge (PseudoTcpSocket *self, guint32 len, guint32 now)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+  guint32 rate;
+  guint64 us;
+
+  if (!priv->pacing || len == 0)
+    return;
+
+  rate = pacing_rate (self);
+  if (rate == 0)
+    return;
+
+  if (priv->pace_next == 0 || time_diff (now, priv->pace_next) > 0) {
+    priv->pace_next = now;
+    priv->pace_frac = 0;
+  }
+
+  us = priv->pace_frac + (guint64) len * 1000000 / rate;
+  priv->pace_next += us / 1000;
+  priv->pace_frac = us % 1000;
+}
+
+/* If @source is %CLOSEDOWN_REMOTE, don’t send an RST packet, since closedown()
+ * has been called as a result of an RST segment being received.
+ * See: RFC 1122, §4.2.2.13. */
+static void
+closedown (PseudoTcpSocket *self, guint32 err, ClosedownSource source)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+
+  DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Closing down socket %p with %s error %u.",
+      self, (source == CLOSEDOWN_LOCAL) ? "local" : "remote", err);
+
+  if (source == CLOSEDOWN_LOCAL && priv->support_fin_ack) {
+    queue_rst_message (self);
+    attempt_send (self, sfRst);
+  } else if (source == CLOSEDOWN_LOCAL) {
+    priv->shutdown = SD_FORCEFUL;
+  }
+
+  /* ‘Cute’ little navigation through the state machine to avoid breaking the
+   * invariant that CLOSED can only be reached from TIME-WAIT or LAST-ACK. */
+  switch (priv->state) {
+  case PSEUDO_TCP_LISTEN:
+  case PSEUDO_TCP_SYN_SENT:
+    break;
+  case PSEUDO_TCP_SYN_RECEIVED:
+  case PSEUDO_TCP_ESTABLISHED:
+    set_state (self, PSEUDO_TCP_FIN_WAIT_1);
+    /* Fall through. */
+  case PSEUDO_TCP_FIN_WAIT_1:
+    set_state (self, PSEUDO_TCP_FIN_WAIT_2);
+    /* Fall through. */
+  case PSEUDO_TCP_FIN_WAIT_2:
+  case PSEUDO_TCP_CLOSING:
+    set_state (self, PSEUDO_TCP_TIME_WAIT);
+    break;
+  case PSEUDO_TCP_CLOSE_WAIT:
+    set_state (self, PSEUDO_TCP_LAST_ACK);
+    break;
+  case PSEUDO_TCP_LAST_ACK:
+  case PSEUDO_TCP_TIME_WAIT:
+  case PSEUDO_TCP_CLOSED:
+  default:
+    break;
+  }
+
+  set_state_closed (self, err);
+}
+
+static void
+adjustMTU(PseudoTcpSocket *self)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+
+  // Determine our current mss level, so that we can adjust appropriately later
+  for (priv->msslevel = 0;
+       PACKET_MAXIMUMS[priv->msslevel + 1] > 0;
+       ++priv->msslevel) {
+    if (((guint16)PACKET_MAXIMUMS[priv->msslevel]) <= priv->mtu_advise) {
+      break;
+    }
+  }
+  priv->mss = priv->mtu_advise - PACKET_OVERHEAD;
+  // !?! Should we reset priv->largest here?
+  DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Adjusting mss to %u bytes", priv->mss);
+  // Enforce minimums on ssthresh and cwnd
+  priv->ssthresh = max(priv->ssthresh, 2 * priv->mss);
+  priv->cwnd = max(priv->cwnd, priv->mss);
+
+  // (Re)start the path MTU search from the advised MTU
+  priv->plpmtud_low = priv->mtu_advise;
+  priv->plpmtud_high = max (MAX_PLPMTU, priv->mtu_advise);
+  priv->plpmtud_raise_time = 0;
+  priv->probe_size = 0;
+  priv->probe_failures = 0;
+}
+
+/* Returns the packet size to probe next, or 0 if no probe should be sent
+ * now. The search is a bisection between the largest confirmed size and the
+ * smallest size known to be too large; once they are close enough, it pauses
+ * for PLPMTUD_RAISE_TIMER before trying the upper end again. */
+static guint32
+plpmtud_probe_size (PseudoTcpSocket *self, guint32 now)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+
+  if (!priv->mtu_discovery || priv->state != PSEUDO_TCP_ESTABLISHED ||
+      priv->probe_size != 0 || priv->dup_acks >= 3)
+    return 0;
+
+  if (priv->plpmtud_high - priv->plpmtud_low < PLPMTUD_SEARCH_GRANULARITY) {
+    if (priv->plpmtud_raise_time == 0) {
+      DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Path MTU search done: %u",
+          priv->plpmtud_low);
+      priv->plpmtud_raise_time = now;
+      return 0;
+    }
+    if (time_diff (now, priv->plpmtud_raise_time) < PLPMTUD_RAISE_TIMER)
+      return 0;
+
+    priv->plpmtud_high = max (MAX_PLPMTU, priv->mtu_advise);
+    priv->plpmtud_raise_time = now;
+    if (priv->plpmtud_high - priv->plpmtud_low < PLPMTUD_SEARCH_GRANULARITY)
+      return 0;
+    priv->plpmtud_raise_time = 0;
+  }
+
+  return priv->plpmtud_low + (priv->plpmtud_high - priv->plpmtud_low + 1) / 2;
+}
+
+static void
+plpmtud_probe_acked (PseudoTcpSocket *self)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+
+  priv->plpmtud_low = priv->probe_size;
+  priv->mss = priv->probe_size - PACKET_OVERHEAD;
+  priv->probe_size = 0;
+  priv->probe_failures = 0;
+  DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "MTU probe acknowledged, mss now %u",
+      priv->mss);
+  priv->ssthresh = max (priv->ssthresh, 2 * priv->mss);
+}
+
+/* @too_large is set when the probe could not even be sent. */
+static void
+plpmtud_probe_lost (PseudoTcpSocket *self, gboolean too_large)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+
+  if (too_large || ++priv->probe_failures >= PLPMTUD_MAX_PROBES) {
+    DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "MTU %u is too large", priv->probe_size);
+    priv->plpmtud_high = priv->probe_size - 1;
+    priv->probe_failures = 0;
+  }
+  priv->probe_size = 0;
+}
+
+/* Called when the oldest segment timed out again: if full sized segments are
+ * silently dropped, fall back to BASE_PLPMTU and search again. */
+static void
+plpmtud_black_hole (PseudoTcpSocket *self)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+  guint32 mtu = priv->mss + PACKET_OVERHEAD;
+
+  if (mtu <= BASE_PLPMTU ||
+      ((SSegment *) g_queue_peek_head (&priv->slist))->len <=
+          BASE_PLPMTU - PACKET_OVERHEAD)
+    return;
+
+  DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Black hole detected at MTU %u", mtu);
+  priv->plpmtud_low = BASE_PLPMTU;
+  priv->plpmtud_high = mtu - 1;
+  priv->plpmtud_raise_time = 0;
+  priv->probe_size = 0;
+  priv->probe_failures = 0;
+  priv->mss = BASE_PLPMTU - PACKET_OVERHEAD;
+}
+
+/* Resends all the data of the lost probe, which transmit() splits into
+ * segments of the current MSS. */
+static int
+plpmtud_retransmit_probe (PseudoTcpSocket *self, guint32 now)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+  guint32 end = priv->probe_seq + priv->probe_len;
+  GList *iter;
+
+  for (iter = g_queue_peek_head_link (&priv->slist); iter; iter = iter->next) {
+    SSegment *sseg = iter->data;
+    int transmit_status;
+
+    if (LARGER_OR_EQUAL (sseg->seq, end) || sseg->xmit == 0)
+      break;
+
+    transmit_status = transmit (self, sseg, now);
+    if (transmit_status != 0)
+      return transmit_status;
+  }
+
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Congestion control modules
+//////////////////////////////////////////////////////////////////////
+
+static void
+reno_init (PseudoTcpSocket *self)
+{
+}
+
+static void
+reno_on_ack (PseudoTcpSocket *self, guint32 acked, long rtt,
+    gboolean in_recovery, guint32 now)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+
+  if (in_recovery)
+    return;
+
+  // Slow start, congestion avoidance
+  if (priv->cwnd < priv->ssthresh) {
+    priv->cwnd += priv->mss;
+  } else {
+    priv->cwnd += max(1LU, priv->mss * priv->mss / priv->cwnd);
+  }
+}
+
+static void
+reno_on_loss (PseudoTcpSocket *self, guint32 now)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+  guint32 nInFlight = priv->snd_nxt - priv->snd_una;
+
+  priv->ssthresh = max(nInFlight / 2, 2 * priv->mss);
+  DEBUG (PSEUDO_TCP_DEBUG_NORMAL,
+      "ssthresh: %u = max((nInFlight: %u / 2), 2 * mss: %u)",
+      priv->ssthresh, nInFlight, priv->mss);
+}
+
+static void
+reno_on_rto (PseudoTcpSocket *self, guint32 now)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+
+  reno_on_loss (self, now);
+  priv->cwnd = priv->mss;
+}
+
+static guint32
+no_pacing_rate (PseudoTcpSocket *self)
+{
+  return 0;
+}
+
+/* CUBIC, RFC 9438, with C = 0.4 and beta = 0.7 */
+#define CUBIC_BETA_NUM 7
+#define CUBIC_BETA_DEN 10
+
+/* Integer cube root, from Hacker's Delight, §11-2. */
+static guint32
+cube_root (guint64 x)
+{
+  guint64 y = 0, b;
+  gint s;
+
+  for (s = 63; s >= 0; s -= 3) {
+    y = 2 * y;
+    b = 3 * y * (y + 1) + 1;
+    if ((x >> s) >= b) {
+      x -= b << s;
+      y++;
+    }
+  }
+
+  return y;
+}
+
+static void
+cubic_init (PseudoTcpSocket *self)
+{
+  CubicState *cubic = &self->priv->cc_state.cubic;
+
+  cubic->w_max = 0;
+  cubic->epoch_start = 0;
+}
+
+static void
+cubic_on_ack (PseudoTcpSocket *self, guint32 acked, long rtt,
+    gboolean in_recovery, guint32 now)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+  CubicState *cubic = &priv->cc_state.cubic;
+  gint64 t, cube;
+  gint64 target;
+
+  if (in_recovery)
+    return;
+
+  if (priv->cwnd < priv->ssthresh) {
+    priv->cwnd += priv->mss;
+    return;
+  }
+
+  if (cubic->epoch_start == 0) {
+    cubic->epoch_start = now;
+    if (priv->cwnd < cubic->w_max) {
+      /* K = cbrt ((w_max - cwnd) / C) seconds, with windows in segments */
+      cubic->k = cube_root ((guint64) (cubic->w_max - priv->cwnd) *
+          2500000000ULL / priv->mss);
+      cubic->origin = cubic->w_max;
+    } else {
+      cubic->k = 0;
+      cubic->origin = priv->cwnd;
+    }
+    cubic->w_est = priv->cwnd;
+  }
+
+  /* Target window one RTT from now, bounded to keep cube in range */
+  t = time_diff (now, cubic->epoch_start) + priv->rx_srtt;
+  t = CLAMP (t - (gint64) cubic->k, -100000, 100000);
+  cube = t * t * t;
+  target = (gint64) cubic->origin + cube / 1000 * 4 * priv->mss / 10000000;
+  target = CLAMP (target, priv->cwnd, priv->cwnd + priv->cwnd / 2);
+
+  /* The window NewReno would have reached, which CUBIC must not fall
+   * behind; the additive increase is 3 * (1 - beta) / (1 + beta) */
+  cubic->w_est += (guint64) priv->mss * acked * 9 / (17 * priv->cwnd);
+
+  priv->cwnd += (guint64) (target - priv->cwnd) * acked / priv->cwnd;
+  if (cubic->w_est > priv->cwnd)
+    priv->cwnd = cubic->w_est;
+}
+
+static void
+cubic_on_loss (PseudoTcpSocket *self, guint32 now)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+  CubicState *cubic = &priv->cc_state.cubic;
+
+  /* Fast convergence: release bandwidth to newer flows */
+  if (priv->cwnd < cubic->w_max)
+    cubic->w_max = (guint64) priv->cwnd * (CUBIC_BETA_DEN + CUBIC_BETA_NUM) /
+        (2 * CUBIC_BETA_DEN);
+  else
+    cubic->w_max = priv->cwnd;
+
+  priv->ssthresh = max ((guint64) priv->cwnd * CUBIC_BETA_NUM / CUBIC_BETA_DEN,
+      2 * priv->mss);
+  cubic->epoch_start = 0;
+
+  DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "CUBIC: ssthresh: %u w_max: %u",
+      priv->ssthresh, cubic->w_max);
+}
+
+static void
+cubic_on_rto (PseudoTcpSocket *self, guint32 now)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+
+  cubic_on_loss (self, now);
+  priv->cwnd = priv->mss;
+}
+
+/* Model-based congestion control after BBR: the bottleneck bandwidth is the
+ * windowed maximum of the per-round delivery rate, and cwnd tracks twice the
+ * bandwidth-delay product once the startup phase has stopped finding more
+ * bandwidth. Losses do not shrink the model. */
+#define BBR_STARTUP_GAIN_PERCENT 277
+#define BBR_MIN_RTT_WINDOW 10000  /* 10 s */
+
+static void
+bbr_init (PseudoTcpSocket *self)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+
+  memset (&priv->cc_state.bbr, 0, sizeof (BbrState));
+}
+
+static guint32
+bbr_bdp (PseudoTcpSocket *self)
+{
+  BbrState *bbr = &self->priv->cc_state.bbr;
+
+  return (guint64) bbr->btl_bw * bbr->min_rtt / 1000;
+}
+
+static void
+bbr_on_ack (PseudoTcpSocket *self, guint32 acked, long rtt,
+    gboolean in_recovery, guint32 now)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+  BbrState *bbr = &priv->cc_state.bbr;
+  guint32 target;
+  guint i;
+
+  if (rtt >= 0 && (bbr->min_rtt == 0 || (guint32) rtt <= bbr->min_rtt ||
+          time_diff (now, bbr->min_rtt_stamp) > BBR_MIN_RTT_WINDOW)) {
+    bbr->min_rtt = max (rtt, 1);
+    bbr->min_rtt_stamp = now;
+  }
+
+  bbr->round_delivered += acked;
+  if (bbr->round_start == 0) {
+    bbr->round_start = now;
+    bbr->round_end = priv->snd_nxt;
+  } else if (LARGER_OR_EQUAL (priv->snd_una, bbr->round_end)) {
+    long elapsed = time_diff (now, bbr->round_start);
+
+    if (elapsed > 0) {
+      bbr->bw_samples[bbr->round_count++ % BBR_BW_ROUNDS] =
+          min ((guint64) bbr->round_delivered * 1000 / elapsed, G_MAXUINT32);
+      bbr->btl_bw = 0;
+      for (i = 0; i < BBR_BW_ROUNDS; i++)
+        bbr->btl_bw = max (bbr->btl_bw, bbr->bw_samples[i]);
+
+      if (!bbr->filled_pipe) {
+        if ((guint64) bbr->btl_bw * 4 >= (guint64) bbr->full_bw * 5) {
+          bbr->full_bw = bbr->btl_bw;
+          bbr->full_bw_count = 0;
+        } else if (++bbr->full_bw_count >= 3) {
+          bbr->filled_pipe = TRUE;
+          DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "BBR: startup done, btl_bw: %u "
+              "min_rtt: %u", bbr->btl_bw, bbr->min_rtt);
+        }
+      }
+    }
+
+    bbr->round_start = now;
+    bbr->round_end = priv->snd_nxt;
+    bbr->round_delivered = 0;
+  }
+
+  if (in_recovery)
+    return;
+
+  if (!bbr->filled_pipe) {
+    /* Startup: double every round trip */
+    priv->cwnd += acked;
+    return;
+  }
+
+  target = max (2 * bbr_bdp (self), 4 * priv->mss);
+  if (priv->cwnd < target)
+    priv->cwnd = min (priv->cwnd + acked, target);
+  else
+    priv->cwnd = target;
+}
+
+static void
+bbr_on_loss (PseudoTcpSocket *self, guint32 now)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+
+  if (self->priv->cc_state.bbr.btl_bw == 0) {
+    reno_on_loss (self, now);
+    return;
+  }
+
+  priv->ssthresh = max (bbr_bdp (self), 2 * priv->mss);
+  DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "BBR: ssthresh: %u", priv->ssthresh);
+}
+
+static void
+bbr_on_rto (PseudoTcpSocket *self, guint32 now)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+
+  bbr_on_loss (self, now);
+  priv->cwnd = priv->mss;
+}
+
+static guint32
+bbr_pacing_rate (PseudoTcpSocket *self)
+{
+  BbrState *bbr = &self->priv->cc_state.bbr;
+
+  if (!bbr->filled_pipe)
+    return (guint64) bbr->btl_bw * BBR_STARTUP_GAIN_PERCENT / 100;
+
+  return bbr->btl_bw;
+}
+
+/* Indexed by PseudoTcpCongestionControl */
+static const CongestionOps congestion_ops[] = {
+  { "reno", reno_init, reno_on_ack, reno_on_loss, reno_on_rto,
+    no_pacing_rate },
+  { "cubic", cubic_init, cubic_on_ack, cubic_on_loss, cubic_on_rto,
+    no_pacing_rate },
+  { "bbr", bbr_init, bbr_on_ack, bbr_on_loss, bbr_on_rto,
+    bbr_pacing_rate },
+};
+
+static void
+set_congestion_control (PseudoTcpSocket *self,
+    PseudoTcpCongestionControl algorithm)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+
+  g_return_if_fail (algorithm < G_N_ELEMENTS (congestion_ops));
+
+  priv->cc_algorithm = algorithm;
+  priv->cc = &congestion_ops[algorithm];
+  priv->cc->init (self);
+
+  DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Using %s congestion control",
+      priv->cc->name);
+}
+
+static void
+apply_window_scale_option (PseudoTcpSocket *self, guint8 scale_factor)
+{
+   PseudoTcpSocketPrivate *priv = self->priv;
+
+   priv->swnd_scale = scale_factor;
+   DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Setting scale factor to %u", scale_factor);
+}
+
+static void
+apply_fin_ack_option (PseudoTcpSocket *self, const guint8 *data, guint32 len)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+
+  priv->support_fin_ack = TRUE;
+
+  if (len < 1 || (data[0] & FIN_ACK_OPT_SACK) == 0) {
+    DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Peer doesn't support SACK");
+    priv->support_sack = FALSE;
+  }
+
+  if (len < 1 || (data[0] & FIN_ACK_OPT_FORWARD) == 0) {
+    DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Peer doesn't support abandoning messages");
+    priv->support_forward = FALSE;
+  }
+}
+
+static void
+apply_option (PseudoTcpSocket *self, guint8 kind, const guint8 *data,
+    guint32 len)
+{
+  switch (kind) {
+  case TCP_OPT_MSS:
+    DEBUG (PSEUDO_TCP_DEBUG_NORMAL,
+        "Peer specified MSS option which is not supported.");
+    // TODO: Implement.
+    break;
+  case TCP_OPT_WND_SCALE:
+    // Window scale factor.
+    // http://www.ietf.org/rfc/rfc1323.txt
+    if (len != 1) {
+      DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Invalid window scale option received.");
+      return;
+    }
+    apply_window_scale_option(self, data[0]);
+    break;
+  case TCP_OPT_FIN_ACK:
+    // FIN-ACK support.
+    DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "FIN-ACK support enabled.");
+    apply_fin_ack_option (self, data, len);
+    break;
+  case TCP_OPT_EOL:
+  case TCP_OPT_NOOP:
+    /* Nothing to do. */
+    break;
+  default:
+    DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Invalid TCP option %u", kind);
+    break;
+  }
+}
+
+
+static void
+parse_options (PseudoTcpSocket *self, const guint8 *data, guint32 len)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+  gboolean has_window_scaling_option = FALSE;
+  gboolean has_fin_ack_option = FALSE;
+  guint32 pos = 0;
+
+  // See http://www.freesoft.org/CIE/Course/Section4/8.htm for
+  // parsing the options list.
+  while (pos < len) {
+    guint8 kind = TCP_OPT_EOL;
+    guint8 opt_len;
+
+    if (len < pos + 1)
+      return;
+
+    kind = data[pos];
+    pos++;
+
+    if (kind == TCP_OPT_EOL) {
+      // End of option list.
+      break;
+    } else if (kind == TCP_OPT_NOOP) {
+      // No op.
+      continue;
+    }
+
+    if (len < pos + 1)
+      return;
+
+    // Length of this option.
+    opt_len = data[pos];
+    pos++;
+
+    if (len < pos + opt_len)
+      return;
+
+    // Content of this option.
+    if (opt_len <= len - pos) {
+      apply_option (self, kind, data + pos, opt_len);
+      pos += opt_len;
+    } else {
+      DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Invalid option length received.");
+      return;
+    }
+
+    if (kind == TCP_OPT_WND_SCALE)
+      has_window_scaling_option = TRUE;
+    else if (kind == TCP_OPT_FIN_ACK)
+      has_fin_ack_option = TRUE;
+  }
+
+  if (!has_window_scaling_option) {
+    DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Peer doesn't support window scaling");
+    if (priv->rwnd_scale > 0) {
+      // Peer doesn't support TCP options and window scaling.
+      // Revert receive buffer size to default value.
+      priv->rbuf_autotune = FALSE;
+      resize_receive_buffer (self, DEFAULT_RCV_BUF_SIZE);
+      priv->swnd_scale = 0;
+    }
+  }
+
+  if (!has_fin_ack_option) {
+    DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Peer doesn't support FIN-ACK");
+    priv->support_fin_ack = FALSE;
+    priv->support_sack = FALSE;
+    priv->support_forward = FALSE;
+  }
+}
+
+static void
+resize_send_buffer (PseudoTcpSocket *self, guint32 new_size)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+
+  priv->sbuf_len = new_size;
+  pseudo_tcp_fifo_set_capacity (&priv->sbuf, new_size);
+}
+
+
+static guint8
+window_scale_for_size (guint32 size)
+{
+  guint8 scale_factor = 0;
+
+  // Determine the scale factor such that the scaled window size can fit
+  // in a 16-bit unsigned integer.
+  while (size > 0xFFFF) {
+    ++scale_factor;
+    size >>= 1;
+  }
+
+  return scale_factor;
+}
+
+static void
+resize_receive_buffer (PseudoTcpSocket *self, guint32 new_size)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+  guint8 scale_factor;
+  gboolean result;
+  gsize available_space;
+
+  // The scale factor is only sent on connection setup, so it has to be large
+  // enough for whatever size autotuning may grow the buffer to later.
+  scale_factor = window_scale_for_size (priv->rbuf_autotune ?
+      max (new_size, priv->rbuf_max) : new_size);
+
+  // Determine the proper size of the buffer.
+  new_size = (new_size >> scale_factor) << scale_factor;
+  if (new_size == 0)
+    new_size = 1 << scale_factor;
+
+  if (priv->rbuf_len == new_size && priv->rwnd_scale == scale_factor)
+    return;
+
+  result = pseudo_tcp_fifo_set_capacity (&priv->rbuf, new_size);
+
+  // Make sure the new buffer is large enough to contain data in the old
+  // buffer. This should always be true because this method is called either
+  // before connection is established or when peers are exchanging connect
+  // messages.
   g_assert (result);
   priv->rbuf_len = new_size;
   priv->rwnd_scale = scale_factor;
@@ -2504,12 +4351,161 @@ resize_receive_buffer (PseudoTcpSocket *self, guint32 new_size)
   priv->rcv_wnd = available_space;
 }
 
+/* The receiver can't sample the RTT from acknowledgements, and the echoed
+ * timestamps go stale when it only sends pure ACKs. Instead, like Linux's
+ * tcp_rcv_rtt_measure(), time how long it takes to receive one window of
+ * data, which is an upper bound of the RTT. */
+static void
+update_receive_rtt (PseudoTcpSocket *self, guint32 now)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+  guint32 sample;
+
+  if (priv->rcv_rtt_time != 0 &&
+      SMALLER (priv->rcv_nxt, priv->rcv_rtt_seq))
+    return;
+
+  if (priv->rcv_rtt_time != 0) {
+    sample = max (time_diff (now, priv->rcv_rtt_time), 1);
+    if (priv->rcv_rtt == 0 || sample < priv->rcv_rtt)
+      priv->rcv_rtt = sample;
+    else
+      priv->rcv_rtt = (7 * priv->rcv_rtt + sample) / 8;
+  }
+
+  priv->rcv_rtt_seq = priv->rcv_nxt + max (priv->rcv_wnd, priv->mss);
+  priv->rcv_rtt_time = now;
+}
+
+static gboolean
+autotune_under_pressure (void)
+{
+  return (gsize) g_atomic_pointer_get (&autotuned_memory) >=
+      AUTOTUNE_MEMORY_PRESSURE;
+}
+
+static void
+autotune_account (PseudoTcpSocket *self, guint32 old_size, guint32 new_size)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+  gssize delta = (gssize) new_size - (gssize) old_size;
+
+  priv->autotuned_bytes += delta;
+  g_atomic_pointer_add (&autotuned_memory, delta);
+}
+
+/* Called after the application read @bytesread bytes, before the receive
+ * window is reopened. Once per receiver RTT, the buffer is grown to twice the
+ * largest amount of data read within one RTT (as in Linux's
+ * tcp_rcv_space_adjust()), so that the window never limits a sender which
+ * the application keeps up with. Under memory pressure it is shrunk instead,
+ * but never below the right edge of the window already advertised. */
+static void
+autotune_receive_buffer (PseudoTcpSocket *self, guint32 bytesread)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+  guint32 now = get_current_time (self);
+  guint32 rtt, old_size, new_size;
+  gsize used;
+
+  if (!priv->rbuf_autotune || priv->state != PSEUDO_TCP_ESTABLISHED)
+    return;
+
+  rtt = priv->rcv_rtt ? priv->rcv_rtt : priv->rx_srtt;
+  if (rtt == 0)
+    return;
+
+  priv->rcvq_copied += bytesread;
+  if (priv->rcvq_time == 0) {
+    priv->rcvq_time = now;
+    return;
+  }
+  if (time_diff (now, priv->rcvq_time) < (long) rtt)
+    return;
+
+  old_size = priv->rbuf_len;
+
+  if (autotune_under_pressure ()) {
+    if (old_size <= DEFAULT_RCV_BUF_SIZE)
+      goto done;
+
+    // Everything up to the advertised right edge or the last out-of-order
+    // segment has to stay in the buffer.
+    used = pseudo_tcp_fifo_get_buffered (&priv->rbuf) + priv->rcv_wnd;
+    if (priv->rlist->len > 0) {
+      RSegment *last = &g_array_index (priv->rlist, RSegment,
+          priv->rlist->len - 1);
+
+      used = max (used, pseudo_tcp_fifo_get_buffered (&priv->rbuf) +
+          (last->seq + last->len - priv->rcv_nxt));
+    }
+
+    // Rounded up to the window scale, so as not to drop below what is used.
+    new_size = max (max (old_size / 2, DEFAULT_RCV_BUF_SIZE), used);
+    new_size = ((new_size + (1 << priv->rwnd_scale) - 1) >> priv->rwnd_scale)
+        << priv->rwnd_scale;
+    new_size = min (new_size, old_size);
+    priv->rcvq_space = new_size / 2;
+  } else if (priv->rcvq_copied > priv->rcvq_space) {
+    priv->rcvq_space = priv->rcvq_copied;
+    new_size = min (2 * priv->rcvq_space, priv->rbuf_max);
+    new_size = min (new_size, (guint32) 0xFFFF << priv->rwnd_scale);
+    new_size = (new_size >> priv->rwnd_scale) << priv->rwnd_scale;
+    if (new_size <= old_size)
+      goto done;
+  } else {
+    goto done;
+  }
+
+  if (new_size != old_size &&
+      pseudo_tcp_fifo_set_capacity (&priv->rbuf, new_size)) {
+    DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Receive buffer autotuned %u -> %u "
+        "(rtt: %u, read: %u)", old_size, new_size, rtt, priv->rcvq_copied);
+    priv->rbuf_len = new_size;
+    autotune_account (self, old_size, new_size);
+  }
+
+done:
+  priv->rcvq_copied = 0;
+  priv->rcvq_time = now;
+}
+
+/* Called on each new ACK: the send buffer has to hold a congestion window of
+ * unacknowledged data plus as much again queued behind it, so that the
+ * application can refill it while the window drains. */
+static void
+autotune_send_buffer (PseudoTcpSocket *self)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+  guint32 old_size = priv->sbuf_len;
+  guint32 new_size;
+
+  if (!priv->sbuf_autotune || autotune_under_pressure ())
+    return;
+
+  new_size = min (2 * min (priv->cwnd, max (priv->snd_wnd, priv->mss)),
+      priv->sbuf_max);
+  if (new_size <= old_size)
+    return;
+
+  DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "Send buffer autotuned %u -> %u (cwnd: %u)",
+      old_size, new_size, priv->cwnd);
+  resize_send_buffer (self, new_size);
+  autotune_account (self, old_size, new_size);
+}
+
 gint
 pseudo_tcp_socket_get_available_bytes (PseudoTcpSocket *self)
 {
   PseudoTcpSocketPrivate *priv = self->priv;
+  gsize available = pseudo_tcp_fifo_get_buffered (&priv->rbuf);
+  guint i;
 
-  return pseudo_tcp_fifo_get_buffered (&priv->rbuf);
+  // Abandoned data is never read
+  for (i = 0; i < priv->rskips->len; i++)
+    available -= g_array_index (priv->rskips, RSkip, i).len;
+
+  return available;
 }
 
 gboolean
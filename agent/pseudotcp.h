@@ -218,6 +218,29 @@ typedef enum {
   PSEUDO_TCP_SHUTDOWN_RDWR,
 } PseudoTcpShutdown;
 
+/**
+ * PseudoTcpCongestionControl:
+ * @PSEUDO_TCP_CONGESTION_RENO: NewReno, the loss-based algorithm pseudo-TCP
+ * has always used
+ * @PSEUDO_TCP_CONGESTION_CUBIC: CUBIC (RFC 9438), which grows the window as a
+ * cubic function of the time since the last loss, and so fills paths with a
+ * large bandwidth-delay product much faster than NewReno
+ * @PSEUDO_TCP_CONGESTION_BBR: A model-based algorithm in the spirit of BBR,
+ * which sizes the window from the measured bottleneck bandwidth and minimum
+ * round-trip time rather than from losses
+ *
+ * The congestion control algorithms which can be selected through the
+ * #PseudoTcpSocket:congestion-control property. The algorithm only affects
+ * the sending side, so both ends of a connection do not need to agree.
+ *
+ * Since: 0.1.24
+ */
+typedef enum {
+  PSEUDO_TCP_CONGESTION_RENO,
+  PSEUDO_TCP_CONGESTION_CUBIC,
+  PSEUDO_TCP_CONGESTION_BBR,
+} PseudoTcpCongestionControl;
+
 /**
  * PseudoTcpCallbacks:
  * @user_data: A user defined pointer to be passed to the callbacks
@@ -337,6 +360,57 @@ gint  pseudo_tcp_socket_recv(PseudoTcpSocket *self, char * buffer, size_t len);
 gint pseudo_tcp_socket_send(PseudoTcpSocket *self, const char * buffer,
     guint32 len);
 
+/**
+ * pseudo_tcp_socket_send_message:
+ * @self: The #PseudoTcpSocket object.
+ * @buffer: The message to send
+ * @len: The length of @buffer, between 1 and 32768 bytes
+ * @lifetime: Milliseconds after which the message may be abandoned, or 0 to
+ * deliver it reliably
+ *
+ * Send a whole message on the socket, to be received with
+ * pseudo_tcp_socket_recv_message(). Messages are delivered in order, but one
+ * with a @lifetime is dropped by the sender if it has not been acknowledged
+ * by then, and the receiver skips over it to the following messages. This is
+ * only done when the peer supports it; otherwise every message is delivered.
+ *
+ * The message is never sent in part: if there is not enough space for it,
+ * this function returns -1 with EWOULDBLOCK as the error and the
+ * %PseudoTcpCallbacks:PseudoTcpWritable callback will be called when the
+ * socket becomes writable. EMSGSIZE is returned for an invalid @len.
+ *
+ * Returns: @len, or -1 in case of error
+ * <para> See also: pseudo_tcp_socket_get_error() </para>
+ *
+ * Since: 0.1.24
+ */
+gint pseudo_tcp_socket_send_message (PseudoTcpSocket *self, const char *buffer,
+    guint32 len, guint32 lifetime);
+
+/**
+ * pseudo_tcp_socket_recv_message:
+ * @self: The #PseudoTcpSocket object.
+ * @buffer: The buffer to fill with the message
+ * @len: The length of @buffer
+ *
+ * Receive the next whole message sent with pseudo_tcp_socket_send_message().
+ * Messages the sender abandoned are skipped.
+ *
+ * If @buffer is too small for the message, -1 is returned with EMSGSIZE as
+ * the error and the message is kept. EBADMSG means the stream does not hold
+ * messages. As with pseudo_tcp_socket_recv(), EWOULDBLOCK means the
+ * %PseudoTcpCallbacks:PseudoTcpReadable callback will be called once more
+ * data arrives.
+ *
+ * Returns: The length of the message, 0 if the peer closed the connection,
+ * or -1 in case of error
+ * <para> See also: pseudo_tcp_socket_get_error() </para>
+ *
+ * Since: 0.1.24
+ */
+gint pseudo_tcp_socket_recv_message (PseudoTcpSocket *self, char *buffer,
+    size_t len);
+
 
 /**
  * pseudo_tcp_socket_close:
@@ -0,0 +1,115 @@
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+
+/*
+ * Buffered reader for streams of length-prefixed frames.
+ */
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "frame-reader.h"
+
+#include <string.h>
+
+void
+nice_frame_reader_init (NiceFrameReader *reader, gsize max_frame_size)
+{
+  reader->buf = NULL;
+  reader->size = 2 * max_frame_size;
+  reader->start = 0;
+  reader->end = 0;
+}
+
+void
+nice_frame_reader_clear (NiceFrameReader *reader)
+{
+  g_clear_pointer (&reader->buf, g_free);
+  reader->start = 0;
+  reader->end = 0;
+}
+
+gint
+nice_frame_reader_fill (NiceFrameReader *reader, NiceSocket *base_socket,
+    gsize needed, NiceAddress *from)
+{
+  GInputVector local_buf;
+  NiceInputMessage local_message;
+  gint ret;
+
+  g_assert (needed <= reader->size / 2);
+
+  if (reader->buf == NULL)
+    reader->buf = g_malloc (reader->size);
+
+  if (reader->start == reader->end) {
+    reader->start = 0;
+    reader->end = 0;
+  } else if (reader->size - reader->end < MAX (needed, reader->size / 4) ||
+      reader->start + needed > reader->size) {
+    /* Move the partial frame back, at most once per buffer's worth read */
+    memmove (reader->buf, reader->buf + reader->start,
+        reader->end - reader->start);
+    reader->end -= reader->start;
+    reader->start = 0;
+  }
+
+  local_buf.buffer = reader->buf + reader->end;
+  local_buf.size = reader->size - reader->end;
+  local_message.buffers = &local_buf;
+  local_message.n_buffers = 1;
+  local_message.from = from;
+  local_message.length = 0;
+
+  ret = nice_socket_recv_messages (base_socket, &local_message, 1, NULL);
+  if (ret == 1)
+    reader->end += local_message.length;
+
+  return ret;
+}
+
+guint8 *
+nice_frame_reader_get_data (NiceFrameReader *reader)
+{
+  return reader->buf + reader->start;
+}
+
+gsize
+nice_frame_reader_get_available (NiceFrameReader *reader)
+{
+  return reader->end - reader->start;
+}
+
+void
+nice_frame_reader_consume (NiceFrameReader *reader, gsize len)
+{
+  g_assert (len <= reader->end - reader->start);
+
+  reader->start += len;
+}
@@ -0,0 +1,108 @@
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+
+#ifndef _FRAME_READER_H
+#define _FRAME_READER_H
+
+#include "socket.h"
+
+G_BEGIN_DECLS
+
+/**
+ * NiceFrameReader:
+ *
+ * Reads a stream of length-prefixed frames (RFC 4571 or TURN over TCP) in
+ * large chunks, so that every frame which is complete after a read can be
+ * parsed in place without another system call. The buffer holds twice the
+ * largest frame, and the partial frame left at its end is only moved back to
+ * its start when there is too little room left to read into.
+ */
+typedef struct {
+  guint8 *buf;  /* owned, allocated by the first read */
+  gsize size;
+  gsize start;  /* offset of the first byte not consumed yet */
+  gsize end;  /* offset past the last byte read */
+} NiceFrameReader;
+
+/**
+ * nice_frame_reader_init:
+ * @reader: The reader to initialise
+ * @max_frame_size: Size of the largest frame, headers included
+ */
+void nice_frame_reader_init (NiceFrameReader *reader, gsize max_frame_size);
+
+/**
+ * nice_frame_reader_clear:
+ * @reader: The reader
+ *
+ * Frees the buffer, discarding any data left in it
+ */
+void nice_frame_reader_clear (NiceFrameReader *reader);
+
+/**
+ * nice_frame_reader_fill:
+ * @reader: The reader
+ * @base_socket: The socket to read from
+ * @needed: Number of bytes from the first unconsumed one which must fit in
+ * the buffer, typically the size of the frame being read
+ * @from: (out) (optional): Return location for the address the data came from
+ *
+ * Does a single read of as much as fits in the buffer.
+ *
+ * Returns: 1 if data was read, 0 if the read would block, -1 on error
+ */
+gint nice_frame_reader_fill (NiceFrameReader *reader, NiceSocket *base_socket,
+    gsize needed, NiceAddress *from);
+
+/**
+ * nice_frame_reader_get_data:
+ * @reader: The reader
+ *
+ * Returns: The first byte not consumed yet, valid until the next fill
+ */
+guint8 *nice_frame_reader_get_data (NiceFrameReader *reader);
+
+/**
+ * nice_frame_reader_get_available:
+ * @reader: The reader
+ *
+ * Returns: The number of bytes read but not consumed yet
+ */
+gsize nice_frame_reader_get_available (NiceFrameReader *reader);
+
+/**
+ * nice_frame_reader_consume:
+ * @reader: The reader
+ * @len: Number of bytes to consume, at most the available ones
+ */
+void nice_frame_reader_consume (NiceFrameReader *reader, gsize len);
+
+G_END_DECLS
+
+#endif /* _FRAME_READER_H */
@@ -276,6 +276,30 @@ nice_socket_is_based_on (NiceSocket *sock, NiceSocket *other)
   return (sock == other);
 }
 
+gboolean
+nice_socket_has_buffered_data (NiceSocket *sock)
+{
+  if (sock->has_buffered_data)
+    return sock->has_buffered_data (sock);
+  return FALSE;
+}
+
+gint
+nice_socket_send_zerocopy (NiceSocket *sock, const NiceAddress *to,
+    const NiceOutputMessage *message, GBytes *payload)
+{
+  if (sock->send_zerocopy)
+    return sock->send_zerocopy (sock, to, message, payload);
+  return sock->send_messages (sock, to, message, 1);
+}
+
+void
+nice_socket_set_corked (NiceSocket *sock, gboolean corked)
+{
+  if (sock->set_corked)
+    sock->set_corked (sock, corked);
+}
+
 void
 nice_socket_free (NiceSocket *sock)
 {
@@ -340,57 +364,6 @@ nice_socket_queue_send (GQueue *send_queue, const NiceAddress *to,
   }
 }
 
-void nice_socket_queue_send_with_callback (GQueue *send_queue,
-    const NiceOutputMessage *message, gsize message_offset, gsize message_len,
-    gboolean head, GSocket *gsock, GSource **io_source, GMainContext *context,
-    GSocketSourceFunc cb, gpointer user_data)
-{
-  NiceSocketQueuedSend *tbs;
-  guint j;
-  gsize offset = 0;
-
-  if (message_offset >= message_len)
-    return;
-
-  tbs = g_slice_new0 (NiceSocketQueuedSend);
-  tbs->length = message_len - message_offset;
-  tbs->buf = g_malloc (tbs->length);
-
-  if (head)
-    g_queue_push_head (send_queue, tbs);
-  else
-    g_queue_push_tail (send_queue, tbs);
-
-  /* Move the data into the buffer. */
-  for (j = 0;
-       (message->n_buffers >= 0 && j < (guint) message->n_buffers) ||
-       (message->n_buffers < 0 && message->buffers[j].buffer != NULL);
-       j++) {
-    const GOutputVector *buffer = &message->buffers[j];
-    gsize len;
-
-    /* Skip this buffer if it’s within @message_offset. */
-    if (buffer->size <= message_offset) {
-      message_offset -= buffer->size;
-      continue;
-    }
-
-    len = MIN (tbs->length - offset, buffer->size - message_offset);
-    memcpy (tbs->buf + offset, (guint8 *) buffer->buffer + message_offset, len);
-    offset += len;
-    if (message_offset >= len)
-      message_offset -= len;
-    else
-      message_offset = 0;
-  }
-
-  if (io_source && gsock && context && cb && *io_source == NULL) {
-    *io_source = g_socket_create_source(gsock, G_IO_OUT, NULL);
-    g_source_set_callback (*io_source, (GSourceFunc) G_CALLBACK (cb), user_data, NULL);
-    g_source_attach (*io_source, context);
-  }
-}
-
 void nice_socket_flush_send_queue (NiceSocket *base_socket, GQueue *send_queue)
 {
   NiceSocketQueuedSend *tbs;
@@ -408,48 +381,6 @@ void nice_socket_flush_send_queue (NiceSocket *base_socket, GQueue *send_queue)
   }
 }
 
-gboolean nice_socket_flush_send_queue_to_socket (GSocket *gsock,
-    GQueue *send_queue)
-{
-  NiceSocketQueuedSend *tbs;
-  GError *gerr = NULL;
-
-
-  while ((tbs = g_queue_pop_head (send_queue)) != NULL) {
-    int ret;
-
-    GOutputVector local_bufs = { tbs->buf, tbs->length };
-    ret = g_socket_send_message (gsock, NULL, &local_bufs, 1, NULL, 0,
-        G_SOCKET_MSG_NONE, NULL, &gerr);
-
-    if (ret < 0) {
-      if (g_error_matches (gerr, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK)) {
-        GOutputVector local_buf = { tbs->buf, tbs->length };
-        NiceOutputMessage local_message = {&local_buf, 1};
-
-        nice_socket_queue_send_with_callback (send_queue, &local_message,
-            0, local_buf.size, TRUE, NULL, NULL, NULL, NULL, NULL);
-        nice_socket_free_queued_send (tbs);
-        g_error_free (gerr);
-        return FALSE;
-      }
-      g_clear_error (&gerr);
-    } else if (ret < (int) tbs->length) {
-      GOutputVector local_buf = { tbs->buf + ret, tbs->length - ret };
-      NiceOutputMessage local_message = {&local_buf, 1};
-
-      nice_socket_queue_send_with_callback (send_queue, &local_message,
-          0, local_buf.size, TRUE, NULL, NULL, NULL, NULL, NULL);
-      nice_socket_free_queued_send (tbs);
-      return FALSE;
-    }
-
-    nice_socket_free_queued_send (tbs);
-  }
-
-  return TRUE;
-}
-
 void
 nice_socket_free_send_queue (GQueue *send_queue)
 {
@@ -90,6 +90,14 @@ struct _NiceSocket
   void (*set_writable_callback) (NiceSocket *sock,
       NiceSocketWritableCb callback, gpointer user_data);
   gboolean (*is_based_on) (NiceSocket *sock, NiceSocket *other);
+  /* Optional, for sockets which read ahead of the messages they return */
+  gboolean (*has_buffered_data) (NiceSocket *sock);
+  /* Optional, for sockets which can send without copying, see
+   * nice_socket_send_zerocopy() */
+  gint (*send_zerocopy) (NiceSocket *sock, const NiceAddress *to,
+      const NiceOutputMessage *message, GBytes *payload);
+  /* Optional, see nice_socket_set_corked() */
+  void (*set_corked) (NiceSocket *sock, gboolean corked);
   void (*close) (NiceSocket *sock);
   void *priv;
 };
@@ -144,6 +152,52 @@ nice_socket_set_writable_callback (NiceSocket *sock,
 gboolean
 nice_socket_is_based_on (NiceSocket *sock, NiceSocket *other);
 
+/**
+ * nice_socket_has_buffered_data:
+ * @sock: a #NiceSocket
+ *
+ * Checks whether @sock already read a whole message from the kernel which it
+ * has not returned yet. Polling its #GSocket does not tell about such data, so
+ * the socket must be read again.
+ *
+ * Returns: %TRUE if a message can be received without a system call
+ */
+gboolean
+nice_socket_has_buffered_data (NiceSocket *sock);
+
+/**
+ * nice_socket_send_zerocopy:
+ * @sock: a #NiceSocket
+ * @to: (allow-none): address of the destination, or %NULL for the default one
+ * @message: the message to send
+ * @payload: the data most of @message points to
+ *
+ * Sends @message like nice_socket_send_messages(), but lets the kernel read
+ * the buffers of @message which point into @payload directly from there,
+ * instead of copying them. @sock keeps a reference on @payload until the
+ * kernel is done with it, so the memory must not be modified until @payload
+ * is freed. The other buffers, for headers and trailers, are copied.
+ *
+ * Sockets which cannot avoid the copy just send @message.
+ *
+ * Returns: 1 if @message was sent, 0 if it would block, or -1 on error
+ */
+gint
+nice_socket_send_zerocopy (NiceSocket *sock, const NiceAddress *to,
+    const NiceOutputMessage *message, GBytes *payload);
+
+/**
+ * nice_socket_set_corked:
+ * @sock: a #NiceSocket
+ * @corked: whether to hold back the data sent
+ *
+ * While @sock is corked, the messages sent on it are queued instead of being
+ * written one by one, and they are written together once it is uncorked. This
+ * only has an effect on TCP sockets.
+ */
+void
+nice_socket_set_corked (NiceSocket *sock, gboolean corked);
+
 void
 nice_socket_free (NiceSocket *sock);
 
@@ -151,6 +205,7 @@ nice_socket_free (NiceSocket *sock);
 #include "tcp-bsd.h"
 #include "tcp-active.h"
 #include "tcp-passive.h"
+#include "tcp-so.h"
 #include "pseudossl.h"
 #include "socks5.h"
 #include "http.h"
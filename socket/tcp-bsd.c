@@ -56,24 +56,83 @@
 #include <unistd.h>
 #endif
 
+#ifdef HAVE_LINUX_ERRQUEUE_H
+#include <linux/errqueue.h>
+#endif
+
+#if defined (HAVE_LINUX_ERRQUEUE_H) && defined (MSG_ZEROCOPY) && \
+    defined (SO_ZEROCOPY)
+#define USE_ZEROCOPY 1
+#endif
+
 /* FIXME: This should be defined in gio/gnetworking.h, which we should include;
  * but we cannot do that without refactoring.
  * (See: https://phabricator.freedesktop.org/D230). */
 #undef TCP_NODELAY
 #define TCP_NODELAY 1
+#if defined (__linux__) && !defined (TCP_CORK)
+#define TCP_CORK 3
+#endif
 
-static GMutex mutex;
-
+/* Data which the kernel could not take yet is kept in a ring buffer, flushed
+ * with a single sendmsg() once the socket is writable. Above the high-water
+ * mark, unreliable sends would block. Reliable ones are still queued, as they
+ * may be completing a message which was partially sent. */
+#define SEND_QUEUE_MIN_SIZE 4096
+#define SEND_QUEUE_HIGH_WATER (64 * 1024)
+
+/* Below this size, pinning the pages of a zero-copy send costs more than
+ * copying them. */
+#define ZEROCOPY_MIN_SIZE (10 * 1024)
+#define ZEROCOPY_MAX_BUFFERS 8
+
+/* A socket closed with zero-copy sends still in flight is polled at this
+ * interval, in milliseconds, until the kernel is done with their pages. Past
+ * the timeout, in microseconds, the connection is reset instead. */
+#define ZEROCOPY_LINGER_INTERVAL 100
+#define ZEROCOPY_LINGER_TIMEOUT (10 * G_USEC_PER_SEC)
+
+typedef enum {
+  ZEROCOPY_UNTRIED,
+  ZEROCOPY_ENABLED,
+  ZEROCOPY_DISABLED,
+} ZerocopyState;
+
+/* A send with MSG_ZEROCOPY, whose memory the kernel may read until it reports
+ * the send @id as completed on the error queue. The kernel pins the small
+ * buffers around the payload too, so they are copied to @headers. */
 typedef struct {
+  guint32 id;
+  GBytes *payload;
+  guint8 headers[];
+} ZerocopySend;
+
+/* Each socket has its own lock. The source flushing the send queue holds a
+ * reference on the private data, so that it can still take the lock, and
+ * find itself destroyed, if it races with socket_close() in another thread. */
+typedef struct {
+  gint ref_count;
+  GMutex mutex;
+  NiceSocket *sock;
   NiceAddress remote_addr;
-  GQueue send_queue;
+  guint8 *send_buf;  /* ring of send_size bytes, a power of two */
+  gsize send_size;
+  gsize send_head;  /* offset of the first queued byte */
+  gsize send_len;  /* number of queued bytes */
   GMainContext *context;
   GSource *io_source;
+  gboolean corked;  /* queue everything until uncorked */
   gboolean error;
   gboolean reliable;
   NiceSocketWritableCb writable_cb;
   gpointer writable_data;
   NiceSocket *passive_parent;
+  gboolean simultaneous_open;  /* connected from a TCP-SO candidate */
+  ZerocopyState zerocopy;
+  guint32 zerocopy_next_id;  /* of the next send with MSG_ZEROCOPY */
+  GQueue zerocopy_pending;  /* of ZerocopySend, by id */
+  GSocket *lingering;  /* closed, until zero-copy sends complete */
+  gint64 linger_deadline;
 } TcpPriv;
 
 static void socket_close (NiceSocket *sock);
@@ -88,9 +147,30 @@ static gboolean socket_is_reliable (NiceSocket *sock);
 static gboolean socket_can_send (NiceSocket *sock, NiceAddress *addr);
 static void socket_set_writable_callback (NiceSocket *sock,
     NiceSocketWritableCb callback, gpointer user_data);
+static void socket_set_corked (NiceSocket *sock, gboolean corked);
 
 static gboolean socket_send_more (GSocket *gsocket, GIOCondition condition,
     gpointer data);
+#ifdef USE_ZEROCOPY
+static gint socket_send_zerocopy (NiceSocket *sock, const NiceAddress *to,
+    const NiceOutputMessage *message, GBytes *payload);
+#endif
+
+static TcpPriv *
+priv_ref (TcpPriv *priv)
+{
+  g_atomic_int_inc (&priv->ref_count);
+  return priv;
+}
+
+static void
+priv_unref (TcpPriv *priv)
+{
+  if (g_atomic_int_dec_and_test (&priv->ref_count)) {
+    g_mutex_clear (&priv->mutex);
+    g_slice_free (TcpPriv, priv);
+  }
+}
 
 NiceSocket *
 nice_tcp_bsd_socket_new_from_gsock (GMainContext *ctx, GSocket *gsock,
@@ -103,6 +183,9 @@ nice_tcp_bsd_socket_new_from_gsock (GMainContext *ctx, GSocket *gsock,
 
   sock = g_slice_new0 (NiceSocket);
   sock->priv = priv = g_slice_new0 (TcpPriv);
+  priv->ref_count = 1;
+  g_mutex_init (&priv->mutex);
+  priv->sock = sock;
 
   if (ctx == NULL)
     ctx = g_main_context_default ();
@@ -112,6 +195,7 @@ nice_tcp_bsd_socket_new_from_gsock (GMainContext *ctx, GSocket *gsock,
   priv->reliable = reliable;
   priv->writable_cb = NULL;
   priv->writable_data = NULL;
+  g_queue_init (&priv->zerocopy_pending);
 
   sock->type = NICE_SOCKET_TYPE_TCP_BSD;
   sock->fileno = g_object_ref (gsock);
@@ -122,6 +206,10 @@ nice_tcp_bsd_socket_new_from_gsock (GMainContext *ctx, GSocket *gsock,
   sock->is_reliable = socket_is_reliable;
   sock->can_send = socket_can_send;
   sock->set_writable_callback = socket_set_writable_callback;
+  sock->set_corked = socket_set_corked;
+#ifdef USE_ZEROCOPY
+  sock->send_zerocopy = socket_send_zerocopy;
+#endif
   sock->close = socket_close;
 
   return sock;
@@ -212,15 +300,206 @@ nice_tcp_bsd_socket_new (GMainContext *ctx, NiceAddress *local_addr,
 }
 
 
+#ifdef USE_ZEROCOPY
+
+static void
+zerocopy_send_free (ZerocopySend *zs)
+{
+  g_bytes_unref (zs->payload);
+  g_free (zs);
+}
+
+/* Moves the pending sends with an id from @first to @last to @completed */
+static void
+zerocopy_complete (TcpPriv *priv, guint32 first, guint32 last,
+    GQueue *completed)
+{
+  GList *l = priv->zerocopy_pending.head;
+
+  while (l != NULL) {
+    GList *next = l->next;
+    ZerocopySend *zs = l->data;
+
+    /* The ids wrap around */
+    if (zs->id - first <= last - first) {
+      g_queue_unlink (&priv->zerocopy_pending, l);
+      g_queue_push_tail_link (completed, l);
+    }
+    l = next;
+  }
+}
+
+/* Reads the notifications of completed zero-copy sends from the error queue
+ * of @gsock. The socket polls with G_IO_ERR as long as the queue is not empty,
+ * so this is done on every read and flush. Must be called with the lock
+ * held. */
+static void
+zerocopy_reap (TcpPriv *priv, GSocket *gsock, GQueue *completed)
+{
+  gint fd;
+
+  if (g_queue_is_empty (&priv->zerocopy_pending) || gsock == NULL)
+    return;
+
+  fd = g_socket_get_fd (gsock);
+
+  while (TRUE) {
+    union {
+      struct cmsghdr hdr;
+      guint8 buf[CMSG_SPACE (sizeof (struct sock_extended_err))];
+    } control;
+    struct msghdr msg = { 0, };
+    struct cmsghdr *cmsg;
+
+    msg.msg_control = &control;
+    msg.msg_controllen = sizeof (control);
+
+    if (recvmsg (fd, &msg, MSG_ERRQUEUE) < 0)
+      break;
+
+    for (cmsg = CMSG_FIRSTHDR (&msg); cmsg != NULL;
+         cmsg = CMSG_NXTHDR (&msg, cmsg)) {
+      struct sock_extended_err serr;
+
+      if (!(cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_RECVERR) &&
+          !(cmsg->cmsg_level == IPPROTO_IPV6 &&
+              cmsg->cmsg_type == IPV6_RECVERR))
+        continue;
+
+      memcpy (&serr, CMSG_DATA (cmsg), sizeof (serr));
+      if (serr.ee_errno != 0 || serr.ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+        continue;
+
+      /* The kernel copied the data after all, as it does on the loopback
+       * interface: pinning the pages only adds to the cost then. */
+      if ((serr.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) &&
+          priv->zerocopy == ZEROCOPY_ENABLED) {
+        nice_debug ("tcp-bsd: %p: zero-copy sends were copied, disabling",
+            priv->sock);
+        priv->zerocopy = ZEROCOPY_DISABLED;
+      }
+
+      zerocopy_complete (priv, serr.ee_info, serr.ee_data, completed);
+    }
+  }
+}
+
+/* Releases the payloads of @completed. This calls back into the application,
+ * so it must be done without the lock held. */
+static void
+zerocopy_release (GQueue *completed)
+{
+  g_list_free_full (completed->head, (GDestroyNotify) zerocopy_send_free);
+  g_queue_init (completed);
+}
+
+static gboolean
+zerocopy_linger_cb (gpointer data)
+{
+  TcpPriv *priv = data;
+  GQueue completed = G_QUEUE_INIT;
+  gboolean done;
+
+  g_mutex_lock (&priv->mutex);
+  zerocopy_reap (priv, priv->lingering, &completed);
+  done = g_queue_is_empty (&priv->zerocopy_pending) ||
+      g_get_monotonic_time () >= priv->linger_deadline;
+  g_mutex_unlock (&priv->mutex);
+
+  zerocopy_release (&completed);
+
+  return done ? G_SOURCE_REMOVE : G_SOURCE_CONTINUE;
+}
+
+static void
+zerocopy_linger_done (gpointer data)
+{
+  TcpPriv *priv = data;
+  GQueue pending;
+
+  g_mutex_lock (&priv->mutex);
+
+  /* Gave up waiting, or the context went away: resetting the connection makes
+   * the kernel drop the data instead of sending it from the payloads. */
+  if (!g_queue_is_empty (&priv->zerocopy_pending)) {
+    struct linger linger = { 1, 0 };
+
+    nice_debug ("tcp-bsd: %p: zero-copy sends did not complete, resetting",
+        priv->sock);
+    setsockopt (g_socket_get_fd (priv->lingering), SOL_SOCKET, SO_LINGER,
+        &linger, sizeof (linger));
+  }
+  g_socket_close (priv->lingering, NULL);
+  g_clear_object (&priv->lingering);
+
+  pending = priv->zerocopy_pending;
+  g_queue_init (&priv->zerocopy_pending);
+
+  g_mutex_unlock (&priv->mutex);
+
+  zerocopy_release (&pending);
+
+  priv_unref (priv);
+}
+
+/* The kernel may still read the payloads of sends which have not completed
+ * when the socket is closed, as a graceful close keeps transmitting them. The
+ * stream is shut down for writing then, but @gsock is kept open to read the
+ * completions. Returns whether @gsock was kept. Must be called with the lock
+ * held. */
+static gboolean
+zerocopy_linger (TcpPriv *priv, GSocket *gsock)
+{
+  GSource *source;
+
+  if (g_queue_is_empty (&priv->zerocopy_pending))
+    return FALSE;
+
+  g_socket_shutdown (gsock, FALSE, TRUE, NULL);
+  priv->lingering = g_object_ref (gsock);
+  priv->linger_deadline = g_get_monotonic_time () + ZEROCOPY_LINGER_TIMEOUT;
+
+  source = g_timeout_source_new (ZEROCOPY_LINGER_INTERVAL);
+  g_source_set_callback (source, zerocopy_linger_cb, priv_ref (priv),
+      zerocopy_linger_done);
+  g_source_attach (source, priv->context);
+  g_source_unref (source);
+
+  return TRUE;
+}
+
+#else
+
+static void
+zerocopy_reap (TcpPriv *priv, GSocket *gsock, GQueue *completed)
+{
+}
+
+static void
+zerocopy_release (GQueue *completed)
+{
+}
+
+static gboolean
+zerocopy_linger (TcpPriv *priv, GSocket *gsock)
+{
+  return FALSE;
+}
+
+#endif
+
 static void
 socket_close (NiceSocket *sock)
 {
   TcpPriv *priv = sock->priv;
+  GQueue completed = G_QUEUE_INIT;
 
-  g_mutex_lock (&mutex);
+  g_mutex_lock (&priv->mutex);
 
   if (sock->fileno) {
-    g_socket_close (sock->fileno, NULL);
+    zerocopy_reap (priv, sock->fileno, &completed);
+    if (!zerocopy_linger (priv, sock->fileno))
+      g_socket_close (sock->fileno, NULL);
     g_object_unref (sock->fileno);
     sock->fileno = NULL;
   }
@@ -233,14 +512,16 @@ socket_close (NiceSocket *sock)
     nice_tcp_passive_socket_remove_connection (priv->passive_parent, &priv->remote_addr);
   }
 
-  nice_socket_free_send_queue (&priv->send_queue);
+  g_free (priv->send_buf);
 
   if (priv->context)
     g_main_context_unref (priv->context);
 
-  g_mutex_unlock (&mutex);
+  g_mutex_unlock (&priv->mutex);
 
-  g_slice_free(TcpPriv, sock->priv);
+  zerocopy_release (&completed);
+
+  priv_unref (priv);
 }
 
 static gint
@@ -249,6 +530,7 @@ socket_recv_messages (NiceSocket *sock,
     NiceMessageExtraData *exdata)
 {
   TcpPriv *priv = sock->priv;
+  GQueue completed = G_QUEUE_INIT;
   guint i;
 
   /* Make sure socket has not been freed: */
@@ -258,6 +540,13 @@ socket_recv_messages (NiceSocket *sock,
   if (priv->error)
     return -1;
 
+  if (priv->zerocopy != ZEROCOPY_UNTRIED) {
+    g_mutex_lock (&priv->mutex);
+    zerocopy_reap (priv, sock->fileno, &completed);
+    g_mutex_unlock (&priv->mutex);
+    zerocopy_release (&completed);
+  }
+
   for (i = 0; i < n_recv_messages; i++) {
     gint flags = G_SOCKET_MSG_NONE;
     GError *gerr = NULL;
@@ -295,6 +584,162 @@ socket_recv_messages (NiceSocket *sock,
   return i;
 }
 
+/* Fills @vectors with the queued data, in order, and returns their number */
+static guint
+send_queue_get_vectors (TcpPriv *priv, GOutputVector vectors[2])
+{
+  gsize first = MIN (priv->send_len, priv->send_size - priv->send_head);
+
+  if (priv->send_len == 0)
+    return 0;
+
+  vectors[0].buffer = priv->send_buf + priv->send_head;
+  vectors[0].size = first;
+  if (first == priv->send_len)
+    return 1;
+
+  vectors[1].buffer = priv->send_buf;
+  vectors[1].size = priv->send_len - first;
+  return 2;
+}
+
+static void
+send_queue_grow (TcpPriv *priv, gsize min_size)
+{
+  GOutputVector vectors[2];
+  guint n_vectors, i;
+  gsize size = MAX (priv->send_size, SEND_QUEUE_MIN_SIZE);
+  gsize offset = 0;
+  guint8 *buf;
+
+  while (size < min_size)
+    size *= 2;
+
+  buf = g_malloc (size);
+  n_vectors = send_queue_get_vectors (priv, vectors);
+  for (i = 0; i < n_vectors; i++) {
+    memcpy (buf + offset, vectors[i].buffer, vectors[i].size);
+    offset += vectors[i].size;
+  }
+
+  g_free (priv->send_buf);
+  priv->send_buf = buf;
+  priv->send_size = size;
+  priv->send_head = 0;
+}
+
+/* Makes sure a source will flush the queue once the socket is writable */
+static void
+send_queue_watch (NiceSocket *sock)
+{
+  TcpPriv *priv = sock->priv;
+
+  if (priv->io_source == NULL) {
+    /* The source holds a reference, see TcpPriv */
+    priv->io_source = g_socket_create_source (sock->fileno, G_IO_OUT, NULL);
+    g_source_set_callback (priv->io_source,
+        (GSourceFunc) G_CALLBACK (socket_send_more), priv_ref (priv),
+        (GDestroyNotify) priv_unref);
+    g_source_attach (priv->io_source, priv->context);
+  }
+}
+
+/* Queues @message from @message_offset, and unless corked, makes sure a
+ * source will send it once the socket is writable. Must be called with the
+ * lock held. */
+static void
+send_queue_push (NiceSocket *sock, const NiceOutputMessage *message,
+    gsize message_offset, gsize message_len)
+{
+  TcpPriv *priv = sock->priv;
+  gsize len;
+  guint j;
+
+  if (message_offset >= message_len)
+    return;
+
+  len = message_len - message_offset;
+  if (priv->send_len + len > priv->send_size)
+    send_queue_grow (priv, priv->send_len + len);
+
+  for (j = 0;
+       len > 0 &&
+       ((message->n_buffers >= 0 && j < (guint) message->n_buffers) ||
+        (message->n_buffers < 0 && message->buffers[j].buffer != NULL));
+       j++) {
+    const GOutputVector *buffer = &message->buffers[j];
+    const guint8 *data = buffer->buffer;
+    gsize size = buffer->size;
+
+    /* Skip this buffer if it’s within @message_offset. */
+    if (size <= message_offset) {
+      message_offset -= size;
+      continue;
+    }
+
+    data += message_offset;
+    size = MIN (size - message_offset, len);
+    message_offset = 0;
+    len -= size;
+
+    while (size > 0) {
+      gsize tail = (priv->send_head + priv->send_len) & (priv->send_size - 1);
+      gsize n = MIN (size, priv->send_size - tail);
+
+      memcpy (priv->send_buf + tail, data, n);
+      priv->send_len += n;
+      data += n;
+      size -= n;
+    }
+  }
+
+  if (!priv->corked)
+    send_queue_watch (sock);
+}
+
+/* Sends as much of the queue as the socket takes. Returns TRUE if the queue
+ * was emptied, FALSE if the socket would block. */
+static gboolean
+send_queue_flush (NiceSocket *sock)
+{
+  TcpPriv *priv = sock->priv;
+  GError *gerr = NULL;
+
+  while (priv->send_len > 0) {
+    GOutputVector vectors[2];
+    guint n_vectors;
+    gssize ret;
+
+    n_vectors = send_queue_get_vectors (priv, vectors);
+    ret = g_socket_send_message (sock->fileno, NULL, vectors, n_vectors,
+        NULL, 0, G_SOCKET_MSG_NONE, NULL, &gerr);
+
+    if (ret < 0) {
+      if (g_error_matches (gerr, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK)) {
+        g_error_free (gerr);
+        return FALSE;
+      }
+
+      nice_debug ("tcp-bsd: dropping %" G_GSIZE_FORMAT " queued bytes: %s",
+          priv->send_len, gerr->message);
+      g_clear_error (&gerr);
+      ret = priv->send_len;
+    }
+
+    priv->send_head = (priv->send_head + ret) & (priv->send_size - 1);
+    priv->send_len -= ret;
+  }
+
+  /* Don't hold on to the memory of a large burst */
+  priv->send_head = 0;
+  if (priv->send_size > SEND_QUEUE_HIGH_WATER) {
+    g_clear_pointer (&priv->send_buf, g_free);
+    priv->send_size = 0;
+  }
+
+  return TRUE;
+}
+
 static gssize
 socket_send_message (NiceSocket *sock,
     const NiceOutputMessage *message, gboolean reliable)
@@ -312,13 +757,13 @@ socket_send_message (NiceSocket *sock,
   if (priv->error)
     return -1;
 
-  g_mutex_lock(&mutex);
+  g_mutex_lock (&priv->mutex);
 
   message_len = output_message_get_size (message);
 
   /* First try to send the data, don't send it later if it can be sent now
-   * this way we avoid allocating memory on every send */
-  if (g_queue_is_empty (&priv->send_queue)) {
+   * this way we avoid copying it on every send */
+  if (priv->send_len == 0 && !priv->corked) {
     ret = g_socket_send_message (sock->fileno, NULL, message->buffers,
         message->n_buffers, NULL, 0, G_SOCKET_MSG_NONE, NULL, &gerr);
 
@@ -327,35 +772,32 @@ socket_send_message (NiceSocket *sock,
           g_error_matches (gerr, G_IO_ERROR, G_IO_ERROR_NOT_CONNECTED) ||
           g_error_matches (gerr, G_IO_ERROR, G_IO_ERROR_FAILED)) {
         /* Queue the message and send it later. */
-        nice_socket_queue_send_with_callback (&priv->send_queue,
-            message, 0, message_len, FALSE, sock->fileno, &priv->io_source,
-            priv->context, socket_send_more, sock);
+        send_queue_push (sock, message, 0, message_len);
         ret = message_len;
       }
 
       g_error_free (gerr);
     } else if ((gsize) ret < message_len) {
       /* Partial send. */
-      nice_socket_queue_send_with_callback (&priv->send_queue,
-          message, ret, message_len, TRUE, sock->fileno, &priv->io_source,
-          priv->context, socket_send_more, sock);
+      send_queue_push (sock, message, ret, message_len);
       ret = message_len;
     }
+  } else if (reliable || priv->send_len < SEND_QUEUE_HIGH_WATER) {
+    /* Queue the message behind the rest and send it later. */
+    send_queue_push (sock, message, 0, message_len);
+    ret = message_len;
   } else {
-    /* Only queue if we're sending reliably  */
-    if (reliable) {
-      /* Queue the message and send it later. */
-      nice_socket_queue_send_with_callback (&priv->send_queue,
-          message, 0, message_len, FALSE, sock->fileno, &priv->io_source,
-          priv->context, socket_send_more, sock);
-      ret = message_len;
-    } else {
-      /* non reliable send, so we shouldn't queue the message */
-      ret = 0;
-    }
+    /* Above the high-water mark: a non reliable send would block */
+    ret = 0;
   }
 
-  g_mutex_unlock(&mutex);
+  /* Even corked, a full queue is written out; TCP_CORK still keeps the
+   * segments full. */
+  if (priv->corked && priv->send_len >= SEND_QUEUE_HIGH_WATER &&
+      !send_queue_flush (sock))
+    send_queue_watch (sock);
+
+  g_mutex_unlock (&priv->mutex);
 
   return ret;
 }
@@ -408,6 +850,122 @@ socket_send_messages_reliable (NiceSocket *sock, const NiceAddress *to,
   return i;
 }
 
+#ifdef USE_ZEROCOPY
+static gboolean
+zerocopy_enable (NiceSocket *sock)
+{
+  TcpPriv *priv = sock->priv;
+  GError *gerr = NULL;
+
+  if (priv->zerocopy == ZEROCOPY_UNTRIED) {
+    if (g_socket_set_option (sock->fileno, SOL_SOCKET, SO_ZEROCOPY, TRUE,
+            &gerr)) {
+      priv->zerocopy = ZEROCOPY_ENABLED;
+    } else {
+      nice_debug ("tcp-bsd: %p: zero-copy sends not supported: %s", sock,
+          gerr->message);
+      g_error_free (gerr);
+      priv->zerocopy = ZEROCOPY_DISABLED;
+    }
+  }
+
+  return priv->zerocopy == ZEROCOPY_ENABLED;
+}
+
+/* Sends the large payloads directly from the memory of the application, when
+ * nothing is queued before them, and copies the rest like any other send. */
+static gint
+socket_send_zerocopy (NiceSocket *sock, const NiceAddress *to,
+    const NiceOutputMessage *message, GBytes *payload)
+{
+  TcpPriv *priv = sock->priv;
+  GQueue completed = G_QUEUE_INIT;
+  GOutputVector vectors[ZEROCOPY_MAX_BUFFERS];
+  ZerocopySend *zs;
+  const guint8 *data;
+  gsize data_len, message_len, headers_len = 0, offset = 0;
+  guint n_buffers = 0, j;
+  gssize ret;
+  GError *gerr = NULL;
+
+  /* Make sure socket has not been freed: */
+  g_assert (sock->priv != NULL);
+
+  if (priv->error)
+    return -1;
+
+  data = g_bytes_get_data (payload, &data_len);
+  message_len = output_message_get_size (message);
+
+  g_mutex_lock (&priv->mutex);
+
+  zerocopy_reap (priv, sock->fileno, &completed);
+
+  if (priv->send_len > 0 || priv->corked || data_len < ZEROCOPY_MIN_SIZE)
+    goto copy;
+
+  for (n_buffers = 0;
+       (message->n_buffers >= 0 && n_buffers < (guint) message->n_buffers) ||
+       (message->n_buffers < 0 && message->buffers[n_buffers].buffer != NULL);
+       n_buffers++) {
+    const guint8 *buffer = message->buffers[n_buffers].buffer;
+    gsize size = message->buffers[n_buffers].size;
+
+    if (n_buffers == ZEROCOPY_MAX_BUFFERS)
+      goto copy;
+    if (buffer < data || buffer + size > data + data_len)
+      headers_len += size;
+  }
+
+  if (!zerocopy_enable (sock))
+    goto copy;
+
+  zs = g_malloc (sizeof (ZerocopySend) + headers_len);
+  for (j = 0; j < n_buffers; j++) {
+    const GOutputVector *buffer = &message->buffers[j];
+    const guint8 *buffer_data = buffer->buffer;
+
+    if (buffer_data < data || buffer_data + buffer->size > data + data_len) {
+      memcpy (zs->headers + offset, buffer_data, buffer->size);
+      vectors[j].buffer = zs->headers + offset;
+      offset += buffer->size;
+    } else {
+      vectors[j].buffer = buffer_data;
+    }
+    vectors[j].size = buffer->size;
+  }
+
+  ret = g_socket_send_message (sock->fileno, NULL, vectors, n_buffers,
+      NULL, 0, MSG_ZEROCOPY, NULL, &gerr);
+
+  if (ret < 0) {
+    /* Nothing was sent: let the copying path queue it or fail */
+    g_error_free (gerr);
+    g_free (zs);
+    goto copy;
+  }
+
+  zs->id = priv->zerocopy_next_id++;
+  zs->payload = g_bytes_ref (payload);
+  g_queue_push_tail (&priv->zerocopy_pending, zs);
+
+  /* Partial send. */
+  if ((gsize) ret < message_len)
+    send_queue_push (sock, message, ret, message_len);
+
+  g_mutex_unlock (&priv->mutex);
+  zerocopy_release (&completed);
+
+  return 1;
+
+copy:
+  g_mutex_unlock (&priv->mutex);
+  zerocopy_release (&completed);
+
+  return socket_send_messages (sock, to, message, 1);
+}
+#endif
+
 static gboolean
 socket_is_reliable (NiceSocket *sock)
 {
@@ -420,8 +978,13 @@ static gboolean
 socket_can_send (NiceSocket *sock, NiceAddress *addr)
 {
   TcpPriv *priv = sock->priv;
+  gboolean can_send;
 
-  return g_queue_is_empty (&priv->send_queue);
+  g_mutex_lock (&priv->mutex);
+  can_send = priv->send_len < SEND_QUEUE_HIGH_WATER;
+  g_mutex_unlock (&priv->mutex);
+
+  return can_send;
 }
 
 static void
@@ -430,8 +993,46 @@ socket_set_writable_callback (NiceSocket *sock,
 {
   TcpPriv *priv = sock->priv;
 
+  g_mutex_lock (&priv->mutex);
   priv->writable_cb = callback;
   priv->writable_data = user_data;
+  g_mutex_unlock (&priv->mutex);
+}
+
+static void
+socket_set_corked (NiceSocket *sock, gboolean corked)
+{
+  TcpPriv *priv = sock->priv;
+
+  g_mutex_lock (&priv->mutex);
+
+  if (priv->corked == corked || sock->fileno == NULL) {
+    g_mutex_unlock (&priv->mutex);
+    return;
+  }
+
+  priv->corked = corked;
+
+#ifdef TCP_CORK
+  if (corked)
+    g_socket_set_option (sock->fileno, IPPROTO_TCP, TCP_CORK, TRUE, NULL);
+#endif
+
+  if (!corked) {
+    gboolean was_blocked = priv->send_len >= SEND_QUEUE_HIGH_WATER;
+
+    /* The writable callback cannot be called from here, as the caller may
+     * hold the lock it takes: the source calls it once the queue is empty. */
+    if (!send_queue_flush (sock) || was_blocked)
+      send_queue_watch (sock);
+
+#ifdef TCP_CORK
+    /* Pushes out the last partial segment */
+    g_socket_set_option (sock->fileno, IPPROTO_TCP, TCP_CORK, FALSE, NULL);
+#endif
+  }
+
+  g_mutex_unlock (&priv->mutex);
 }
 
 static gboolean
@@ -440,37 +1041,54 @@ socket_send_more (
   GIOCondition condition,
   gpointer data)
 {
-  NiceSocket *sock = (NiceSocket *) data;
-  TcpPriv *priv;
+  TcpPriv *priv = data;
+  NiceSocket *sock;
+  GQueue completed = G_QUEUE_INIT;
+  gboolean was_blocked, unblocked;
+  NiceSocketWritableCb writable_cb;
+  gpointer writable_data;
 
-  g_mutex_lock (&mutex);
+  g_mutex_lock (&priv->mutex);
 
   if (g_source_is_destroyed (g_main_current_source ())) {
     nice_debug ("Source was destroyed. "
         "Avoided race condition in tcp-bsd.c:socket_send_more");
-    g_mutex_unlock (&mutex);
+    g_mutex_unlock (&priv->mutex);
     return FALSE;
   }
 
-  priv = sock->priv;
+  sock = priv->sock;
+  writable_cb = priv->writable_cb;
+  writable_data = priv->writable_data;
+  zerocopy_reap (priv, sock->fileno, &completed);
+  was_blocked = priv->send_len >= SEND_QUEUE_HIGH_WATER;
 
   /* connection hangs up or queue was emptied */
-  if (condition & G_IO_HUP ||
-      nice_socket_flush_send_queue_to_socket (sock->fileno,
-          &priv->send_queue)) {
+  if (condition & G_IO_HUP || send_queue_flush (sock)) {
     g_source_destroy (priv->io_source);
     g_source_unref (priv->io_source);
     priv->io_source = NULL;
 
-    g_mutex_unlock (&mutex);
+    g_mutex_unlock (&priv->mutex);
+
+    zerocopy_release (&completed);
 
-    if (priv->writable_cb)
-      priv->writable_cb (sock, priv->writable_data);
+    if (writable_cb)
+      writable_cb (sock, writable_data);
 
     return FALSE;
   }
 
-  g_mutex_unlock (&mutex);
+  /* Unblock the sender as soon as it drops below the high-water mark */
+  unblocked = was_blocked && priv->send_len < SEND_QUEUE_HIGH_WATER;
+
+  g_mutex_unlock (&priv->mutex);
+
+  zerocopy_release (&completed);
+
+  if (unblocked && writable_cb)
+    writable_cb (sock, writable_data);
+
   return TRUE;
 }
 
@@ -491,3 +1109,19 @@ nice_tcp_bsd_socket_get_passive_parent (NiceSocket *sock)
 
   return priv->passive_parent;
 }
+
+void
+nice_tcp_bsd_socket_set_simultaneous_open (NiceSocket *sock)
+{
+  TcpPriv *priv = sock->priv;
+
+  priv->simultaneous_open = TRUE;
+}
+
+gboolean
+nice_tcp_bsd_socket_is_simultaneous_open (NiceSocket *sock)
+{
+  TcpPriv *priv = sock->priv;
+
+  return priv->simultaneous_open;
+}
@@ -55,6 +55,12 @@ nice_tcp_bsd_socket_set_passive_parent (NiceSocket *socket, NiceSocket *passive_
 NiceSocket *
 nice_tcp_bsd_socket_get_passive_parent (NiceSocket *socket);
 
+void
+nice_tcp_bsd_socket_set_simultaneous_open (NiceSocket *socket);
+
+gboolean
+nice_tcp_bsd_socket_is_simultaneous_open (NiceSocket *socket);
+
 G_END_DECLS
 
 #endif /* _TCP_BSD_H */
@@ -0,0 +1,294 @@
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+
+/*
+ * Implementation of the ICE-TCP simultaneous-open candidates (RFC 6544,
+ * section 4.2). The candidate socket only reserves its local port: it is
+ * bound with SO_REUSEADDR, but never listens. Each check then connects a new
+ * socket bound to the very same address, so that the two peers connecting to
+ * each other at the same time open a single connection, even through NATs
+ * that drop the incoming SYNs.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "socket.h"
+#include "tcp-so.h"
+#include "agent-priv.h"
+
+#include <string.h>
+
+/* FIXME: This should be defined in gio/gnetworking.h, which we should include;
+ * but we cannot do that without refactoring.
+ * (See: https://phabricator.freedesktop.org/D230). */
+#undef TCP_NODELAY
+#define TCP_NODELAY 1
+
+typedef struct {
+  GSocket *gsock;  /* bound, to keep the port ours */
+  GSocketAddress *local_addr;
+  GMainContext *context;
+} TcpSoPriv;
+
+
+static void socket_close (NiceSocket *sock);
+static gint socket_recv_messages (NiceSocket *sock,
+    NiceInputMessage *recv_messages, guint n_recv_messages,
+    NiceMessageExtraData *exdata);
+static gint socket_send_messages (NiceSocket *sock, const NiceAddress *to,
+    const NiceOutputMessage *messages, guint n_messages);
+static gint socket_send_messages_reliable (NiceSocket *sock,
+    const NiceAddress *to, const NiceOutputMessage *messages, guint n_messages);
+static gboolean socket_is_reliable (NiceSocket *sock);
+static gboolean socket_can_send (NiceSocket *sock, NiceAddress *addr);
+static void socket_set_writable_callback (NiceSocket *sock,
+    NiceSocketWritableCb callback, gpointer user_data);
+
+
+static GSocket *
+tcp_so_socket_bind (GSocketAddress *gaddr, GError **error)
+{
+  GSocket *gsock;
+
+  gsock = g_socket_new (g_socket_address_get_family (gaddr),
+      G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_TCP, error);
+
+  if (gsock == NULL)
+    return NULL;
+
+  /* GSocket: All socket file descriptors are set to be close-on-exec. */
+  g_socket_set_blocking (gsock, false);
+
+  /* setting TCP_NODELAY to TRUE in order to avoid packet batching */
+  g_socket_set_option (gsock, IPPROTO_TCP, TCP_NODELAY, TRUE, NULL);
+
+  /* Every socket sharing the port must allow it, none of them may listen. */
+  if (!g_socket_bind (gsock, gaddr, TRUE, error)) {
+    g_socket_close (gsock, NULL);
+    g_object_unref (gsock);
+    return NULL;
+  }
+
+  return gsock;
+}
+
+NiceSocket *
+nice_tcp_so_socket_new (GMainContext *ctx, NiceAddress *addr, GError **error)
+{
+  union {
+    struct sockaddr_storage storage;
+    struct sockaddr addr;
+  } name;
+  NiceSocket *sock;
+  TcpSoPriv *priv;
+  GSocket *gsock;
+  GSocketAddress *gaddr;
+
+  if (addr != NULL) {
+    nice_address_copy_to_sockaddr (addr, &name.addr);
+  } else {
+    memset (&name, 0, sizeof (name));
+    name.storage.ss_family = AF_INET;
+#ifdef HAVE_SA_LEN
+    name.storage.ss_len = sizeof (struct sockaddr_in);
+#endif
+  }
+
+  gaddr = g_socket_address_new_from_native (&name.addr, sizeof (name));
+
+  if (gaddr == NULL) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+        "Invalid local address");
+    return NULL;
+  }
+
+  gsock = tcp_so_socket_bind (gaddr, error);
+  g_object_unref (gaddr);
+
+  if (gsock == NULL)
+    return NULL;
+
+  /* The connections must be bound to the port actually picked. */
+  gaddr = g_socket_get_local_address (gsock, error);
+  if (gaddr == NULL ||
+      !g_socket_address_to_native (gaddr, &name.addr, sizeof (name), error)) {
+    g_clear_object (&gaddr);
+    g_socket_close (gsock, NULL);
+    g_object_unref (gsock);
+    return NULL;
+  }
+
+  if (ctx == NULL) {
+    ctx = g_main_context_default ();
+  }
+
+  sock = g_slice_new0 (NiceSocket);
+
+  nice_address_set_from_sockaddr (&sock->addr, &name.addr);
+
+  sock->priv = priv = g_slice_new0 (TcpSoPriv);
+  priv->gsock = gsock;
+  priv->local_addr = gaddr;
+  priv->context = g_main_context_ref (ctx);
+
+  sock->type = NICE_SOCKET_TYPE_TCP_SO;
+  sock->fileno = NULL;
+  sock->send_messages = socket_send_messages;
+  sock->send_messages_reliable = socket_send_messages_reliable;
+  sock->recv_messages = socket_recv_messages;
+  sock->is_reliable = socket_is_reliable;
+  sock->can_send = socket_can_send;
+  sock->set_writable_callback = socket_set_writable_callback;
+  sock->close = socket_close;
+
+  return sock;
+}
+
+static void
+socket_close (NiceSocket *sock)
+{
+  TcpSoPriv *priv = sock->priv;
+
+  if (priv->gsock) {
+    g_socket_close (priv->gsock, NULL);
+    g_object_unref (priv->gsock);
+  }
+  if (priv->context)
+    g_main_context_unref (priv->context);
+  if (priv->local_addr)
+    g_object_unref (priv->local_addr);
+
+  g_slice_free (TcpSoPriv, sock->priv);
+}
+
+static gint socket_recv_messages (NiceSocket *sock,
+    NiceInputMessage *recv_messages, guint n_recv_messages,
+    NiceMessageExtraData *exdata)
+{
+  return -1;
+}
+
+static gint socket_send_messages (NiceSocket *sock, const NiceAddress *to,
+    const NiceOutputMessage *messages, guint n_messages)
+{
+  return -1;
+}
+
+static gint socket_send_messages_reliable (NiceSocket *sock,
+    const NiceAddress *to, const NiceOutputMessage *messages, guint n_messages)
+{
+  return -1;
+}
+
+static gboolean
+socket_is_reliable (NiceSocket *sock)
+{
+  return TRUE;
+}
+
+static gboolean
+socket_can_send (NiceSocket *sock, NiceAddress *addr)
+{
+  return FALSE;
+}
+
+static void
+socket_set_writable_callback (NiceSocket *sock,
+    NiceSocketWritableCb callback, gpointer user_data)
+{
+}
+
+NiceSocket *
+nice_tcp_so_socket_connect (NiceSocket *sock, NiceAddress *addr)
+{
+  union {
+    struct sockaddr_storage storage;
+    struct sockaddr addr;
+  } name;
+  TcpSoPriv *priv = sock->priv;
+  GSocket *gsock;
+  GSocketAddress *gaddr;
+  GError *gerr = NULL;
+  NiceSocket *new_socket;
+  char remote_addr_str[INET6_ADDRSTRLEN];
+  char local_addr_str[INET6_ADDRSTRLEN];
+
+  if (addr == NULL) {
+    /* We can't connect a tcp socket with no destination address */
+    return NULL;
+  }
+
+  gsock = tcp_so_socket_bind (priv->local_addr, &gerr);
+  if (gsock == NULL)
+    goto error;
+
+  nice_address_copy_to_sockaddr (addr, &name.addr);
+  gaddr = g_socket_address_new_from_native (&name.addr, sizeof (name));
+  if (gaddr == NULL) {
+    g_socket_close (gsock, NULL);
+    g_object_unref (gsock);
+    return NULL;
+  }
+
+  if (!g_socket_connect (gsock, gaddr, NULL, &gerr)) {
+    if (!g_error_matches (gerr, G_IO_ERROR, G_IO_ERROR_PENDING)) {
+      g_object_unref (gaddr);
+      g_socket_close (gsock, NULL);
+      g_object_unref (gsock);
+      goto error;
+    }
+    g_clear_error (&gerr);
+  }
+  g_object_unref (gaddr);
+
+  new_socket = nice_tcp_bsd_socket_new_from_gsock (priv->context, gsock,
+      &sock->addr, addr, TRUE);
+  g_object_unref (gsock);
+
+  if (new_socket)
+    nice_tcp_bsd_socket_set_simultaneous_open (new_socket);
+
+  return new_socket;
+
+error:
+  nice_address_to_string (&sock->addr, local_addr_str);
+  nice_address_to_string (addr, remote_addr_str);
+
+  nice_debug ("%s: tcp-so socket connect %p %s:%u -> %s:%u: error: %s",
+      G_STRFUNC, sock,
+      local_addr_str, nice_address_get_port (&sock->addr),
+      remote_addr_str, nice_address_get_port (addr),
+      gerr->message);
+
+  g_error_free (gerr);
+
+  return NULL;
+}
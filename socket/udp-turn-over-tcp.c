@@ -43,6 +43,7 @@
 #endif
 
 #include "udp-turn-over-tcp.h"
+#include "frame-reader.h"
 #include "agent-priv.h"
 
 #include <string.h>
@@ -55,12 +56,8 @@
 
 typedef struct {
   NiceTurnSocketCompatibility compatibility;
-  union {
-    guint8 u8[65536];
-    guint16 u16[32768];
-  } recv_buf;
-  gsize recv_buf_len;  /* in bytes */
-  guint expecting_len;
+  NiceFrameReader reader;
+  NiceAddress from;  /* of the data in @reader */
   NiceSocket *base_socket;
 } TurnTcpPriv;
 
@@ -71,6 +68,9 @@ typedef enum {
 
 #define MAX_UDP_MESSAGE_SIZE 65535
 
+/* A STUN message with the largest length and its padding */
+#define MAX_FRAME_SIZE (STUN_MESSAGE_HEADER_LENGTH + MAX_UDP_MESSAGE_SIZE + 3)
+
 #define MAGIC_COOKIE_OFFSET \
   STUN_MESSAGE_HEADER_LENGTH + STUN_MESSAGE_TYPE_LEN + \
   STUN_MESSAGE_LENGTH_LEN + sizeof(guint16)
@@ -88,6 +88,9 @@ static gboolean socket_can_send (NiceSocket *sock, NiceAddress *addr);
 static void socket_set_writable_callback (NiceSocket *sock,
     NiceSocketWritableCb callback, gpointer user_data);
 static gboolean socket_is_based_on (NiceSocket *sock, NiceSocket *other);
+static gboolean socket_has_buffered_data (NiceSocket *sock);
+static gint socket_send_zerocopy (NiceSocket *sock, const NiceAddress *to,
+    const NiceOutputMessage *message, GBytes *payload);
 
 NiceSocket *
 nice_udp_turn_over_tcp_socket_new (NiceSocket *base_socket,
@@ -99,6 +102,7 @@ nice_udp_turn_over_tcp_socket_new (NiceSocket *base_socket,
 
   priv->compatibility = compatibility;
   priv->base_socket = base_socket;
+  nice_frame_reader_init (&priv->reader, MAX_FRAME_SIZE);
 
   sock->type = NICE_SOCKET_TYPE_UDP_TURN_OVER_TCP;
   sock->fileno = priv->base_socket->fileno;
@@ -110,6 +114,8 @@ nice_udp_turn_over_tcp_socket_new (NiceSocket *base_socket,
   sock->can_send = socket_can_send;
   sock->set_writable_callback = socket_set_writable_callback;
   sock->is_based_on = socket_is_based_on;
+  sock->has_buffered_data = socket_has_buffered_data;
+  sock->send_zerocopy = socket_send_zerocopy;
   sock->close = socket_close;
 
   return sock;
@@ -124,118 +130,111 @@ socket_close (NiceSocket *sock)
   if (priv->base_socket)
     nice_socket_free (priv->base_socket);
 
+  nice_frame_reader_clear (&priv->reader);
+
   g_slice_free(TurnTcpPriv, sock->priv);
   sock->priv = NULL;
 }
 
+/* Returns the size of the frame at the start of @data, including its header
+ * and padding, 0 if more data is needed to tell, or -1 if the stream is
+ * corrupt. The message returned to the caller starts @header_len bytes into
+ * the frame. */
+static gssize
+get_frame_size (TurnTcpPriv *priv, const guint8 *data, gsize len,
+    gsize *header_len)
+{
+  if (priv->compatibility == NICE_TURN_SOCKET_COMPATIBILITY_DRAFT9 ||
+      priv->compatibility == NICE_TURN_SOCKET_COMPATIBILITY_RFC5766) {
+    guint16 magic, packetlen;
+    gsize frame_len;
+
+    if (len < 4)
+      return 0;
+
+    magic = (data[0] << 8) | data[1];
+    packetlen = (data[2] << 8) | data[3];
+
+    if (magic < 0x4000) {
+      /* Its STUN */
+      frame_len = STUN_MESSAGE_HEADER_LENGTH + packetlen;
+    } else {
+      /* Channel data */
+      frame_len = 4 + packetlen;
+    }
+
+    /* The padding is returned along with the message */
+    *header_len = 0;
+    return (frame_len % 4) ? frame_len + 4 - (frame_len % 4) : frame_len;
+  } else if (priv->compatibility == NICE_TURN_SOCKET_COMPATIBILITY_GOOGLE) {
+    if (len < 2)
+      return 0;
+
+    *header_len = 2;
+    return 2 + ((data[0] << 8) | data[1]);
+  } else if (priv->compatibility == NICE_TURN_SOCKET_COMPATIBILITY_OC2007) {
+    if (len < 4)
+      return 0;
+
+    if (data[0] != MS_TURN_CONTROL_MESSAGE &&
+        data[0] != MS_TURN_END_TO_END_DATA) {
+      /* Unexpected data, error in stream */
+      return -1;
+    }
+
+    /* Keep the RFC4571 framing for the NiceAgent to unframe */
+    *header_len = 2;
+    return 4 + ((data[2] << 8) | data[3]);
+  }
+
+  return -1;
+}
+
+/* Returns the next frame, reading from the base socket at most once, and only
+ * if no whole frame is buffered. */
 static gssize
 socket_recv_message (NiceSocket *sock, NiceInputMessage *recv_message)
 {
   TurnTcpPriv *priv = sock->priv;
-  gssize ret;
-  guint padlen;
-  GInputVector local_recv_buf;
-  NiceInputMessage local_recv_message;
+  gboolean has_read = FALSE;
 
   /* Make sure socket has not been freed: */
   g_assert (sock->priv != NULL);
 
-  if (priv->expecting_len == 0) {
-    guint headerlen = 0;
+  while (TRUE) {
+    const guint8 *data = nice_frame_reader_get_data (&priv->reader);
+    gsize available = nice_frame_reader_get_available (&priv->reader);
+    gsize header_len = 0;
+    gssize frame_len;
+    gint ret;
 
-    if (priv->compatibility == NICE_TURN_SOCKET_COMPATIBILITY_DRAFT9 ||
-        priv->compatibility == NICE_TURN_SOCKET_COMPATIBILITY_RFC5766 ||
-        priv->compatibility == NICE_TURN_SOCKET_COMPATIBILITY_OC2007)
-      headerlen = 4;
-    else if (priv->compatibility == NICE_TURN_SOCKET_COMPATIBILITY_GOOGLE)
-      headerlen = 2;
-    else
+    frame_len = get_frame_size (priv, data, available, &header_len);
+    if (frame_len < 0)
       return -1;
 
-    local_recv_buf.buffer = priv->recv_buf.u8 + priv->recv_buf_len;
-    local_recv_buf.size = headerlen - priv->recv_buf_len;
-    local_recv_message.buffers = &local_recv_buf;
-    local_recv_message.n_buffers = 1;
-    local_recv_message.from = recv_message->from;
-    local_recv_message.length = 0;
+    if (frame_len > 0 && available >= (gsize) frame_len) {
+      gssize len;
 
-    ret = nice_socket_recv_messages (priv->base_socket, &local_recv_message, 1,
-        NULL);
-    if (ret < 0)
-        return ret;
+      /* FIXME: Eliminate this memcpy(). */
+      len = memcpy_buffer_to_input_message (recv_message, data + header_len,
+          frame_len - header_len);
+      if (recv_message->from)
+        *recv_message->from = priv->from;
 
-    priv->recv_buf_len += local_recv_message.length;
+      nice_frame_reader_consume (&priv->reader, frame_len);
 
-    if (priv->recv_buf_len < headerlen)
-      return 0;
-
-    if (priv->compatibility == NICE_TURN_SOCKET_COMPATIBILITY_DRAFT9 ||
-        priv->compatibility == NICE_TURN_SOCKET_COMPATIBILITY_RFC5766) {
-      guint16 magic = ntohs (*priv->recv_buf.u16);
-      guint16 packetlen = ntohs (*(priv->recv_buf.u16 + 1));
-
-      if (magic < 0x4000) {
-        /* Its STUN */
-        priv->expecting_len = 20 + packetlen;
-      } else {
-        /* Channel data */
-        priv->expecting_len = 4 + packetlen;
-      }
-    }
-    else if (priv->compatibility == NICE_TURN_SOCKET_COMPATIBILITY_GOOGLE) {
-      guint compat_len = ntohs (*priv->recv_buf.u16);
-      priv->expecting_len = compat_len;
-      priv->recv_buf_len = 0;
+      return len;
     }
-    else if (priv->compatibility == NICE_TURN_SOCKET_COMPATIBILITY_OC2007) {
-      guint8 pt = *priv->recv_buf.u8;
-      guint16 packetlen = ntohs (priv->recv_buf.u16[1]);
-
-      if (pt != MS_TURN_CONTROL_MESSAGE &&
-          pt != MS_TURN_END_TO_END_DATA) {
-        /* Unexpected data, error in stream */
-        return -1;
-      }
 
-      /* Keep the RFC4571 framing for the NiceAgent to unframe */
-      priv->expecting_len = packetlen + sizeof(guint16);
-      priv->recv_buf_len = sizeof(guint16);
-      priv->recv_buf.u16[0] = priv->recv_buf.u16[1];
-    }
-  }
+    if (has_read)
+      return 0;
 
-  if (priv->compatibility == NICE_TURN_SOCKET_COMPATIBILITY_DRAFT9 ||
-      priv->compatibility == NICE_TURN_SOCKET_COMPATIBILITY_RFC5766)
-    padlen = (priv->expecting_len % 4) ?  4 - (priv->expecting_len % 4) : 0;
-  else
-    padlen = 0;
-
-  local_recv_buf.buffer = priv->recv_buf.u8 + priv->recv_buf_len;
-  local_recv_buf.size = priv->expecting_len + padlen - priv->recv_buf_len;
-  local_recv_message.buffers = &local_recv_buf;
-  local_recv_message.n_buffers = 1;
-  local_recv_message.from = recv_message->from;
-  local_recv_message.length = 0;
-
-  ret = nice_socket_recv_messages (priv->base_socket, &local_recv_message, 1,
-      NULL);
-  if (ret < 0)
+    ret = nice_frame_reader_fill (&priv->reader, priv->base_socket,
+        MAX (frame_len, 4), &priv->from);
+    if (ret <= 0)
       return ret;
-
-  priv->recv_buf_len += local_recv_message.length;
-
-  if (priv->recv_buf_len == priv->expecting_len + padlen) {
-    /* FIXME: Eliminate this memcpy(). */
-    ret = memcpy_buffer_to_input_message (recv_message,
-        priv->recv_buf.u8, priv->recv_buf_len);
-
-    priv->expecting_len = 0;
-    priv->recv_buf_len = 0;
-
-    return ret;
+    has_read = TRUE;
   }
-
-  return 0;
 }
 
 static gint
@@ -271,7 +270,7 @@ socket_recv_messages (NiceSocket *nicesock,
 
 static gssize
 socket_send_message (NiceSocket *sock, const NiceAddress *to,
-    const NiceOutputMessage *message, gboolean reliable)
+    const NiceOutputMessage *message, gboolean reliable, GBytes *payload)
 {
   TurnTcpPriv *priv = sock->priv;
   guint8 padbuf[3] = {0, 0, 0};
@@ -371,7 +370,10 @@ socket_send_message (NiceSocket *sock, const NiceAddress *to,
   }
 
 
-  if (reliable)
+  if (payload)
+    ret = nice_socket_send_zerocopy (priv->base_socket, to, &local_message,
+        payload);
+  else if (reliable)
     ret = nice_socket_send_messages_reliable (priv->base_socket, to,
         &local_message, 1);
   else
@@ -396,7 +398,7 @@ socket_send_messages (NiceSocket *sock, const NiceAddress *to,
     const NiceOutputMessage *message = &messages[i];
     gssize len;
 
-    len = socket_send_message (sock, to, message, FALSE);
+    len = socket_send_message (sock, to, message, FALSE, NULL);
 
     if (len < 0) {
       /* Error. */
@@ -422,7 +424,7 @@ socket_send_messages_reliable (NiceSocket *sock, const NiceAddress *to,
     const NiceOutputMessage *message = &messages[i];
     gssize len;
 
-    len = socket_send_message (sock, to, message, TRUE);
+    len = socket_send_message (sock, to, message, TRUE, NULL);
 
     if (len < 0) {
       /* Error. */
@@ -433,6 +435,20 @@ socket_send_messages_reliable (NiceSocket *sock, const NiceAddress *to,
   return i;
 }
 
+static gint
+socket_send_zerocopy (NiceSocket *sock, const NiceAddress *to,
+    const NiceOutputMessage *message, GBytes *payload)
+{
+  gssize len;
+
+  /* Make sure socket has not been freed: */
+  g_assert (sock->priv != NULL);
+
+  /* The framing is added around the payload, which is left in place */
+  len = socket_send_message (sock, to, message, FALSE, payload);
+
+  return (len > 0) ? 1 : len;
+}
 
 static gboolean
 socket_is_reliable (NiceSocket *sock)
@@ -459,6 +475,21 @@ socket_set_writable_callback (NiceSocket *sock,
   nice_socket_set_writable_callback (priv->base_socket, callback, user_data);
 }
 
+static gboolean
+socket_has_buffered_data (NiceSocket *sock)
+{
+  TurnTcpPriv *priv = sock->priv;
+  gsize available = nice_frame_reader_get_available (&priv->reader);
+  gsize header_len;
+  gssize frame_len;
+
+  frame_len = get_frame_size (priv, nice_frame_reader_get_data (&priv->reader),
+      available, &header_len);
+
+  /* A corrupt stream is reported by the next read */
+  return frame_len < 0 || (frame_len > 0 && available >= (gsize) frame_len);
+}
+
 static gboolean
 socket_is_based_on (NiceSocket *sock, NiceSocket *other)
 {
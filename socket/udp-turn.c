@@ -57,7 +57,13 @@
 #define STUN_PERMISSION_TIMEOUT (300 - STUN_EXPIRE_TIMEOUT) /* 240 s */
 #define STUN_BINDING_TIMEOUT (600 - STUN_EXPIRE_TIMEOUT) /* 540 s */
 
-static GMutex mutex;
+/* Largest RFC4571 frame carried by a reliable (MS-TURN over TCP) socket */
+#define FRAGMENT_FRAME_MAX (G_MAXUINT16 + sizeof (guint16))
+/* The reassembly ring holds at most one partial frame plus the payloads of a
+ * batch of TURN messages read from the base socket in one go. */
+#define FRAGMENT_RING_SIZE (4 * FRAGMENT_FRAME_MAX)
+/* Size of the scratch buffer used to linearize vectored messages */
+#define RECV_SCRATCH_SIZE (G_MAXUINT16 + 1)
 
 typedef struct {
   StunMessage message;
@@ -72,7 +78,12 @@ typedef struct {
   GSource *timeout_source;
 } ChannelBinding;
 
+/* Each allocation has its own lock. The timers hold a reference on the
+ * private data, so that a callback racing with socket_close() in another
+ * thread can still take the lock, and find its source destroyed. */
 typedef struct {
+  gint ref_count;
+  GMutex mutex;
   GMainContext *ctx;
   StunAgent agent;
   GList *channels;
@@ -106,9 +117,12 @@ typedef struct {
   guint8 *cached_nonce;
   uint16_t cached_nonce_len;
 
-  GByteArray *fragment_buffer;
+  guint8 *fragment_ring;        /* FRAGMENT_RING_SIZE bytes, lazily allocated */
+  gsize fragment_ring_head;     /* offset of the first buffered byte */
+  gsize fragment_ring_len;      /* number of buffered bytes */
   NiceAddress from;
   uint8_t *send_buffer;
+  guint8 *recv_scratch;         /* RECV_SCRATCH_SIZE bytes, lazily allocated */
 } UdpTurnPriv;
 
 
@@ -138,6 +152,8 @@ static gboolean socket_can_send (NiceSocket *sock, NiceAddress *addr);
 static void socket_set_writable_callback (NiceSocket *sock,
     NiceSocketWritableCb callback, gpointer user_data);
 static gboolean socket_is_based_on (NiceSocket *sock, NiceSocket *other);
+static gint socket_send_zerocopy (NiceSocket *sock, const NiceAddress *to,
+    const NiceOutputMessage *message, GBytes *payload);
 
 static void priv_process_pending_bindings (UdpTurnPriv *priv);
 static gboolean priv_retransmissions_tick_unlocked (UdpTurnPriv *priv);
@@ -154,6 +170,22 @@ static gboolean priv_add_channel_binding (UdpTurnPriv *priv,
 static gboolean priv_forget_send_request_timeout (gpointer pointer);
 static void priv_clear_permissions (UdpTurnPriv *priv);
 
+static UdpTurnPriv *
+priv_ref (UdpTurnPriv *priv)
+{
+  g_atomic_int_inc (&priv->ref_count);
+  return priv;
+}
+
+static void
+priv_unref (UdpTurnPriv *priv)
+{
+  if (g_atomic_int_dec_and_test (&priv->ref_count)) {
+    g_mutex_clear (&priv->mutex);
+    g_free (priv);
+  }
+}
+
 static void
 send_request_free (SendRequest *r)
 {
@@ -204,6 +236,8 @@ nice_udp_turn_socket_new (GMainContext *ctx, NiceAddress *addr,
   }
 
   priv = g_new0 (UdpTurnPriv, 1);
+  priv->ref_count = 1;
+  g_mutex_init (&priv->mutex);
 
   if (compatibility == NICE_TURN_SOCKET_COMPATIBILITY_DRAFT9 ||
       compatibility == NICE_TURN_SOCKET_COMPATIBILITY_RFC5766) {
@@ -270,6 +304,7 @@ nice_udp_turn_socket_new (GMainContext *ctx, NiceAddress *addr,
   sock->can_send = socket_can_send;
   sock->set_writable_callback = socket_set_writable_callback;
   sock->is_based_on = socket_is_based_on;
+  sock->send_zerocopy = socket_send_zerocopy;
   sock->close = socket_close;
   sock->priv = (void *) priv;
 
@@ -284,7 +319,7 @@ socket_close (NiceSocket *sock)
   UdpTurnPriv *priv = (UdpTurnPriv *) sock->priv;
   GList *i = NULL;
 
-  g_mutex_lock (&mutex);
+  g_mutex_lock (&priv->mutex);
 
   for (i = priv->channels; i; i = i->next) {
     ChannelBinding *b = i->data;
@@ -333,17 +368,149 @@ socket_close (NiceSocket *sock)
   g_free (priv->cached_realm);
   g_free (priv->cached_nonce);
 
-  if (priv->fragment_buffer) {
-    g_byte_array_free(priv->fragment_buffer, TRUE);
+  g_free (priv->fragment_ring);
+  g_free (priv->send_buffer);
+  g_free (priv->recv_scratch);
+
+  sock->priv = NULL;
+
+  g_mutex_unlock (&priv->mutex);
+
+  priv_unref (priv);
+}
+
+/* Removes the first @offset bytes of @message and keeps the following @len
+ * bytes, by moving them towards the start of the buffer vector in place.
+ * @offset + @len must not exceed the message length. */
+static void
+priv_input_message_strip (NiceInputMessage *message, gsize offset, gsize len)
+{
+  GInputVector *bufs = message->buffers;
+  guint src = 0, dst = 0;
+  gsize src_off = offset, dst_off = 0;
+
+  g_assert (offset + len <= message->length);
+
+  message->length = len;
+
+  if (len == 0)
+    return;
+
+  while (src_off >= bufs[src].size) {
+    src_off -= bufs[src].size;
+    src++;
   }
 
-  g_free (priv->send_buffer);
+  while (len > 0) {
+    gsize chunk = MIN (len,
+        MIN (bufs[src].size - src_off, bufs[dst].size - dst_off));
 
-  g_free (priv);
+    memmove ((guint8 *) bufs[dst].buffer + dst_off,
+        (guint8 *) bufs[src].buffer + src_off, chunk);
 
-  sock->priv = NULL;
+    src_off += chunk;
+    dst_off += chunk;
+    len -= chunk;
 
-  g_mutex_unlock (&mutex);
+    if (src_off == bufs[src].size) {
+      src++;
+      src_off = 0;
+    }
+    if (dst_off == bufs[dst].size) {
+      dst++;
+      dst_off = 0;
+    }
+  }
+}
+
+static guint8 *
+priv_get_recv_scratch (UdpTurnPriv *priv)
+{
+  if (priv->recv_scratch == NULL)
+    priv->recv_scratch = g_malloc (RECV_SCRATCH_SIZE);
+
+  return priv->recv_scratch;
+}
+
+/* Appends @len bytes to the reassembly ring. Returns FALSE if they don't
+ * fit, which the caller avoids by bounding the size of its receive batch. */
+static gboolean
+priv_fragment_ring_push (UdpTurnPriv *priv, const guint8 *data, gsize len)
+{
+  gsize tail, first;
+
+  if (len > FRAGMENT_RING_SIZE - priv->fragment_ring_len) {
+    g_warning ("Dropped %" G_GSIZE_FORMAT " bytes of fragmented TURN data "
+        "due to not fitting in the reassembly buffer", len);
+    return FALSE;
+  }
+
+  if (priv->fragment_ring == NULL)
+    priv->fragment_ring = g_malloc (FRAGMENT_RING_SIZE);
+
+  tail = (priv->fragment_ring_head + priv->fragment_ring_len) %
+      FRAGMENT_RING_SIZE;
+  first = MIN (len, FRAGMENT_RING_SIZE - tail);
+
+  memcpy (priv->fragment_ring + tail, data, first);
+  memcpy (priv->fragment_ring, data + first, len - first);
+  priv->fragment_ring_len += len;
+
+  return TRUE;
+}
+
+static guint8
+priv_fragment_ring_byte (UdpTurnPriv *priv, gsize index)
+{
+  return priv->fragment_ring[(priv->fragment_ring_head + index) %
+      FRAGMENT_RING_SIZE];
+}
+
+/* Moves the first @len buffered bytes into @message. */
+static void
+priv_fragment_ring_pop (UdpTurnPriv *priv, NiceInputMessage *message,
+    gsize len)
+{
+  gsize first = MIN (len, FRAGMENT_RING_SIZE - priv->fragment_ring_head);
+  GInputVector *bufs = message->buffers;
+  const guint8 *src = priv->fragment_ring + priv->fragment_ring_head;
+  gsize copied = 0;
+  guint i;
+
+  g_assert (len <= priv->fragment_ring_len);
+
+  message->length = 0;
+
+  for (i = 0;
+       copied < len &&
+       ((message->n_buffers >= 0 && i < (guint) message->n_buffers) ||
+        (message->n_buffers < 0 && bufs[i].buffer != NULL));
+       i++) {
+    gsize buf_off = 0;
+
+    while (buf_off < bufs[i].size && copied < len) {
+      gsize chunk;
+
+      if (copied == first)
+        src = priv->fragment_ring;
+
+      chunk = MIN (bufs[i].size - buf_off,
+          (copied < first ? first : len) - copied);
+      memcpy ((guint8 *) bufs[i].buffer + buf_off, src, chunk);
+
+      src += chunk;
+      buf_off += chunk;
+      copied += chunk;
+    }
+  }
+
+  message->length = copied;
+
+  priv->fragment_ring_head = (priv->fragment_ring_head + len) %
+      FRAGMENT_RING_SIZE;
+  priv->fragment_ring_len -= len;
+  if (priv->fragment_ring_len == 0)
+    priv->fragment_ring_head = 0;
 }
 
 static gint
@@ -352,8 +519,10 @@ socket_recv_messages (NiceSocket *sock,
     NiceMessageExtraData *exdata)
 {
   UdpTurnPriv *priv = (UdpTurnPriv *) sock->priv;
+  gboolean reliable = nice_socket_is_reliable (sock);
   gint n_messages;
   gint n_output_messages = 0;
+  guint n_base_messages;
   guint i;
   gboolean error = FALSE;
 
@@ -362,57 +531,54 @@ socket_recv_messages (NiceSocket *sock,
 
   nice_debug_verbose ("received message on TURN socket");
 
-  if (priv->fragment_buffer) {
+  if (priv->fragment_ring_len > 0) {
     /* Fill as many recv_messages as possible with RFC4571-framed data we
-     * already hold in our buffer before reading more from the base socket. */
-    guint8 *f_buffer = priv->fragment_buffer->data;
-    guint f_buffer_len = priv->fragment_buffer->len;
-
-    for (i = 0; i < n_recv_messages && f_buffer_len >= sizeof (guint16); ++i) {
-      guint32 msg_len = ((f_buffer[0] << 8) | f_buffer[1]) + sizeof (guint16);
-
-      if (msg_len > f_buffer_len) {
-        /* The next message in the buffer isn't complete yet. Wait for more
+     * already hold in our ring before reading more from the base socket. */
+    for (i = 0; i < n_recv_messages &&
+             priv->fragment_ring_len >= sizeof (guint16); ++i) {
+      gsize msg_len = ((priv_fragment_ring_byte (priv, 0) << 8) |
+          priv_fragment_ring_byte (priv, 1)) + sizeof (guint16);
+
+      if (msg_len > priv->fragment_ring_len) {
+        /* The next message in the ring isn't complete yet. Wait for more
          * data from the base socket. */
         break;
       }
 
-      /* We have a full message in the buffer. Copy it into the user-provided
+      /* We have a full message in the ring. Copy it into the user-provided
        * NiceInputMessage. */
-      memcpy_buffer_to_input_message (&recv_messages[i], f_buffer, msg_len);
+      priv_fragment_ring_pop (priv, &recv_messages[i], msg_len);
       *recv_messages[i].from = priv->from;
 
-      f_buffer += msg_len;
-      f_buffer_len -= msg_len;
       ++n_output_messages;
     }
 
     /* Adjust recv_messages with the number of messages we've just filled. */
     recv_messages += n_output_messages;
     n_recv_messages -= n_output_messages;
+  }
 
-    /* Shrink the fragment buffer, deallocate it if empty. */
-    g_byte_array_remove_range (priv->fragment_buffer, 0,
-                               priv->fragment_buffer->len - f_buffer_len);
-    if (priv->fragment_buffer->len == 0) {
-      g_byte_array_free (priv->fragment_buffer, TRUE);
-      priv->fragment_buffer = NULL;
-    }
+  /* Every TURN message read from the base socket may end up in the ring, so
+   * only read as many as there is room for. */
+  n_base_messages = n_recv_messages;
+  if (reliable) {
+    n_base_messages = MIN (n_base_messages,
+        (FRAGMENT_RING_SIZE - priv->fragment_ring_len) / FRAGMENT_FRAME_MAX);
   }
 
+  if (n_base_messages == 0)
+    return n_output_messages;
+
   n_messages = nice_socket_recv_messages (priv->base_socket,
-      recv_messages, n_recv_messages, NULL);
+      recv_messages, n_base_messages, NULL);
 
   if (n_messages < 0)
     return n_messages;
 
   /* Process all the messages. Those which fail parsing are re-used for the next
-   * message.
-   *
-   * FIXME: This needs a fast path which avoids allocations or memcpy()s.
-   * Implementing such a path means rewriting the TURN parser (and hence the
-   * STUN message code) to operate on vectors of buffers, rather than a
-   * monolithic buffer. */
+   * message. Messages are unwrapped in place; vectored messages are
+   * linearized into a per-socket scratch buffer rather than a fresh
+   * allocation. */
   for (i = 0; i < (guint) n_messages; ++i) {
     NiceInputMessage *message = &recv_messages[i];
     NiceSocket *dummy;
@@ -420,6 +586,7 @@ socket_recv_messages (NiceSocket *sock,
     guint8 *buffer;
     gsize buffer_length;
     gint parsed_buffer_length;
+    gboolean compacted_buffer = FALSE;
     gboolean allocated_buffer = FALSE;
 
     if (message->length == 0)
@@ -433,10 +600,16 @@ socket_recv_messages (NiceSocket *sock,
          message->buffers[1].buffer == NULL)) {
       buffer = message->buffers[0].buffer;
       buffer_length = message->length;
+    } else if (message->length <= RECV_SCRATCH_SIZE) {
+      buffer = priv_get_recv_scratch (priv);
+      buffer_length = memcpy_input_message_to_buffer (message, buffer,
+          message->length);
+      compacted_buffer = TRUE;
     } else {
       nice_debug_verbose ("%s: **WARNING: SLOW PATH**", G_STRFUNC);
 
       buffer = compact_input_message (message, &buffer_length);
+      compacted_buffer = TRUE;
       allocated_buffer = TRUE;
     }
 
@@ -454,11 +627,11 @@ socket_recv_messages (NiceSocket *sock,
     /* parsed_buffer_length == 0 means this is a TURN control message which
      * needs ignoring. */
 
-    if (nice_socket_is_reliable (sock) && parsed_buffer_length > 0) {
+    if (reliable && parsed_buffer_length > 0) {
       /* Determine the portion of the current NiceInputMessage we can already
        * return. */
       gint32 msg_len = 0;
-      if (!priv->fragment_buffer) {
+      if (priv->fragment_ring_len == 0) {
         msg_len = ((buffer[0] << 8) | buffer[1]) + sizeof (guint16);
         if (msg_len > parsed_buffer_length) {
           /* The RFC4571 frame is larger than the current TURN message, need to
@@ -467,22 +640,10 @@ socket_recv_messages (NiceSocket *sock,
         }
       }
 
-      if (msg_len != parsed_buffer_length && !priv->fragment_buffer) {
-        /* Start of message fragmenting detected. Allocate fragment buffer
-         * large enough for the recv_message's we haven't parsed yet. */
-        gint j;
-        guint buffer_len = 0;
-
-        for (j = i; j < n_messages; ++j) {
-          buffer_len += recv_messages[j].length;
-        }
-        priv->fragment_buffer = g_byte_array_sized_new (buffer_len);
-      }
-
-      if (priv->fragment_buffer) {
+      if (msg_len != parsed_buffer_length) {
         /* The messages are fragmented. Store the excess data (after msg_len
-         * bytes) into fragment buffer for reassembly. */
-        g_byte_array_append (priv->fragment_buffer, buffer + msg_len,
+         * bytes) into the ring for reassembly. */
+        priv_fragment_ring_push (priv, buffer + msg_len,
             parsed_buffer_length - msg_len);
 
         parsed_buffer_length = msg_len;
@@ -492,7 +653,7 @@ socket_recv_messages (NiceSocket *sock,
     }
 
     /* Split up the monolithic buffer again into the caller-provided buffers. */
-    if (parsed_buffer_length > 0 && allocated_buffer) {
+    if (parsed_buffer_length > 0 && compacted_buffer) {
       memcpy_buffer_to_input_message (message, buffer,
           parsed_buffer_length);
     }
@@ -513,10 +674,10 @@ socket_recv_messages (NiceSocket *sock,
   return n_output_messages;
 }
 
-/* interval is given in milliseconds */
+/* interval is given in milliseconds; @function is passed @priv */
 static GSource *
 priv_timeout_add_with_context (UdpTurnPriv *priv, guint interval,
-    GSourceFunc function, gpointer data)
+    GSourceFunc function)
 {
   GSource *source = NULL;
 
@@ -524,16 +685,17 @@ priv_timeout_add_with_context (UdpTurnPriv *priv, guint interval,
 
   source = g_timeout_source_new (interval);
 
-  g_source_set_callback (source, function, data, NULL);
+  g_source_set_callback (source, function, priv_ref (priv),
+      (GDestroyNotify) priv_unref);
   g_source_attach (source, priv->ctx);
 
   return source;
 }
 
-/* interval is given in seconds */
+/* interval is given in seconds; @function is passed @priv */
 static GSource *
 priv_timeout_add_seconds_with_context (UdpTurnPriv *priv, guint interval,
-    GSourceFunc function, gpointer data)
+    GSourceFunc function)
 {
   GSource *source = NULL;
 
@@ -541,7 +703,8 @@ priv_timeout_add_seconds_with_context (UdpTurnPriv *priv, guint interval,
 
   source = g_timeout_source_new_seconds (interval);
 
-  g_source_set_callback (source, function, data, NULL);
+  g_source_set_callback (source, function, priv_ref (priv),
+      (GDestroyNotify) priv_unref);
   g_source_attach (source, priv->ctx);
 
   return source;
@@ -941,7 +1104,7 @@ socket_send_message (NiceSocket *sock, const NiceAddress *to,
       req->priv = priv;
       stun_message_id (&msg, req->id);
       req->source = priv_timeout_add_with_context (priv,
-          STUN_END_TIMEOUT, priv_forget_send_request_timeout, req);
+          STUN_END_TIMEOUT, priv_forget_send_request_timeout);
       g_queue_push_tail (priv->send_requests, req);
     }
   }
@@ -986,12 +1149,13 @@ static gint
 socket_send_messages (NiceSocket *sock, const NiceAddress *to,
     const NiceOutputMessage *messages, guint n_messages)
 {
+  UdpTurnPriv *priv = (UdpTurnPriv *) sock->priv;
   guint i;
 
-  g_mutex_lock (&mutex);
-
   /* Make sure socket has not been freed: */
-  g_assert (sock->priv != NULL);
+  g_assert (priv != NULL);
+
+  g_mutex_lock (&priv->mutex);
 
   for (i = 0; i < n_messages; i++) {
     const NiceOutputMessage *message = &messages[i];
@@ -1003,7 +1167,7 @@ socket_send_messages (NiceSocket *sock, const NiceAddress *to,
       /* Error. */
       if (i > 0)
         break;
-      g_mutex_unlock (&mutex);
+      g_mutex_unlock (&priv->mutex);
       return len;
     } else if (len == 0) {
       /* EWOULDBLOCK. */
@@ -1011,7 +1175,7 @@ socket_send_messages (NiceSocket *sock, const NiceAddress *to,
     }
   }
 
-  g_mutex_unlock (&mutex);
+  g_mutex_unlock (&priv->mutex);
 
   return i;
 }
@@ -1023,7 +1187,7 @@ socket_send_messages_reliable (NiceSocket *sock, const NiceAddress *to,
   UdpTurnPriv *priv = (UdpTurnPriv *) sock->priv;
   guint i;
 
-  g_mutex_lock (&mutex);
+  g_mutex_lock (&priv->mutex);
 
   /* TURN can depend either on tcp-turn or udp-bsd as a base socket
    * if we allow reliable send and need to create permissions and we queue the
@@ -1031,7 +1195,7 @@ socket_send_messages_reliable (NiceSocket *sock, const NiceAddress *to,
    * we check for udp-bsd here as the base socket and don't allow it.
    */
   if (priv->base_socket->type == NICE_SOCKET_TYPE_UDP_BSD) {
-    g_mutex_unlock (&mutex);
+    g_mutex_unlock (&priv->mutex);
     return -1;
   }
 
@@ -1043,7 +1207,7 @@ socket_send_messages_reliable (NiceSocket *sock, const NiceAddress *to,
 
     if (len < 0) {
       /* Error. */
-      g_mutex_unlock (&mutex);
+      g_mutex_unlock (&priv->mutex);
       return len;
     } else if (len == 0) {
       /* EWOULDBLOCK. */
@@ -1051,10 +1215,83 @@ socket_send_messages_reliable (NiceSocket *sock, const NiceAddress *to,
     }
   }
 
-  g_mutex_unlock (&mutex);
+  g_mutex_unlock (&priv->mutex);
   return i;
 }
 
+/* Only ChannelData messages can leave the payload where it is, behind their
+ * four bytes of header. Anything else is built in the send buffer. */
+static gint
+socket_send_zerocopy (NiceSocket *sock, const NiceAddress *to,
+    const NiceOutputMessage *message, GBytes *payload)
+{
+  UdpTurnPriv *priv = (UdpTurnPriv *) sock->priv;
+  ChannelBinding *binding = NULL;
+  gsize message_len;
+  GList *i;
+  gint ret;
+
+  /* Make sure socket has not been freed: */
+  g_assert (priv != NULL);
+
+  g_mutex_lock (&priv->mutex);
+
+  for (i = priv->channels; i; i = i->next) {
+    ChannelBinding *b = i->data;
+    if (nice_address_equal (&b->peer, to)) {
+      binding = b;
+      break;
+    }
+  }
+
+  message_len = output_message_get_size (message);
+
+  if (binding != NULL && !nice_socket_is_reliable (priv->base_socket) &&
+      message_len + sizeof (guint32) <= STUN_MAX_MESSAGE_SIZE &&
+      (priv->compatibility == NICE_TURN_SOCKET_COMPATIBILITY_DRAFT9 ||
+          (priv->compatibility == NICE_TURN_SOCKET_COMPATIBILITY_RFC5766 &&
+              priv_has_permission_for_peer (priv, to)))) {
+    GOutputVector *local_bufs;
+    NiceOutputMessage local_message;
+    guint16 header[2];
+    guint n_bufs = 0;
+    guint j;
+
+    /* Count the number of buffers. */
+    if (message->n_buffers == -1) {
+      for (j = 0; message->buffers[j].buffer != NULL; j++)
+        n_bufs++;
+    } else {
+      n_bufs = message->n_buffers;
+    }
+
+    local_bufs = g_alloca ((n_bufs + 1) * sizeof (GOutputVector));
+    local_message.buffers = local_bufs;
+    local_message.n_buffers = n_bufs + 1;
+
+    header[0] = htons (binding->channel);
+    header[1] = htons ((guint16) message_len);
+    local_bufs[0].buffer = header;
+    local_bufs[0].size = sizeof (header);
+
+    for (j = 0; j < n_bufs; j++) {
+      local_bufs[j + 1].buffer = message->buffers[j].buffer;
+      local_bufs[j + 1].size = message->buffers[j].size;
+    }
+
+    ret = nice_socket_send_zerocopy (priv->base_socket, &priv->server_addr,
+        &local_message, payload);
+
+    g_mutex_unlock (&priv->mutex);
+
+    return ret;
+  }
+
+  g_mutex_unlock (&priv->mutex);
+
+  return socket_send_messages (sock, to, message, 1);
+}
+
 static gboolean
 socket_is_reliable (NiceSocket *sock)
 {
@@ -1092,20 +1329,30 @@ socket_is_based_on (NiceSocket *sock, NiceSocket *other)
 static gboolean
 priv_forget_send_request_timeout (gpointer pointer)
 {
-  SendRequest *req = pointer;
+  UdpTurnPriv *priv = pointer;
+  GSource *source;
+  GList *l;
 
-  g_mutex_lock (&mutex);
-  if (g_source_is_destroyed (g_main_current_source ())) {
+  g_mutex_lock (&priv->mutex);
+  source = g_main_current_source ();
+  if (g_source_is_destroyed (source)) {
     nice_debug ("Source was destroyed. "
         "Avoided race condition in turn.c:priv_forget_send_request");
-    g_mutex_unlock (&mutex);
+    g_mutex_unlock (&priv->mutex);
     return G_SOURCE_REMOVE;
   }
 
-  g_queue_remove (req->priv->send_requests, req);
-  send_request_free (req);
+  for (l = priv->send_requests->head; l; l = l->next) {
+    SendRequest *req = l->data;
+
+    if (req->source == source) {
+      g_queue_delete_link (priv->send_requests, l);
+      send_request_free (req);
+      break;
+    }
+  }
 
-  g_mutex_unlock (&mutex);
+  g_mutex_unlock (&priv->mutex);
 
   return G_SOURCE_REMOVE;
 }
@@ -1117,13 +1364,13 @@ priv_permission_timeout (gpointer data)
 
   nice_debug ("Permission is about to timeout, schedule renewal");
 
-  g_mutex_lock (&mutex);
+  g_mutex_lock (&priv->mutex);
 
   if (g_source_is_destroyed (g_main_current_source ())) {
     nice_debug ("Source was destroyed. Avoided race condition in "
                 "udp-turn.c:priv_permission_timeout");
 
-    g_mutex_unlock (&mutex);
+    g_mutex_unlock (&priv->mutex);
     return G_SOURCE_REMOVE;
   }
 
@@ -1131,7 +1378,7 @@ priv_permission_timeout (gpointer data)
   /* remove all permissions for this agent (the permission for the peer
      we are sending to will be renewed) */
   priv_clear_permissions (priv);
-  g_mutex_unlock (&mutex);
+  g_mutex_unlock (&priv->mutex);
 
   return TRUE;
 }
@@ -1143,12 +1390,12 @@ priv_binding_expired_timeout (gpointer data)
   GList *i;
   GSource *source = NULL;
 
-  g_mutex_lock (&mutex);
+  g_mutex_lock (&priv->mutex);
   if (g_source_is_destroyed (g_main_current_source ())) {
     nice_debug ("Source was destroyed. Avoided race condition in "
                 "udp-turn.c:priv_permission_timeout");
 
-    g_mutex_unlock (&mutex);
+    g_mutex_unlock (&priv->mutex);
     return G_SOURCE_REMOVE;
   }
 
@@ -1190,7 +1437,7 @@ priv_binding_expired_timeout (gpointer data)
     }
   }
 
-  g_mutex_unlock (&mutex);
+  g_mutex_unlock (&priv->mutex);
   return G_SOURCE_REMOVE;
 }
 
@@ -1201,12 +1448,12 @@ priv_binding_timeout (gpointer data)
   GList *i;
   GSource *source = NULL;
 
-  g_mutex_lock (&mutex);
+  g_mutex_lock (&priv->mutex);
   if (g_source_is_destroyed (g_main_current_source ())) {
     nice_debug ("Source was destroyed. Avoided race condition in "
                 "udp-turn.c:priv_permission_timeout");
 
-    g_mutex_unlock (&mutex);
+    g_mutex_unlock (&priv->mutex);
     return G_SOURCE_REMOVE;
   }
 
@@ -1228,7 +1475,7 @@ priv_binding_timeout (gpointer data)
 
       /* Install timer to expire the permission */
       b->timeout_source = priv_timeout_add_seconds_with_context (priv,
-          STUN_EXPIRE_TIMEOUT, priv_binding_expired_timeout, priv);
+          STUN_EXPIRE_TIMEOUT, priv_binding_expired_timeout);
 
       /* Send renewal */
       if (!priv->current_binding_msg)
@@ -1237,7 +1484,7 @@ priv_binding_timeout (gpointer data)
     }
   }
 
-  g_mutex_unlock (&mutex);
+  g_mutex_unlock (&priv->mutex);
 
   return G_SOURCE_REMOVE;
 }
@@ -1273,19 +1520,79 @@ void
 nice_udp_turn_socket_cache_realm_nonce (NiceSocket *sock,
     StunMessage *msg)
 {
-  g_mutex_lock (&mutex);
+  UdpTurnPriv *priv = sock->priv;
+
+  g_mutex_lock (&priv->mutex);
   nice_udp_turn_socket_cache_realm_nonce_locked (sock, msg);
-  g_mutex_unlock (&mutex);
+  g_mutex_unlock (&priv->mutex);
+}
+
+/* Unwraps a ChannelData message spread over several buffers in place,
+ * without linearizing it. Returns FALSE if @message is not ChannelData for
+ * one of our bound channels, in which case it is left untouched. */
+static gboolean
+priv_parse_recv_channel_data_in_place (NiceSocket *sock,
+    NiceSocket **from_sock, NiceInputMessage *message)
+{
+  UdpTurnPriv *priv = (UdpTurnPriv *) sock->priv;
+  guint8 header[sizeof (uint32_t)];
+  uint16_t channel, data_len;
+  NiceAddress peer;
+  gboolean found = FALSE;
+  GList *l;
+
+  if (priv->compatibility != NICE_TURN_SOCKET_COMPATIBILITY_DRAFT9 &&
+      priv->compatibility != NICE_TURN_SOCKET_COMPATIBILITY_RFC5766)
+    return FALSE;
+
+  if (nice_socket_is_reliable (sock))
+    return FALSE;
+
+  if (memcpy_input_message_to_buffer (message, header, sizeof (header)) <
+      sizeof (header))
+    return FALSE;
+
+  /* Channel numbers are in the 0x4000 - 0x7FFF range, which no STUN message
+   * can start with. */
+  if ((header[0] & 0xC0) != 0x40)
+    return FALSE;
+
+  channel = (header[0] << 8) | header[1];
+  data_len = (header[2] << 8) | header[3];
+
+  if (data_len > message->length - sizeof (header))
+    return FALSE;
+
+  g_mutex_lock (&priv->mutex);
+  for (l = priv->channels; l; l = l->next) {
+    ChannelBinding *b = l->data;
+
+    if (b->channel == channel) {
+      peer = b->peer;
+      found = TRUE;
+      break;
+    }
+  }
+  g_mutex_unlock (&priv->mutex);
+
+  if (!found)
+    return FALSE;
+
+  priv_input_message_strip (message, sizeof (header), data_len);
+  *message->from = peer;
+  *from_sock = sock;
+
+  return TRUE;
 }
 
 guint
 nice_udp_turn_socket_parse_recv_message (NiceSocket *sock, NiceSocket **from_sock,
     NiceInputMessage *message)
 {
-  /* TODO: Speed this up in the common reliable case of having a 24-byte header
-   * buffer to begin with, followed by one or more massive buffers. */
+  UdpTurnPriv *priv = (UdpTurnPriv *) sock->priv;
   guint8 *buf;
   gsize buf_len, len;
+  gboolean allocated_buffer = FALSE;
 
   if (message->n_buffers == 1 ||
       (message->n_buffers == -1 &&
@@ -1303,15 +1610,30 @@ nice_udp_turn_socket_parse_recv_message (NiceSocket *sock, NiceSocket **from_soc
     return (len > 0) ? 1 : 0;
   }
 
-  /* Slow path. */
-  nice_debug_verbose ("%s: **WARNING: SLOW PATH**", G_STRFUNC);
+  /* Relayed data on a channel, typically a header buffer followed by a
+   * large body buffer: shift the payload down without copying it out. */
+  if (priv_parse_recv_channel_data_in_place (sock, from_sock, message))
+    return (message->length > 0) ? 1 : 0;
+
+  /* Control messages and Data indications need a contiguous buffer for the
+   * STUN parser. Use the socket's scratch area to avoid an allocation. */
+  if (message->length <= RECV_SCRATCH_SIZE) {
+    buf = priv_get_recv_scratch (priv);
+    buf_len = memcpy_input_message_to_buffer (message, buf, message->length);
+  } else {
+    nice_debug_verbose ("%s: **WARNING: SLOW PATH**", G_STRFUNC);
+
+    buf = compact_input_message (message, &buf_len);
+    allocated_buffer = TRUE;
+  }
 
-  buf = compact_input_message (message, &buf_len);
   len = nice_udp_turn_socket_parse_recv (sock, from_sock,
       message->from, buf_len, buf,
       message->from, buf, buf_len);
   len = memcpy_buffer_to_input_message (message, buf, len);
-  g_free (buf);
+
+  if (allocated_buffer)
+    g_free (buf);
 
   return (len > 0) ? 1 : 0;
 }
@@ -1333,7 +1655,7 @@ nice_udp_turn_socket_parse_recv (NiceSocket *sock, NiceSocket **from_sock,
     const guint16 *u16;
   } recv_buf;
 
-  g_mutex_lock (&mutex);
+  g_mutex_lock (&priv->mutex);
 
   /* In the case of a reliable UDP-TURN-OVER-TCP (which means MS-TURN)
    * we must use RFC4571 framing */
@@ -1512,7 +1834,7 @@ nice_udp_turn_socket_parse_recv (NiceSocket *sock, NiceSocket **from_sock,
                 /* Install timer to schedule refresh of the permission */
                 binding->timeout_source =
                     priv_timeout_add_seconds_with_context (priv,
-                    STUN_BINDING_TIMEOUT, priv_binding_timeout, priv);
+                    STUN_BINDING_TIMEOUT, priv_binding_timeout);
               }
               priv_process_pending_bindings (priv);
             }
@@ -1604,8 +1926,7 @@ nice_udp_turn_socket_parse_recv (NiceSocket *sock, NiceSocket **from_sock,
                 !priv->permission_timeout_source) {
               priv->permission_timeout_source =
                   priv_timeout_add_seconds_with_context (priv,
-                      STUN_PERMISSION_TIMEOUT, priv_permission_timeout,
-                      priv);
+                      STUN_PERMISSION_TIMEOUT, priv_permission_timeout);
             }
 
             /* send enqued data */
@@ -1661,7 +1982,7 @@ nice_udp_turn_socket_parse_recv (NiceSocket *sock, NiceSocket **from_sock,
 
         *from_sock = sock;
         memmove (buf, data, len > data_len ? data_len : len);
-        g_mutex_unlock (&mutex);
+        g_mutex_unlock (&priv->mutex);
         return len > data_len ? data_len : len;
       } else {
         goto recv;
@@ -1694,7 +2015,7 @@ nice_udp_turn_socket_parse_recv (NiceSocket *sock, NiceSocket **from_sock,
   }
 
   memmove (buf, recv_buf.u8, len > recv_len ? recv_len : len);
-  g_mutex_unlock (&mutex);
+  g_mutex_unlock (&priv->mutex);
   return len > recv_len ? recv_len : len;
 
  msn_google_lock:
@@ -1712,23 +2033,21 @@ nice_udp_turn_socket_parse_recv (NiceSocket *sock, NiceSocket **from_sock,
   }
 
  done:
-  g_mutex_unlock (&mutex);
+  g_mutex_unlock (&priv->mutex);
   return 0;
 }
 
 gboolean
 nice_udp_turn_socket_set_peer (NiceSocket *sock, NiceAddress *peer)
 {
-  UdpTurnPriv *priv;
+  UdpTurnPriv *priv = (UdpTurnPriv *) sock->priv;
   gboolean ret;
 
-  g_mutex_lock (&mutex);
-
-  priv = (UdpTurnPriv *) sock->priv;
+  g_mutex_lock (&priv->mutex);
 
   ret = priv_add_channel_binding (priv, peer);
 
-  g_mutex_unlock (&mutex);
+  g_mutex_unlock (&priv->mutex);
 
   return ret;
 }
@@ -1875,12 +2194,12 @@ priv_retransmissions_tick (gpointer pointer)
 {
   UdpTurnPriv *priv = pointer;
 
-  g_mutex_lock (&mutex);
+  g_mutex_lock (&priv->mutex);
   if (g_source_is_destroyed (g_main_current_source ())) {
     nice_debug ("Source was destroyed. Avoided race condition in "
                 "udp-turn.c:priv_permission_timeout");
 
-    g_mutex_unlock (&mutex);
+    g_mutex_unlock (&priv->mutex);
     return G_SOURCE_REMOVE;
   }
 
@@ -1892,7 +2211,7 @@ priv_retransmissions_tick (gpointer pointer)
     }
   }
 
-  g_mutex_unlock (&mutex);
+  g_mutex_unlock (&priv->mutex);
 
   return G_SOURCE_REMOVE;
 }
@@ -1902,12 +2221,12 @@ priv_retransmissions_create_permission_tick (gpointer pointer)
 {
   UdpTurnPriv *priv = pointer;
 
-  g_mutex_lock (&mutex);
+  g_mutex_lock (&priv->mutex);
   if (g_source_is_destroyed (g_main_current_source ())) {
     nice_debug ("Source was destroyed. Avoided race condition in "
                 "udp-turn.c:priv_permission_timeout");
 
-    g_mutex_unlock (&mutex);
+    g_mutex_unlock (&priv->mutex);
     return G_SOURCE_REMOVE;
   }
 
@@ -1916,7 +2235,7 @@ priv_retransmissions_create_permission_tick (gpointer pointer)
    * if there are pending permissions that require it */
   priv_schedule_tick (priv);
 
-  g_mutex_unlock (&mutex);
+  g_mutex_unlock (&priv->mutex);
 
   return G_SOURCE_REMOVE;
 }
@@ -1939,7 +2258,7 @@ priv_schedule_tick (UdpTurnPriv *priv)
     if (timeout > 0) {
       priv->tick_source_channel_bind =
           priv_timeout_add_with_context (priv, timeout,
-              priv_retransmissions_tick, priv);
+              priv_retransmissions_tick);
     } else {
       priv_retransmissions_tick_unlocked (priv);
     }
@@ -1977,8 +2296,7 @@ priv_schedule_tick (UdpTurnPriv *priv)
   if (min_timeout != G_MAXUINT) {
     priv->tick_source_create_permission =
         priv_timeout_add_with_context (priv, min_timeout,
-            priv_retransmissions_create_permission_tick,
-            priv);
+            priv_retransmissions_create_permission_tick);
   }
 }
 
@@ -2265,10 +2583,10 @@ nice_udp_turn_socket_set_ms_realm(NiceSocket *sock, StunMessage *msg)
   const uint8_t *realm = stun_message_find(msg, STUN_ATTRIBUTE_REALM, &alen);
 
   if (realm && alen <= STUN_MAX_MS_REALM_LEN) {
-    g_mutex_lock (&mutex);
+    g_mutex_lock (&priv->mutex);
     memcpy(priv->ms_realm, realm, alen);
     priv->ms_realm[alen] = '\0';
-    g_mutex_unlock (&mutex);
+    g_mutex_unlock (&priv->mutex);
   }
 }
 
@@ -2282,10 +2600,10 @@ nice_udp_turn_socket_set_ms_connection_id (NiceSocket *sock, StunMessage *msg)
 
 
   if (ms_seq_num && alen == 24) {
-    g_mutex_lock (&mutex);
+    g_mutex_lock (&priv->mutex);
     memcpy (priv->ms_connection_id, ms_seq_num, 20);
     priv->ms_sequence_num = ntohl((uint32_t)*(ms_seq_num + 20));
     priv->ms_connection_id_valid = TRUE;
-    g_mutex_unlock (&mutex);
+    g_mutex_unlock (&priv->mutex);
   }
 }
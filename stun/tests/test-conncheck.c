@@ -77,6 +77,9 @@ int main (void)
   } addr;
   uint8_t req_buf[STUN_MAX_MESSAGE_SIZE];
   uint8_t resp_buf[STUN_MAX_MESSAGE_SIZE];
+  uint8_t tmpl_buf[STUN_MAX_MESSAGE_SIZE];
+  size_t tmpl_len;
+  StunTransactionId id, id2;
   const uint64_t tie = 0x8000000000000000LL;
   StunMessageReturn val;
   StunUsageIceReturn val2;
@@ -308,5 +311,36 @@ int main (void)
   stun_message_find_error (&resp, &code);
   assert (code == STUN_ERROR_ROLE_CONFLICT);
 
+  /* Requests built from a template */
+  tmpl_len = stun_usage_ice_conncheck_create_template (&agent, &req,
+      tmpl_buf, sizeof (tmpl_buf), (uint8_t *) username, strlen (username),
+      true, true, 0x12345678, tie, NULL, STUN_USAGE_ICE_COMPATIBILITY_RFC5245);
+  assert (tmpl_len > 0);
+  rlen = stun_usage_ice_conncheck_create (&agent, &req, req_buf,
+      sizeof (req_buf), (uint8_t *) username, strlen (username),
+      pass, pass_len, true, true, 0x12345678, tie, NULL,
+      STUN_USAGE_ICE_COMPATIBILITY_RFC5245);
+  assert (rlen > tmpl_len);
+  stun_message_id (&req, id);
+
+  len = stun_usage_ice_conncheck_create_from_template (&agent, &req,
+      req_buf, sizeof (req_buf), tmpl_buf, tmpl_len, pass, pass_len);
+  assert (len == rlen);
+  valid = stun_agent_validate (&agent, &req, req_buf, len,
+      stun_agent_default_validater, validater_data);
+  assert (valid == STUN_VALIDATION_SUCCESS);
+  assert (stun_message_get_class (&req) == STUN_REQUEST);
+  assert (stun_message_has_cookie (&req));
+  assert (stun_usage_ice_conncheck_priority (&req) == 0x12345678);
+  assert (stun_usage_ice_conncheck_use_candidate (&req) == true);
+  stun_message_id (&req, id2);
+  assert (memcmp (id, id2, sizeof (id)) != 0);
+
+  /* A truncated template is refused */
+  len = stun_usage_ice_conncheck_create_from_template (&agent, &req,
+      req_buf, sizeof (req_buf), tmpl_buf, STUN_MESSAGE_HEADER_LENGTH - 1,
+      pass, pass_len);
+  assert (len == 0);
+
   return 0;
 }
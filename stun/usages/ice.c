@@ -54,23 +54,25 @@
 
 
 #include "stunagent.h"
+#include "stunhmac.h"
 
 /** ICE connectivity checks **/
 #include "ice.h"
 
 
-size_t
-stun_usage_ice_conncheck_create (StunAgent *agent, StunMessage *msg,
+/* Builds everything but the MESSAGE-INTEGRITY and FINGERPRINT trailers */
+static bool
+stun_usage_ice_conncheck_build (StunAgent *agent, StunMessage *msg,
     uint8_t *buffer, size_t buffer_len,
     const uint8_t *username, const size_t username_len,
-    const uint8_t *password, const size_t password_len,
     bool cand_use, bool controlling, uint32_t priority,
     uint64_t tie, const char *candidate_identifier,
     StunUsageIceCompatibility compatibility)
 {
   StunMessageReturn val;
 
-  stun_agent_init_request (agent, msg, buffer, buffer_len, STUN_BINDING);
+  if (!stun_agent_init_request (agent, msg, buffer, buffer_len, STUN_BINDING))
+    return false;
 
   if (compatibility == STUN_USAGE_ICE_COMPATIBILITY_RFC5245 ||
       compatibility == STUN_USAGE_ICE_COMPATIBILITY_MSICE2) {
@@ -78,26 +80,26 @@ stun_usage_ice_conncheck_create (StunAgent *agent, StunMessage *msg,
     {
       val = stun_message_append_flag (msg, STUN_ATTRIBUTE_USE_CANDIDATE);
       if (val != STUN_MESSAGE_RETURN_SUCCESS)
-        return 0;
+        return false;
     }
 
     val = stun_message_append32 (msg, STUN_ATTRIBUTE_PRIORITY, priority);
     if (val != STUN_MESSAGE_RETURN_SUCCESS)
-      return 0;
+      return false;
 
     if (controlling)
       val = stun_message_append64 (msg, STUN_ATTRIBUTE_ICE_CONTROLLING, tie);
     else
       val = stun_message_append64 (msg, STUN_ATTRIBUTE_ICE_CONTROLLED, tie);
     if (val != STUN_MESSAGE_RETURN_SUCCESS)
-      return 0;
+      return false;
   }
 
   if (username && username_len > 0) {
     val = stun_message_append_bytes (msg, STUN_ATTRIBUTE_USERNAME,
         username, username_len);
     if (val != STUN_MESSAGE_RETURN_SUCCESS)
-      return 0;
+      return false;
   }
 
   if (compatibility == STUN_USAGE_ICE_COMPATIBILITY_MSICE2 &&
@@ -114,7 +116,7 @@ stun_usage_ice_conncheck_create (StunAgent *agent, StunMessage *msg,
     assert (attribute_len >= identifier_len);
     buf = malloc(attribute_len);
     if (buf == NULL)
-      return 0;
+      return false;
 
     memset(buf, 0, attribute_len);
     memcpy(buf, candidate_identifier, identifier_len);
@@ -125,19 +127,85 @@ stun_usage_ice_conncheck_create (StunAgent *agent, StunMessage *msg,
     free(buf);
 
     if (val != STUN_MESSAGE_RETURN_SUCCESS)
-		return 0;
+		return false;
 
     val = stun_message_append32 (msg,
         STUN_ATTRIBUTE_MS_IMPLEMENTATION_VERSION, 2);
 
     if (val != STUN_MESSAGE_RETURN_SUCCESS)
-      return 0;
+      return false;
   }
 
+  return true;
+}
+
+size_t
+stun_usage_ice_conncheck_create (StunAgent *agent, StunMessage *msg,
+    uint8_t *buffer, size_t buffer_len,
+    const uint8_t *username, const size_t username_len,
+    const uint8_t *password, const size_t password_len,
+    bool cand_use, bool controlling, uint32_t priority,
+    uint64_t tie, const char *candidate_identifier,
+    StunUsageIceCompatibility compatibility)
+{
+  if (!stun_usage_ice_conncheck_build (agent, msg, buffer, buffer_len,
+          username, username_len, cand_use, controlling, priority, tie,
+          candidate_identifier, compatibility))
+    return 0;
+
   return stun_agent_finish_message (agent, msg, password, password_len);
 
 }
 
+size_t
+stun_usage_ice_conncheck_create_template (StunAgent *agent, StunMessage *msg,
+    uint8_t *buffer, size_t buffer_len,
+    const uint8_t *username, const size_t username_len,
+    bool cand_use, bool controlling, uint32_t priority,
+    uint64_t tie, const char *candidate_identifier,
+    StunUsageIceCompatibility compatibility)
+{
+  if (!stun_usage_ice_conncheck_build (agent, msg, buffer, buffer_len,
+          username, username_len, cand_use, controlling, priority, tie,
+          candidate_identifier, compatibility))
+    return 0;
+
+  return stun_message_length (msg);
+}
+
+size_t
+stun_usage_ice_conncheck_create_from_template (StunAgent *agent,
+    StunMessage *msg, uint8_t *buffer, size_t buffer_len,
+    const uint8_t *tmpl, size_t tmpl_len,
+    const uint8_t *password, const size_t password_len)
+{
+  StunTransactionId id;
+
+  if (tmpl_len < STUN_MESSAGE_HEADER_LENGTH || tmpl_len > buffer_len)
+    return 0;
+
+  memcpy (buffer, tmpl, tmpl_len);
+
+  msg->buffer = buffer;
+  msg->buffer_len = buffer_len;
+  msg->agent = agent;
+  msg->key = NULL;
+  msg->key_len = 0;
+  msg->long_term_valid = FALSE;
+
+  /* Only the transaction ID differs from one request to the next, the
+   * trailers are then computed over it as usual */
+  stun_make_transid (id);
+  if (agent->compatibility == STUN_COMPATIBILITY_RFC5389 ||
+      agent->compatibility == STUN_COMPATIBILITY_MSICE2) {
+    uint32_t cookie = htonl (STUN_MAGIC_COOKIE);
+    memcpy (id, &cookie, sizeof (cookie));
+  }
+  memcpy (buffer + STUN_MESSAGE_TRANS_ID_POS, id, STUN_MESSAGE_TRANS_ID_LEN);
+
+  return stun_agent_finish_message (agent, msg, password, password_len);
+}
+
 
 StunUsageIceReturn stun_usage_ice_conncheck_process (StunMessage *msg,
     struct sockaddr_storage *addr, socklen_t *addrlen,
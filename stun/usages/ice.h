@@ -158,6 +158,66 @@ stun_usage_ice_conncheck_create (StunAgent *agent, StunMessage *msg,
     uint64_t tie, const char *candidate_identifier,
     StunUsageIceCompatibility compatibility);
 
+/**
+ * stun_usage_ice_conncheck_create_template:
+ * @agent: The #StunAgent to use to build the request
+ * @msg: The #StunMessage to build
+ * @buffer: The buffer to use for creating the #StunMessage
+ * @buffer_len: The size of the @buffer
+ * @username: The username to use in the request
+ * @username_len: The length of @username
+ * @cand_use: Set to %TRUE to append the USE-CANDIDATE flag to the request
+ * @controlling: Set to %TRUE if you are the controlling agent or set to
+ * %FALSE if you are the controlled agent.
+ * @priority: The value of the PRIORITY attribute
+ * @tie: The value of the tie-breaker to put in the ICE-CONTROLLED or
+ * ICE-CONTROLLING attribute
+ * @candidate_identifier: The foundation value to put in the
+ * CANDIDATE-IDENTIFIER attribute
+ * @compatibility: The compatibility mode to use for building the conncheck
+ * request
+ *
+ * Builds the same message as stun_usage_ice_conncheck_create(), but stops
+ * before the MESSAGE-INTEGRITY and FINGERPRINT attributes are appended and
+ * does not register the transaction with @agent. The resulting buffer can be
+ * stored and turned into as many requests as needed with
+ * stun_usage_ice_conncheck_create_from_template().
+ * Returns: The length of the template built, or 0 on error.
+ * Since: 0.1.24
+ */
+size_t
+stun_usage_ice_conncheck_create_template (StunAgent *agent, StunMessage *msg,
+    uint8_t *buffer, size_t buffer_len,
+    const uint8_t *username, const size_t username_len,
+    bool cand_use, bool controlling, uint32_t priority,
+    uint64_t tie, const char *candidate_identifier,
+    StunUsageIceCompatibility compatibility);
+
+/**
+ * stun_usage_ice_conncheck_create_from_template:
+ * @agent: The #StunAgent to use to build the request
+ * @msg: The #StunMessage to build
+ * @buffer: The buffer to use for creating the #StunMessage
+ * @buffer_len: The size of the @buffer
+ * @tmpl: A template built by stun_usage_ice_conncheck_create_template()
+ * @tmpl_len: The length of @tmpl
+ * @password: The key to use for building the MESSAGE-INTEGRITY
+ * @password_len: The length of @password
+ *
+ * Builds an ICE connectivity check STUN message by copying @tmpl, giving
+ * it a new transaction ID and appending the MESSAGE-INTEGRITY and
+ * FINGERPRINT attributes. The result is identical to what
+ * stun_usage_ice_conncheck_create() would have produced with the same
+ * arguments, without formatting the attributes again.
+ * Returns: The length of the message built.
+ * Since: 0.1.24
+ */
+size_t
+stun_usage_ice_conncheck_create_from_template (StunAgent *agent,
+    StunMessage *msg, uint8_t *buffer, size_t buffer_len,
+    const uint8_t *tmpl, size_t tmpl_len,
+    const uint8_t *password, const size_t password_len);
+
 
 /**
  * stun_usage_ice_conncheck_process:
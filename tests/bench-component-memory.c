@@ -0,0 +1,180 @@
+/* vim: et ts=2 sw=2 tw=80: */
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_MALLINFO2
+#include <malloc.h>
+#endif
+
+#include "agent.h"
+
+
+/**
+ * A benchmark of what each idle component costs. An agent adds a number of
+ * streams with RTP and RTCP components, and gathers their host candidates on
+ * the loopback interface. What the process then holds beyond what it held
+ * before is divided by the number of components, and reported as a line of
+ * JSON on stdout:
+ *  • heap_bytes_per_component: memory allocated with malloc(), sockets
+ *    included, or null where it cannot be measured;
+ *  • fds_per_component: open file descriptors, sockets included, or null
+ *    where they cannot be counted.
+ */
+
+
+/* Configuration options. */
+static gint n_streams = 50;
+static gboolean ice_tcp = FALSE;
+
+static guint n_gathering;  /* streams still gathering */
+
+
+static gint64
+heap_size (void)
+{
+#ifdef HAVE_MALLINFO2
+  return mallinfo2 ().uordblks;
+#else
+  return -1;
+#endif
+}
+
+static gint64
+n_open_fds (void)
+{
+  GDir *dir;
+  gint64 n = 0;
+
+  dir = g_dir_open ("/proc/self/fd", 0, NULL);
+  if (dir == NULL)
+    return -1;
+
+  while (g_dir_read_name (dir) != NULL)
+    n++;
+  g_dir_close (dir);
+
+  return n - 1;  /* the directory itself */
+}
+
+static void
+print_per_component (const gchar *name, gint64 before, gint64 after,
+    guint n_components)
+{
+  if (before < 0 || after < 0)
+    g_print ("\"%s\": null", name);
+  else
+    g_print ("\"%s\": %.1f", name, (gdouble) (after - before) / n_components);
+}
+
+static void
+cb_candidate_gathering_done (NiceAgent *agent, guint stream_id, gpointer data)
+{
+  n_gathering--;
+}
+
+static GOptionEntry entries[] = {
+  { "streams", 's', 0, G_OPTION_ARG_INT, &n_streams,
+    "Number of streams, each with two components", "N" },
+  { "ice-tcp", 't', 0, G_OPTION_ARG_NONE, &ice_tcp,
+    "Also gather the TCP candidates", NULL },
+  { NULL }
+};
+
+int main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  NiceAgent *agent;
+  NiceAddress addr;
+  gint64 heap_before, fds_before;
+  gint i;
+
+  /* Configuration. */
+  context = g_option_context_new ("— benchmark the cost of idle components");
+  g_option_context_add_main_entries (context, entries, NULL);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("Option parsing failed: %s\n", error->message);
+    goto context_error;
+  }
+
+  if (n_streams <= 0) {
+    g_printerr ("Option parsing failed: %s\n", "Invalid number of streams.");
+    goto context_error;
+  }
+
+  g_option_context_free (context);
+
+  agent = nice_agent_new (NULL, NICE_COMPATIBILITY_RFC5245);
+  g_object_set (agent, "ice-tcp", ice_tcp, "upnp", FALSE, NULL);
+  g_signal_connect (agent, "candidate-gathering-done",
+      G_CALLBACK (cb_candidate_gathering_done), NULL);
+
+  nice_address_init (&addr);
+  g_assert_true (nice_address_set_from_string (&addr, "127.0.0.1"));
+  nice_agent_add_local_address (agent, &addr);
+
+  /* Warm up the type system and the allocator with a first stream */
+  n_gathering = 1;
+  nice_agent_gather_candidates (agent, nice_agent_add_stream (agent, 2));
+  while (n_gathering > 0)
+    g_main_context_iteration (NULL, TRUE);
+
+  heap_before = heap_size ();
+  fds_before = n_open_fds ();
+
+  n_gathering = n_streams;
+  for (i = 0; i < n_streams; i++)
+    nice_agent_gather_candidates (agent, nice_agent_add_stream (agent, 2));
+  while (n_gathering > 0)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_print ("{\"streams\": %d, \"ice_tcp\": %s, ", n_streams,
+      ice_tcp ? "true" : "false");
+  print_per_component ("heap_bytes_per_component", heap_before, heap_size (),
+      2 * n_streams);
+  g_print (", ");
+  print_per_component ("fds_per_component", fds_before, n_open_fds (),
+      2 * n_streams);
+  g_print ("}\n");
+
+  g_object_unref (agent);
+
+  return 0;
+
+context_error:
+  g_printerr ("\n%s\n", g_option_context_get_help (context, TRUE, NULL));
+  g_option_context_free (context);
+
+  return 1;
+}
@@ -0,0 +1,540 @@
+/* vim: et ts=2 sw=2 tw=80: */
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "pseudotcp.h"
+
+
+/**
+ * A benchmark for the pseudotcp socket. Two sockets are connected through an
+ * emulated link with a given round-trip time, bandwidth, random loss and
+ * reordering, and a bulk transfer from the left socket to the right one is
+ * timed. The sockets run on virtual time (see pseudo_tcp_socket_set_time()),
+ * driven by a discrete event loop, and the link draws from a PRNG with a
+ * fixed seed, so each run gives exactly the same results: a change in the
+ * numbers is a change in pseudo-TCP.
+ *
+ * Each combination of the conditions below is run in turn, and reported as a
+ * line of JSON on stdout:
+ *  • goodput_kbps: payload delivered to the receiver, per second from the
+ *    connection opening to the last byte being read;
+ *  • retransmission_ratio: payload bytes sent beyond the transfer size, as a
+ *    fraction of it;
+ *  • latency_p50_ms and latency_p99_ms: time from a chunk of CHUNK_SIZE bytes
+ *    being accepted by pseudo_tcp_socket_send() to it being read.
+ *
+ * Options such as --rtt replace one dimension of the matrix with a single
+ * value, to reproduce one of its runs.
+ */
+
+
+#define BASE_TIME 1000  /* ms; pseudo_tcp_socket_set_time() takes 0 as unset */
+#define TIME_LIMIT (600 * G_USEC_PER_SEC)  /* of virtual time per run */
+#define CHUNK_SIZE 1000  /* bytes over which delivery latency is measured */
+#define HEADER_SIZE 24  /* of a pseudo-TCP segment */
+#define PATH_MTU 1500  /* larger packets are dropped by the link */
+#define MIN_QUEUE_DELAY (20 * 1000)  /* µs of buffering at the bottleneck */
+
+typedef struct {
+  guint rtt;  /* ms */
+  guint bandwidth;  /* kbit/s, in each direction */
+  gdouble loss;  /* probability of a packet being lost */
+  gdouble reorder;  /* probability of a packet being held back */
+  PseudoTcpCongestionControl congestion_control;
+} Conditions;
+
+typedef struct {
+  PseudoTcpSocket *sock;
+  guint64 clock;  /* µs, or G_MAXUINT64 once the socket is closed */
+  guint64 link_free;  /* µs at which the outgoing link is next idle */
+} Endpoint;
+
+typedef struct {
+  guint64 arrival;  /* µs */
+  guint64 id;  /* keeps packets arriving at the same time in order */
+  Endpoint *to;
+  guint32 len;
+  guint8 data[];
+} Packet;
+
+typedef struct {
+  const Conditions *conditions;
+  GRand *prng;
+  guint64 now;  /* µs since the start of the run */
+  Endpoint left, right;
+  GQueue packets;  /* of owned Packet, by arrival */
+  guint64 n_packets;
+
+  gsize size;  /* of the transfer */
+  gsize n_queued, n_received;
+  guint64 opened;  /* µs at which the connection opened */
+  guint64 *queued_at;  /* µs at which each chunk was queued */
+  guint n_chunks_delivered;
+  GArray *latencies;  /* of guint64, in µs */
+  guint64 payload_sent;  /* bytes of payload sent by the left socket */
+} Simulation;
+
+/* Configuration options. */
+static gint64 seed = 1;
+static gint size_kib = 512;
+static gint rtt = 0;
+static gint bandwidth = 0;
+static gdouble loss = -1;
+static gdouble reorder = -1;
+static gchar *congestion_control = NULL;
+
+/* The matrix of conditions. */
+static guint rtts[] = { 10, 100 };
+static guint bandwidths[] = { 2000, 20000 };
+static gdouble losses[] = { 0, 0.01, 0.05 };
+static gdouble reorders[] = { 0, 0.02 };
+static PseudoTcpCongestionControl congestion_controls[] = {
+  PSEUDO_TCP_CONGESTION_RENO,
+  PSEUDO_TCP_CONGESTION_CUBIC,
+  PSEUDO_TCP_CONGESTION_BBR,
+};
+
+
+static guint64
+socket_time (Simulation *sim)
+{
+  return BASE_TIME + sim->now / 1000;
+}
+
+static void
+update_clock (Simulation *sim, Endpoint *endpoint, gboolean notified)
+{
+  guint64 timeout = 0;
+  guint64 now = socket_time (sim);
+
+  if (!pseudo_tcp_socket_get_next_clock (endpoint->sock, &timeout)) {
+    endpoint->clock = G_MAXUINT64;
+    return;
+  }
+
+  /* The socket has just handled everything due by now; the clock only has
+   * millisecond resolution, so don’t call it again within the same one. */
+  if (notified && timeout <= now)
+    timeout = now + 1;
+  else if (timeout < now)
+    timeout = now;
+
+  endpoint->clock = (timeout - BASE_TIME) * 1000;
+}
+
+static void
+fill_send_buffer (Simulation *sim)
+{
+  static const gchar buf[CHUNK_SIZE] = { 0, };
+
+  while (sim->n_queued < sim->size) {
+    gsize len = MIN (CHUNK_SIZE - sim->n_queued % CHUNK_SIZE,
+        sim->size - sim->n_queued);
+    gint ret;
+
+    ret = pseudo_tcp_socket_send (sim->left.sock, buf, len);
+    if (ret <= 0)
+      break;
+
+    sim->n_queued += ret;
+    if (sim->n_queued % CHUNK_SIZE == 0 || sim->n_queued == sim->size)
+      sim->queued_at[(sim->n_queued - 1) / CHUNK_SIZE] = sim->now;
+
+    if ((gsize) ret < len)
+      break;
+  }
+}
+
+static void
+opened (PseudoTcpSocket *sock, gpointer user_data)
+{
+  Simulation *sim = user_data;
+
+  if (sock == sim->left.sock) {
+    sim->opened = sim->now;
+    fill_send_buffer (sim);
+  }
+}
+
+static void
+readable (PseudoTcpSocket *sock, gpointer user_data)
+{
+  Simulation *sim = user_data;
+  gchar buf[8192];
+  gint len;
+
+  while ((len = pseudo_tcp_socket_recv (sock, buf, sizeof (buf))) > 0) {
+    sim->n_received += len;
+
+    while ((gsize) sim->n_chunks_delivered * CHUNK_SIZE < sim->size &&
+        MIN ((sim->n_chunks_delivered + 1) * CHUNK_SIZE, sim->size) <=
+        sim->n_received) {
+      guint64 latency = sim->now - sim->queued_at[sim->n_chunks_delivered++];
+
+      g_array_append_val (sim->latencies, latency);
+    }
+  }
+}
+
+static void
+writable (PseudoTcpSocket *sock, gpointer user_data)
+{
+  Simulation *sim = user_data;
+
+  if (sock == sim->left.sock)
+    fill_send_buffer (sim);
+}
+
+static void
+closed (PseudoTcpSocket *sock, guint32 err, gpointer user_data)
+{
+  g_printerr ("Socket %p closed: %s\n", sock, g_strerror (err));
+}
+
+static gint
+compare_packets (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+  const Packet *pa = a, *pb = b;
+
+  if (pa->arrival != pb->arrival)
+    return (pa->arrival < pb->arrival) ? -1 : 1;
+  return (pa->id < pb->id) ? -1 : 1;
+}
+
+/* Emulates a link made of a drop-tail bottleneck queue, followed by a path
+ * which loses and delays packets at random. */
+static PseudoTcpWriteResult
+write_packet (PseudoTcpSocket *sock, const gchar *buffer, guint32 len,
+    gpointer user_data)
+{
+  Simulation *sim = user_data;
+  const Conditions *conditions = sim->conditions;
+  Endpoint *from, *to;
+  guint64 departure;
+  Packet *packet;
+  gboolean lost, reordered;
+
+  if (sock == sim->left.sock) {
+    from = &sim->left;
+    to = &sim->right;
+    sim->payload_sent += len - MIN (len, HEADER_SIZE);
+  } else {
+    from = &sim->right;
+    to = &sim->left;
+  }
+
+  /* Always draw both, so that the conditions don’t change the sequence */
+  lost = g_rand_double (sim->prng) < conditions->loss;
+  reordered = g_rand_double (sim->prng) < conditions->reorder;
+
+  departure = MAX (from->link_free, sim->now);
+  if (departure - sim->now >
+      MAX ((guint64) conditions->rtt * 1000, MIN_QUEUE_DELAY))
+    return WR_SUCCESS;  /* The queue is full */
+
+  /* Serialisation: bits divided by kbit/s gives ms */
+  from->link_free = departure + (guint64) len * 8 * 1000 /
+      conditions->bandwidth;
+
+  if (lost || len > PATH_MTU)
+    return WR_SUCCESS;
+
+  packet = g_malloc (sizeof (Packet) + len);
+  packet->arrival = from->link_free + conditions->rtt * 1000 / 2;
+  if (reordered)
+    packet->arrival += conditions->rtt * 1000 / 4 + 1000;
+  packet->id = sim->n_packets++;
+  packet->to = to;
+  packet->len = len;
+  memcpy (packet->data, buffer, len);
+
+  g_queue_insert_sorted (&sim->packets, packet, compare_packets, NULL);
+
+  return WR_SUCCESS;
+}
+
+static gint
+compare_latencies (gconstpointer a, gconstpointer b)
+{
+  guint64 la = *(const guint64 *) a, lb = *(const guint64 *) b;
+
+  return (la < lb) ? -1 : (la > lb);
+}
+
+static gdouble
+percentile_ms (GArray *latencies, guint percent)
+{
+  if (latencies->len == 0)
+    return 0;
+
+  return g_array_index (latencies, guint64,
+      (latencies->len - 1) * percent / 100) / 1000.0;
+}
+
+static const gchar *
+congestion_control_name (PseudoTcpCongestionControl value)
+{
+  GEnumClass *enum_class;
+  GEnumValue *enum_value;
+  const gchar *name;
+
+  enum_class = g_type_class_ref (pseudo_tcp_congestion_control_get_type ());
+  enum_value = g_enum_get_value (enum_class, value);
+  name = enum_value->value_nick;
+  g_type_class_unref (enum_class);
+
+  return name;
+}
+
+static void
+print_number (GString *out, const gchar *key, gdouble value)
+{
+  gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+  g_string_append_printf (out, ", \"%s\": %s", key,
+      g_ascii_formatd (buf, sizeof (buf), "%.4f", value));
+}
+
+static void
+run (const Conditions *conditions)
+{
+  PseudoTcpCallbacks cbs = {
+    NULL, opened, readable, writable, closed, write_packet
+  };
+  Simulation sim = { 0, };
+  Packet *packet;
+  gboolean completed;
+  GString *out;
+  guint64 duration;
+
+  sim.conditions = conditions;
+  sim.prng = g_rand_new_with_seed (seed);
+  g_queue_init (&sim.packets);
+  sim.size = (gsize) size_kib * 1024;
+  sim.queued_at = g_new0 (guint64, (sim.size + CHUNK_SIZE - 1) / CHUNK_SIZE);
+  sim.latencies = g_array_new (FALSE, FALSE, sizeof (guint64));
+
+  cbs.user_data = &sim;
+  sim.left.sock = pseudo_tcp_socket_new (0, &cbs);
+  sim.right.sock = pseudo_tcp_socket_new (0, &cbs);
+
+  /* The way the agent configures its sockets */
+  g_object_set (sim.left.sock, "congestion-control",
+      conditions->congestion_control, "mtu-discovery", TRUE,
+      "rack-tlp", TRUE, "pacing", TRUE, NULL);
+  g_object_set (sim.right.sock, "congestion-control",
+      conditions->congestion_control, "mtu-discovery", TRUE,
+      "rack-tlp", TRUE, "pacing", TRUE, NULL);
+  pseudo_tcp_socket_notify_mtu (sim.left.sock, 1400);
+  pseudo_tcp_socket_notify_mtu (sim.right.sock, 1400);
+
+  pseudo_tcp_socket_set_time (sim.left.sock, socket_time (&sim));
+  pseudo_tcp_socket_set_time (sim.right.sock, socket_time (&sim));
+  pseudo_tcp_socket_connect (sim.left.sock);
+  update_clock (&sim, &sim.left, FALSE);
+  update_clock (&sim, &sim.right, FALSE);
+
+  while (sim.n_received < sim.size) {
+    guint64 next = MIN (sim.left.clock, sim.right.clock);
+
+    packet = g_queue_peek_head (&sim.packets);
+    if (packet != NULL)
+      next = MIN (next, packet->arrival);
+    if (next == G_MAXUINT64 || next > TIME_LIMIT)
+      break;
+
+    sim.now = MAX (sim.now, next);
+    pseudo_tcp_socket_set_time (sim.left.sock, socket_time (&sim));
+    pseudo_tcp_socket_set_time (sim.right.sock, socket_time (&sim));
+
+    while ((packet = g_queue_peek_head (&sim.packets)) != NULL &&
+        packet->arrival <= sim.now) {
+      g_queue_pop_head (&sim.packets);
+      pseudo_tcp_socket_notify_packet (packet->to->sock,
+          (const gchar *) packet->data, packet->len);
+      update_clock (&sim, packet->to, FALSE);
+      g_free (packet);
+    }
+
+    if (sim.left.clock <= sim.now) {
+      pseudo_tcp_socket_notify_clock (sim.left.sock);
+      update_clock (&sim, &sim.left, TRUE);
+    }
+    if (sim.right.clock <= sim.now) {
+      pseudo_tcp_socket_notify_clock (sim.right.sock);
+      update_clock (&sim, &sim.right, TRUE);
+    }
+  }
+
+  completed = (sim.n_received == sim.size);
+  duration = MAX (sim.now - sim.opened, 1);
+  g_array_sort (sim.latencies, compare_latencies);
+
+  out = g_string_new (NULL);
+  g_string_append_printf (out, "{\"congestion_control\": \"%s\"",
+      congestion_control_name (conditions->congestion_control));
+  g_string_append_printf (out, ", \"rtt_ms\": %u", conditions->rtt);
+  g_string_append_printf (out, ", \"bandwidth_kbps\": %u",
+      conditions->bandwidth);
+  print_number (out, "loss", conditions->loss);
+  print_number (out, "reorder", conditions->reorder);
+  g_string_append_printf (out, ", \"bytes\": %" G_GSIZE_FORMAT, sim.size);
+  g_string_append_printf (out, ", \"completed\": %s",
+      completed ? "true" : "false");
+  print_number (out, "duration_ms", duration / 1000.0);
+  print_number (out, "goodput_kbps",
+      (gdouble) sim.n_received * 8 * 1000 / duration);
+  print_number (out, "retransmission_ratio",
+      sim.n_queued > 0 ?
+      ((gdouble) sim.payload_sent - sim.n_queued) / sim.n_queued : 0);
+  print_number (out, "latency_p50_ms", percentile_ms (sim.latencies, 50));
+  print_number (out, "latency_p99_ms", percentile_ms (sim.latencies, 99));
+  g_string_append (out, "}\n");
+  g_print ("%s", out->str);
+  g_string_free (out, TRUE);
+
+  g_queue_clear_full (&sim.packets, g_free);
+  g_object_unref (sim.left.sock);
+  g_object_unref (sim.right.sock);
+  g_array_unref (sim.latencies);
+  g_free (sim.queued_at);
+  g_rand_free (sim.prng);
+}
+
+static GOptionEntry entries[] = {
+  { "seed", 's', 0, G_OPTION_ARG_INT64, &seed, "PRNG seed", "N" },
+  { "size", 'n', 0, G_OPTION_ARG_INT, &size_kib,
+    "Size of each transfer, in KiB", "KIB" },
+  { "rtt", 'r', 0, G_OPTION_ARG_INT, &rtt,
+    "Only run with this round-trip time, in ms", "MS" },
+  { "bandwidth", 'b', 0, G_OPTION_ARG_INT, &bandwidth,
+    "Only run with this bandwidth, in kbit/s", "KBPS" },
+  { "loss", 'l', 0, G_OPTION_ARG_DOUBLE, &loss,
+    "Only run with this probability of loss", "P" },
+  { "reorder", 'o', 0, G_OPTION_ARG_DOUBLE, &reorder,
+    "Only run with this probability of reordering", "P" },
+  { "congestion-control", 'c', 0, G_OPTION_ARG_STRING, &congestion_control,
+    "Only run with this congestion control algorithm", "NAME" },
+  { NULL }
+};
+
+int main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  guint n_rtts = G_N_ELEMENTS (rtts);
+  guint n_bandwidths = G_N_ELEMENTS (bandwidths);
+  guint n_losses = G_N_ELEMENTS (losses);
+  guint n_reorders = G_N_ELEMENTS (reorders);
+  guint n_congestion_controls = G_N_ELEMENTS (congestion_controls);
+  guint i, j, k, l, m;
+
+  /* Configuration. */
+  context = g_option_context_new ("— benchmark the pseudotcp socket");
+  g_option_context_add_main_entries (context, entries, NULL);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("Option parsing failed: %s\n", error->message);
+    goto context_error;
+  }
+
+  if (size_kib <= 0 || rtt < 0 || bandwidth < 0 || loss >= 1 ||
+      reorder > 1) {
+    g_printerr ("Option parsing failed: %s\n", "Invalid conditions.");
+    goto context_error;
+  }
+
+  g_option_context_free (context);
+
+  if (rtt > 0) {
+    rtts[0] = rtt;
+    n_rtts = 1;
+  }
+  if (bandwidth > 0) {
+    bandwidths[0] = bandwidth;
+    n_bandwidths = 1;
+  }
+  if (loss >= 0) {
+    losses[0] = loss;
+    n_losses = 1;
+  }
+  if (reorder >= 0) {
+    reorders[0] = reorder;
+    n_reorders = 1;
+  }
+  if (congestion_control != NULL) {
+    GEnumClass *enum_class;
+    GEnumValue *enum_value;
+
+    enum_class = g_type_class_ref (pseudo_tcp_congestion_control_get_type ());
+    enum_value = g_enum_get_value_by_nick (enum_class, congestion_control);
+    g_type_class_unref (enum_class);
+
+    if (enum_value == NULL) {
+      g_printerr ("Unknown congestion control algorithm: %s\n",
+          congestion_control);
+      return 1;
+    }
+
+    congestion_controls[0] = enum_value->value;
+    n_congestion_controls = 1;
+  }
+
+  pseudo_tcp_set_debug_level (PSEUDO_TCP_DEBUG_NONE);
+
+  for (i = 0; i < n_congestion_controls; i++)
+    for (j = 0; j < n_rtts; j++)
+      for (k = 0; k < n_bandwidths; k++)
+        for (l = 0; l < n_losses; l++)
+          for (m = 0; m < n_reorders; m++) {
+            Conditions conditions = {
+              rtts[j], bandwidths[k], losses[l], reorders[m],
+              congestion_controls[i]
+            };
+
+            run (&conditions);
+          }
+
+  g_free (congestion_control);
+
+  return 0;
+
+context_error:
+  g_printerr ("\n%s\n", g_option_context_get_help (context, TRUE, NULL));
+  g_option_context_free (context);
+
+  return 1;
+}
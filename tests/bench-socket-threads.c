@@ -0,0 +1,241 @@
+/* vim: et ts=2 sw=2 tw=80: */
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <gio/gnetworking.h>
+
+#include "socket.h"
+
+
+/**
+ * A stress benchmark for the locking of the TCP sockets. Each thread runs its
+ * own main context with its own pair of connected ICE-TCP sockets over the
+ * loopback interface, and sends small messages from one to the other as fast
+ * as it can, for a fixed duration.
+ *
+ * The threads share nothing, so the throughput should grow with their number
+ * up to the number of cores; any lock shared between sockets shows up as a
+ * flat line. Each thread count is reported as a line of JSON on stdout:
+ *  • throughput_mbps: payload received by all threads, per second;
+ *  • messages_per_second: the same, in messages.
+ */
+
+
+#define MESSAGE_SIZE 200  /* bytes, about the size of an audio packet */
+#define BATCH_SIZE 64  /* messages sent before draining the receiver */
+
+typedef struct {
+  GThread *thread;
+  guint64 n_bytes;  /* received */
+} Worker;
+
+/* Configuration options. */
+static gint duration_ms = 1000;
+static gint max_threads = 0;
+
+/* Starts all the threads at once, once their sockets are connected. */
+static GMutex start_mutex;
+static GCond start_cond;
+static guint n_ready;
+static gint64 deadline;  /* monotonic µs, or 0 before the start */
+
+
+static void
+connect_pair (GMainContext *context, NiceSocket **passive_sock,
+    NiceSocket **client, NiceSocket **server)
+{
+  NiceAddress addr;
+  NiceSocket *active_sock;
+  GError *error = NULL;
+
+  nice_address_init (&addr);
+  g_assert_true (nice_address_set_from_string (&addr, "127.0.0.1"));
+
+  *passive_sock = nice_tcp_passive_socket_new (context, &addr, &error);
+  g_assert_no_error (error);
+  g_assert_true (*passive_sock);
+
+  active_sock = nice_tcp_active_socket_new (context, &addr);
+  g_assert_true (active_sock);
+  *client = nice_tcp_active_socket_connect (active_sock, &(*passive_sock)->addr);
+  g_assert_true (*client);
+  nice_socket_free (active_sock);
+
+  g_socket_condition_wait ((*passive_sock)->fileno, G_IO_IN, NULL, &error);
+  g_assert_no_error (error);
+  *server = nice_tcp_passive_socket_accept (*passive_sock);
+  g_assert_true (*server);
+}
+
+static gpointer
+worker_thread (gpointer data)
+{
+  Worker *worker = data;
+  GMainContext *context;
+  NiceSocket *passive_sock, *client, *server;
+  gchar send_buf[MESSAGE_SIZE] = { 0, };
+  gchar recv_buf[BATCH_SIZE * MESSAGE_SIZE];
+  GOutputVector buffer = { send_buf, MESSAGE_SIZE };
+  NiceOutputMessage messages[BATCH_SIZE];
+  NiceAddress from;
+  gint64 end;
+  guint i;
+
+  context = g_main_context_new ();
+  connect_pair (context, &passive_sock, &client, &server);
+
+  for (i = 0; i < BATCH_SIZE; i++) {
+    messages[i].buffers = &buffer;
+    messages[i].n_buffers = 1;
+  }
+
+  g_mutex_lock (&start_mutex);
+  n_ready++;
+  g_cond_broadcast (&start_cond);
+  while (deadline == 0)
+    g_cond_wait (&start_cond, &start_mutex);
+  end = deadline;
+  g_mutex_unlock (&start_mutex);
+
+  while (g_get_monotonic_time () < end) {
+    gint n_sent;
+    gint n_received;
+
+    /* Messages are not queued once the socket would block; flushing its
+     * queue, if any, is left to the context. */
+    n_sent = nice_socket_send_messages (client, &server->addr, messages,
+        BATCH_SIZE);
+    g_assert_cmpint (n_sent, >=, 0);
+
+    do {
+      n_received = nice_socket_recv (server, &from, sizeof (recv_buf),
+          recv_buf);
+      g_assert_cmpint (n_received, >=, 0);
+      worker->n_bytes += n_received;
+    } while (n_received == sizeof (recv_buf));
+
+    while (g_main_context_iteration (context, FALSE));
+  }
+
+  nice_socket_free (client);
+  nice_socket_free (server);
+  nice_socket_free (passive_sock);
+  g_main_context_unref (context);
+
+  return NULL;
+}
+
+static void
+run (guint n_threads)
+{
+  Worker *workers;
+  guint64 n_bytes = 0;
+  gdouble seconds = duration_ms / 1000.0;
+  guint i;
+
+  workers = g_new0 (Worker, n_threads);
+  n_ready = 0;
+  deadline = 0;
+
+  for (i = 0; i < n_threads; i++)
+    workers[i].thread = g_thread_new ("bench", worker_thread, &workers[i]);
+
+  g_mutex_lock (&start_mutex);
+  while (n_ready < n_threads)
+    g_cond_wait (&start_cond, &start_mutex);
+  deadline = g_get_monotonic_time () + duration_ms * (gint64) 1000;
+  g_cond_broadcast (&start_cond);
+  g_mutex_unlock (&start_mutex);
+
+  for (i = 0; i < n_threads; i++) {
+    g_thread_join (workers[i].thread);
+    n_bytes += workers[i].n_bytes;
+  }
+
+  g_print ("{\"threads\": %u, \"duration_ms\": %d, "
+      "\"throughput_mbps\": %.1f, \"messages_per_second\": %.0f}\n",
+      n_threads, duration_ms, n_bytes * 8 / seconds / 1e6,
+      n_bytes / MESSAGE_SIZE / seconds);
+
+  g_free (workers);
+}
+
+static GOptionEntry entries[] = {
+  { "duration", 'd', 0, G_OPTION_ARG_INT, &duration_ms,
+    "Duration of each run, in ms", "MS" },
+  { "max-threads", 't', 0, G_OPTION_ARG_INT, &max_threads,
+    "Largest number of threads, by default the number of processors", "N" },
+  { NULL }
+};
+
+int main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  guint n_threads;
+
+  /* Configuration. */
+  context = g_option_context_new ("— benchmark the TCP sockets across threads");
+  g_option_context_add_main_entries (context, entries, NULL);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("Option parsing failed: %s\n", error->message);
+    goto context_error;
+  }
+
+  if (duration_ms <= 0 || max_threads < 0) {
+    g_printerr ("Option parsing failed: %s\n", "Invalid duration or threads.");
+    goto context_error;
+  }
+
+  g_option_context_free (context);
+
+  if (max_threads == 0)
+    max_threads = g_get_num_processors ();
+
+  g_networking_init ();
+
+  /* Doubling, and the largest count even if it is not a power of two. */
+  for (n_threads = 1; n_threads < (guint) max_threads; n_threads *= 2)
+    run (n_threads);
+  run (max_threads);
+
+  return 0;
+
+context_error:
+  g_printerr ("\n%s\n", g_option_context_get_help (context, TRUE, NULL));
+  g_option_context_free (context);
+
+  return 1;
+}
@@ -0,0 +1,163 @@
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include "agent.h"
+#include "test-common.h"
+
+#include <string.h>
+
+/* A DTLS handshake record and an RTP packet header, as seen on the wire */
+static const gchar dtls_packet[] = { 22, 0xfe, 0xfd, 0, 0, 0, 0, 0 };
+static const gchar rtp_packet[] = { 0x80, 0x60, 0, 1, 0, 0, 0, 0 };
+
+static GMainLoop *global_mainloop = NULL;
+static guint global_ready = 0;
+static guint global_default_read = 0;
+static guint global_rtp_read = 0;
+
+static gboolean timer_cb (gpointer pointer)
+{
+  g_debug ("test-demux:%s: %p", G_STRFUNC, pointer);
+
+  /* note: should not be reached, abort */
+  g_error ("ERROR: test has got stuck, aborting...");
+
+  return FALSE;
+}
+
+static void cb_component_state_changed (NiceAgent *agent, guint stream_id,
+    guint component_id, guint state, gpointer data)
+{
+  if (state == NICE_COMPONENT_STATE_READY && ++global_ready == 2)
+    g_main_loop_quit (global_mainloop);
+
+  /* XXX: dear compiler, these are for you: */
+  (void)agent; (void)stream_id; (void)component_id; (void)data;
+}
+
+static void cb_nice_recv (NiceAgent *agent, guint stream_id,
+    guint component_id, guint len, gchar *buf, gpointer user_data)
+{
+  /* Anything that isn't RTP falls through to the default callback */
+  g_assert_cmpuint (len, ==, sizeof (dtls_packet));
+  g_assert_cmpmem (buf, len, dtls_packet, sizeof (dtls_packet));
+  global_default_read++;
+
+  if (global_default_read && global_rtp_read)
+    g_main_loop_quit (global_mainloop);
+
+  /* XXX: dear compiler, these are for you: */
+  (void)agent; (void)stream_id; (void)component_id; (void)user_data;
+}
+
+static void cb_nice_recv_rtp (NiceAgent *agent, guint stream_id,
+    guint component_id, guint len, gchar *buf, NiceMessageExtraData *exdata,
+    gpointer user_data)
+{
+  g_assert_cmpuint (len, ==, sizeof (rtp_packet));
+  g_assert_cmpmem (buf, len, rtp_packet, sizeof (rtp_packet));
+  global_rtp_read++;
+
+  if (global_default_read && global_rtp_read)
+    g_main_loop_quit (global_mainloop);
+
+  /* XXX: dear compiler, these are for you: */
+  (void)agent; (void)stream_id; (void)component_id; (void)exdata;
+  (void)user_data;
+}
+
+int main (void)
+{
+  NiceAgent *lagent, *ragent;
+  GMainContext *ctx;
+  guint timer_id;
+  guint ls_id, rs_id;
+
+  global_mainloop = g_main_loop_new (NULL, FALSE);
+  ctx = g_main_loop_get_context (global_mainloop);
+
+  lagent = nice_agent_new (ctx, NICE_COMPATIBILITY_RFC5245);
+  ragent = nice_agent_new (ctx, NICE_COMPATIBILITY_RFC5245);
+  g_object_set (G_OBJECT (lagent), "ice-tcp", FALSE, "upnp", FALSE,
+      "controlling-mode", TRUE, NULL);
+  g_object_set (G_OBJECT (ragent), "ice-tcp", FALSE, "upnp", FALSE,
+      "controlling-mode", FALSE, NULL);
+
+  g_signal_connect (G_OBJECT (lagent), "component-state-changed",
+      G_CALLBACK (cb_component_state_changed), GUINT_TO_POINTER (1));
+  g_signal_connect (G_OBJECT (ragent), "component-state-changed",
+      G_CALLBACK (cb_component_state_changed), GUINT_TO_POINTER (2));
+
+  ls_id = nice_agent_add_stream (lagent, 1);
+  rs_id = nice_agent_add_stream (ragent, 1);
+  g_assert_cmpuint (ls_id, >, 0);
+  g_assert_cmpuint (rs_id, >, 0);
+
+  nice_agent_attach_recv (lagent, ls_id, 1, ctx, cb_nice_recv, NULL);
+  nice_agent_attach_recv (ragent, rs_id, 1, ctx, cb_nice_recv, NULL);
+
+  /* STUN cannot be claimed by the application */
+  g_assert_false (nice_agent_attach_recv_demux (ragent, rs_id, 1,
+      NICE_DEMUX_PROTOCOL_STUN, cb_nice_recv_rtp, NULL, NULL));
+  g_assert_true (nice_agent_attach_recv_demux (ragent, rs_id, 1,
+      NICE_DEMUX_PROTOCOL_RTP, cb_nice_recv_rtp, NULL, NULL));
+
+  g_assert_true (nice_agent_gather_candidates (lagent, ls_id));
+  g_assert_true (nice_agent_gather_candidates (ragent, rs_id));
+
+  test_common_set_credentials (lagent, ls_id, ragent, rs_id);
+  test_common_set_candidates (lagent, ls_id, ragent, rs_id, 1, FALSE, FALSE);
+  test_common_set_candidates (ragent, rs_id, lagent, ls_id, 1, FALSE, FALSE);
+
+  timer_id = g_timeout_add_seconds (30, timer_cb, NULL);
+
+  /* step: wait for both sides to be connected */
+  g_main_loop_run (global_mainloop);
+
+  /* step: each packet must reach only the callback of its protocol */
+  g_assert_cmpint (nice_agent_send (lagent, ls_id, 1, sizeof (rtp_packet),
+      rtp_packet), ==, sizeof (rtp_packet));
+  g_assert_cmpint (nice_agent_send (lagent, ls_id, 1, sizeof (dtls_packet),
+      dtls_packet), ==, sizeof (dtls_packet));
+  g_main_loop_run (global_mainloop);
+
+  g_assert_cmpuint (global_rtp_read, ==, 1);
+  g_assert_cmpuint (global_default_read, ==, 1);
+
+  g_source_remove (timer_id);
+
+  g_object_unref (lagent);
+  g_object_unref (ragent);
+  g_main_loop_unref (global_mainloop);
+
+  return 0;
+}
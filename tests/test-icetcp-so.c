@@ -0,0 +1,219 @@
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include "agent.h"
+#include "test-common.h"
+
+#include <string.h>
+#include <gio/gnetworking.h>
+
+/* Connection attempts made for a simultaneous-open pair before it fails, see
+ * TCP_SO_MAX_CONNECT_ATTEMPTS in conncheck.c */
+#define SO_MAX_CONNECT_ATTEMPTS 10
+
+static GMainLoop *global_mainloop = NULL;
+static gboolean global_gathering_done = FALSE;
+static gboolean global_failed = FALSE;
+static guint global_connections = 0;
+
+static gboolean timer_cb (gpointer pointer)
+{
+  g_debug ("test-icetcp-so:%s: %p", G_STRFUNC, pointer);
+
+  /* note: should not be reached, abort */
+  g_error ("ERROR: test has got stuck, aborting...");
+
+  return FALSE;
+}
+
+static void cb_candidate_gathering_done (NiceAgent *agent, guint stream_id,
+    gpointer data)
+{
+  global_gathering_done = TRUE;
+  g_main_loop_quit (global_mainloop);
+
+  /* XXX: dear compiler, these are for you: */
+  (void)agent; (void)stream_id; (void)data;
+}
+
+static void cb_component_state_changed (NiceAgent *agent, guint stream_id,
+    guint component_id, guint state, gpointer data)
+{
+  g_assert_cmpint (state, !=, NICE_COMPONENT_STATE_READY);
+
+  if (state == NICE_COMPONENT_STATE_FAILED) {
+    global_failed = TRUE;
+    g_main_loop_quit (global_mainloop);
+  }
+
+  /* XXX: dear compiler, these are for you: */
+  (void)agent; (void)stream_id; (void)component_id; (void)data;
+}
+
+/* The remote candidate closes every connection it gets, as a peer whose own
+ * connection attempt had not started yet would refuse it. */
+static gboolean cb_connection_available (GSocket *listener,
+    GIOCondition condition, gpointer data)
+{
+  GSocket *connection;
+
+  connection = g_socket_accept (listener, NULL, NULL);
+  if (connection != NULL) {
+    global_connections++;
+    g_socket_close (connection, NULL);
+    g_object_unref (connection);
+  }
+
+  /* XXX: dear compiler, these are for you: */
+  (void)condition; (void)data;
+
+  return G_SOURCE_CONTINUE;
+}
+
+static GSocket *listen_on_loopback (NiceAddress *addr)
+{
+  GSocket *listener;
+  GInetAddress *inet_addr;
+  GSocketAddress *gaddr;
+  GError *error = NULL;
+  union {
+    struct sockaddr_storage storage;
+    struct sockaddr addr;
+  } name;
+
+  listener = g_socket_new (G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_STREAM,
+      G_SOCKET_PROTOCOL_TCP, &error);
+  g_assert_no_error (error);
+  g_socket_set_blocking (listener, FALSE);
+
+  inet_addr = g_inet_address_new_loopback (G_SOCKET_FAMILY_IPV4);
+  gaddr = g_inet_socket_address_new (inet_addr, 0);
+  g_assert_true (g_socket_bind (listener, gaddr, FALSE, &error));
+  g_assert_no_error (error);
+  g_object_unref (gaddr);
+  g_object_unref (inet_addr);
+
+  g_assert_true (g_socket_listen (listener, &error));
+  g_assert_no_error (error);
+
+  gaddr = g_socket_get_local_address (listener, &error);
+  g_assert_no_error (error);
+  g_assert_true (g_socket_address_to_native (gaddr, &name.addr,
+          sizeof (name), &error));
+  g_assert_no_error (error);
+  nice_address_set_from_sockaddr (addr, &name.addr);
+  g_object_unref (gaddr);
+
+  return listener;
+}
+
+/* A simultaneous-open pair whose connection is closed under it goes back to
+ * waiting and is checked again, from the same candidate, until it runs out of
+ * attempts. */
+int main (void)
+{
+  NiceAgent *agent;
+  NiceAddress baseaddr;
+  NiceCandidate *cand;
+  GSList *cands;
+  GMainContext *ctx;
+  GSocket *listener;
+  GSource *source;
+  guint timer_id;
+  guint stream_id;
+
+  global_mainloop = g_main_loop_new (NULL, FALSE);
+  ctx = g_main_loop_get_context (global_mainloop);
+
+  listener = listen_on_loopback (&baseaddr);
+  source = g_socket_create_source (listener, G_IO_IN, NULL);
+  g_source_set_callback (source,
+      (GSourceFunc) G_CALLBACK (cb_connection_available), NULL, NULL);
+  g_source_attach (source, ctx);
+
+  agent = nice_agent_new (ctx, NICE_COMPATIBILITY_RFC5245);
+  g_object_set (G_OBJECT (agent), "ice-udp", FALSE, "ice-tcp-so", TRUE,
+      "upnp", FALSE, "controlling-mode", TRUE, NULL);
+
+  g_signal_connect (G_OBJECT (agent), "candidate-gathering-done",
+      G_CALLBACK (cb_candidate_gathering_done), NULL);
+  g_signal_connect (G_OBJECT (agent), "component-state-changed",
+      G_CALLBACK (cb_component_state_changed), NULL);
+
+  {
+    NiceAddress localaddr;
+
+    g_assert_true (nice_address_set_from_string (&localaddr, "127.0.0.1"));
+    nice_agent_add_local_address (agent, &localaddr);
+  }
+
+  stream_id = nice_agent_add_stream (agent, 1);
+  g_assert_cmpuint (stream_id, >, 0);
+
+  timer_id = g_timeout_add_seconds (30, timer_cb, NULL);
+
+  g_assert_true (nice_agent_gather_candidates (agent, stream_id));
+  if (!global_gathering_done)
+    g_main_loop_run (global_mainloop);
+
+  nice_agent_set_remote_credentials (agent, stream_id, "ufrag",
+      "remote-password");
+
+  /* step: pair the simultaneous-open candidate with the listener only */
+  cand = nice_candidate_new (NICE_CANDIDATE_TYPE_HOST);
+  cand->component_id = 1;
+  cand->transport = NICE_CANDIDATE_TRANSPORT_TCP_SO;
+  cand->priority = 100000;
+  strcpy (cand->foundation, "1");
+  cand->addr = baseaddr;
+  cands = g_slist_append (NULL, cand);
+  g_assert_cmpint (nice_agent_set_remote_candidates (agent, stream_id, 1,
+          cands), ==, 1);
+  g_slist_free_full (cands, (GDestroyNotify) nice_candidate_free);
+
+  /* step: run until the pair has used up its attempts */
+  g_main_loop_run (global_mainloop);
+
+  g_assert_true (global_failed);
+  g_assert_cmpuint (global_connections, ==, SO_MAX_CONNECT_ATTEMPTS);
+
+  g_source_remove (timer_id);
+
+  g_object_unref (agent);
+  g_source_destroy (source);
+  g_source_unref (source);
+  g_socket_close (listener, NULL);
+  g_object_unref (listener);
+  g_main_loop_unref (global_mainloop);
+
+  return 0;
+}
@@ -59,6 +59,8 @@ static gboolean global_ready_reached = FALSE;
 static int global_lagent_cands = 0;
 static int global_ragent_cands = 0;
 static gint global_ragent_read = 0;
+static GByteArray *global_ragent_frames = NULL;
+static gsize global_ragent_frames_expected = 0;
 static guint global_exit_when_ibr_received = 0;
 
 static void priv_print_global_status (void)
@@ -94,6 +96,15 @@ static void cb_nice_recv (NiceAgent *agent, guint stream_id, guint component_id,
   /* XXX: dear compiler, these are for you: */
   (void)agent; (void)stream_id; (void)component_id; (void)buf;
 
+  /* Frames of a long message, which don't all start with the pattern */
+  if (global_ragent_frames != NULL && GPOINTER_TO_UINT (user_data) == 2 &&
+      component_id == 1) {
+    g_byte_array_append (global_ragent_frames, (const guint8 *) buf, len);
+    if (global_ragent_frames->len >= global_ragent_frames_expected)
+      g_main_loop_quit (global_mainloop);
+    return;
+  }
+
   /*
    * Lets ignore stun packets that got through
    */
@@ -251,10 +262,74 @@ static void set_candidates (NiceAgent *from, guint from_stream,
   g_slist_free (cands);
 }
 
+static guint count_local_candidates (NiceAgent *agent, guint stream_id,
+    guint component_id)
+{
+  GSList *cands;
+  guint n;
+
+  cands = nice_agent_get_local_candidates (agent, stream_id, component_id);
+  n = g_slist_length (cands);
+  g_slist_free_full (cands, (GDestroyNotify) nice_candidate_free);
+
+  return n;
+}
+
+/* Sends a message longer than one RFC 4571 frame, in buffers that don't line
+ * up with the frames, so the second frame starts in the middle of a buffer */
+static void send_multi_frame_message (NiceAgent *lagent, guint ls_id)
+{
+  static const gsize sizes[] = { 30000, 40000, 30000 };
+  GOutputVector buffers[G_N_ELEMENTS (sizes)];
+  NiceOutputMessage message = { buffers, G_N_ELEMENTS (sizes) };
+  guint8 *data;
+  gsize total = 0, offset = 0;
+  GError *error = NULL;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++)
+    total += sizes[i];
+
+  data = g_malloc (total);
+  for (i = 0; i < total; i++)
+    data[i] = i % 251;
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++) {
+    buffers[i].buffer = data + offset;
+    buffers[i].size = sizes[i];
+    offset += sizes[i];
+  }
+
+  global_ragent_frames = g_byte_array_new ();
+  global_ragent_frames_expected = total;
+
+  g_assert_cmpint (nice_agent_send_messages_nonblocking (lagent, ls_id, 1,
+          &message, 1, NULL, &error), ==, 1);
+  g_assert_no_error (error);
+  g_main_loop_run (global_mainloop);
+
+  g_assert_cmpuint (global_ragent_frames->len, ==, total);
+  g_assert_true (memcmp (global_ragent_frames->data, data, total) == 0);
+
+  g_byte_array_unref (global_ragent_frames);
+  global_ragent_frames = NULL;
+  g_free (data);
+}
+
+/* The host candidate which is not part of the selected pair is released */
+static void wait_for_release (NiceAgent *agent, guint stream_id)
+{
+  guint n_cands = count_local_candidates (agent, stream_id, 1);
+
+  while (count_local_candidates (agent, stream_id, 1) == n_cands)
+    g_main_context_iteration (g_main_loop_get_context (global_mainloop), TRUE);
+}
+
 static int run_full_test (NiceAgent *lagent, NiceAgent *ragent, NiceAddress *baseaddr, guint ready, guint failed)
 {
   guint ls_id, rs_id;
   gint ret;
+  gint backup_pairs;
 
   /* XXX: dear compiler, this is for you */
   (void)baseaddr;
@@ -371,6 +446,22 @@ static int run_full_test (NiceAgent *lagent, NiceAgent *ragent, NiceAddress *bas
   g_main_loop_run (global_mainloop);
   g_assert_cmpint (global_ragent_read, ==, 16);
 
+  send_multi_frame_message (lagent, ls_id);
+
+  g_object_get (G_OBJECT (lagent), "backup-pairs", &backup_pairs, NULL);
+  if (backup_pairs >= 0) {
+    g_debug ("test-icetcp: Waiting for the unused sockets to be released...");
+    wait_for_release (lagent, ls_id);
+    wait_for_release (ragent, rs_id);
+
+    /* The selected pair still works */
+    global_ragent_read = 0;
+    g_assert_cmpint (nice_agent_send (lagent, ls_id, 1, 16, "1234567812345678"),
+        ==, 16);
+    g_main_loop_run (global_mainloop);
+    g_assert_cmpint (global_ragent_read, ==, 16);
+  }
+
   g_debug ("test-icetcp: Ran mainloop, removing streams...");
 
   /* step: clean up resources and exit */
@@ -468,6 +559,16 @@ int main (void)
   g_assert_cmpint (global_lagent_cands, >=, 2);
   g_assert_cmpint (global_ragent_cands, >=, 2);
 
+  /* step: run test again, releasing the unused sockets once ready */
+  g_debug ("test-icetcp: TEST STARTS / running test for the 3rd time");
+  g_object_set (G_OBJECT (lagent), "backup-pairs", 0, NULL);
+  g_object_set (G_OBJECT (ragent), "backup-pairs", 0, NULL);
+  result = run_full_test (lagent, ragent, &baseaddr, 4, 0);
+  priv_print_global_status ();
+  g_assert_cmpint (result, ==, 0);
+  g_assert_cmpint (global_lagent_state[0], ==, NICE_COMPONENT_STATE_READY);
+  g_assert_cmpint (global_ragent_state[0], ==, NICE_COMPONENT_STATE_READY);
+
   g_object_unref (lagent);
   g_object_unref (ragent);
 
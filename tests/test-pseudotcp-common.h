@@ -0,0 +1,109 @@
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * © 2014, 2015 Collabora Ltd.
+ *  Contact: Philip Withnall
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Contributors:
+ *   Philip Withnall, Collabora Ltd.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+
+#ifndef __TEST_PSEUDOTCP_COMMON_H__
+#define __TEST_PSEUDOTCP_COMMON_H__
+
+#include "pseudotcp.h"
+
+/* Helpers for the tests driving a pair of pseudo-TCP sockets segment by
+ * segment, with their clocks controlled by the test. */
+
+typedef struct {
+  PseudoTcpSocket *left;  /* owned */
+  PseudoTcpSocket *right;  /* owned */
+
+  guint32 left_current_time;
+  guint32 right_current_time;
+
+  /* Data sent and received by each socket. */
+  GQueue/*<owned GBytes>*/ *left_sent;  /* owned */
+  GQueue/*<owned GBytes>*/ *right_sent;  /* owned */
+} Data;
+
+/* NOTE: Must match the on-the-wire flag values from pseudotcp.c. */
+typedef enum {
+  FLAG_NONE = 0,
+  FLAG_FIN = 1 << 0,
+  FLAG_SYN = 1 << 1,
+  FLAG_RST = 1 << 2,
+  FLAG_SACK = 1 << 3,
+  FLAG_FORWARD = 1 << 4,
+} SegmentFlags;
+
+void
+data_clear (Data *data);
+gchar *
+segment_bytes_to_string (const guint8 *bytes);
+void
+create_sockets (Data *data, gboolean support_fin_ack);
+void
+expect_segment (PseudoTcpSocket *socket, GQueue/*<owned GBytes>*/ *queue,
+    guint32 seq, guint32 ack, guint32 len, SegmentFlags flags);
+void
+assert_empty_queues (Data *data);
+gboolean
+forward_segment (GQueue/*<owned GBytes>*/ *from, PseudoTcpSocket *to);
+void
+forward_segment_ltr (Data *data);
+void
+forward_segment_rtl (Data *data);
+void
+drop_segment (PseudoTcpSocket *socket, GQueue/*<owned GBytes>*/ *queue);
+void
+expect_socket_state (PseudoTcpSocket *socket, PseudoTcpState expected_state);
+void
+expect_sockets_connected (Data *data);
+void
+increment_time (PseudoTcpSocket *socket, guint32 *counter, guint32 increment);
+void
+increment_time_both (Data *data, guint32 increment);
+void
+expect_ack (PseudoTcpSocket *socket, GQueue/*<owned GBytes>*/ *queue,
+    guint32 seq, guint32 ack);
+void
+expect_data (PseudoTcpSocket *socket, GQueue/*<owned GBytes>*/ *queue,
+    guint32 seq, guint32 ack, guint32 len);
+void
+expect_sack (PseudoTcpSocket *socket, GQueue/*<owned GBytes>*/ *queue,
+    guint32 seq, guint32 ack, const guint32 *edges, guint n_edges);
+void
+connect_sockets (Data *data);
+void
+establish_connection (Data *data);
+void
+expect_received (Data *data, const guint8 *buf, gsize len);
+
+#endif /* __TEST_PSEUDOTCP_COMMON_H__ */
@@ -0,0 +1,122 @@
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <locale.h>
+
+#include "test-pseudotcp-common.h"
+
+
+/* Check that a bulk transfer with periodic losses completes with each of the
+ * congestion control algorithms. */
+static void
+pseudotcp_congestion_control (void)
+{
+  const PseudoTcpCongestionControl algorithms[] = {
+    PSEUDO_TCP_CONGESTION_RENO,
+    PSEUDO_TCP_CONGESTION_CUBIC,
+    PSEUDO_TCP_CONGESTION_BBR,
+  };
+  guint8 *buf, *received;
+  const gsize len = 256 * 1024;
+  gsize i;
+  guint a;
+
+  buf = g_malloc (len);
+  received = g_malloc (len);
+  for (i = 0; i < len; i++)
+    buf[i] = i % 251;
+
+  for (a = 0; a < G_N_ELEMENTS (algorithms); a++) {
+    Data data = { 0, };
+    guint algorithm;
+    gsize n_sent = 0, n_received = 0;
+    guint n_segments = 0, rounds;
+
+    create_sockets (&data, TRUE);
+    g_object_set (data.left, "congestion-control", algorithms[a], NULL);
+    g_object_get (data.left, "congestion-control", &algorithm, NULL);
+    g_assert_cmpuint (algorithm, ==, algorithms[a]);
+    connect_sockets (&data);
+
+    for (rounds = 0; n_received < len && rounds < 100000; rounds++) {
+      gint ret;
+
+      if (n_sent < len) {
+        ret = pseudo_tcp_socket_send (data.left, (const char *) buf + n_sent,
+            len - n_sent);
+        if (ret > 0)
+          n_sent += ret;
+      }
+
+      /* Lose one segment in 37 on the way to the RHS. */
+      while (g_queue_get_length (data.left_sent) > 0) {
+        if (++n_segments % 37 == 0)
+          drop_segment (data.left, data.left_sent);
+        else
+          forward_segment (data.left_sent, data.right);
+      }
+      while (g_queue_get_length (data.right_sent) > 0)
+        forward_segment (data.right_sent, data.left);
+
+      ret = pseudo_tcp_socket_recv (data.right,
+          (char *) received + n_received, len - n_received);
+      if (ret > 0)
+        n_received += ret;
+
+      increment_time_both (&data, 5);
+    }
+
+    g_assert_cmpuint (n_received, ==, len);
+    g_assert_cmpmem (received, len, buf, len);
+
+    data_clear (&data);
+  }
+
+  g_free (received);
+  g_free (buf);
+}
+
+int
+main (int argc, char *argv[])
+{
+  setlocale (LC_ALL, "");
+  g_test_init (&argc, &argv, NULL);
+  pseudo_tcp_set_debug_level (PSEUDO_TCP_DEBUG_VERBOSE);
+
+  g_test_add_func ("/pseudotcp/congestion-control",
+      pseudotcp_congestion_control);
+
+  g_test_run ();
+
+  return 0;
+}
@@ -42,270 +42,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
-#include <arpa/inet.h>
 
-#include "pseudotcp.h"
+#include "test-pseudotcp-common.h"
 
 
-typedef struct {
-  PseudoTcpSocket *left;  /* owned */
-  PseudoTcpSocket *right;  /* owned */
-
-  guint32 left_current_time;
-  guint32 right_current_time;
-
-  /* Data sent and received by each socket. */
-  GQueue/*<owned GBytes>*/ *left_sent;  /* owned */
-  GQueue/*<owned GBytes>*/ *right_sent;  /* owned */
-} Data;
-
-/* NOTE: Must match the on-the-wire flag values from pseudotcp.c. */
-typedef enum {
-  FLAG_NONE = 0,
-  FLAG_FIN = 1 << 0,
-  FLAG_SYN = 1 << 1,
-  FLAG_RST = 1 << 2,
-} SegmentFlags;
-
 typedef void (*TestFunc) (Data *data, const void *next_funcs);
 
 
-static void
-data_clear (Data *data)
-{
-  if (data->left != NULL)
-    g_object_unref (data->left);
-  if (data->right != NULL)
-    g_object_unref (data->right);
-
-  if (data->left_sent != NULL)
-    g_queue_free_full (data->left_sent, (GDestroyNotify) g_bytes_unref);
-  if (data->right_sent != NULL)
-    g_queue_free_full (data->right_sent, (GDestroyNotify) g_bytes_unref);
-}
-
-
-static gchar *
-segment_flags_to_string (SegmentFlags flags)
-{
-  GString *str = g_string_new (NULL);
-
-  if (flags & FLAG_SYN)
-    g_string_append (str, "SYN,");
-  if (flags & FLAG_FIN)
-    g_string_append (str, "FIN,");
-  if (flags & FLAG_RST)
-    g_string_append (str, "RST,");
-
-  /* Strip the trailing comma. */
-  if (str->len > 0)
-    g_string_truncate (str, str->len - 1);
-
-  if (str->len == 0)
-    g_string_append (str, "0");
-
-  return g_string_free (str, FALSE);
-}
-
-static gchar *
-segment_to_string (guint32 seq, guint32 ack, SegmentFlags flags)
-{
-  gchar *ctl, *out;
-
-  ctl = segment_flags_to_string (flags);
-  out = g_strdup_printf ("<SEQ=%u><ACK=%u><CTL=%s>", seq, ack, ctl);
-  g_free (ctl);
-
-  return out;
-}
-
-static gchar *
-segment_bytes_to_string (const guint8 *bytes)
-{
-  union {
-    const guint8 *u8;
-    const guint32 *u32;
-  } b;
-  guint32 seq, ack;
-  guint8 flags;
-
-  b.u8 = bytes;
-
-  seq = ntohl (b.u32[1]);
-  ack = ntohl (b.u32[2]);
-  flags = b.u8[13];
-
-  return segment_to_string (seq, ack, flags);
-}
-
-
-static void
-opened (PseudoTcpSocket *sock, gpointer data)
-{
-  g_debug ("Socket %p opened", sock);
-}
-
-static void
-readable (PseudoTcpSocket *sock, gpointer data)
-{
-  g_debug ("Socket %p readable", sock);
-}
-
-static void
-writable (PseudoTcpSocket *sock, gpointer data)
-{
-  g_debug ("Socket %p writeable", sock);
-}
-
-static void
-closed (PseudoTcpSocket *sock, guint32 err, gpointer data)
-{
-  g_debug ("Socket %p closed: %s", sock, strerror (err));
-}
-
-static PseudoTcpWriteResult
-write_packet (PseudoTcpSocket *sock, const gchar *buffer, guint32 len,
-    gpointer user_data)
-{
-  Data *data = user_data;
-  gchar *str;  /* owned */
-  GQueue/*<owned GBytes>*/ *queue = NULL;  /* unowned */
-  GBytes *segment;  /* owned */
-
-  /* Debug output. */
-  str = segment_bytes_to_string ((const guint8 *) buffer);
-  g_debug ("%p sent: %s", sock, str);
-  g_free (str);
-
-  /* One of the sockets has outputted a packet. */
-  if (sock == data->left)
-    queue = data->left_sent;
-  else if (sock == data->right)
-    queue = data->right_sent;
-  else
-    g_assert_not_reached ();
-
-  segment = g_bytes_new (buffer, len);
-  g_queue_push_tail (queue, segment);
-
-  return WR_SUCCESS;
-}
-
-
-static void
-create_sockets (Data *data, gboolean support_fin_ack)
-{
-  PseudoTcpCallbacks cbs = {
-    data, opened, readable, writable, closed, write_packet
-  };
-
-  data->left = g_object_new (PSEUDO_TCP_SOCKET_TYPE,
-      "conversation", 0,
-      "callbacks", &cbs,
-      "support-fin-ack", support_fin_ack,
-      NULL);
-  data->right = g_object_new (PSEUDO_TCP_SOCKET_TYPE,
-      "conversation", 0,
-      "callbacks", &cbs,
-      "support-fin-ack", support_fin_ack,
-      NULL);
-
-  g_debug ("Left: %p, right: %p", data->left, data->right);
-
-  /* Control the socket clocks precisely. */
-  pseudo_tcp_socket_set_time (data->left, 1);
-  pseudo_tcp_socket_set_time (data->right, 1);
-
-  /* Sanity check the socket state. */
-  g_assert_cmpint (pseudo_tcp_socket_send (data->left, "foo", 3), ==, -1);
-  g_assert_cmpint (pseudo_tcp_socket_get_error (data->left), ==, ENOTCONN);
-
-  g_assert_cmpint (pseudo_tcp_socket_send (data->right, "foo", 3), ==, -1);
-  g_assert_cmpint (pseudo_tcp_socket_get_error (data->right), ==, ENOTCONN);
-
-  data->left_sent = g_queue_new ();
-  data->right_sent = g_queue_new ();
-}
-
-static void
-expect_segment (PseudoTcpSocket *socket, GQueue/*<owned GBytes>*/ *queue,
-    guint32 seq, guint32 ack, guint32 len, SegmentFlags flags)
-{
-  GBytes *bytes;  /* unowned */
-  union {
-    const guint8 *u8;
-    const guint32 *u32;
-  } b;
-  gsize size;
-  gchar *str;
-
-  str = segment_to_string (seq, ack, flags);
-  g_debug ("%p expect: %s", socket, str);
-  g_free (str);
-
-  /* Grab the segment. */
-  bytes = g_queue_peek_head (queue);
-  g_assert_true (bytes != NULL);
-
-  b.u8 = g_bytes_get_data (bytes, &size);
-  g_assert_cmpuint (size, >=, 24);  /* minimum packet size */
-  g_assert_cmpuint (size - 24, ==, len);
-
-  /* Check the segment’s fields. */
-  g_assert_cmpuint (ntohl (b.u32[1]), ==, seq);
-  g_assert_cmpuint (ntohl (b.u32[2]), ==, ack);
-  g_assert_cmpuint (b.u8[13], ==, flags);
-}
-
-static void
-expect_syn_sent (Data *data)
-{
-  expect_segment (data->left, data->left_sent, 0, 0, 7, FLAG_SYN);
-}
-
-static void
-expect_syn_received (Data *data)
-{
-  expect_segment (data->right, data->right_sent, 0, 7, 7, FLAG_SYN);
-}
-
-static void
-assert_empty_queues (Data *data)
-{
-  g_assert_cmpuint (g_queue_get_length (data->left_sent), ==, 0);
-  g_assert_cmpuint (g_queue_get_length (data->right_sent), ==, 0);
-}
-
-/* Return whether the socket accepted the packet. */
-static gboolean
-forward_segment (GQueue/*<owned GBytes>*/ *from, PseudoTcpSocket *to)
-{
-  GBytes *segment;  /* owned */
-  const guint8 *b;
-  gsize size;
-  gboolean retval;
-
-  segment = g_queue_pop_head (from);
-  g_assert_true (segment != NULL);
-  b = g_bytes_get_data (segment, &size);
-  retval = pseudo_tcp_socket_notify_packet (to, (const gchar *) b, size);
-  g_bytes_unref (segment);
-
-  return retval;
-}
-
-static void
-forward_segment_ltr (Data *data)
-{
-  g_assert_true (forward_segment (data->left_sent, data->right));
-}
-
-static void
-forward_segment_rtl (Data *data)
-{
-  g_assert_true (forward_segment (data->right_sent, data->left));
-}
-
 static void
 duplicate_segment (GQueue/*<owned GBytes>*/ *queue)
 {
@@ -316,22 +59,6 @@ duplicate_segment (GQueue/*<owned GBytes>*/ *queue)
   g_queue_push_head (queue, g_bytes_ref (segment));
 }
 
-static void
-drop_segment (PseudoTcpSocket *socket, GQueue/*<owned GBytes>*/ *queue)
-{
-  GBytes *segment;  /* owned */
-  gchar *str;
-
-  segment = g_queue_pop_head (queue);
-  g_assert_true (segment != NULL);
-
-  str = segment_bytes_to_string (g_bytes_get_data (segment, NULL));
-  g_debug ("%p drop: %s", socket, str);
-  g_free (str);
-
-  g_bytes_unref (segment);
-}
-
 /* Swap the order of the head-most two segments in the @queue. */
 static void
 reorder_segments (PseudoTcpSocket *socket, GQueue/*<owned GBytes>*/ *queue)
@@ -355,22 +82,6 @@ reorder_segments (PseudoTcpSocket *socket, GQueue/*<owned GBytes>*/ *queue)
   g_queue_push_head (queue, segment2);
 }
 
-static void
-expect_socket_state (PseudoTcpSocket *socket, PseudoTcpState expected_state)
-{
-  PseudoTcpState state;
-
-  g_object_get (socket, "state", &state, NULL);
-  g_assert_cmpuint (state, ==, expected_state);
-}
-
-static void
-expect_sockets_connected (Data *data)
-{
-  expect_socket_state (data->left, PSEUDO_TCP_ESTABLISHED);
-  expect_socket_state (data->right, PSEUDO_TCP_ESTABLISHED);
-}
-
 static void
 expect_sockets_closed (Data *data)
 {
@@ -388,24 +99,6 @@ expect_sockets_closed (Data *data)
   g_assert_cmpint (pseudo_tcp_socket_recv (data->right, (char *) buf, sizeof (buf)), ==, 0);
 }
 
-static void
-increment_time (PseudoTcpSocket *socket, guint32 *counter, guint32 increment)
-{
-  g_debug ("Incrementing %p time by %u from %u to %u", socket, increment,
-      *counter, *counter + increment);
-  *counter = *counter + increment;
-
-  pseudo_tcp_socket_set_time (socket, *counter);
-  pseudo_tcp_socket_notify_clock (socket);
-}
-
-static void
-increment_time_both (Data *data, guint32 increment)
-{
-  increment_time (data->left, &data->left_current_time, increment);
-  increment_time (data->right, &data->right_current_time, increment);
-}
-
 static void
 expect_fin (PseudoTcpSocket *socket, GQueue/*<owned GBytes>*/ *queue,
     guint32 seq, guint32 ack)
@@ -420,20 +113,6 @@ expect_rst (PseudoTcpSocket *socket, GQueue/*<owned GBytes>*/ *queue,
   expect_segment (socket, queue, seq, ack, 0, FLAG_RST);
 }
 
-static void
-expect_ack (PseudoTcpSocket *socket, GQueue/*<owned GBytes>*/ *queue,
-    guint32 seq, guint32 ack)
-{
-  expect_segment (socket, queue, seq, ack, 0, FLAG_NONE);
-}
-
-static void
-expect_data (PseudoTcpSocket *socket, GQueue/*<owned GBytes>*/ *queue,
-    guint32 seq, guint32 ack, guint32 len)
-{
-  expect_segment (socket, queue, seq, ack, len, FLAG_NONE);
-}
-
 static void
 close_socket (PseudoTcpSocket *socket)
 {
@@ -446,24 +125,6 @@ close_socket (PseudoTcpSocket *socket)
   g_assert_cmpint (pseudo_tcp_socket_recv (socket, (char *) buf, sizeof (buf)), ==, 0);
 }
 
-/* Helper to create a socket pair and perform the SYN handshake. */
-static void
-establish_connection (Data *data)
-{
-  create_sockets (data, TRUE);
-  pseudo_tcp_socket_connect (data->left);
-  expect_syn_sent (data);
-  forward_segment_ltr (data);
-  expect_syn_received (data);
-  forward_segment_rtl (data);
-  increment_time_both (data, 110);
-  expect_ack (data->left,  data->left_sent, 7, 7);
-  forward_segment_ltr (data);
-  expect_sockets_connected (data);
-
-  assert_empty_queues (data);
-}
-
 /* Helper to close the LHS of a socket pair which has not transmitted any
  * data (i.e. perform the first half of the FIN handshake). */
 static void
@@ -0,0 +1,96 @@
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <locale.h>
+
+#include "test-pseudotcp-common.h"
+
+
+/* Check that pacing holds back the part of the window which the pacing rate
+ * doesn’t allow yet, and that the clock wakes up to send it. */
+static void
+pseudotcp_pacing (void)
+{
+  Data data = { 0, };
+  guint8 buf[2568], received[2568];
+  gsize i;
+  guint64 timeout = 0;
+  gboolean pacing;
+
+  for (i = 0; i < sizeof (buf); i++)
+    buf[i] = i;
+
+  create_sockets (&data, TRUE);
+  /* One full segment every 10ms, as there is no RTT sample yet. */
+  g_object_set (data.left, "pacing", TRUE, "max-pacing-rate", 128400, NULL);
+  g_object_get (data.left, "pacing", &pacing, NULL);
+  g_assert_true (pacing);
+  connect_sockets (&data);
+
+  g_assert_cmpint (pseudo_tcp_socket_send (data.left, (const char *) buf,
+      sizeof (buf)), ==, sizeof (buf));
+  expect_data (data.left, data.left_sent, 7, 7, 1284);
+  forward_segment_ltr (&data);
+  assert_empty_queues (&data);
+
+  g_assert_true (pseudo_tcp_socket_get_next_clock (data.left, &timeout));
+  g_assert_cmpuint (timeout, ==, data.left_current_time + 10);
+
+  increment_time_both (&data, 9);
+  g_assert_cmpuint (g_queue_get_length (data.left_sent), ==, 0);
+
+  increment_time_both (&data, 1);
+  expect_data (data.left, data.left_sent, 1291, 7, 1284);
+  forward_segment_ltr (&data);
+
+  g_assert_cmpint (pseudo_tcp_socket_recv (data.right, (char *) received,
+      sizeof (received)), ==, sizeof (received));
+  g_assert_cmpmem (received, sizeof (received), buf, sizeof (buf));
+
+  data_clear (&data);
+}
+
+int
+main (int argc, char *argv[])
+{
+  setlocale (LC_ALL, "");
+  g_test_init (&argc, &argv, NULL);
+  pseudo_tcp_set_debug_level (PSEUDO_TCP_DEBUG_VERBOSE);
+
+  g_test_add_func ("/pseudotcp/pacing",
+      pseudotcp_pacing);
+
+  g_test_run ();
+
+  return 0;
+}
@@ -0,0 +1,116 @@
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <locale.h>
+#include <string.h>
+#include <errno.h>
+
+#include "test-pseudotcp-common.h"
+
+
+/* Check that a message whose lifetime runs out before it is delivered is
+ * abandoned by the sender, and that the receiver skips over it to the next
+ * message rather than waiting for a retransmission. */
+static void
+pseudotcp_partial_reliability (void)
+{
+  Data data = { 0, };
+  gchar messages[3][100], received[100];
+
+  memset (messages[0], 'A', sizeof (messages[0]));
+  memset (messages[1], 'B', sizeof (messages[1]));
+  memset (messages[2], 'C', sizeof (messages[2]));
+
+  create_sockets (&data, TRUE);
+  connect_sockets (&data);
+
+  /* Each message is a segment of its own, with a 4-byte length prefix. */
+  g_assert_cmpint (pseudo_tcp_socket_send_message (data.left, messages[0],
+      sizeof (messages[0]), 0), ==, sizeof (messages[0]));
+  g_assert_cmpint (pseudo_tcp_socket_send_message (data.left, messages[1],
+      sizeof (messages[1]), 50), ==, sizeof (messages[1]));
+  g_assert_cmpint (pseudo_tcp_socket_send_message (data.left, messages[2],
+      sizeof (messages[2]), 0), ==, sizeof (messages[2]));
+
+  expect_data (data.left, data.left_sent, 7, 7, 104);
+  forward_segment_ltr (&data);
+  expect_data (data.left, data.left_sent, 111, 7, 104);
+  drop_segment (data.left, data.left_sent);
+  expect_data (data.left, data.left_sent, 215, 7, 104);
+  forward_segment_ltr (&data);
+
+  g_assert_cmpint (pseudo_tcp_socket_recv_message (data.right, received,
+      sizeof (received)), ==, sizeof (received));
+  g_assert_cmpmem (received, sizeof (received), messages[0],
+      sizeof (messages[0]));
+  g_assert_cmpint (pseudo_tcp_socket_recv_message (data.right, received,
+      sizeof (received)), ==, -1);
+  g_assert_cmpint (pseudo_tcp_socket_get_error (data.right), ==, EWOULDBLOCK);
+
+  /* The SACK for the third message. */
+  forward_segment_rtl (&data);
+  assert_empty_queues (&data);
+
+  /* The second message expires, and the receiver is told to skip it. */
+  increment_time_both (&data, 50);
+  expect_segment (data.left, data.left_sent, 215, 7, 0, FLAG_FORWARD);
+  forward_segment_ltr (&data);
+  expect_ack (data.right, data.right_sent, 7, 319);
+  forward_segment_rtl (&data);
+  assert_empty_queues (&data);
+
+  g_assert_cmpint (pseudo_tcp_socket_recv_message (data.right, received,
+      sizeof (received)), ==, sizeof (received));
+  g_assert_cmpmem (received, sizeof (received), messages[2],
+      sizeof (messages[2]));
+  g_assert_cmpint (pseudo_tcp_socket_recv_message (data.right, received,
+      sizeof (received)), ==, -1);
+  g_assert_cmpint (pseudo_tcp_socket_get_error (data.right), ==, EWOULDBLOCK);
+
+  data_clear (&data);
+}
+
+int
+main (int argc, char *argv[])
+{
+  setlocale (LC_ALL, "");
+  g_test_init (&argc, &argv, NULL);
+  pseudo_tcp_set_debug_level (PSEUDO_TCP_DEBUG_VERBOSE);
+
+  g_test_add_func ("/pseudotcp/partial-reliability",
+      pseudotcp_partial_reliability);
+
+  g_test_run ();
+
+  return 0;
+}
@@ -0,0 +1,122 @@
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <locale.h>
+
+#include "test-pseudotcp-common.h"
+
+
+/* Check that a lost segment at the tail of a flight, which can't cause any
+ * duplicate ACKs, is repaired by a tail loss probe before the retransmission
+ * timeout. */
+static void
+pseudotcp_rack_tlp (void)
+{
+  Data data = { 0, };
+  guint8 buf[750], received[750];
+  gsize i, n_received = 0;
+  guint32 elapsed = 0;
+  gboolean rack_tlp;
+
+  for (i = 0; i < sizeof (buf); i++)
+    buf[i] = i;
+
+  create_sockets (&data, TRUE);
+  g_object_set (data.left, "rack-tlp", TRUE, NULL);
+  g_object_get (data.left, "rack-tlp", &rack_tlp, NULL);
+  g_assert_true (rack_tlp);
+  connect_sockets (&data);
+
+  /* Take an RTT sample of 120ms. */
+  g_assert_cmpint (pseudo_tcp_socket_send (data.left, (const char *) buf, 250),
+      ==, 250);
+  expect_data (data.left, data.left_sent, 7, 7, 250);
+  increment_time_both (&data, 20);
+  forward_segment_ltr (&data);
+  increment_time_both (&data, 100);
+  expect_ack (data.right, data.right_sent, 7, 257);
+  forward_segment_rtl (&data);
+
+  /* Lose the last of two segments. */
+  g_assert_cmpint (pseudo_tcp_socket_send (data.left,
+      (const char *) buf + 250, 250), ==, 250);
+  g_assert_cmpint (pseudo_tcp_socket_send (data.left,
+      (const char *) buf + 500, 250), ==, 250);
+  expect_data (data.left, data.left_sent, 257, 7, 250);
+  forward_segment_ltr (&data);
+  expect_data (data.left, data.left_sent, 507, 7, 250);
+  drop_segment (data.left, data.left_sent);
+
+  n_received = pseudo_tcp_socket_recv (data.right, (char *) received,
+      sizeof (received));
+  g_assert_cmpuint (n_received, ==, 500);
+
+  while (n_received < sizeof (buf)) {
+    gint len;
+
+    g_assert_cmpuint (elapsed, <, 1000);
+    increment_time_both (&data, 10);
+    elapsed += 10;
+
+    while (!g_queue_is_empty (data.left_sent))
+      forward_segment_ltr (&data);
+    while (!g_queue_is_empty (data.right_sent))
+      forward_segment_rtl (&data);
+
+    len = pseudo_tcp_socket_recv (data.right, (char *) received + n_received,
+        sizeof (received) - n_received);
+    if (len > 0)
+      n_received += len;
+  }
+
+  /* Well before the minimum RTO of one second. */
+  g_assert_cmpuint (elapsed, <, 1000);
+  g_assert_cmpmem (received, sizeof (received), buf, sizeof (buf));
+
+  data_clear (&data);
+}
+
+int
+main (int argc, char *argv[])
+{
+  setlocale (LC_ALL, "");
+  g_test_init (&argc, &argv, NULL);
+  pseudo_tcp_set_debug_level (PSEUDO_TCP_DEBUG_VERBOSE);
+
+  g_test_add_func ("/pseudotcp/rack-tlp",
+      pseudotcp_rack_tlp);
+
+  g_test_run ();
+
+  return 0;
+}
@@ -0,0 +1,103 @@
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <locale.h>
+
+#include "test-pseudotcp-common.h"
+
+
+/* Check that segments arriving in reverse order are reassembled, and that the
+ * out-of-order ranges are merged into one SACK block as they fill in. */
+static void
+pseudotcp_reassembly (void)
+{
+  Data data = { 0, };
+  guint8 buf[1250];
+  const guint32 sack1[] = { 1007, 1257 };
+  const guint32 sack2[] = { 757, 1257 };
+  const guint32 sack3[] = { 507, 1257 };
+  const guint32 sack4[] = { 257, 1257 };
+  guint i;
+
+  for (i = 0; i < sizeof (buf); i++)
+    buf[i] = i;
+
+  establish_connection (&data);
+
+  for (i = 0; i < 5; i++) {
+    g_assert_cmpint (pseudo_tcp_socket_send (data.left,
+        (const char *) buf + i * 250, 250), ==, 250);
+    expect_data (data.left, data.left_sent, 7 + i * 250, 7, 250);
+  }
+
+  g_queue_reverse (data.left_sent);
+
+  /* Lose the duplicate ACKs so that the LHS doesn't retransmit anything. */
+  forward_segment_ltr (&data);
+  expect_sack (data.right, data.right_sent, 7, 7, sack1, 2);
+  drop_segment (data.right, data.right_sent);
+  forward_segment_ltr (&data);
+  expect_sack (data.right, data.right_sent, 7, 7, sack2, 2);
+  drop_segment (data.right, data.right_sent);
+  forward_segment_ltr (&data);
+  expect_sack (data.right, data.right_sent, 7, 7, sack3, 2);
+  drop_segment (data.right, data.right_sent);
+  forward_segment_ltr (&data);
+  expect_sack (data.right, data.right_sent, 7, 7, sack4, 2);
+  drop_segment (data.right, data.right_sent);
+
+  /* The first segment fills the only hole. */
+  forward_segment_ltr (&data);
+  expect_ack (data.right, data.right_sent, 7, 1257);
+  forward_segment_rtl (&data);
+
+  assert_empty_queues (&data);
+  expect_received (&data, buf, sizeof (buf));
+
+  data_clear (&data);
+}
+
+int
+main (int argc, char *argv[])
+{
+  setlocale (LC_ALL, "");
+  g_test_init (&argc, &argv, NULL);
+  pseudo_tcp_set_debug_level (PSEUDO_TCP_DEBUG_VERBOSE);
+
+  g_test_add_func ("/pseudotcp/sack/reassembly",
+      pseudotcp_reassembly);
+
+  g_test_run ();
+
+  return 0;
+}
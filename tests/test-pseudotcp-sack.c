@@ -0,0 +1,171 @@
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <locale.h>
+
+#include "test-pseudotcp-common.h"
+
+
+/* Send five 250-byte segments from the LHS and lose the first and the third
+ * one. */
+static void
+send_with_two_holes (Data *data, const guint8 *buf)
+{
+  guint i;
+
+  for (i = 0; i < 5; i++) {
+    g_assert_cmpint (pseudo_tcp_socket_send (data->left,
+        (const char *) buf + i * 250, 250), ==, 250);
+    expect_data (data->left, data->left_sent, 7 + i * 250, 7, 250);
+
+    if (i == 0 || i == 2)
+      drop_segment (data->left, data->left_sent);
+    else
+      forward_segment_ltr (data);
+  }
+}
+
+/* Check that both holes of a window are retransmitted on the third duplicate
+ * ACK when SACK is negotiated, rather than one per round trip. */
+static void
+pseudotcp_sack (void)
+{
+  Data data = { 0, };
+  guint8 buf[1250];
+  gboolean support_sack;
+  const guint32 sack1[] = { 257, 507 };
+  const guint32 sack2[] = { 257, 507, 757, 1007 };
+  const guint32 sack3[] = { 257, 507, 757, 1257 };
+  const guint32 sack4[] = { 757, 1257 };
+  guint i;
+
+  for (i = 0; i < sizeof (buf); i++)
+    buf[i] = i;
+
+  establish_connection (&data);
+
+  g_object_get (data.left, "support-sack", &support_sack, NULL);
+  g_assert_true (support_sack);
+
+  send_with_two_holes (&data, buf);
+
+  /* Each out-of-order segment is acknowledged with what the RHS holds. */
+  expect_sack (data.right, data.right_sent, 7, 7, sack1, 2);
+  forward_segment_rtl (&data);
+  expect_sack (data.right, data.right_sent, 7, 7, sack2, 4);
+  forward_segment_rtl (&data);
+  expect_sack (data.right, data.right_sent, 7, 7, sack3, 4);
+  forward_segment_rtl (&data);
+
+  /* Both holes are retransmitted straight away. */
+  g_assert_cmpuint (g_queue_get_length (data.left_sent), ==, 2);
+  g_assert_cmpuint (g_queue_get_length (data.right_sent), ==, 0);
+  expect_data (data.left, data.left_sent, 7, 7, 250);
+  forward_segment_ltr (&data);
+  expect_data (data.left, data.left_sent, 507, 7, 250);
+  forward_segment_ltr (&data);
+
+  expect_sack (data.right, data.right_sent, 7, 507, sack4, 2);
+  forward_segment_rtl (&data);
+  expect_ack (data.right, data.right_sent, 7, 1257);
+  forward_segment_rtl (&data);
+
+  assert_empty_queues (&data);
+  expect_received (&data, buf, sizeof (buf));
+
+  data_clear (&data);
+}
+
+/* Check that a peer without SACK support gets plain duplicate ACKs, and that
+ * the holes are then repaired one at a time as before. */
+static void
+pseudotcp_sack_compatibility (void)
+{
+  Data data = { 0, };
+  guint8 buf[1250];
+  gboolean support_sack;
+  guint i;
+
+  for (i = 0; i < sizeof (buf); i++)
+    buf[i] = i;
+
+  create_sockets (&data, TRUE);
+  g_object_set (data.right, "support-sack", FALSE, NULL);
+  connect_sockets (&data);
+
+  g_object_get (data.left, "support-sack", &support_sack, NULL);
+  g_assert_false (support_sack);
+
+  send_with_two_holes (&data, buf);
+
+  for (i = 0; i < 3; i++) {
+    expect_ack (data.right, data.right_sent, 7, 7);
+    forward_segment_rtl (&data);
+  }
+
+  /* Only the first hole is retransmitted on the third duplicate ACK... */
+  g_assert_cmpuint (g_queue_get_length (data.left_sent), ==, 1);
+  g_assert_cmpuint (g_queue_get_length (data.right_sent), ==, 0);
+  expect_data (data.left, data.left_sent, 7, 7, 250);
+  forward_segment_ltr (&data);
+
+  /* ...and the second one on the partial ACK which follows. */
+  expect_ack (data.right, data.right_sent, 7, 507);
+  forward_segment_rtl (&data);
+  expect_data (data.left, data.left_sent, 507, 7, 250);
+  forward_segment_ltr (&data);
+  expect_ack (data.right, data.right_sent, 7, 1257);
+  forward_segment_rtl (&data);
+
+  assert_empty_queues (&data);
+  expect_received (&data, buf, sizeof (buf));
+
+  data_clear (&data);
+}
+
+int
+main (int argc, char *argv[])
+{
+  setlocale (LC_ALL, "");
+  g_test_init (&argc, &argv, NULL);
+  pseudo_tcp_set_debug_level (PSEUDO_TCP_DEBUG_VERBOSE);
+
+  g_test_add_func ("/pseudotcp/sack",
+      pseudotcp_sack);
+  g_test_add_func ("/pseudotcp/sack/compatibility",
+      pseudotcp_sack_compatibility);
+
+  g_test_run ();
+
+  return 0;
+}
@@ -0,0 +1,221 @@
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include "agent.h"
+#include "test-common.h"
+
+#include <string.h>
+
+#define N_SUBSTREAMS 2
+#define N_MESSAGES 10
+
+static GMainLoop *global_mainloop = NULL;
+static guint global_ready = 0;
+static guint global_ls_id, global_rs_id;
+static guint global_sent[N_SUBSTREAMS + 1];
+static guint global_received[N_SUBSTREAMS + 1];
+
+static gboolean timer_cb (gpointer pointer)
+{
+  g_debug ("test-substreams:%s: %p", G_STRFUNC, pointer);
+
+  /* note: should not be reached, abort */
+  g_error ("ERROR: test has got stuck, aborting...");
+
+  return FALSE;
+}
+
+static void cb_component_state_changed (NiceAgent *agent, guint stream_id,
+    guint component_id, guint state, gpointer data)
+{
+  if (state == NICE_COMPONENT_STATE_READY && ++global_ready == 2)
+    g_main_loop_quit (global_mainloop);
+
+  /* XXX: dear compiler, these are for you: */
+  (void)agent; (void)stream_id; (void)component_id; (void)data;
+}
+
+static void cb_nice_recv (NiceAgent *agent, guint stream_id,
+    guint component_id, guint len, gchar *buf, gpointer user_data)
+{
+  /* Nothing is sent on the component’s own byte stream */
+  g_assert_not_reached ();
+}
+
+/* Each message carries its substream and its index on that substream. */
+static void send_messages (NiceAgent *agent, guint substream_id)
+{
+  while (global_sent[substream_id] < N_MESSAGES) {
+    gchar *message;
+    GError *error = NULL;
+    gssize ret;
+
+    message = g_strdup_printf ("substream %u message %u", substream_id,
+        global_sent[substream_id]);
+    ret = nice_agent_send_substream (agent, global_ls_id, 1, substream_id,
+        (const guint8 *) message, strlen (message), 0, &error);
+
+    if (ret < 0) {
+      /* Opening the substream, or full */
+      g_assert_error (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK);
+      g_clear_error (&error);
+      g_free (message);
+      return;
+    }
+
+    g_assert_cmpint (ret, ==, strlen (message));
+    global_sent[substream_id]++;
+    g_free (message);
+  }
+}
+
+static void cb_substream_writable (NiceAgent *agent, guint stream_id,
+    guint component_id, guint substream_id, gpointer data)
+{
+  /* Only the left agent sends */
+  if (GPOINTER_TO_UINT (data) == 1)
+    send_messages (agent, substream_id);
+}
+
+static void cb_substream_readable (NiceAgent *agent, guint stream_id,
+    guint component_id, guint substream_id, gpointer data)
+{
+  guint8 buf[100];
+  GError *error = NULL;
+  gssize len;
+
+  g_assert_cmpuint (GPOINTER_TO_UINT (data), ==, 2);
+  g_assert_cmpuint (substream_id, >=, 1);
+  g_assert_cmpuint (substream_id, <=, N_SUBSTREAMS);
+
+  while ((len = nice_agent_recv_substream_nonblocking (agent, stream_id,
+              component_id, substream_id, buf, sizeof (buf), NULL,
+              &error)) > 0) {
+    gchar *expected;
+
+    /* Messages arrive whole and in order on each substream */
+    expected = g_strdup_printf ("substream %u message %u", substream_id,
+        global_received[substream_id]);
+    g_assert_cmpmem (buf, len, expected, strlen (expected));
+    g_free (expected);
+    global_received[substream_id]++;
+  }
+
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK);
+  g_clear_error (&error);
+
+  if (global_received[1] == N_MESSAGES && global_received[2] == N_MESSAGES)
+    g_main_loop_quit (global_mainloop);
+}
+
+int main (void)
+{
+  NiceAgent *lagent, *ragent;
+  GMainContext *ctx;
+  guint timer_id;
+  guint i;
+  guint8 buf[100];
+  GError *error = NULL;
+
+  global_mainloop = g_main_loop_new (NULL, FALSE);
+  ctx = g_main_loop_get_context (global_mainloop);
+
+  lagent = nice_agent_new_reliable (ctx, NICE_COMPATIBILITY_RFC5245);
+  ragent = nice_agent_new_reliable (ctx, NICE_COMPATIBILITY_RFC5245);
+  g_object_set (G_OBJECT (lagent), "ice-tcp", FALSE, "upnp", FALSE,
+      "controlling-mode", TRUE, NULL);
+  g_object_set (G_OBJECT (ragent), "ice-tcp", FALSE, "upnp", FALSE,
+      "controlling-mode", FALSE, NULL);
+
+  g_signal_connect (G_OBJECT (lagent), "component-state-changed",
+      G_CALLBACK (cb_component_state_changed), GUINT_TO_POINTER (1));
+  g_signal_connect (G_OBJECT (ragent), "component-state-changed",
+      G_CALLBACK (cb_component_state_changed), GUINT_TO_POINTER (2));
+  g_signal_connect (G_OBJECT (lagent), "reliable-substream-writable",
+      G_CALLBACK (cb_substream_writable), GUINT_TO_POINTER (1));
+  g_signal_connect (G_OBJECT (ragent), "reliable-substream-writable",
+      G_CALLBACK (cb_substream_writable), GUINT_TO_POINTER (2));
+  g_signal_connect (G_OBJECT (ragent), "reliable-substream-readable",
+      G_CALLBACK (cb_substream_readable), GUINT_TO_POINTER (2));
+
+  global_ls_id = nice_agent_add_stream (lagent, 1);
+  global_rs_id = nice_agent_add_stream (ragent, 1);
+  g_assert_cmpuint (global_ls_id, >, 0);
+  g_assert_cmpuint (global_rs_id, >, 0);
+
+  nice_agent_attach_recv (lagent, global_ls_id, 1, ctx, cb_nice_recv, NULL);
+  nice_agent_attach_recv (ragent, global_rs_id, 1, ctx, cb_nice_recv, NULL);
+
+  /* Substreams need a selected pair */
+  g_assert_cmpint (nice_agent_send_substream (lagent, global_ls_id, 1, 1,
+      (const guint8 *) "x", 1, 0, &error), ==, -1);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_NOT_CONNECTED);
+  g_clear_error (&error);
+
+  g_assert_true (nice_agent_gather_candidates (lagent, global_ls_id));
+  g_assert_true (nice_agent_gather_candidates (ragent, global_rs_id));
+
+  test_common_set_credentials (lagent, global_ls_id, ragent, global_rs_id);
+  test_common_set_candidates (lagent, global_ls_id, ragent, global_rs_id, 1,
+      FALSE, FALSE);
+  test_common_set_candidates (ragent, global_rs_id, lagent, global_ls_id, 1,
+      FALSE, FALSE);
+
+  timer_id = g_timeout_add_seconds (30, timer_cb, NULL);
+
+  /* step: wait for both sides to be connected */
+  g_main_loop_run (global_mainloop);
+
+  /* step: open the substreams, and send on each once it is connected */
+  for (i = 1; i <= N_SUBSTREAMS; i++)
+    send_messages (lagent, i);
+  g_main_loop_run (global_mainloop);
+
+  for (i = 1; i <= N_SUBSTREAMS; i++) {
+    g_assert_cmpuint (global_sent[i], ==, N_MESSAGES);
+    g_assert_cmpuint (global_received[i], ==, N_MESSAGES);
+  }
+
+  /* Nothing more to read */
+  g_assert_cmpint (nice_agent_recv_substream_nonblocking (ragent,
+      global_rs_id, 1, 1, buf, sizeof (buf), NULL, &error), ==, -1);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK);
+  g_clear_error (&error);
+
+  g_source_remove (timer_id);
+
+  g_object_unref (lagent);
+  g_object_unref (ragent);
+  g_main_loop_unref (global_mainloop);
+
+  return 0;
+}
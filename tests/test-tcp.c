@@ -48,6 +48,8 @@ NiceSocket *passive_sock, *server;
 NiceAddress tmp;
 gchar buf[5];
 
+#define ZEROCOPY_LEN (256 * 1024)
+
 static gboolean
 on_server_connection_available (gpointer user_data)
 {
@@ -81,6 +83,285 @@ on_client_input_available (gpointer user_data)
   return FALSE;
 }
 
+static void
+on_zerocopy_released (gpointer data)
+{
+  gboolean *released = data;
+
+  *released = TRUE;
+}
+
+/* A large zero-copy send arrives whole, and its memory is released once the
+ * kernel is done with it, whether it supports MSG_ZEROCOPY or not. */
+static void
+test_zerocopy (void)
+{
+  guint8 *data = g_malloc (ZEROCOPY_LEN);
+  guint8 *received = g_malloc (ZEROCOPY_LEN + 4);
+  GOutputVector buffers[2] = { { "head", 4 }, { data, ZEROCOPY_LEN } };
+  NiceOutputMessage message = { buffers, 2 };
+  gboolean released = FALSE;
+  GBytes *bytes;
+  gsize len = 0;
+  guint i;
+
+  for (i = 0; i < ZEROCOPY_LEN; i++)
+    data[i] = i % 251;
+
+  bytes = g_bytes_new_with_free_func (data, ZEROCOPY_LEN, on_zerocopy_released,
+      &released);
+  g_assert_cmpint (nice_socket_send_zerocopy (client, &tmp, &message, bytes),
+      ==, 1);
+  g_bytes_unref (bytes);
+
+  while (len < ZEROCOPY_LEN + 4) {
+    gssize ret = nice_socket_recv (server, NULL, ZEROCOPY_LEN + 4 - len,
+        (gchar *) received + len);
+
+    g_assert_cmpint (ret, >=, 0);
+    len += ret;
+    /* Flushes what the client queued */
+    g_main_context_iteration (NULL, FALSE);
+  }
+
+  g_assert_true (memcmp (received, "head", 4) == 0);
+  g_assert_true (memcmp (received + 4, data, ZEROCOPY_LEN) == 0);
+
+  /* Completions are read along with the input */
+  while (!released) {
+    g_assert_cmpint (nice_socket_recv (client, NULL, sizeof (buf), buf), ==, 0);
+    g_main_context_iteration (NULL, FALSE);
+  }
+
+  g_free (received);
+  g_free (data);
+}
+
+typedef struct {
+  guint8 *data;
+  gboolean released;
+} ZerocopyPayload;
+
+static void
+on_zerocopy_payload_released (gpointer data)
+{
+  ZerocopyPayload *payload = data;
+
+  /* Anything the kernel reads from here on is garbage */
+  memset (payload->data, 0xAA, ZEROCOPY_LEN);
+  payload->released = TRUE;
+}
+
+/* Closing a socket right after a zero-copy send does not release its memory
+ * before the kernel is done with it, and the data still arrives whole. */
+static void
+test_zerocopy_close (void)
+{
+  NiceAddress bind_addr;
+  NiceSocket *sock, *zc_client, *zc_server;
+  guint8 *expected = g_malloc (ZEROCOPY_LEN);
+  guint8 *received = g_malloc (ZEROCOPY_LEN);
+  ZerocopyPayload payload = { g_malloc (ZEROCOPY_LEN), FALSE };
+  GOutputVector buffer = { payload.data, ZEROCOPY_LEN };
+  NiceOutputMessage message = { &buffer, 1 };
+  GError *error = NULL;
+  GBytes *bytes;
+  gsize len = 0;
+  guint i;
+
+  for (i = 0; i < ZEROCOPY_LEN; i++)
+    expected[i] = payload.data[i] = i % 251;
+
+  nice_address_init (&bind_addr);
+  g_assert_true (nice_address_set_from_string (&bind_addr, "127.0.0.1"));
+  sock = nice_tcp_active_socket_new (g_main_loop_get_context (mainloop),
+      &bind_addr);
+  g_assert_true (sock);
+  zc_client = nice_tcp_active_socket_connect (sock, &passive_sock->addr);
+  g_assert_true (zc_client);
+  nice_socket_free (sock);
+
+  g_socket_condition_wait (passive_sock->fileno, G_IO_IN, NULL, &error);
+  g_assert_no_error (error);
+  zc_server = nice_tcp_passive_socket_accept (passive_sock);
+  g_assert_true (zc_server);
+
+  bytes = g_bytes_new_with_free_func (payload.data, ZEROCOPY_LEN,
+      on_zerocopy_payload_released, &payload);
+  g_assert_cmpint (nice_socket_send_zerocopy (zc_client, &passive_sock->addr,
+          &message, bytes), ==, 1);
+  g_bytes_unref (bytes);
+  nice_socket_free (zc_client);
+
+  while (len < ZEROCOPY_LEN) {
+    gssize ret = nice_socket_recv (zc_server, NULL, ZEROCOPY_LEN - len,
+        (gchar *) received + len);
+
+    g_assert_cmpint (ret, >=, 0);
+    len += ret;
+    g_main_context_iteration (NULL, FALSE);
+  }
+
+  g_assert_true (memcmp (received, expected, ZEROCOPY_LEN) == 0);
+
+  while (!payload.released)
+    g_main_context_iteration (NULL, TRUE);
+
+  nice_socket_free (zc_server);
+  g_free (payload.data);
+  g_free (received);
+  g_free (expected);
+}
+
+/* Messages sent on a corked socket are only written once it is uncorked */
+static void
+test_cork (void)
+{
+  gchar received[15];
+  gsize len = 0;
+
+  nice_socket_set_corked (client, TRUE);
+  g_assert_cmpint (5, ==, nice_socket_send (client, &tmp, 5, "hello"));
+  g_assert_cmpint (5, ==, nice_socket_send (client, &tmp, 5, "uryyb"));
+  g_assert_cmpint (5, ==, nice_socket_send (client, &tmp, 5, "world"));
+
+  while (g_main_context_iteration (NULL, FALSE));
+  g_assert_cmpint (nice_socket_recv (server, NULL, sizeof (received), received),
+      ==, 0);
+
+  nice_socket_set_corked (client, FALSE);
+
+  while (len < sizeof (received)) {
+    gssize ret = nice_socket_recv (server, NULL, sizeof (received) - len,
+        received + len);
+
+    g_assert_cmpint (ret, >=, 0);
+    len += ret;
+    g_main_context_iteration (NULL, FALSE);
+  }
+
+  g_assert_true (memcmp (received, "hellouryybworld", 15) == 0);
+}
+
+/* A simultaneous-open candidate reserves its port, and connects from it */
+static void
+test_simultaneous_open (void)
+{
+  NiceAddress so_bind_addr, from;
+  NiceSocket *so_sock, *so_client, *so_server;
+  GError *error = NULL;
+
+  nice_address_init (&so_bind_addr);
+  g_assert_true (nice_address_set_from_string (&so_bind_addr, "127.0.0.1"));
+
+  so_sock = nice_tcp_so_socket_new (NULL, &so_bind_addr, &error);
+  g_assert_no_error (error);
+  g_assert_true (so_sock);
+  g_assert_true (nice_address_get_port (&so_sock->addr) != 0);
+
+  so_client = nice_tcp_so_socket_connect (so_sock, &passive_sock->addr);
+  g_assert_true (so_client);
+  g_assert_true (nice_address_equal (&so_client->addr, &so_sock->addr));
+
+  g_socket_condition_wait (passive_sock->fileno, G_IO_IN, NULL, &error);
+  g_assert_no_error (error);
+  so_server = nice_tcp_passive_socket_accept (passive_sock);
+  g_assert_true (so_server);
+
+  g_assert_cmpint (5, ==, nice_socket_send (so_client, &passive_sock->addr, 5,
+      "hello"));
+  g_socket_condition_wait (so_server->fileno, G_IO_IN, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_cmpint (5, ==, nice_socket_recv (so_server, &from, 5, buf));
+  g_assert_true (0 == strncmp (buf, "hello", 5));
+  g_assert_true (nice_address_equal (&from, &so_sock->addr));
+
+  nice_socket_free (so_client);
+  nice_socket_free (so_server);
+  nice_socket_free (so_sock);
+}
+
+/* Whether the connection of @sock, just started, was established */
+static gboolean
+so_connection_established (NiceSocket *sock)
+{
+  GError *error = NULL;
+  gboolean established;
+
+  g_socket_condition_timed_wait (sock->fileno, G_IO_OUT, G_USEC_PER_SEC,
+      NULL, &error);
+  g_assert_no_error (error);
+
+  established = g_socket_check_connect_result (sock->fileno, &error);
+  g_clear_error (&error);
+
+  return established;
+}
+
+/* Two simultaneous-open candidates connect to each other, from their own
+ * ports. A SYN which reaches the peer before its own connection attempt is
+ * refused, as it always is on the loopback interface, so both attempts fail
+ * together, and the candidates connect again from the same ports, as the
+ * connectivity checks do. Where the SYNs cross, both sockets share a single
+ * connection. */
+static void
+test_simultaneous_open_crossing (void)
+{
+  NiceAddress so_bind_addr, from;
+  NiceSocket *so_a, *so_b;
+  GError *error = NULL;
+  guint attempt;
+
+  nice_address_init (&so_bind_addr);
+  g_assert_true (nice_address_set_from_string (&so_bind_addr, "127.0.0.1"));
+
+  so_a = nice_tcp_so_socket_new (NULL, &so_bind_addr, &error);
+  g_assert_no_error (error);
+  so_b = nice_tcp_so_socket_new (NULL, &so_bind_addr, &error);
+  g_assert_no_error (error);
+
+  for (attempt = 0; attempt < 10; attempt++) {
+    NiceSocket *a, *b;
+    gboolean a_established, b_established;
+
+    a = nice_tcp_so_socket_connect (so_a, &so_b->addr);
+    b = nice_tcp_so_socket_connect (so_b, &so_a->addr);
+    g_assert_true (a);
+    g_assert_true (b);
+    g_assert_true (nice_address_equal (&a->addr, &so_a->addr));
+    g_assert_true (nice_address_equal (&b->addr, &so_b->addr));
+
+    a_established = so_connection_established (a);
+    b_established = so_connection_established (b);
+    g_assert_true (a_established == b_established);
+
+    if (a_established) {
+      g_assert_cmpint (5, ==, nice_socket_send (a, &so_b->addr, 5, "hello"));
+      g_socket_condition_wait (b->fileno, G_IO_IN, NULL, &error);
+      g_assert_no_error (error);
+      g_assert_cmpint (5, ==, nice_socket_recv (b, &from, 5, buf));
+      g_assert_true (0 == strncmp (buf, "hello", 5));
+      g_assert_true (nice_address_equal (&from, &so_a->addr));
+
+      g_assert_cmpint (5, ==, nice_socket_send (b, &so_a->addr, 5, "uryyb"));
+      g_socket_condition_wait (a->fileno, G_IO_IN, NULL, &error);
+      g_assert_no_error (error);
+      g_assert_cmpint (5, ==, nice_socket_recv (a, &from, 5, buf));
+      g_assert_true (0 == strncmp (buf, "uryyb", 5));
+      g_assert_true (nice_address_equal (&from, &so_b->addr));
+    }
+
+    nice_socket_free (a);
+    nice_socket_free (b);
+
+    if (a_established)
+      break;
+  }
+
+  nice_socket_free (so_a);
+  nice_socket_free (so_b);
+}
+
 int
 main (void)
 {
@@ -149,6 +430,14 @@ main (void)
   g_main_loop_run (mainloop); /* -> on_client_input_available */
   g_assert_true (0 == strncmp (buf, "uryyb", 5));
 
+  g_source_destroy (srv_input_source);
+  g_source_destroy (cli_input_source);
+  test_zerocopy ();
+  test_zerocopy_close ();
+  test_cork ();
+  test_simultaneous_open ();
+  test_simultaneous_open_crossing ();
+
   nice_socket_free (client);
   nice_socket_free (server);
   nice_socket_free (passive_sock);
@@ -12,6 +12,7 @@ static gboolean global_lagent_gathering_done = FALSE;
 static gboolean global_ragent_gathering_done = FALSE;
 static int global_lagent_cands = 0;
 static int global_ragent_cands = 0;
+static GByteArray *global_ragent_frames = NULL;
 
 #define TURN_USER "toto"
 #define TURN_PASS "password"
@@ -35,6 +36,12 @@ static void cb_nice_recv (NiceAgent *agent, guint stream_id, guint component_id,
   /* XXX: dear compiler, these are for you: */
   (void)agent; (void)stream_id; (void)component_id; (void)buf;
 
+  /* Frames of a long message, which don't all start with the pattern */
+  if (global_ragent_frames != NULL && GPOINTER_TO_UINT (user_data) == 2) {
+    g_byte_array_append (global_ragent_frames, (const guint8 *) buf, len);
+    return;
+  }
+
   /*
    * Lets ignore stun packets that got through
    */
@@ -109,6 +116,49 @@ static void cb_closed (GObject *src, GAsyncResult *res, gpointer data)
   *((gboolean *)data) = TRUE;
 }
 
+/* Sends a message longer than one RFC 4571 frame over the relay, which must
+ * go out as one TURN message per frame */
+static void
+send_multi_frame_message (NiceAgent *lagent, guint ls_id)
+{
+  static const gsize sizes[] = { 30000, 40000, 30000 };
+  GOutputVector buffers[G_N_ELEMENTS (sizes)];
+  NiceOutputMessage message = { buffers, G_N_ELEMENTS (sizes) };
+  guint8 *data;
+  gsize total = 0, offset = 0;
+  GError *error = NULL;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++)
+    total += sizes[i];
+
+  data = g_malloc (total);
+  for (i = 0; i < total; i++)
+    data[i] = i % 251;
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++) {
+    buffers[i].buffer = data + offset;
+    buffers[i].size = sizes[i];
+    offset += sizes[i];
+  }
+
+  global_ragent_frames = g_byte_array_new ();
+
+  g_assert_cmpint (nice_agent_send_messages_nonblocking (lagent, ls_id, 1,
+          &message, 1, NULL, &error), ==, 1);
+  g_assert_no_error (error);
+
+  while (global_ragent_frames->len < total)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpuint (global_ragent_frames->len, ==, total);
+  g_assert_true (memcmp (global_ragent_frames->data, data, total) == 0);
+
+  g_byte_array_unref (global_ragent_frames);
+  global_ragent_frames = NULL;
+  g_free (data);
+}
+
 static void
 run_test(guint turn_port, gboolean is_ipv6,
     gboolean ice_udp, gboolean ice_tcp, gboolean force_relay,
@@ -217,6 +267,9 @@ run_test(guint turn_port, gboolean is_ipv6,
   g_assert_cmpint (global_lagent_state[0], ==, NICE_COMPONENT_STATE_READY);
   g_assert_cmpint (global_ragent_state[0], ==, NICE_COMPONENT_STATE_READY);
 
+  if (force_relay && turn_type == NICE_RELAY_TYPE_TURN_TCP)
+    send_multi_frame_message (lagent, ls_id);
+
   nice_agent_remove_stream (lagent, ls_id);
   nice_agent_remove_stream (ragent, rs_id);
 
@@ -204,6 +204,122 @@ tcp_turn_fragmentation (void)
   nice_socket_free (testsock);
 }
 
+typedef struct {
+  GByteArray *stream;
+  gsize offset;
+  guint n_reads;
+} StreamSocketPriv;
+
+static gint
+stream_socket_recv_messages (NiceSocket *sock, NiceInputMessage *recv_messages,
+    guint n_recv_messages, NiceMessageExtraData *exdata) {
+  StreamSocketPriv *priv = sock->priv;
+  gsize len;
+
+  if (n_recv_messages == 0 || priv->offset == priv->stream->len)
+    return 0;
+
+  /* Return a random chunk of the stream, as TCP would */
+  len = MIN (priv->stream->len - priv->offset,
+      (gsize) g_rand_int_range (randg, 1, 32768));
+  len = memcpy_buffer_to_input_message (&recv_messages[0],
+      priv->stream->data + priv->offset, len);
+  if (recv_messages[0].from)
+    nice_address_set_from_string (recv_messages[0].from, "127.0.0.1");
+  priv->offset += len;
+  priv->n_reads++;
+
+  return 1;
+}
+
+static void
+stream_socket_close (NiceSocket *sock) {
+  StreamSocketPriv *priv = sock->priv;
+
+  g_byte_array_unref (priv->stream);
+  g_free (priv);
+}
+
+#define N_FRAMES 1000
+
+static void
+tcp_turn_framing (void)
+{
+  /* Send a stream of padded ChannelData messages through a base socket which
+   * returns it in random chunks, and check that the TURN-over-TCP socket
+   * extracts each one, reading less than once per message. */
+  GPtrArray *frames = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) g_byte_array_unref);
+  StreamSocketPriv *priv = g_new0 (StreamSocketPriv, 1);
+  NiceSocket *testsock = g_slice_new0 (NiceSocket);
+  NiceSocket *turnsock;
+  guint8 recv_buffer[G_MAXUINT16 + 4 + 3];
+  gsize consumed = 0;
+  guint i;
+
+  priv->stream = g_byte_array_new ();
+  for (i = 0; i != N_FRAMES; ++i) {
+    GByteArray *frame = g_byte_array_new ();
+    guint16 len = g_rand_int_range (randg, 0, 1000);
+    guint8 header[4] = { 0x40, 0x00, len >> 8, len & 0xff };
+    guint j;
+
+    g_byte_array_append (frame, header, sizeof (header));
+    for (j = 0; j != len; ++j) {
+      guint8 byte = g_rand_int (randg);
+      g_byte_array_append (frame, &byte, 1);
+    }
+    while (frame->len % 4) {
+      guint8 zero = 0;
+      g_byte_array_append (frame, &zero, 1);
+    }
+
+    g_byte_array_append (priv->stream, frame->data, frame->len);
+    g_ptr_array_add (frames, frame);
+  }
+
+  testsock->type = NICE_SOCKET_TYPE_TCP_BSD;
+  testsock->recv_messages = stream_socket_recv_messages;
+  testsock->is_reliable = test_socket_is_reliable;
+  testsock->close = stream_socket_close;
+  testsock->priv = priv;
+
+  turnsock = nice_udp_turn_over_tcp_socket_new (testsock,
+      NICE_TURN_SOCKET_COMPATIBILITY_RFC5766);
+
+  i = 0;
+  while (i != N_FRAMES) {
+    GInputVector vec = { recv_buffer, sizeof (recv_buffer) };
+    NiceAddress from;
+    NiceInputMessage message = { &vec, 1, &from, 0 };
+    GByteArray *frame = g_ptr_array_index (frames, i);
+    gint n_messages;
+
+    n_messages = nice_socket_recv_messages (turnsock, &message, 1, NULL);
+    g_assert_cmpint (n_messages, >=, 0);
+    if (n_messages == 0)
+      continue;
+
+    g_assert_cmpmem (recv_buffer, message.length, frame->data, frame->len);
+    consumed += frame->len;
+    i++;
+
+    /* Whether the next message was read along with this one */
+    if (i != N_FRAMES) {
+      GByteArray *next = g_ptr_array_index (frames, i);
+
+      g_assert_true (nice_socket_has_buffered_data (turnsock) ==
+          (priv->offset - consumed >= next->len));
+    }
+  }
+
+  g_assert_false (nice_socket_has_buffered_data (turnsock));
+  g_assert_cmpuint (priv->n_reads, <, N_FRAMES / 4);
+
+  nice_socket_free (turnsock);
+  g_ptr_array_unref (frames);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -217,6 +333,7 @@ main (int argc, char *argv[])
   mainloop = g_main_loop_new (NULL, TRUE);
 
   g_test_add_func ("/udp-turn/tcp-fragmentation", tcp_turn_fragmentation);
+  g_test_add_func ("/udp-turn-over-tcp/framing", tcp_turn_framing);
 
   g_test_run ();
 